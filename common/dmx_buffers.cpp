@@ -0,0 +1,189 @@
+/*
+ * memory mapped demux buffers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <cstdlib>
+#include <cstring>
+#include <linux/dvb/dmx.h>
+
+#include "dmx_buffers.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+
+cDemuxBuffers::cDemuxBuffers(int _fd)
+{
+	fd = _fd;
+	current = -1;
+	current_len = 0;
+	pending = false;
+	count = 0;
+	readbuf = NULL;
+}
+
+cDemuxBuffers::~cDemuxBuffers()
+{
+	unmap();
+	free(readbuf);
+}
+
+bool cDemuxBuffers::Init(void)
+{
+	if (map())
+		return true;
+	readbuf = (unsigned char *)malloc(DMX_BUFFER_SIZE);
+	return readbuf != NULL;
+}
+
+bool cDemuxBuffers::map(void)
+{
+#ifdef DMX_REQBUFS
+	struct dmx_requestbuffers req;
+	memset(&req, 0, sizeof(req));
+	req.count = DMX_BUFFER_COUNT;
+	req.size = DMX_BUFFER_SIZE;
+	if (ioctl(fd, DMX_REQBUFS, &req) < 0 || req.count == 0)
+	{
+		hal_info("%s: no mmap buffers (%m), using read()\n", __func__);
+		return false;
+	}
+	for (unsigned int i = 0; i < req.count; i++)
+	{
+		struct dmx_buffer b;
+		memset(&b, 0, sizeof(b));
+		b.index = i;
+		if (ioctl(fd, DMX_QUERYBUF, &b) < 0)
+		{
+			hal_info("%s: DMX_QUERYBUF %u failed (%m)\n", __func__, i);
+			break;
+		}
+		void *p = mmap(NULL, b.length, PROT_READ, MAP_SHARED, fd, b.offset);
+		if (p == MAP_FAILED)
+		{
+			hal_info("%s: mmap buffer %u failed (%m)\n", __func__, i);
+			break;
+		}
+		maps.push_back((unsigned char *)p);
+		lengths.push_back(b.length);
+	}
+	if (maps.size() < req.count)
+	{
+		unmap();
+		return false;
+	}
+	/* the first DMX_QBUF starts streaming into the buffers */
+	for (unsigned int i = 0; i < maps.size(); i++)
+	{
+		struct dmx_buffer b;
+		memset(&b, 0, sizeof(b));
+		b.index = i;
+		if (ioctl(fd, DMX_QBUF, &b) < 0)
+		{
+			hal_info("%s: DMX_QBUF %u failed (%m)\n", __func__, i);
+			if (i == 0)
+			{
+				unmap();
+				return false;
+			}
+		}
+	}
+	hal_info("%s: fd %d: %d mmap buffers of %d bytes\n", __func__, fd, (int)maps.size(), (int)lengths[0]);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void cDemuxBuffers::unmap(void)
+{
+	for (unsigned int i = 0; i < maps.size(); i++)
+		munmap(maps[i], lengths[i]);
+	maps.clear();
+	lengths.clear();
+	current = -1;
+	pending = false;
+}
+
+int cDemuxBuffers::Dequeue(const unsigned char **data, int timeout)
+{
+#ifdef DMX_REQBUFS
+	if (pending)
+	{
+		pending = false;
+		*data = maps[current];
+		return current_len;
+	}
+	/* the caller did not give the last one back */
+	if (current >= 0)
+		Queue();
+	if (timeout > 0)
+	{
+		struct pollfd ufds;
+		ufds.fd = fd;
+		ufds.events = POLLIN | POLLPRI | POLLERR;
+		ufds.revents = 0;
+		int rc = ::poll(&ufds, 1, timeout);
+		if (rc <= 0)
+			return rc;
+	}
+	struct dmx_buffer b;
+	memset(&b, 0, sizeof(b));
+	if (ioctl(fd, DMX_DQBUF, &b) < 0)
+		return -1;
+	if (b.index >= maps.size())
+	{
+		errno = EIO;
+		return -1;
+	}
+	current = b.index;
+	current_len = b.bytesused;
+	*data = maps[current];
+	/* the kernel counts the buffers it fills, a gap means the
+	 * consumer was too slow and data was dropped */
+	bool lost = (b.flags & DMX_BUFFER_FLAG_DISCONTINUITY_DETECTED) || (count && b.count != count);
+	count = b.count + 1;
+	if (lost)
+	{
+		hal_debug("%s: fd %d: data lost before buffer %u (flags 0x%x)\n", __func__, fd, b.count, b.flags);
+		pending = true;
+		errno = EOVERFLOW;
+		return -1;
+	}
+	return current_len;
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+void cDemuxBuffers::Queue(void)
+{
+#ifdef DMX_REQBUFS
+	if (current < 0 || pending)
+		return;
+	struct dmx_buffer b;
+	memset(&b, 0, sizeof(b));
+	b.index = current;
+	if (ioctl(fd, DMX_QBUF, &b) < 0)
+		hal_info("%s: DMX_QBUF %d failed (%m)\n", __func__, current);
+	current = -1;
+#endif
+}
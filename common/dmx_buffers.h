@@ -0,0 +1,66 @@
+/*
+ * memory mapped demux buffers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DMX_BUFFERS_H__
+#define __DMX_BUFFERS_H__
+
+#include <config.h>
+#include <inttypes.h>
+#include <vector>
+
+/* requested from the kernel, which may hand out fewer / smaller ones */
+#define DMX_BUFFER_COUNT 32
+#define DMX_BUFFER_SIZE (188 * 348)
+
+/*
+ * The buffers of one DMX_TP_CHANNEL filter. Kernels with DVB_MMAP
+ * support fill buffers that are mapped into the process
+ * (DMX_REQBUFS / DMX_QBUF / DMX_DQBUF), which saves copying every
+ * packet in read(). Otherwise there is one plain buffer to read() into.
+ */
+class cDemuxBuffers
+{
+	public:
+		cDemuxBuffers(int fd);
+		~cDemuxBuffers();
+		/* maps the kernel buffers, or allocates the read() buffer */
+		bool Init(void);
+		int getFD(void) { return fd; };
+		bool isMapped(void) { return !maps.empty(); };
+		unsigned char *getReadBuffer(void) { return readbuf; };
+
+		/* mapped mode: the next filled buffer, valid until Queue().
+		 * Returns its length, 0 on timeout (ms), -1 and errno on error.
+		 * If data was lost before the buffer, returns -1 / EOVERFLOW
+		 * once first, like read() does. */
+		int Dequeue(const unsigned char **data, int timeout);
+		/* hands the dequeued buffer back to the kernel */
+		void Queue(void);
+	private:
+		int fd;
+		std::vector<unsigned char *> maps;
+		std::vector<size_t> lengths;
+		int current;		/* dequeued buffer, -1: none */
+		int current_len;
+		bool pending;		/* dequeued, but EOVERFLOW returned first */
+		uint32_t count;		/* of the next buffer the kernel fills */
+		unsigned char *readbuf;
+		bool map(void);
+		void unmap(void);
+};
+
+#endif // __DMX_BUFFERS_H__
@@ -0,0 +1,298 @@
+/*
+ * pool of configured demux device fds
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <cstdio>
+#include <linux/dvb/dmx.h>
+
+#include "dmx_hal.h"
+#include "dmx_pool.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+
+static int64_t time_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+cDemuxPool *cDemuxPool::getInstance()
+{
+	static cDemuxPool *instance = NULL;
+	static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&instance_mutex);
+	if (!instance)
+		instance = new cDemuxPool();
+	pthread_mutex_unlock(&instance_mutex);
+	return instance;
+}
+
+cDemuxPool::cDemuxPool()
+{
+	pthread_mutex_init(&mutex, NULL);
+}
+
+/* called with mutex held */
+void cDemuxPool::account(unsigned long request, const char *name, int64_t us, bool failed)
+{
+	std::map<unsigned long, dmx_pool_stat>::iterator i = stats.find(request);
+	if (i == stats.end())
+	{
+		dmx_pool_stat s;
+		s.request = request;
+		s.name = name;
+		s.count = 0;
+		s.failed = 0;
+		s.total_us = 0;
+		s.max_us = 0;
+		i = stats.insert(std::make_pair(request, s)).first;
+	}
+	i->second.count++;
+	if (failed)
+		i->second.failed++;
+	i->second.total_us += us;
+	if (us > i->second.max_us)
+		i->second.max_us = us;
+}
+
+int cDemuxPool::Ioctl(int fd, unsigned long request, const char *name, unsigned long arg)
+{
+	int64_t start = time_us();
+	int ret = ::ioctl(fd, request, arg);
+	int64_t us = time_us() - start;
+	int err = errno;
+	pthread_mutex_lock(&mutex);
+	account(request, name, us, ret < 0);
+	pthread_mutex_unlock(&mutex);
+	errno = err;
+	return ret;
+}
+
+void cDemuxPool::close_fd(int fd)
+{
+	int64_t start = time_us();
+	int ret = close(fd);
+	int64_t us = time_us() - start;
+	pthread_mutex_lock(&mutex);
+	account(DMX_POOL_CLOSE, "close", us, ret < 0);
+	pthread_mutex_unlock(&mutex);
+}
+
+/* closes the fds that were idle for too long */
+void cDemuxPool::expire(void)
+{
+	std::vector<int> old;
+	int64_t limit = time_us() - (int64_t)DMX_POOL_IDLE_TIME * 1000000;
+	pthread_mutex_lock(&mutex);
+	for (std::map<int, slot>::iterator i = fds.begin(); i != fds.end();)
+	{
+		if (i->second.idle && i->second.idle_since < limit)
+		{
+			old.push_back(i->first);
+			fds.erase(i++);
+		}
+		else
+			++i;
+	}
+	pthread_mutex_unlock(&mutex);
+	for (unsigned int i = 0; i < old.size(); i++)
+	{
+		hal_debug("%s: closing idle fd %d\n", __func__, old[i]);
+		close_fd(old[i]);
+	}
+}
+
+int cDemuxPool::Get(int adapter, int demux, int source, int flags, int buffersize)
+{
+	int fd = -1;
+	int size = 0;
+	expire();
+	pthread_mutex_lock(&mutex);
+	/* an idle one, preferably with the same buffer size */
+	for (std::map<int, slot>::iterator i = fds.begin(); i != fds.end(); ++i)
+	{
+		slot &s = i->second;
+		if (!s.idle || s.adapter != adapter || s.demux != demux || s.flags != flags)
+			continue;
+		if (fd < 0 || s.buffersize == buffersize)
+		{
+			fd = i->first;
+			size = s.buffersize;
+		}
+		if (size == buffersize)
+			break;
+	}
+	if (fd > -1)
+	{
+		fds[fd].idle = false;
+		account(DMX_POOL_REUSE, "reuse", 0, false);
+	}
+	pthread_mutex_unlock(&mutex);
+
+	if (fd < 0)
+	{
+		char dev[32];
+		snprintf(dev, sizeof(dev), "/dev/dvb/adapter%d/demux%d", adapter, demux);
+		int64_t start = time_us();
+		fd = open(dev, flags);
+		int64_t us = time_us() - start;
+		int err = errno;
+		pthread_mutex_lock(&mutex);
+		account(DMX_POOL_OPEN, "open", us, fd < 0);
+		if (fd > -1)
+		{
+			slot s;
+			s.adapter = adapter;
+			s.demux = demux;
+			s.flags = flags;
+			s.buffersize = 0;
+			s.idle = false;
+			s.idle_since = 0;
+			fds[fd] = s;
+		}
+		pthread_mutex_unlock(&mutex);
+		if (fd < 0)
+		{
+			errno = err;
+			hal_info("%s %s: %m\n", __func__, dev);
+			return -1;
+		}
+		hal_debug("%s: opened %s fd %d\n", __func__, dev, fd);
+	}
+
+	if (source > -1)
+	{
+		int key = (adapter << 8) | demux;
+		pthread_mutex_lock(&mutex);
+		std::map<int, int>::iterator i = sources.find(key);
+		bool done = i != sources.end() && i->second == source;
+		pthread_mutex_unlock(&mutex);
+		if (!done)
+		{
+			/* this would actually need locking, but the worst that
+			 * can happen is DMX_SET_SOURCE twice on a device */
+			hal_info("%s: setting adapter%d/demux%d to source %d\n", __func__, adapter, demux, source);
+			if (Ioctl(fd, DMX_SET_SOURCE, "DMX_SET_SOURCE", &source) < 0)
+				hal_info("%s DMX_SET_SOURCE failed!\n", __func__);
+			else
+			{
+				pthread_mutex_lock(&mutex);
+				sources[key] = source;
+				pthread_mutex_unlock(&mutex);
+			}
+		}
+	}
+	if (buffersize > 0 && size != buffersize)
+	{
+		if (Ioctl(fd, DMX_SET_BUFFER_SIZE, "DMX_SET_BUFFER_SIZE", buffersize) < 0)
+			hal_info("%s DMX_SET_BUFFER_SIZE failed (%m)\n", __func__);
+		else
+		{
+			pthread_mutex_lock(&mutex);
+			fds[fd].buffersize = buffersize;
+			pthread_mutex_unlock(&mutex);
+		}
+	}
+	return fd;
+}
+
+void cDemuxPool::Put(int fd, bool reuse)
+{
+	if (fd < 0)
+		return;
+	expire();
+	int size = 0;
+	pthread_mutex_lock(&mutex);
+	std::map<int, slot>::iterator i = fds.find(fd);
+	if (i == fds.end())
+		reuse = false;	/* not from Get() */
+	else
+	{
+		int idle = 0;
+		for (std::map<int, slot>::iterator j = fds.begin(); j != fds.end(); ++j)
+			if (j->second.idle && j->second.adapter == i->second.adapter &&
+			    j->second.demux == i->second.demux && j->second.flags == i->second.flags)
+				idle++;
+		if (idle >= DMX_POOL_IDLE)
+			reuse = false;
+		if (!reuse)
+			fds.erase(i);
+		else
+			size = i->second.buffersize;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	if (!reuse)
+	{
+		close_fd(fd);
+		return;
+	}
+	/* a stopped filter does not take a hardware filter */
+	Ioctl(fd, DMX_STOP, "DMX_STOP");
+	/* don't keep megabytes of kernel buffer for a TS tap that may
+	 * never come back, the next Get() sets the size again anyway */
+	if (size > DMX_POOL_IDLE_BUFSIZE)
+	{
+		if (Ioctl(fd, DMX_SET_BUFFER_SIZE, "DMX_SET_BUFFER_SIZE", DMX_POOL_IDLE_BUFSIZE) < 0)
+		{
+			pthread_mutex_lock(&mutex);
+			fds.erase(fd);
+			pthread_mutex_unlock(&mutex);
+			close_fd(fd);
+			return;
+		}
+		size = DMX_POOL_IDLE_BUFSIZE;
+	}
+	pthread_mutex_lock(&mutex);
+	fds[fd].buffersize = size;
+	fds[fd].idle = true;
+	fds[fd].idle_since = time_us();
+	pthread_mutex_unlock(&mutex);
+}
+
+void cDemuxPool::getStats(std::vector<dmx_pool_stat> &out)
+{
+	pthread_mutex_lock(&mutex);
+	out.clear();
+	for (std::map<unsigned long, dmx_pool_stat>::iterator i = stats.begin(); i != stats.end(); ++i)
+		out.push_back(i->second);
+	pthread_mutex_unlock(&mutex);
+}
+
+void cDemuxPool::Dump(void)
+{
+	std::vector<dmx_pool_stat> s;
+	getStats(s);
+	int idle = 0, total;
+	pthread_mutex_lock(&mutex);
+	total = fds.size();
+	for (std::map<int, slot>::iterator i = fds.begin(); i != fds.end(); ++i)
+		if (i->second.idle)
+			idle++;
+	pthread_mutex_unlock(&mutex);
+	hal_info("%s: %d fds, %d idle\n", __func__, total, idle);
+	for (unsigned int i = 0; i < s.size(); i++)
+		hal_info("%s: %-20s %8u calls %6u failed %10.1f us avg %8u us max\n", __func__, s[i].name,
+			s[i].count, s[i].failed, s[i].count ? (double)s[i].total_us / s[i].count : 0.0, s[i].max_us);
+}
@@ -0,0 +1,389 @@
+/*
+ * one thread serving many demux filters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "dmx_reactor.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+
+/* events handled per epoll_wait() */
+#define DMX_REACTOR_EVENTS 16
+
+struct dmx_reactor_filter
+{
+	cDemux *dmx;
+	int fd;			/* -1: not in the epoll set */
+	dmx_reactor_cb cb;
+	void *user;
+	int bufsize;
+	bool removed;
+};
+
+/* queue entry, followed by the data. dmx == NULL marks padding at the
+ * end of the queue buffer */
+struct dmx_reactor_entry
+{
+	cDemux *dmx;
+	int32_t len;
+	uint32_t size;		/* of the entry including data and padding */
+};
+
+#define DMX_REACTOR_ALIGN 16
+
+static void *execute_reactor_thread(void *c)
+{
+	cDemuxReactor *obj = (cDemuxReactor *)c;
+	obj->Run();
+	return NULL;
+}
+
+cDemuxReactor::cDemuxReactor()
+{
+	running = false;
+	buf = NULL;
+	bufsize = 0;
+	q_head = q_tail = 0;
+	memset(&stats, 0, sizeof(stats));
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	queue = (unsigned char *)malloc(DMX_REACTOR_QUEUE);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	queue_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (epoll_fd < 0 || wake_fd < 0 || queue_fd < 0 || !queue)
+		hal_info("%s: setup failed (%m)\n", __func__);
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_fd > -1 && wake_fd > -1)
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+cDemuxReactor::~cDemuxReactor()
+{
+	Stop();
+	for (std::map<cDemux *, struct dmx_reactor_filter *>::iterator i = filters.begin(); i != filters.end(); ++i)
+		delete i->second;
+	for (std::vector<struct dmx_reactor_filter *>::iterator i = removed.begin(); i != removed.end(); ++i)
+		delete *i;
+	if (epoll_fd > -1)
+		close(epoll_fd);
+	if (wake_fd > -1)
+		close(wake_fd);
+	if (queue_fd > -1)
+		close(queue_fd);
+	free(queue);
+	free(buf);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool cDemuxReactor::Start(void)
+{
+	if (running)
+		return true;
+	if (epoll_fd < 0 || wake_fd < 0 || queue_fd < 0 || !queue)
+		return false;
+	running = true;
+	int ret = pthread_create(&thread, 0, execute_reactor_thread, this);
+	if (ret)
+	{
+		errno = ret;
+		hal_info("%s: pthread_create (%m)\n", __func__);
+		running = false;
+		return false;
+	}
+	return true;
+}
+
+void cDemuxReactor::Stop(void)
+{
+	if (!running)
+		return;
+	running = false;
+	uint64_t v = 1;
+	if (write(wake_fd, &v, sizeof(v)) != sizeof(v))
+		hal_info("%s: wakeup failed (%m)\n", __func__);
+	pthread_join(thread, NULL);
+	pthread_mutex_lock(&mutex);
+	for (std::vector<struct dmx_reactor_filter *>::iterator i = removed.begin(); i != removed.end(); ++i)
+		delete *i;
+	removed.clear();
+	pthread_mutex_unlock(&mutex);
+}
+
+bool cDemuxReactor::Add(cDemux *dmx, dmx_reactor_cb cb, void *user, int size)
+{
+	int fd = dmx->getFD();
+	if (fd < 0 || epoll_fd < 0)
+	{
+		hal_info("%s: demux not open\n", __func__);
+		return false;
+	}
+	pthread_mutex_lock(&mutex);
+	if (size > bufsize)
+	{
+		unsigned char *b = (unsigned char *)realloc(buf, size);
+		if (!b)
+		{
+			pthread_mutex_unlock(&mutex);
+			hal_info("%s: out of memory\n", __func__);
+			return false;
+		}
+		buf = b;
+		bufsize = size;
+	}
+	struct dmx_reactor_filter *f;
+	std::map<cDemux *, struct dmx_reactor_filter *>::iterator i = filters.find(dmx);
+	if (i != filters.end())
+	{
+		f = i->second;
+		/* the demux device was reopened */
+		if (f->fd != fd && f->fd > -1)
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, f->fd, NULL);
+	}
+	else
+	{
+		f = new dmx_reactor_filter;
+		f->dmx = dmx;
+		f->fd = -1;
+		f->removed = false;
+		filters[dmx] = f;
+		stats.filters++;
+	}
+	f->cb = cb;
+	f->user = user;
+	f->bufsize = size;
+	bool ret = true;
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.ptr = f;
+	/* a reopened device may have got the same fd number, but closing
+	 * the old one removed it from the epoll set */
+	if ((f->fd != fd || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev)) &&
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+	{
+		hal_info("%s: EPOLL_CTL_ADD fd %d (%m)\n", __func__, fd);
+		f->fd = -1;
+		ret = false;
+	}
+	else
+		f->fd = fd;
+	pthread_mutex_unlock(&mutex);
+	hal_debug("%s: fd %d, %d filters\n", __func__, dmx->getFD(), stats.filters);
+	return ret;
+}
+
+void cDemuxReactor::Remove(cDemux *dmx)
+{
+	pthread_mutex_lock(&mutex);
+	std::map<cDemux *, struct dmx_reactor_filter *>::iterator i = filters.find(dmx);
+	if (i == filters.end())
+	{
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	struct dmx_reactor_filter *f = i->second;
+	filters.erase(i);
+	stats.filters--;
+	if (f->fd > -1)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, f->fd, NULL);
+	/* epoll_wait() may already have returned an event for it,
+	 * the reactor thread frees it after handling those */
+	f->removed = true;
+	if (running)
+		removed.push_back(f);
+	else
+		delete f;
+	pthread_mutex_unlock(&mutex);
+}
+
+void cDemuxReactor::Run(void)
+{
+	char threadname[17];
+	strncpy(threadname, "DmxReactor", sizeof(threadname));
+	threadname[16] = 0;
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	hal_info("%s: begin\n", __func__);
+
+	struct epoll_event ev[DMX_REACTOR_EVENTS];
+	while (running)
+	{
+		int n = epoll_wait(epoll_fd, ev, DMX_REACTOR_EVENTS, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			hal_info("%s: epoll_wait (%m)\n", __func__);
+			break;
+		}
+		pthread_mutex_lock(&mutex);
+		stats.wakeups++;
+		for (int i = 0; i < n; i++)
+		{
+			struct dmx_reactor_filter *f = (struct dmx_reactor_filter *)ev[i].data.ptr;
+			if (!f)
+			{
+				uint64_t v;
+				if (read(wake_fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+					hal_info("%s: wake_fd (%m)\n", __func__);
+				continue;
+			}
+			if (f->removed || f->fd < 0)
+				continue;
+			int len;
+			if (ev[i].events & EPOLLHUP)
+			{
+				/* e.g. DMX_SET_BUFFER_SIZE failed, reading won't help */
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, f->fd, NULL);
+				f->fd = -1;
+				len = -EPIPE;
+			}
+			else
+			{
+				/* through the demux, so that the section cache, timing
+				 * and analyzer see the data as with cDemux::Read() */
+				len = f->dmx->ReadAvailable(buf, f->bufsize);
+				if (len < 0)
+				{
+					if (errno == EAGAIN || errno == EINTR)
+						continue;
+					len = -errno;
+				}
+				else if (len == 0)
+					continue;
+			}
+			stats.reads++;
+			if (f->cb)
+				f->cb(f->dmx, len > 0 ? buf : NULL, len, f->user);
+			else
+				put(f->dmx, buf, len);
+		}
+		for (std::vector<struct dmx_reactor_filter *>::iterator i = removed.begin(); i != removed.end(); ++i)
+			delete *i;
+		removed.clear();
+		pthread_mutex_unlock(&mutex);
+	}
+	hal_info("%s: end\n", __func__);
+}
+
+/* producer side of the queue, reactor thread only */
+void cDemuxReactor::put(cDemux *dmx, const unsigned char *data, int len)
+{
+	uint32_t datalen = len > 0 ? len : 0;
+	uint32_t need = (sizeof(struct dmx_reactor_entry) + datalen + DMX_REACTOR_ALIGN - 1) & ~(DMX_REACTOR_ALIGN - 1);
+	uint32_t old = q_head;
+	uint32_t head = old;
+	uint32_t tail = __atomic_load_n(&q_tail, __ATOMIC_ACQUIRE);
+	uint32_t pos = head % DMX_REACTOR_QUEUE;
+	uint32_t contig = DMX_REACTOR_QUEUE - pos;
+	uint32_t total = need > contig ? need + contig : need;
+	if (DMX_REACTOR_QUEUE - (head - tail) < total)
+	{
+		stats.dropped++;
+		return;
+	}
+	struct dmx_reactor_entry *e;
+	if (need > contig)
+	{
+		e = (struct dmx_reactor_entry *)(queue + pos);
+		e->dmx = NULL;
+		e->len = 0;
+		e->size = contig;
+		head += contig;
+		pos = 0;
+	}
+	e = (struct dmx_reactor_entry *)(queue + pos);
+	e->dmx = dmx;
+	e->len = len;
+	e->size = need;
+	memcpy(e + 1, data, datalen);
+	__atomic_store_n(&q_head, head + need, __ATOMIC_SEQ_CST);
+	stats.queued++;
+	/* wake the consumer if it may have seen the queue empty. Both
+	 * sides store their index before loading the other one, so at
+	 * least one of them notices the new entry. */
+	if (__atomic_load_n(&q_tail, __ATOMIC_SEQ_CST) == old)
+	{
+		uint64_t v = 1;
+		if (write(queue_fd, &v, sizeof(v)) != sizeof(v))
+			hal_info("%s: wakeup failed (%m)\n", __func__);
+	}
+}
+
+/* consumer side of the queue */
+int cDemuxReactor::Get(cDemux **dmx, unsigned char *data, int len, int timeout)
+{
+	while (true)
+	{
+		if (__atomic_load_n(&q_head, __ATOMIC_SEQ_CST) != q_tail)
+		{
+			struct dmx_reactor_entry *e = (struct dmx_reactor_entry *)(queue + q_tail % DMX_REACTOR_QUEUE);
+			uint32_t size = e->size;
+			if (!e->dmx)
+			{
+				__atomic_store_n(&q_tail, q_tail + size, __ATOMIC_SEQ_CST);
+				continue;
+			}
+			int ret = e->len;
+			if (ret > len)
+				ret = len;
+			if (ret > 0)
+				memcpy(data, e + 1, ret);
+			*dmx = e->dmx;
+			__atomic_store_n(&q_tail, q_tail + size, __ATOMIC_SEQ_CST);
+			return ret;
+		}
+		uint64_t v;
+		if (read(queue_fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+			return -errno;
+		if (__atomic_load_n(&q_head, __ATOMIC_SEQ_CST) != q_tail)
+			continue;
+		if (timeout == 0)
+			return 0;
+		struct pollfd pfd;
+		pfd.fd = queue_fd;
+		pfd.events = POLLIN;
+		int r = ::poll(&pfd, 1, timeout);
+		if (r == 0)
+			return 0;
+		if (r < 0 && errno != EINTR)
+			return -errno;
+	}
+}
+
+void cDemuxReactor::GetStats(dmx_reactor_stats_t *s)
+{
+	pthread_mutex_lock(&mutex);
+	*s = stats;
+	pthread_mutex_unlock(&mutex);
+}
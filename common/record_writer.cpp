@@ -0,0 +1,731 @@
+/*
+ * ring buffer + asynchronous file writer for cRecord
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#include "record_writer.h"
+#include "ts_fanout.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_RECORD, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_RECORD, this, args)
+
+static int64_t time_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+cRecordCache::cRecordCache(int _fd, off_t start, size_t _window)
+{
+	window = _window;
+	if (window < RECORD_CACHE_WINDOW_MIN)
+		window = RECORD_CACHE_WINDOW_MIN;
+	evicted = 0;
+	evict_time = 0;
+	Reset(_fd, start);
+}
+
+void cRecordCache::Reset(int _fd, off_t start)
+{
+	fd = _fd;
+	evict_pos = start & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+	retry_pos = evict_pos;
+	written = start;
+}
+
+/* Never waits for the disk. The range is usually written back already,
+ * as writeback was started when it was written a window ago. Pages that
+ * are still dirty are skipped by POSIX_FADV_DONTNEED, so the previous
+ * range is advised once more, by then they are clean. */
+void cRecordCache::evict(off_t end)
+{
+	off_t len = end - evict_pos;
+	if (len <= 0)
+		return;
+	if (posix_fadvise(fd, retry_pos, end - retry_pos, POSIX_FADV_DONTNEED))
+		perror("posix_fadvise");
+	evicted += len;
+	retry_pos = evict_pos;
+	evict_pos = end;
+}
+
+void cRecordCache::Written(off_t offset, size_t len)
+{
+	int64_t t = time_us();
+	if (sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE))
+		perror("sync_file_range");
+	if (offset + (off_t)len > written)
+		written = offset + len;
+	/* evict in steps of at least a quarter window to keep the syscall count low */
+	off_t end = (written - (off_t)window) & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+	if (end - evict_pos >= (off_t)window / 4)
+		evict(end);
+	evict_time += time_us() - t;
+}
+
+void cRecordCache::Finish(void)
+{
+	int64_t t = time_us();
+	evict(written);
+	evict_time += time_us() - t;
+}
+
+cRecordWriter::cRecordWriter(int _fd, size_t _bufsize, size_t _chunksize, size_t _cache_window)
+{
+	fd = _fd;
+	buf = NULL;
+	bufsize = _bufsize;
+	chunksize = _chunksize;
+	if (chunksize == 0 || chunksize > bufsize)
+		chunksize = bufsize;
+	head = submitted = tail = 0;
+	file_start = 0;
+	cache_window = _cache_window;
+	cache = NULL;
+	split_size = 0;
+	part_fd = fd;
+	part = 0;
+	part_base = 0;
+	part_limit = (uint64_t)-1;
+	prealloc_end = 0;
+	prealloc = true;
+	ring_size = 0;
+	memset(&ring, 0, sizeof(ring));
+	failed = false;
+	flushing = false;
+	first = 0;
+	inflight = 0;
+	memset(slots, 0, sizeof(slots));
+	memset(&stats, 0, sizeof(stats));
+	stats.bufsize = bufsize;
+	ring_fd = -1;
+	sq_ptr = cq_ptr = sqes = cqes = NULL;
+	sq_size = cq_size = sqes_size = 0;
+}
+
+cRecordWriter::~cRecordWriter()
+{
+	/* the kernel may still be reading from buf */
+	while (inflight > 0 && reap(-1) >= 0)
+		;
+	uring_teardown();
+	free(buf);
+	delete cache;
+	if (part_fd != fd)
+		close(part_fd);
+}
+
+void cRecordWriter::SetSplitSize(uint64_t size)
+{
+	/* whole packets per part, and far more than one write */
+	if (size && size < RECORD_PREALLOC)
+		size = RECORD_PREALLOC;
+	split_size = size - size % TS_PACKET_SIZE;
+}
+
+void cRecordWriter::SetRingSize(uint64_t size)
+{
+	/* room for several ring buffers, so that a reader has a chance */
+	if (size && size < RECORD_PREALLOC)
+		size = RECORD_PREALLOC;
+	if (size && size < 4 * (uint64_t)bufsize)
+		size = 4 * (uint64_t)bufsize;
+	ring_size = size - size % TS_PACKET_SIZE;
+}
+
+void cRecordWriter::AddPts(uint64_t offset, uint64_t pts)
+{
+	if (!ring_size)
+		return;
+	ring.last_pts = pts;
+	/* about one per second is enough to find the PTS at the tail */
+	if (ring_pts.empty() || ((pts - ring_pts.back().second) & 0x1FFFFFFFFULL) >= 90000)
+		ring_pts.push_back(std::make_pair(offset, pts));
+}
+
+bool cRecordWriter::Init(void)
+{
+	buf = (uint8_t *)malloc(bufsize);
+	if (!buf)
+	{
+		hal_info("%s: unable to allocate buffer! (out of memory)\n", __func__);
+		return false;
+	}
+	/* several writes are in flight at the same time, so each of them
+	 * needs an explicit file offset. O_APPEND would ignore that. */
+	int val = fcntl(fd, F_GETFL);
+	if (val != -1 && (val & O_APPEND) && fcntl(fd, F_SETFL, val & ~O_APPEND))
+		hal_info("%s: clear O_APPEND? (%m)\n", __func__);
+	file_start = lseek(fd, 0, SEEK_END);
+	if (file_start < 0)
+		file_start = 0;
+	prealloc_end = file_start;
+	if (ring_size && !ring_setup())
+		return false;
+	if (ring_size)
+		cache = new cRecordCache(fd, TS_RING_HEADER_SIZE, cache_window);
+	else if (split_size)
+	{
+		/* the parts are named after the file */
+		char link[32];
+		char name[PATH_MAX];
+		snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+		ssize_t len = readlink(link, name, sizeof(name) - 1);
+		if (len > 0)
+		{
+			name[len] = 0;
+			path = name;
+			/* a file that is appended to gets split at the next multiple */
+			part_limit = (file_start / split_size + 1) * split_size;
+		}
+		else
+		{
+			hal_info("%s: readlink %s failed (%m), not splitting\n", __func__, link);
+			split_size = 0;
+		}
+	}
+	if (!cache)
+		cache = new cRecordCache(fd, file_start, cache_window);
+	stats.parts = 1;
+	stats.io_uring = uring_setup();
+	hal_info("%s: bufsize %zu chunksize %zu split %" PRIu64 " ring %" PRIu64 ", using %s\n", __func__,
+		bufsize, chunksize, split_size, ring_size, stats.io_uring ? "io_uring" : "posix aio");
+	return true;
+}
+
+uint8_t *cRecordWriter::GetWritePtr(size_t *avail)
+{
+	size_t used = head - tail;
+	size_t pos = head % bufsize;
+	size_t contig = bufsize - pos;
+	*avail = bufsize - used;
+	if (*avail > contig)
+		*avail = contig;
+	return buf + pos;
+}
+
+void cRecordWriter::Commit(size_t len)
+{
+	head += len;
+	if (head - tail > stats.fill_max)
+		stats.fill_max = head - tail;
+	submit_pending();
+}
+
+int cRecordWriter::Process(int timeout)
+{
+	if (inflight > 0)
+		reap(timeout);
+	submit_pending();
+	return failed ? -1 : 0;
+}
+
+bool cRecordWriter::Flush(void)
+{
+	flushing = true;
+	submit_pending();
+	while (inflight > 0 && !failed)
+	{
+		if (reap(-1) < 0)
+			break;
+		submit_pending();
+	}
+	flushing = false;
+	if (cache)
+		finish_part();
+	if (ring_size)
+		ring_update();
+	return !failed && submitted == head;
+}
+
+void cRecordWriter::GetStats(record_stats_t *s)
+{
+	stats.fill = head - tail;
+	stats.inflight = inflight;
+	if (cache)
+	{
+		stats.evicted = cache->evicted;
+		stats.evict_time = cache->evict_time;
+	}
+	*s = stats;
+}
+
+/* hand the filled part of the ring to the kernel. While a write is in
+ * flight, wait until a full chunk is available, so that the number of
+ * requests stays low when the disk is fast. When the disk is slow,
+ * more requests are queued so that it never runs idle. */
+void cRecordWriter::submit_pending(void)
+{
+	while (!failed && inflight < RECORD_WRITER_INFLIGHT && submitted < head)
+	{
+		size_t len = head - submitted;
+		if (len < chunksize && inflight > 0 && !flushing)
+			break;
+		uint64_t stream_pos = file_start + submitted;
+		if (stream_pos >= part_limit)
+		{
+			/* the previous part must be complete when the next one
+			 * shows up, playback derives the offsets from the sizes */
+			if (inflight > 0)
+				break;
+			if (!next_part())
+			{
+				failed = true;
+				break;
+			}
+		}
+		if (len > chunksize)
+			len = chunksize;
+		size_t pos = submitted % bufsize;
+		if (len > bufsize - pos)
+			len = bufsize - pos;
+		if (len > part_limit - stream_pos)
+			len = part_limit - stream_pos;
+		unsigned int i = (first + inflight) % RECORD_WRITER_INFLIGHT;
+		struct slot *sl = &slots[i];
+		sl->buf = buf + pos;
+		sl->len = len;
+		sl->ring_len = len;
+		sl->offset = stream_pos - part_base + (ring_size ? TS_RING_HEADER_SIZE : 0);
+		preallocate(sl->offset + len);
+		sl->busy = true;
+		sl->done = false;
+		sl->t_submit = time_us();
+		if (!submit_slot(i))
+		{
+			sl->busy = false;
+			stats.write_errors++;
+			failed = true;
+			break;
+		}
+		submitted += len;
+		inflight++;
+	}
+}
+
+void cRecordWriter::complete(unsigned int i, ssize_t res)
+{
+	struct slot *sl = &slots[i];
+	if (res < 0)
+	{
+		errno = -res;
+		hal_info("%s: write of %zu bytes at %lld failed (%m)\n", __func__, sl->len, (long long)sl->offset);
+		stats.write_errors++;
+		failed = true;
+	}
+	else if ((size_t)res < sl->len && res > 0 && !failed)
+	{
+		/* short write, queue the rest again */
+		sl->buf += res;
+		sl->len -= res;
+		sl->offset += res;
+		if (submit_slot(i))
+			return;
+		stats.write_errors++;
+		failed = true;
+	}
+	else if (res == 0 && sl->len)
+	{
+		hal_info("%s: write returned 0, disk full?\n", __func__);
+		stats.write_errors++;
+		failed = true;
+	}
+	sl->done = true;
+	unsigned int lat = time_us() - sl->t_submit;
+	stats.lat_last = lat;
+	stats.lat_avg = stats.writes ? (stats.lat_avg * 7 + lat) / 8 : lat;
+	if (lat > stats.lat_max)
+		stats.lat_max = lat;
+	stats.writes++;
+
+	/* io_uring may complete out of order, but the ring can only be
+	 * reclaimed from the tail */
+	uint64_t old_tail = tail;
+	while (inflight > 0 && slots[first].done)
+	{
+		if (!failed)
+			cache->Written(file_start + tail - part_base + (ring_size ? TS_RING_HEADER_SIZE : 0), slots[first].ring_len);
+		tail += slots[first].ring_len;
+		if (failed)
+			stats.failed_bytes += slots[first].ring_len;
+		else
+			stats.written += slots[first].ring_len;
+		slots[first].busy = false;
+		slots[first].done = false;
+		first = (first + 1) % RECORD_WRITER_INFLIGHT;
+		inflight--;
+	}
+	if (ring_size && tail != old_tail && !failed)
+		ring_update();
+}
+
+/* reserve disk space up to end (and beyond) */
+void cRecordWriter::preallocate(off_t end)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+	while (prealloc && prealloc_end < end)
+	{
+		off_t len = RECORD_PREALLOC;
+		if (split_size && (uint64_t)(prealloc_end + len) > part_limit - part_base)
+			len = part_limit - part_base - prealloc_end;
+		if (fallocate(part_fd, FALLOC_FL_KEEP_SIZE, prealloc_end, len))
+		{
+			/* EOPNOTSUPP on vfat, NFS, ... */
+			hal_info("%s: fallocate failed (%m), no preallocation\n", __func__);
+			prealloc = false;
+			break;
+		}
+		prealloc_end += len;
+	}
+#else
+	(void)end;
+	prealloc = false;
+#endif
+}
+
+/* evict the current part from the page cache and
+ * release the space reserved beyond its end */
+void cRecordWriter::finish_part(void)
+{
+	cache->Finish();
+	struct stat st;
+	if (prealloc_end > 0 && fstat(part_fd, &st) == 0 && S_ISREG(st.st_mode) &&
+		st.st_size < prealloc_end && ftruncate(part_fd, st.st_size))
+		hal_info("%s: ftruncate failed (%m)\n", __func__);
+}
+
+bool cRecordWriter::next_part(void)
+{
+	finish_part();
+	if (ring_size)
+	{
+		/* next lap */
+		part++;
+		part_base = part_limit;
+		part_limit += ring_size;
+		cache->Reset(fd, TS_RING_HEADER_SIZE);
+		return true;
+	}
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), ".%03u", part + 1);
+	std::string name = path + suffix;
+	int nfd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (nfd < 0)
+	{
+		hal_info("%s: open %s failed (%m)\n", __func__, name.c_str());
+		return false;
+	}
+	if (part_fd != fd)
+		close(part_fd);
+	part_fd = nfd;
+	part++;
+	part_base = part_limit;
+	part_limit += split_size;
+	prealloc_end = 0;
+	cache->Reset(part_fd, 0);
+	stats.parts = part + 1;
+	hal_info("%s: continuing in %s\n", __func__, name.c_str());
+	return true;
+}
+
+/* the whole file is allocated up front, a previous ring file of the
+ * same size is reused as it is */
+bool cRecordWriter::ring_setup(void)
+{
+	off_t size = TS_RING_HEADER_SIZE + ring_size;
+	bool allocated = false;
+#ifdef FALLOC_FL_KEEP_SIZE
+	allocated = fallocate(fd, 0, 0, size) == 0;
+	if (!allocated)
+		hal_info("%s: fallocate failed (%m), file will be sparse\n", __func__);
+#endif
+	if ((!allocated || file_start > size) && ftruncate(fd, size))
+	{
+		hal_info("%s: ftruncate failed (%m)\n", __func__);
+		return false;
+	}
+	prealloc = false;
+	file_start = 0;
+	part_limit = ring_size;
+	ring.magic = TS_RING_MAGIC;
+	ring.version = TS_RING_VERSION;
+	ring.header_size = TS_RING_HEADER_SIZE;
+	ring.size = ring_size;
+	ring.head = 0;
+	ring.tail = 0;
+	ring.first_pts = TS_RING_NO_PTS;
+	ring.last_pts = TS_RING_NO_PTS;
+	ring_pts.clear();
+	if (pwrite(fd, &ring, sizeof(ring), 0) != sizeof(ring))
+	{
+		hal_info("%s: header write failed (%m)\n", __func__);
+		return false;
+	}
+	return true;
+}
+
+void cRecordWriter::ring_update(void)
+{
+	ring.head = tail;
+	/* everything up to tail + bufsize may get overwritten before the
+	 * next update, as that much can be submitted in the meantime */
+	uint64_t t = 0;
+	if (tail + bufsize > ring_size)
+	{
+		t = tail + bufsize - ring_size;
+		t += (TS_PACKET_SIZE - t % TS_PACKET_SIZE) % TS_PACKET_SIZE;
+	}
+	ring.tail = t;
+	while (!ring_pts.empty() && ring_pts.front().first < t)
+		ring_pts.pop_front();
+	ring.first_pts = ring_pts.empty() ? TS_RING_NO_PTS : ring_pts.front().second;
+	if (pwrite(fd, &ring, sizeof(ring), 0) != sizeof(ring))
+		hal_info("%s: header write failed (%m)\n", __func__);
+}
+
+#if HAVE_IO_URING
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+bool cRecordWriter::uring_setup(void)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	ring_fd = sys_io_uring_setup(RECORD_WRITER_INFLIGHT * 2, &p);
+	if (ring_fd < 0)
+	{
+		hal_debug("%s: io_uring_setup failed (%m)\n", __func__);
+		ring_fd = -1;
+		return false;
+	}
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	bool single = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+	single = (p.features & IORING_FEAT_SINGLE_MMAP);
+	if (single && cq_size > sq_size)
+		sq_size = cq_size;
+#endif
+	sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ptr == MAP_FAILED)
+		goto fail;
+	if (single)
+		cq_ptr = sq_ptr;
+	else
+	{
+		cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+	sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		goto fail;
+	sq_head = (unsigned int *)((uint8_t *)sq_ptr + p.sq_off.head);
+	sq_tail = (unsigned int *)((uint8_t *)sq_ptr + p.sq_off.tail);
+	sq_mask = (unsigned int *)((uint8_t *)sq_ptr + p.sq_off.ring_mask);
+	sq_array = (unsigned int *)((uint8_t *)sq_ptr + p.sq_off.array);
+	cq_head = (unsigned int *)((uint8_t *)cq_ptr + p.cq_off.head);
+	cq_tail = (unsigned int *)((uint8_t *)cq_ptr + p.cq_off.tail);
+	cq_mask = (unsigned int *)((uint8_t *)cq_ptr + p.cq_off.ring_mask);
+	cqes = (uint8_t *)cq_ptr + p.cq_off.cqes;
+	return true;
+fail:
+	hal_info("%s: mmap failed (%m), falling back to posix aio\n", __func__);
+	uring_teardown();
+	return false;
+}
+
+void cRecordWriter::uring_teardown(void)
+{
+	if (sqes && sqes != MAP_FAILED)
+		munmap(sqes, sqes_size);
+	if (cq_ptr && cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+		munmap(cq_ptr, cq_size);
+	if (sq_ptr && sq_ptr != MAP_FAILED)
+		munmap(sq_ptr, sq_size);
+	sq_ptr = cq_ptr = sqes = cqes = NULL;
+	if (ring_fd > -1)
+		close(ring_fd);
+	ring_fd = -1;
+}
+#else
+bool cRecordWriter::uring_setup(void)
+{
+	return false;
+}
+
+void cRecordWriter::uring_teardown(void)
+{
+}
+#endif
+
+bool cRecordWriter::submit_slot(unsigned int i)
+{
+	struct slot *sl = &slots[i];
+#if HAVE_IO_URING
+	if (ring_fd > -1)
+	{
+		/* IORING_OP_WRITEV works on all io_uring kernels (5.1+),
+		 * IORING_OP_WRITE needs 5.6 */
+		sl->iov.iov_base = sl->buf;
+		sl->iov.iov_len = sl->len;
+		unsigned int t = *sq_tail;
+		unsigned int idx = t & *sq_mask;
+		struct io_uring_sqe *sqe = &((struct io_uring_sqe *)sqes)[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->fd = part_fd;
+		sqe->addr = (unsigned long)&sl->iov;
+		sqe->len = 1;
+		sqe->off = sl->offset;
+		sqe->user_data = i;
+		sq_array[idx] = idx;
+		__atomic_store_n(sq_tail, t + 1, __ATOMIC_RELEASE);
+		int r;
+		do
+			r = sys_io_uring_enter(ring_fd, 1, 0, 0);
+		while (r < 0 && errno == EINTR);
+		if (r < 0)
+		{
+			hal_info("%s: io_uring_enter (%m)\n", __func__);
+			return false;
+		}
+		return true;
+	}
+#endif
+	memset(&sl->cb, 0, sizeof(sl->cb));
+	sl->cb.aio_fildes = part_fd;
+	sl->cb.aio_buf = sl->buf;
+	sl->cb.aio_nbytes = sl->len;
+	sl->cb.aio_offset = sl->offset;
+	sl->cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+	if (aio_write(&sl->cb))
+	{
+		hal_info("%s: aio_write (%m)\n", __func__);
+		return false;
+	}
+	return true;
+}
+
+/* returns number of completed writes, < 0 on error */
+int cRecordWriter::reap(int timeout)
+{
+	int n = 0;
+#if HAVE_IO_URING
+	if (ring_fd > -1)
+	{
+		while (true)
+		{
+			unsigned int h = *cq_head;
+			while (h != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+			{
+				struct io_uring_cqe *cqe = &((struct io_uring_cqe *)cqes)[h & *cq_mask];
+				unsigned int i = cqe->user_data;
+				int res = cqe->res;
+				h++;
+				__atomic_store_n(cq_head, h, __ATOMIC_RELEASE);
+				if (i < RECORD_WRITER_INFLIGHT && slots[i].busy)
+					complete(i, res);
+				n++;
+			}
+			if (n || timeout == 0 || inflight == 0)
+				return n;
+			/* the ring fd becomes readable when completions are queued */
+			struct pollfd pfd;
+			pfd.fd = ring_fd;
+			pfd.events = POLLIN;
+			int r = ::poll(&pfd, 1, timeout);
+			if (r < 0 && errno != EINTR)
+				return -1;
+			if (r == 0)
+				return 0;
+			timeout = 0;
+		}
+	}
+#endif
+	while (true)
+	{
+		unsigned int busy[RECORD_WRITER_INFLIGHT];
+		unsigned int nbusy = 0;
+		for (unsigned int k = 0; k < inflight; k++)
+		{
+			unsigned int i = (first + k) % RECORD_WRITER_INFLIGHT;
+			if (!slots[i].done)
+				busy[nbusy++] = i;
+		}
+		/* complete() may reclaim or resubmit slots, so work on a copy */
+		for (unsigned int k = 0; k < nbusy; k++)
+		{
+			struct slot *sl = &slots[busy[k]];
+			int r = aio_error(&sl->cb);
+			if (r == EINPROGRESS)
+				continue;
+			// not calling aio_return causes a memory leak --martii
+			ssize_t res = aio_return(&sl->cb);
+			if (res < 0)
+				res = -r;
+			complete(busy[k], res);
+			n++;
+		}
+		const struct aiocb *list[RECORD_WRITER_INFLIGHT];
+		int cnt = 0;
+		for (unsigned int k = 0; k < inflight; k++)
+		{
+			unsigned int i = (first + k) % RECORD_WRITER_INFLIGHT;
+			if (!slots[i].done)
+				list[cnt++] = &slots[i].cb;
+		}
+		if (n || timeout == 0 || cnt == 0)
+			return n;
+		struct timespec ts, *tp = NULL;
+		if (timeout > 0)
+		{
+			ts.tv_sec = timeout / 1000;
+			ts.tv_nsec = (timeout % 1000) * 1000000;
+			tp = &ts;
+		}
+		if (aio_suspend(list, cnt, tp) && errno == EAGAIN)
+			return 0;
+		timeout = 0;
+	}
+}
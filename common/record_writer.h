@@ -0,0 +1,183 @@
+/*
+ * ring buffer + asynchronous file writer for cRecord
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RECORD_WRITER_H__
+#define __RECORD_WRITER_H__
+
+#include <config.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <aio.h>
+#include <sys/uio.h>
+#include <string>
+#include <deque>
+#include <utility>
+
+#include "record_hal.h"
+#include "ts_ring.h"
+
+/* number of writes that may be in flight at the same time */
+#define RECORD_WRITER_INFLIGHT 4
+/* default amount of recently written data that stays in the page cache */
+#define RECORD_CACHE_WINDOW (4 * 1024 * 1024)
+/* with smaller windows, eviction would mostly find pages still being
+ * written back, which it skips */
+#define RECORD_CACHE_WINDOW_MIN (1024 * 1024)
+/* disk space is reserved ahead of the write position in steps of this
+ * size, so that the file system can hand out large extents */
+#define RECORD_PREALLOC (32 * 1024 * 1024)
+
+/*
+ * Sliding page cache eviction: writeback of every written range is
+ * started right away, ranges that are more than "window" bytes behind
+ * the write position are evicted from the page cache. Unlike
+ * posix_fadvise() on the whole file, the cost per call does not grow
+ * with the size of the recording, and it never waits for writeback, so
+ * a slow disk does not stall the recording thread.
+ */
+class cRecordCache
+{
+	public:
+		cRecordCache(int fd, off_t start, size_t window);
+		void Written(off_t offset, size_t len);
+		/* evict everything that was written back */
+		void Finish(void);
+		/* continue with another file, keeps the statistics */
+		void Reset(int fd, off_t start);
+		uint64_t evicted;	/* bytes evicted from the page cache */
+		uint64_t evict_time;	/* usec spent starting writeback and evicting */
+	private:
+		int fd;
+		size_t window;
+		off_t evict_pos;
+		off_t retry_pos;	/* start of the range evicted before */
+		off_t written;
+		void evict(off_t end);
+};
+
+/*
+ * The record thread reads from the demux straight into the ring
+ * (GetWritePtr() / Commit()), the writer hands the filled part of the
+ * ring to the kernel in chunks of up to chunksize bytes, with up to
+ * RECORD_WRITER_INFLIGHT writes outstanding. Data is never moved inside
+ * the ring, space is reclaimed in order as the writes complete.
+ * io_uring is used if the kernel supports it, POSIX aio otherwise.
+ *
+ * Space is preallocated with fallocate(FALLOC_FL_KEEP_SIZE) and the
+ * unused rest is released again when a file is finished. With a split
+ * size set, the recording continues in <name>.001, <name>.002, ...
+ * whenever a file reaches that size. Offsets (e.g. in the index) stay
+ * those of the concatenated stream.
+ *
+ * With a ring size set, the file has a fixed size instead and is
+ * written circularly (see ts_ring.h), for permanent timeshift.
+ */
+class cRecordWriter
+{
+	public:
+		cRecordWriter(int fd, size_t bufsize, size_t chunksize, size_t cache_window = RECORD_CACHE_WINDOW);
+		~cRecordWriter();
+
+		/* 0: don't split. Must be called before Init() */
+		void SetSplitSize(uint64_t size);
+		/* 0: normal file. Must be called before Init() */
+		void SetRingSize(uint64_t size);
+		/* video PTS at stream offset, for the PTS range of a ring file */
+		void AddPts(uint64_t offset, uint64_t pts);
+		bool Init(void);
+		/* contiguous free space at the head of the ring */
+		uint8_t *GetWritePtr(size_t *avail);
+		void Commit(size_t len);
+		/* reap completed writes, submit new ones. timeout in ms,
+		 * -1 waits until at least one write completed.
+		 * returns < 0 on write error */
+		int Process(int timeout = 0);
+		/* write out everything that is still buffered */
+		bool Flush(void);
+		void GetStats(record_stats_t *s);
+		bool Failed(void) { return failed; };
+	private:
+		struct slot
+		{
+			uint8_t *buf;
+			size_t len;
+			off_t offset;
+			size_t ring_len;	/* ring bytes freed on completion */
+			bool busy;
+			bool done;
+			int64_t t_submit;
+			struct iovec iov;
+			struct aiocb cb;
+		};
+		int fd;
+		uint8_t *buf;
+		size_t bufsize;
+		size_t chunksize;
+		uint64_t head;		/* bytes committed by the reader */
+		uint64_t submitted;	/* bytes handed to the kernel */
+		uint64_t tail;		/* bytes written to disk */
+		off_t file_start;
+		size_t cache_window;
+		cRecordCache *cache;	/* of part_fd */
+
+		/* current part of a split recording, fd if not split */
+		uint64_t split_size;
+		std::string path;
+		int part_fd;
+		unsigned int part;
+		uint64_t part_base;	/* stream offset of the part */
+		uint64_t part_limit;	/* stream offset of the next part */
+		off_t prealloc_end;	/* reserved up to here in part_fd */
+		bool prealloc;
+
+		/* ring file, each lap is a part at file offset TS_RING_HEADER_SIZE */
+		uint64_t ring_size;
+		ts_ring_header_t ring;
+		std::deque<std::pair<uint64_t, uint64_t> > ring_pts;	/* offset, PTS */
+		bool failed;
+		bool flushing;
+		struct slot slots[RECORD_WRITER_INFLIGHT];
+		unsigned int first;	/* oldest slot in flight */
+		unsigned int inflight;
+		record_stats_t stats;
+
+		/* io_uring, ring_fd == -1 => POSIX aio */
+		int ring_fd;
+		void *sq_ptr;
+		size_t sq_size;
+		void *cq_ptr;
+		size_t cq_size;
+		void *sqes;
+		size_t sqes_size;
+		unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+		unsigned int *cq_head, *cq_tail, *cq_mask;
+		void *cqes;
+
+		bool uring_setup(void);
+		void uring_teardown(void);
+		bool submit_slot(unsigned int i);
+		int reap(int timeout);
+		void complete(unsigned int i, ssize_t res);
+		void submit_pending(void);
+		void preallocate(off_t end);
+		void finish_part(void);
+		bool next_part(void);
+		bool ring_setup(void);
+		void ring_update(void);
+};
+
+#endif // __RECORD_WRITER_H__
@@ -0,0 +1,196 @@
+/*
+ * PSI / SI section cache for cDemux
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <time.h>
+#include <cstring>
+
+#include "section_cache.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+
+static int64_t time_ms(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/* table_id, table_id_extension, section_number and CRC of a long
+ * section, false for short sections and broken lengths */
+static bool section_id(const unsigned char *sec, int len, uint32_t *id, uint32_t *crc)
+{
+	if (len < 12 || !(sec[1] & 0x80))
+		return false;
+	int total = 3 + (((sec[1] & 0x0f) << 8) | sec[2]);
+	if (total < 12 || total > len)
+		return false;
+	*id = ((uint32_t)sec[0] << 24) | (sec[3] << 16) | (sec[4] << 8) | sec[6];
+	const unsigned char *c = sec + total - 4;
+	*crc = ((uint32_t)c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+	return true;
+}
+
+static inline uint64_t section_key(int source, unsigned short pid, uint32_t id)
+{
+	return ((uint64_t)(source & 0xff) << 45) | ((uint64_t)(pid & 0x1fff) << 32) | id;
+}
+
+cSectionCache *cSectionCache::getInstance()
+{
+	static cSectionCache *instance = NULL;
+	static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&instance_mutex);
+	if (!instance)
+		instance = new cSectionCache();
+	pthread_mutex_unlock(&instance_mutex);
+	return instance;
+}
+
+cSectionCache::cSectionCache()
+{
+	size = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+void cSectionCache::drop(std::map<uint64_t, entry>::iterator i)
+{
+	size -= i->second.data.size();
+	lru.erase(i->second.lru);
+	sections.erase(i);
+}
+
+bool cSectionCache::Update(int source, unsigned short pid, const unsigned char *sec, int len)
+{
+	uint32_t id, crc;
+	if (!section_id(sec, len, &id, &crc))
+		return true;
+	len = 3 + (((sec[1] & 0x0f) << 8) | sec[2]);
+	uint64_t key = section_key(source, pid, id);
+
+	pthread_mutex_lock(&mutex);
+	if (pid == 0 && sec[0] == 0)
+	{
+		/* a PAT of another transport stream, the source was retuned */
+		unsigned short ts = (sec[3] << 8) | sec[4];
+		std::map<int, unsigned short>::iterator t = tsid.find(source & 0xff);
+		if (t != tsid.end() && t->second != ts)
+		{
+			hal_debug("%s: source %d tsid 0x%04x => 0x%04x\n", __func__, source, t->second, ts);
+			flush(source);
+		}
+		tsid[source & 0xff] = ts;
+	}
+	std::map<uint64_t, entry>::iterator i = sections.find(key);
+	if (i != sections.end())
+	{
+		entry &e = i->second;
+		e.seen = time_ms();
+		lru.splice(lru.begin(), lru, e.lru);
+		if (e.crc == crc && e.data.size() == (size_t)len)
+		{
+			pthread_mutex_unlock(&mutex);
+			return false;
+		}
+		size -= e.data.size();
+		e.data.assign(sec, sec + len);
+		e.crc = crc;
+		size += len;
+	}
+	else
+	{
+		entry &e = sections[key];
+		e.data.assign(sec, sec + len);
+		e.crc = crc;
+		e.seen = time_ms();
+		lru.push_front(key);
+		e.lru = lru.begin();
+		size += len;
+	}
+	while (size > SECTION_CACHE_SIZE && lru.size() > 1)
+		drop(sections.find(lru.back()));
+	pthread_mutex_unlock(&mutex);
+	return true;
+}
+
+int cSectionCache::Lookup(int source, unsigned short pid, unsigned char table_id, unsigned short ext,
+	unsigned char secnum, unsigned char *buf, int len, unsigned int max_age)
+{
+	uint64_t key = section_key(source, pid, ((uint32_t)table_id << 24) | (ext << 8) | secnum);
+	int ret = 0;
+	pthread_mutex_lock(&mutex);
+	std::map<uint64_t, entry>::iterator i = sections.find(key);
+	if (i != sections.end() && (max_age == 0 || time_ms() - i->second.seen <= (int64_t)max_age))
+	{
+		ret = i->second.data.size();
+		if (ret > len)
+			ret = len;
+		memcpy(buf, &i->second.data[0], ret);
+	}
+	pthread_mutex_unlock(&mutex);
+	hal_debug("%s: source %d pid 0x%04x table 0x%02x ext 0x%04x #%d: %d\n",
+		__func__, source, pid, table_id, ext, secnum, ret);
+	return ret;
+}
+
+void cSectionCache::Flush(int source)
+{
+	pthread_mutex_lock(&mutex);
+	flush(source);
+	pthread_mutex_unlock(&mutex);
+}
+
+/* called with mutex held */
+void cSectionCache::flush(int source)
+{
+	if (source < 0)
+		tsid.clear();
+	else
+		tsid.erase(source & 0xff);
+	std::map<uint64_t, entry>::iterator i = sections.begin();
+	while (i != sections.end())
+	{
+		std::map<uint64_t, entry>::iterator next = i;
+		++next;
+		if (source < 0 || (int)(i->first >> 45) == (source & 0xff))
+			drop(i);
+		i = next;
+	}
+}
+
+bool cSectionSession::Deliver(int source, unsigned short pid, const unsigned char *sec, int len)
+{
+	/* keeps the cache up to date and the "last seen" times current */
+	cSectionCache::getInstance()->Update(source, pid, sec, len);
+
+	uint32_t id, crc;
+	if (!section_id(sec, len, &id, &crc))
+		return true;
+	std::map<uint32_t, uint32_t>::iterator i = seen.find(id);
+	if (i != seen.end())
+	{
+		if (i->second == crc)
+			return false;
+		i->second = crc;
+		return true;
+	}
+	if (seen.size() >= SECTION_SESSION_MAX)
+		seen.clear();
+	seen[id] = crc;
+	return true;
+}
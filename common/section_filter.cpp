@@ -0,0 +1,250 @@
+/*
+ * software section filters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <pthread.h>
+#include <cstring>
+
+#include "section_filter.h"
+
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+	for (int i = 0; i < 256; i++)
+	{
+		uint32_t crc = (uint32_t)i << 24;
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+		crc_table[0][i] = crc;
+	}
+	/* table k: the CRC of byte i followed by k zero bytes */
+	for (int k = 1; k < 8; k++)
+		for (int i = 0; i < 256; i++)
+			crc_table[k][i] = (crc_table[k - 1][i] << 8) ^ crc_table[0][crc_table[k - 1][i] >> 24];
+}
+
+uint32_t crc32_mpeg(const uint8_t *data, unsigned int len)
+{
+	pthread_once(&crc_once, crc_init);
+	uint32_t crc = 0xffffffff;
+	/* eight bytes per step */
+	while (len >= 8)
+	{
+		uint32_t hi = crc ^ (((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+		uint32_t lo = ((uint32_t)data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+		crc = crc_table[7][hi >> 24] ^ crc_table[6][(hi >> 16) & 0xff] ^
+			crc_table[5][(hi >> 8) & 0xff] ^ crc_table[4][hi & 0xff] ^
+			crc_table[3][lo >> 24] ^ crc_table[2][(lo >> 16) & 0xff] ^
+			crc_table[1][(lo >> 8) & 0xff] ^ crc_table[0][lo & 0xff];
+		data += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = (crc << 8) ^ crc_table[0][(crc >> 24) ^ *data++];
+	return crc;
+}
+
+cSectionFilter::cSectionFilter(unsigned short _pid)
+{
+	pid = _pid;
+	used = 0;
+	Reset();
+}
+
+int cSectionFilter::Add(const struct dmx_sct_filter_params *p, section_filter_cb cb, void *user)
+{
+	filter f;
+	uint8_t value[DMX_FILTER_SIZE], equal[DMX_FILTER_SIZE], notequal[DMX_FILTER_SIZE];
+	f.min_len = 0;
+	for (int i = 0; i < DMX_FILTER_SIZE; i++)
+	{
+		uint8_t mask = p->filter.mask[i];
+		value[i] = p->filter.filter[i] & mask;
+		equal[i] = mask & ~p->filter.mode[i];
+		notequal[i] = mask & p->filter.mode[i];
+		if (mask)
+			f.min_len = (i ? i + 2 : 0) + 1;
+	}
+	memcpy(f.value, value, sizeof(f.value));
+	memcpy(f.equal, equal, sizeof(f.equal));
+	memcpy(f.notequal, notequal, sizeof(f.notequal));
+	f.flags = p->flags;
+	f.active = true;
+	f.cb = cb;
+	f.user = user;
+	used++;
+	for (unsigned int i = 0; i < filters.size(); i++)
+	{
+		if (!filters[i].cb)
+		{
+			filters[i] = f;
+			return i;
+		}
+	}
+	filters.push_back(f);
+	return filters.size() - 1;
+}
+
+void cSectionFilter::Remove(int id)
+{
+	if (id < 0 || id >= (int)filters.size() || !filters[id].cb)
+		return;
+	used--;
+	filters[id].active = false;
+	filters[id].cb = NULL;
+}
+
+bool cSectionFilter::Active(int id)
+{
+	return id >= 0 && id < (int)filters.size() && filters[id].active;
+}
+
+void cSectionFilter::Reset(void)
+{
+	sec_len = 0;
+	sec_sync = false;
+	cc = -1;
+}
+
+void cSectionFilter::Section(const uint8_t *s, int len)
+{
+	if (len < 3)
+		return;
+	/* the bytes the filters look at, in the same layout */
+	uint8_t k[DMX_FILTER_SIZE];
+	memset(k, 0, sizeof(k));
+	k[0] = s[0];
+	int n = len - 3;
+	if (n > DMX_FILTER_SIZE - 1)
+		n = DMX_FILTER_SIZE - 1;
+	memcpy(k + 1, s + 3, n);
+	uint64_t key[2];
+	memcpy(key, k, sizeof(key));
+
+	int bad_crc = -1;	/* not computed yet */
+	/* by index, callbacks may add filters */
+	for (unsigned int i = 0; i < filters.size(); i++)
+	{
+		filter &f = filters[i];
+		if (!f.active || len < f.min_len)
+			continue;
+		uint64_t d0 = key[0] ^ f.value[0];
+		uint64_t d1 = key[1] ^ f.value[1];
+		if ((d0 & f.equal[0]) | (d1 & f.equal[1]))
+			continue;
+		if ((f.notequal[0] | f.notequal[1]) && !((d0 & f.notequal[0]) | (d1 & f.notequal[1])))
+			continue;
+		if (f.flags & DMX_CHECK_CRC)
+		{
+			if (bad_crc < 0)
+				bad_crc = crc32_mpeg(s, len) != 0;
+			if (bad_crc)
+				continue;
+		}
+		section_filter_cb cb = f.cb;
+		void *user = f.user;
+		if (f.flags & DMX_ONESHOT)
+			f.active = false;
+		cb(i, s, len, user);
+	}
+}
+
+void cSectionFilter::data(const uint8_t *d, int len)
+{
+	if (sec_len + len > (int)sizeof(sec))
+	{
+		Reset();
+		return;
+	}
+	memcpy(sec + sec_len, d, len);
+	sec_len += len;
+	int pos = 0;
+	while (sec_len - pos >= 3)
+	{
+		const uint8_t *s = sec + pos;
+		/* stuffing up to the next payload_unit_start */
+		if (s[0] == 0xff)
+		{
+			sec_sync = false;
+			break;
+		}
+		int total = 3 + (((s[1] & 0x0f) << 8) | s[2]);
+		if (total > SECTION_MAX)
+		{
+			sec_sync = false;
+			break;
+		}
+		if (sec_len - pos < total)
+			break;
+		Section(s, total);
+		pos += total;
+	}
+	if (!sec_sync)
+	{
+		sec_len = 0;
+		return;
+	}
+	memmove(sec, sec + pos, sec_len - pos);
+	sec_len -= pos;
+}
+
+void cSectionFilter::Packet(const uint8_t *p)
+{
+	/* transport_error_indicator */
+	if (p[1] & 0x80)
+		return;
+	int afc = (p[3] >> 4) & 3;
+	int off = 4;
+	if (afc & 2)
+		off += 1 + p[4];
+	if (!(afc & 1) || off >= 188)
+		return;
+	int c = p[3] & 0x0f;
+	if (cc >= 0 && c != ((cc + 1) & 0x0f))
+	{
+		if (c == cc)
+			return;		/* duplicate packet */
+		sec_sync = false;
+		sec_len = 0;
+	}
+	cc = c;
+	const uint8_t *d = p + off;
+	int n = 188 - off;
+	if (p[1] & 0x40)
+	{
+		/* payload_unit_start: pointer_field to the next section */
+		int ptr = d[0];
+		d++;
+		n--;
+		if (ptr >= n)
+		{
+			sec_sync = false;
+			sec_len = 0;
+			return;
+		}
+		if (sec_sync)
+			data(d, ptr);
+		d += ptr;
+		n -= ptr;
+		sec_len = 0;
+		sec_sync = true;
+	}
+	if (sec_sync)
+		data(d, n);
+}
@@ -0,0 +1,90 @@
+/*
+ * software section filters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SECTION_FILTER_H__
+#define __SECTION_FILTER_H__
+
+#include <config.h>
+#include <inttypes.h>
+#include <vector>
+#include <linux/dvb/dmx.h>
+
+#define SECTION_MAX 4096
+
+/* MPEG-2 CRC of PSI sections, table driven (slice by 8). A section
+ * including its CRC_32 gives 0 */
+uint32_t crc32_mpeg(const uint8_t *data, unsigned int len);
+
+/* called for every section that passes filter "id" */
+typedef void (*section_filter_cb)(int id, const uint8_t *sec, int len, void *user);
+
+/*
+ * Reassembles the sections of one PID and matches every section against
+ * all filters on it in one pass, so one PID read serves any number of
+ * filters (e.g. all EIT filters on 0x12). The filters are the ones of
+ * struct dmx_sct_filter_params with the semantics of the kernel demux:
+ * filter bytes are section bytes 0 and 3..17, bits set in mode (the
+ * negmask) must not all be equal, DMX_CHECK_CRC drops sections with a
+ * bad CRC_32, DMX_ONESHOT stops the filter after the first section.
+ * The CRC is computed at most once per section, and only if a filter
+ * that matches wants it.
+ * Not thread safe, the callbacks may Add() and Remove() filters.
+ */
+class cSectionFilter
+{
+	public:
+		cSectionFilter(unsigned short pid);
+
+		/* returns the filter id */
+		int Add(const struct dmx_sct_filter_params *p, section_filter_cb cb, void *user);
+		void Remove(int id);
+		/* false after DMX_ONESHOT delivered its section */
+		bool Active(int id);
+		/* no filters added, or all removed again */
+		bool Empty(void) { return used == 0; };
+		unsigned short getPid(void) { return pid; };
+
+		/* a TS packet of the PID */
+		void Packet(const uint8_t *p);
+		/* a complete section, e.g. from a demux filter on the whole PID */
+		void Section(const uint8_t *sec, int len);
+		/* drop a partially received section, e.g. after an overflow */
+		void Reset(void);
+	private:
+		struct filter
+		{
+			uint64_t value[2];	/* filter & mask, DMX_FILTER_SIZE bytes */
+			uint64_t equal[2];	/* mask & ~mode */
+			uint64_t notequal[2];	/* mask & mode */
+			int min_len;		/* the filter looks at bytes up to here */
+			int flags;
+			bool active;
+			section_filter_cb cb;
+			void *user;
+		};
+		unsigned short pid;
+		std::vector<filter> filters;
+		int used;
+
+		uint8_t sec[SECTION_MAX + 188];
+		int sec_len;
+		bool sec_sync;
+		int cc;
+		void data(const uint8_t *d, int len);
+};
+
+#endif // __SECTION_FILTER_H__
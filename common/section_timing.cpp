@@ -0,0 +1,403 @@
+/*
+ * section repetition intervals learned per transponder
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "section_timing.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+
+/* remembered sections per filter, for the repetition intervals */
+#define SECTION_WATCH_MAX 1024
+
+static int64_t time_ms(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static inline uint64_t timing_key(uint32_t transponder, unsigned short pid, unsigned char table_id)
+{
+	return ((uint64_t)transponder << 24) | ((pid & 0x1fff) << 8) | table_id;
+}
+
+cSectionTiming *cSectionTiming::getInstance()
+{
+	static cSectionTiming *instance = NULL;
+	static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&instance_mutex);
+	if (!instance)
+	{
+		instance = new cSectionTiming();
+		instance->Load();
+		atexit(save_at_exit);
+		instance->startSaver();
+	}
+	pthread_mutex_unlock(&instance_mutex);
+	return instance;
+}
+
+cSectionTiming::cSectionTiming()
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_mutex_init(&file_mutex, NULL);
+	const char *f = getenv("HAL_SECTION_TIMING");
+	file = f ? f : SECTION_TIMING_FILE;
+	dirty = false;
+}
+
+void cSectionTiming::save_at_exit(void)
+{
+	cSectionTiming *t = getInstance();
+	pthread_mutex_lock(&t->mutex);
+	bool d = t->dirty;
+	pthread_mutex_unlock(&t->mutex);
+	if (d)
+		t->Save();
+}
+
+static void *execute_saver_thread(void *c)
+{
+	cSectionTiming *obj = (cSectionTiming *)c;
+	obj->Run();
+	return NULL;
+}
+
+void cSectionTiming::startSaver(void)
+{
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int ret = pthread_create(&thread, &attr, execute_saver_thread, this);
+	pthread_attr_destroy(&attr);
+	if (ret)
+		hal_info("%s: pthread_create failed (%d), saving at exit only\n", __func__, ret);
+}
+
+/* writes the model back every SECTION_TIMING_SAVE seconds if it
+ * changed, so that the demux read threads never wait for the file */
+void cSectionTiming::Run(void)
+{
+	char threadname[17];
+	strncpy(threadname, "SectionTiming", sizeof(threadname));
+	threadname[16] = 0;
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	while (true)
+	{
+		sleep(SECTION_TIMING_SAVE);
+		pthread_mutex_lock(&mutex);
+		bool d = dirty;
+		pthread_mutex_unlock(&mutex);
+		if (d)
+			Save();
+	}
+}
+
+int cSectionTiming::interval(const entry &e)
+{
+	return e.repeat > e.first ? e.repeat : e.first;
+}
+
+int cSectionTiming::timeout(const entry &e, int def_timeout)
+{
+	if (e.samples < SECTION_TIMING_SAMPLES)
+		return def_timeout;
+	int64_t to = (int64_t)interval(e) * SECTION_TIMING_FACTOR;
+	/* it timed out before, maybe the table is just slower now */
+	to <<= e.missed > 4 ? 4 : e.missed;
+	if (to < SECTION_TIMING_MIN)
+		to = SECTION_TIMING_MIN;
+	if (to > def_timeout)
+		to = def_timeout;
+	return to;
+}
+
+/* called with mutex held */
+uint32_t cSectionTiming::transponder(int src)
+{
+	std::map<int, source>::iterator s = sources.find(src);
+	if (s == sources.end())
+		return SECTION_TIMING_ANY;
+	return s->second.transponder;
+}
+
+/* called with mutex held: the entry that decides the timeout, the one
+ * of the transponder once it has enough samples, else the one learned
+ * on all transponders */
+std::map<uint64_t, cSectionTiming::entry>::iterator cSectionTiming::lookup(int source, unsigned short pid, unsigned char table_id)
+{
+	std::map<uint64_t, entry>::iterator e = entries.find(timing_key(transponder(source), pid, table_id));
+	if (e == entries.end() || e->second.samples < SECTION_TIMING_SAMPLES)
+		e = entries.find(timing_key(SECTION_TIMING_ANY, pid, table_id));
+	return e;
+}
+
+int cSectionTiming::Timeout(int source, unsigned short pid, unsigned char table_id, int def_timeout)
+{
+	if (def_timeout <= 0)
+		return def_timeout;
+	pthread_mutex_lock(&mutex);
+	std::map<uint64_t, entry>::iterator e = lookup(source, pid, table_id);
+	int to = def_timeout;
+	if (e != entries.end())
+		to = timeout(e->second, def_timeout);
+	pthread_mutex_unlock(&mutex);
+	return to;
+}
+
+void cSectionTiming::Sample(int source, unsigned short pid, unsigned char table_id, int ms, bool repeat)
+{
+	if (ms < 0)
+		return;
+	pthread_mutex_lock(&mutex);
+	uint32_t tp[2] = { transponder(source), SECTION_TIMING_ANY };
+	for (int i = 0; i < 2; i++)
+	{
+		if (i == 1 && tp[0] == SECTION_TIMING_ANY)
+			break;
+		std::map<uint64_t, entry>::iterator it = entries.find(timing_key(tp[i], pid, table_id));
+		if (it == entries.end())
+		{
+			entry n;
+			memset(&n, 0, sizeof(n));
+			it = entries.insert(std::make_pair(timing_key(tp[i], pid, table_id), n)).first;
+		}
+		entry &e = it->second;
+		if (repeat)
+			e.repeat = e.repeat ? e.repeat + (ms - e.repeat) / 8 : ms;
+		else
+		{
+			/* the first section comes anywhere within one interval,
+			 * keep the largest recent wait */
+			e.first -= e.first / 8;
+			if (ms > e.first)
+				e.first = ms;
+		}
+		e.samples++;
+		e.missed = 0;
+	}
+	dirty = true;
+	pthread_mutex_unlock(&mutex);
+}
+
+void cSectionTiming::Missed(int source, unsigned short pid, unsigned char table_id)
+{
+	pthread_mutex_lock(&mutex);
+	/* the entry that Timeout() used for the filter */
+	std::map<uint64_t, entry>::iterator e = lookup(source, pid, table_id);
+	if (e != entries.end() && e->second.samples >= SECTION_TIMING_SAMPLES)
+	{
+		e->second.missed++;
+		hal_debug("%s: source %d pid 0x%04x table 0x%02x missed %d times\n", __func__,
+			source, pid, table_id, e->second.missed);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void cSectionTiming::SetTransponder(int src, uint32_t tp)
+{
+	pthread_mutex_lock(&mutex);
+	if (tp)
+	{
+		sources[src].transponder = tp;
+		sources[src].fixed = true;
+	}
+	else
+		sources.erase(src);
+	pthread_mutex_unlock(&mutex);
+}
+
+void cSectionTiming::SetTransportStreamId(int src, unsigned short tsid)
+{
+	pthread_mutex_lock(&mutex);
+	std::map<int, source>::iterator s = sources.find(src);
+	if (s == sources.end())
+		s = sources.insert(std::make_pair(src, source())).first;
+	else if (s->second.fixed)
+		s = sources.end();
+	if (s != sources.end())
+	{
+		s->second.transponder = tsid;
+		s->second.fixed = false;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+uint32_t cSectionTiming::GetTransponder(int source)
+{
+	pthread_mutex_lock(&mutex);
+	uint32_t tp = transponder(source);
+	pthread_mutex_unlock(&mutex);
+	return tp;
+}
+
+void cSectionTiming::Get(std::vector<section_timing> &out)
+{
+	out.clear();
+	pthread_mutex_lock(&mutex);
+	for (std::map<uint64_t, entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+	{
+		section_timing t;
+		t.transponder = i->first >> 24;
+		t.pid = (i->first >> 8) & 0x1fff;
+		t.table_id = i->first & 0xff;
+		t.interval = interval(i->second);
+		t.samples = i->second.samples;
+		t.timeout = i->second.samples < SECTION_TIMING_SAMPLES ? 0 : timeout(i->second, 0x7fffffff);
+		out.push_back(t);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void cSectionTiming::Clear(void)
+{
+	pthread_mutex_lock(&mutex);
+	entries.clear();
+	dirty = true;
+	pthread_mutex_unlock(&mutex);
+}
+
+bool cSectionTiming::Load(const char *f)
+{
+	if (!f)
+		f = file.c_str();
+	FILE *fp = fopen(f, "r");
+	if (!fp)
+		return false;
+	char line[128];
+	int n = 0;
+	pthread_mutex_lock(&mutex);
+	while (fgets(line, sizeof(line), fp))
+	{
+		unsigned int tp, pid, table_id;
+		entry e;
+		memset(&e, 0, sizeof(e));
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%x %x %x %d %d %d", &tp, &pid, &table_id, &e.repeat, &e.first, &e.samples) != 6)
+			continue;
+		if (pid > 0x1fff || table_id > 0xff || e.repeat < 0 || e.first < 0)
+			continue;
+		entries[timing_key(tp, pid, table_id)] = e;
+		n++;
+	}
+	pthread_mutex_unlock(&mutex);
+	fclose(fp);
+	hal_info("%s: %d entries from %s\n", __func__, n, f);
+	return true;
+}
+
+/* the file is written from a copy, without holding the mutex that
+ * Timeout() and Sample() need */
+bool cSectionTiming::Save(const char *f)
+{
+	if (!f)
+		f = file.c_str();
+	pthread_mutex_lock(&file_mutex);
+	pthread_mutex_lock(&mutex);
+	std::map<uint64_t, entry> copy = entries;
+	dirty = false;
+	pthread_mutex_unlock(&mutex);
+	bool ret = save(f, copy);
+	if (!ret)
+	{
+		pthread_mutex_lock(&mutex);
+		dirty = true;
+		pthread_mutex_unlock(&mutex);
+	}
+	pthread_mutex_unlock(&file_mutex);
+	return ret;
+}
+
+/* called with file_mutex held */
+bool cSectionTiming::save(const char *f, const std::map<uint64_t, entry> &e)
+{
+	std::string tmp = std::string(f) + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "w");
+	if (!fp)
+	{
+		hal_info("%s: %s: %m\n", __func__, tmp.c_str());
+		return false;
+	}
+	fprintf(fp, "# transponder pid table_id repeat_ms first_ms samples\n");
+	for (std::map<uint64_t, entry>::const_iterator i = e.begin(); i != e.end(); ++i)
+		fprintf(fp, "%08x %04x %02x %d %d %d\n", (unsigned int)(i->first >> 24),
+			(unsigned int)(i->first >> 8) & 0x1fff, (unsigned int)i->first & 0xff,
+			i->second.repeat, i->second.first, i->second.samples);
+	if (fclose(fp) != 0 || rename(tmp.c_str(), f) < 0)
+	{
+		hal_info("%s: %s: %m\n", __func__, f);
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+void cSectionWatch::Start(int _source, unsigned short _pid, unsigned char _table_id)
+{
+	active = true;
+	first = true;
+	source = _source;
+	pid = _pid;
+	table_id = _table_id;
+	start = time_ms();
+	last.clear();
+}
+
+void cSectionWatch::Section(const unsigned char *sec, int len)
+{
+	if (!active || len < 3 || sec[0] != table_id)
+		return;
+	cSectionTiming *timing = cSectionTiming::getInstance();
+	/* the PAT tells the transponder, before its own sample counts */
+	if (pid == 0 && table_id == 0 && len >= 8)
+		timing->SetTransportStreamId(source, (sec[3] << 8) | sec[4]);
+	int64_t now = time_ms();
+	if (first)
+	{
+		timing->Sample(source, pid, table_id, now - start, false);
+		first = false;
+	}
+	uint32_t id = table_id;
+	if ((sec[1] & 0x80) && len >= 8)
+		id = ((uint32_t)sec[0] << 24) | (sec[3] << 16) | (sec[4] << 8) | sec[6];
+	std::map<uint32_t, int64_t>::iterator l = last.find(id);
+	if (l != last.end())
+	{
+		timing->Sample(source, pid, table_id, now - l->second, true);
+		l->second = now;
+	}
+	else if (last.size() < SECTION_WATCH_MAX)
+		last[id] = now;
+}
+
+void cSectionWatch::Timeout(void)
+{
+	if (!active)
+		return;
+	cSectionTiming::getInstance()->Missed(source, pid, table_id);
+	active = false;
+}
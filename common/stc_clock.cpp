@@ -0,0 +1,284 @@
+/*
+ * system time clock recovered from the PCR
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <cstdio>
+
+#include "dmx_hal.h"
+#include "stc_clock.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+
+/* PCR base is 33 bits of 90 kHz, times 300 for 27 MHz */
+#define PCR_WRAP ((int64_t)300 << 33)
+/* the PCR is specified to +-30 ppm, anything far off is a bad fit */
+#define STC_MAX_DRIFT 0.001
+#define STC_BUFSIZE (188 * 64)
+
+static int64_t time_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+cSTCClock *cSTCClock::getInstance(int unit)
+{
+	static cSTCClock *clocks[MAX_DMX_UNITS];
+	static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+	if (unit < 0 || unit >= MAX_DMX_UNITS)
+		unit = 0;
+	pthread_mutex_lock(&instance_mutex);
+	if (!clocks[unit])
+		clocks[unit] = new cSTCClock(unit);
+	pthread_mutex_unlock(&instance_mutex);
+	return clocks[unit];
+}
+
+cSTCClock::cSTCClock(int _unit)
+{
+	unit = _unit;
+	pid = 0;
+	dmx = NULL;
+	running = false;
+	discontinuities = 0;
+	pcr_count = 0;
+	pthread_mutex_init(&mutex, NULL);
+	reset();
+}
+
+/* called with mutex held */
+void cSTCClock::reset(void)
+{
+	window.clear();
+	last_raw = -1;
+	last_pcr = 0;
+	locked = false;
+	ref_t = 0;
+	ref_pcr = 0;
+	rate = 27.0;
+	jitter2 = 0;
+}
+
+static void *execute_stc_thread(void *c)
+{
+	cSTCClock *obj = (cSTCClock *)c;
+	obj->Run();
+	return NULL;
+}
+
+bool cSTCClock::Start(unsigned short pcr_pid)
+{
+	if (running && pid == pcr_pid)
+		return true;
+	Stop();
+	pid = pcr_pid;
+	dmx = new cDemux(unit);
+	/* not through cTSFanout: its big demux buffers would hand over
+	 * the packets in bursts and spoil the arrival times */
+	if (!dmx->Open(DMX_TP_CHANNEL, NULL, STC_BUFSIZE * 4) || !dmx->pesFilter(pid) || !dmx->Start())
+	{
+		hal_info("%s: unit %d: can not filter PCR PID 0x%04x\n", __func__, unit, pid);
+		delete dmx;
+		dmx = NULL;
+		return false;
+	}
+	pthread_mutex_lock(&mutex);
+	reset();
+	pthread_mutex_unlock(&mutex);
+	running = true;
+	int ret = pthread_create(&thread, 0, execute_stc_thread, this);
+	if (ret != 0)
+	{
+		errno = ret;
+		hal_info("%s: error creating thread! (%m)\n", __func__);
+		running = false;
+		delete dmx;
+		dmx = NULL;
+		return false;
+	}
+	hal_debug("%s: unit %d PCR PID 0x%04x\n", __func__, unit, pid);
+	return true;
+}
+
+void cSTCClock::Stop(void)
+{
+	if (!running)
+		return;
+	running = false;
+	pthread_join(thread, NULL);
+	delete dmx;
+	dmx = NULL;
+	pthread_mutex_lock(&mutex);
+	reset();
+	pthread_mutex_unlock(&mutex);
+}
+
+void cSTCClock::Run(void)
+{
+	char threadname[17];
+	snprintf(threadname, sizeof(threadname), "STCClock%d", unit);
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	uint8_t buf[STC_BUFSIZE];
+	while (running)
+	{
+		int len = dmx->Read(buf, sizeof(buf), 100);
+		if (len <= 0)
+			continue;
+		int64_t now = time_us();
+		for (uint8_t *p = buf; p + 188 <= buf + len; p += 188)
+		{
+			/* sync, PID, adaptation field with PCR_flag */
+			if (p[0] != 0x47 || (((p[1] & 0x1f) << 8) | p[2]) != pid)
+				continue;
+			if (!(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10))
+				continue;
+			int64_t base = ((int64_t)p[6] << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+			int ext = ((p[10] & 0x01) << 8) | p[11];
+			Sample(base * 300 + ext, now, p[5] & 0x80);
+		}
+	}
+}
+
+void cSTCClock::Sample(int64_t pcr, int64_t t, bool discontinuity)
+{
+	pthread_mutex_lock(&mutex);
+	pcr_count++;
+	if (last_raw >= 0)
+	{
+		int64_t d = pcr - last_raw;
+		if (d < -PCR_WRAP / 2)
+			d += PCR_WRAP;
+		else if (d > PCR_WRAP / 2)
+			d -= PCR_WRAP;
+		last_pcr += d;
+	}
+	else
+		last_pcr = pcr;
+	last_raw = pcr;
+
+	if (!discontinuity && locked)
+	{
+		double late = (ref_pcr + rate * (t - ref_t) - last_pcr) / 27.0;
+		if (fabs(late) > STC_MAX_ERROR * 1000.0)
+			discontinuity = true;
+		else
+			jitter2 += (late * late - jitter2) / 64;
+	}
+	if (discontinuity && !window.empty())
+	{
+		hal_debug("%s: unit %d: PCR discontinuity\n", __func__, unit);
+		discontinuities++;
+		reset();
+		last_raw = pcr;
+		last_pcr = pcr;
+	}
+	sample s;
+	s.t = t;
+	s.pcr = last_pcr;
+	if (!window.empty() && t / (STC_BUCKET * 1000) == window.back().t / (STC_BUCKET * 1000))
+	{
+		/* same bucket, keep the one that was less late */
+		sample &b = window.back();
+		if (s.pcr - b.pcr <= 27.0 * (s.t - b.t))
+		{
+			pthread_mutex_unlock(&mutex);
+			return;
+		}
+		b = s;
+	}
+	else
+	{
+		window.push_back(s);
+		if (window.size() > STC_WINDOW)
+			window.pop_front();
+	}
+	fit();
+	pthread_mutex_unlock(&mutex);
+}
+
+/* called with mutex held */
+void cSTCClock::fit(void)
+{
+	int n = window.size();
+	if (n < 2)
+		return;
+	/* least squares relative to the first sample, in doubles */
+	const sample &f = window.front();
+	double st = 0, sp = 0;
+	for (int i = 0; i < n; i++)
+	{
+		st += window[i].t - f.t;
+		sp += window[i].pcr - f.pcr;
+	}
+	double mt = st / n, mp = sp / n;
+	double stt = 0, stp = 0;
+	for (int i = 0; i < n; i++)
+	{
+		double dt = window[i].t - f.t - mt;
+		double dp = window[i].pcr - f.pcr - mp;
+		stt += dt * dt;
+		stp += dt * dp;
+	}
+	double r = stt > 0 ? stp / stt : 27.0;
+	if (fabs(r / 27.0 - 1.0) > STC_MAX_DRIFT)
+		r = 27.0;
+	/* move the line up to the sample that was the least late */
+	double top = -1e300;
+	for (int i = 0; i < n; i++)
+	{
+		double res = window[i].pcr - f.pcr - (mp + r * (window[i].t - f.t - mt));
+		if (res > top)
+			top = res;
+	}
+	rate = r;
+	ref_t = window.back().t;
+	ref_pcr = f.pcr + mp + r * (ref_t - f.t - mt) + top;
+	locked = n >= STC_MIN_SAMPLES && window.back().t - f.t >= STC_MIN_SPAN * 1000;
+}
+
+bool cSTCClock::getSTC(int64_t *stc)
+{
+	int64_t now = time_us();
+	pthread_mutex_lock(&mutex);
+	bool ok = locked && now - window.back().t < STC_TIMEOUT * 1000;
+	if (ok)
+	{
+		int64_t pcr = ref_pcr + rate * (now - ref_t);
+		*stc = (pcr / 300) & (((int64_t)1 << 33) - 1);
+	}
+	pthread_mutex_unlock(&mutex);
+	return ok;
+}
+
+void cSTCClock::getStatus(struct stc_status *s)
+{
+	pthread_mutex_lock(&mutex);
+	s->locked = locked;
+	s->pid = pid;
+	s->samples = window.size();
+	s->drift_ppm = (rate / 27.0 - 1.0) * 1e6;
+	s->jitter_us = sqrt(jitter2);
+	s->discontinuities = discontinuities;
+	s->pcr_count = pcr_count;
+	pthread_mutex_unlock(&mutex);
+}
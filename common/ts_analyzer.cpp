@@ -0,0 +1,214 @@
+/*
+ * transport stream integrity counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <time.h>
+#include <cstring>
+
+#include "ts_analyzer.h"
+
+#define TS_PACKET_SIZE 188
+#define PCR_WRAP ((int64_t)300 << 33)
+/* PCRs further apart (us) are not compared */
+#define PCR_MAX_GAP 1000000
+/* the earliest arrival may move later by this much per us, which
+ * covers the drift between the PCR and the local clock */
+#define PCR_MAX_DRIFT 0.0001
+
+static int64_t time_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+cTSAnalyzer::cTSAnalyzer()
+{
+	pthread_mutex_init(&mutex, NULL);
+	reset();
+}
+
+cTSAnalyzer::~cTSAnalyzer()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+/* called with mutex held */
+void cTSAnalyzer::reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(cc, 0xff, sizeof(cc));
+	memset(seen, 0, sizeof(seen));
+	pcrs.clear();
+	jitter_sum = 0;
+	jitter_count = 0;
+	carry_len = 0;
+	synced = false;
+}
+
+void cTSAnalyzer::Reset(void)
+{
+	pthread_mutex_lock(&mutex);
+	reset();
+	pthread_mutex_unlock(&mutex);
+}
+
+void cTSAnalyzer::Overflow(void)
+{
+	pthread_mutex_lock(&mutex);
+	stats.overflows++;
+	memset(cc, 0xff, sizeof(cc));
+	pcrs.clear();
+	carry_len = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+void cTSAnalyzer::GetStats(struct ts_stats *s)
+{
+	pthread_mutex_lock(&mutex);
+	*s = stats;
+	pthread_mutex_unlock(&mutex);
+}
+
+/* called with mutex held */
+void cTSAnalyzer::packet(const uint8_t *p, int64_t now)
+{
+	stats.packets++;
+	unsigned int pid = ((p[1] & 0x1f) << 8) | p[2];
+	if (!(seen[pid >> 3] & (1 << (pid & 7))))
+	{
+		seen[pid >> 3] |= 1 << (pid & 7);
+		stats.pids++;
+	}
+	/* the rest of the header can not be trusted */
+	if (p[1] & 0x80)
+	{
+		stats.tei++;
+		return;
+	}
+	if (pid == 0x1fff)
+		return;
+	if (p[3] & 0xc0)
+		stats.scrambled++;
+
+	int afc = (p[3] >> 4) & 3;
+	bool af = (afc & 2) && p[4] > 0;
+	bool discontinuity = af && (p[5] & 0x80);
+	/* the counter only counts packets with payload, one duplicate
+	 * packet is allowed */
+	if (afc & 1)
+	{
+		int c = p[3] & 0x0f;
+		if (cc[pid] != 0xff && !discontinuity && c != cc[pid] && c != ((cc[pid] + 1) & 0x0f))
+			stats.cc_errors++;
+		cc[pid] = c;
+	}
+
+	if (!af || p[4] < 7 || !(p[5] & 0x10))
+		return;
+	int64_t base = ((int64_t)p[6] << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+	int64_t pcr = base * 300 + (((p[10] & 0x01) << 8) | p[11]);
+	stats.pcr_count++;
+	/* how much later than the earliest one this PCR arrived */
+	std::map<unsigned short, pcr_state>::iterator i = pcrs.find(pid);
+	if (i != pcrs.end() && !discontinuity)
+	{
+		pcr_state &s = i->second;
+		int64_t dp = pcr - s.pcr;
+		if (dp < 0)
+			dp += PCR_WRAP;
+		int64_t dt = dp / 27;
+		if (dt < PCR_MAX_GAP)
+		{
+			s.pcr = pcr;
+			s.elapsed += dt;
+			int64_t arrival = now - s.t0 - s.elapsed;
+			s.earliest += dt * PCR_MAX_DRIFT;
+			if (arrival < s.earliest)
+				s.earliest = arrival;
+			unsigned int late = arrival - s.earliest;
+			jitter_sum += late;
+			jitter_count++;
+			stats.pcr_jitter_avg = jitter_sum / jitter_count;
+			if (late > stats.pcr_jitter_max)
+				stats.pcr_jitter_max = late;
+			return;
+		}
+	}
+	pcr_state &s = pcrs[pid];
+	s.pcr = pcr;
+	s.t0 = now;
+	s.elapsed = 0;
+	s.earliest = 0;
+}
+
+void cTSAnalyzer::Process(const uint8_t *data, size_t len)
+{
+	const uint8_t *p = data, *end = data + len;
+	int64_t now = time_us();
+	pthread_mutex_lock(&mutex);
+	stats.bytes += len;
+	/* complete the packet split off at the end of the last call */
+	if (carry_len)
+	{
+		size_t n = TS_PACKET_SIZE - carry_len;
+		if (n > len)
+			n = len;
+		memcpy(carry + carry_len, p, n);
+		carry_len += n;
+		p += n;
+		if (carry_len < TS_PACKET_SIZE)
+		{
+			pthread_mutex_unlock(&mutex);
+			return;
+		}
+		packet(carry, now);
+		carry_len = 0;
+	}
+	while (p < end)
+	{
+		if (*p != 0x47)
+		{
+			if (synced)
+				stats.sync_losses++;
+			synced = false;
+			/* a sync byte with another one a packet later */
+			const uint8_t *s = p + 1;
+			while ((s = (const uint8_t *)memchr(s, 0x47, end - s)) != NULL)
+			{
+				if (end - s <= TS_PACKET_SIZE || s[TS_PACKET_SIZE] == 0x47)
+					break;
+				s++;
+			}
+			if (!s)
+				s = end;
+			stats.skipped += s - p;
+			p = s;
+			continue;
+		}
+		synced = true;
+		if (end - p < TS_PACKET_SIZE)
+		{
+			memcpy(carry, p, end - p);
+			carry_len = end - p;
+			break;
+		}
+		packet(p, now);
+		p += TS_PACKET_SIZE;
+	}
+	pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,486 @@
+/*
+ * shared transport stream reader for concurrent recordings
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "ts_fanout.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_RECORD, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_RECORD, this, args)
+#define hal_info_c(args...) _hal_info(HAL_DEBUG_RECORD, NULL, args)
+
+struct ts_source
+{
+	int source;
+	cDemux *dmx;
+	bool filter_set;
+	bool running;
+	int error;		/* why the thread gave up, 0 while it runs */
+	pthread_t thread;
+	pthread_mutex_t mutex;	/* readers, pidcount and demux filter */
+	pthread_cond_t cond;
+	std::vector<cTSFanout *> readers;
+	uint16_t pidcount[TS_MAX_PID];
+
+	void run(void);
+	void dispatch(const uint8_t *data, size_t len);
+	const uint8_t *scan(const uint8_t *p, const uint8_t *end);
+	void overflow(void);
+	void fail(int err);
+};
+
+static pthread_mutex_t sources_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<ts_source *> sources;
+
+static void *execute_fanout_thread(void *c)
+{
+	ts_source *src = (ts_source *)c;
+	src->run();
+	return NULL;
+}
+
+static inline unsigned int ts_pid(const uint8_t *p)
+{
+	return ((p[1] & 0x1f) << 8) | p[2];
+}
+
+void ts_source::dispatch(const uint8_t *data, size_t len)
+{
+	const uint8_t *end = data + len;
+	pthread_mutex_lock(&mutex);
+	for (std::vector<cTSFanout *>::iterator r = readers.begin(); r != readers.end(); ++r)
+	{
+		cTSFanout *t = *r;
+		pthread_mutex_lock(&t->mutex);
+		if (!t->active)
+		{
+			pthread_mutex_unlock(&t->mutex);
+			continue;
+		}
+		/* copy runs of consecutive wanted packets in one go */
+		const uint8_t *run = NULL;
+		bool queued = false;
+		for (const uint8_t *p = data; p < end; p += TS_PACKET_SIZE)
+		{
+			unsigned int pid = ts_pid(p);
+			if (t->want[pid >> 3] & (1 << (pid & 7)))
+			{
+				if (!run)
+					run = p;
+				continue;
+			}
+			if (run)
+			{
+				t->queue(run, p - run);
+				queued = true;
+				run = NULL;
+			}
+		}
+		if (run)
+		{
+			t->queue(run, end - run);
+			queued = true;
+		}
+		if (queued)
+			pthread_cond_signal(&t->cond);
+		pthread_mutex_unlock(&t->mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void ts_source::overflow(void)
+{
+	pthread_mutex_lock(&mutex);
+	for (std::vector<cTSFanout *>::iterator r = readers.begin(); r != readers.end(); ++r)
+	{
+		pthread_mutex_lock(&(*r)->mutex);
+		(*r)->overflow = true;
+		pthread_cond_signal(&(*r)->cond);
+		pthread_mutex_unlock(&(*r)->mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/* the thread stops reading, every reader fails with err from now on */
+void ts_source::fail(int err)
+{
+	pthread_mutex_lock(&mutex);
+	error = err;
+	for (std::vector<cTSFanout *>::iterator r = readers.begin(); r != readers.end(); ++r)
+	{
+		pthread_mutex_lock(&(*r)->mutex);
+		(*r)->error = err;
+		pthread_cond_signal(&(*r)->cond);
+		pthread_mutex_unlock(&(*r)->mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/* hands on the packets in [p, end), returns the start of the incomplete
+ * packet at the end */
+const uint8_t *ts_source::scan(const uint8_t *p, const uint8_t *end)
+{
+	while (end - p >= TS_PACKET_SIZE)
+	{
+		if (*p != 0x47)
+		{
+			/* lost sync, skip to the next sync byte */
+			const uint8_t *s = (const uint8_t *)memchr(p + 1, 0x47, end - p - 1);
+			p = s ? s : end;
+			continue;
+		}
+		const uint8_t *q = p;
+		while (end - q >= TS_PACKET_SIZE && *q == 0x47)
+			q += TS_PACKET_SIZE;
+		dispatch(p, q - p);
+		p = q;
+	}
+	return p;
+}
+
+void ts_source::run(void)
+{
+	char threadname[17];
+	snprintf(threadname, sizeof(threadname), "TSFanout%d", source);
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	hal_info_c("%s: source %d begin\n", __func__, source);
+	/* a packet split between two demux buffers */
+	uint8_t packet[TS_PACKET_SIZE];
+	size_t carry = 0;
+	while (running)
+	{
+		if (!filter_set)
+		{
+			/* the demux is not opened before the first PID is set */
+			pthread_mutex_lock(&mutex);
+			while (!filter_set && running)
+				pthread_cond_wait(&cond, &mutex);
+			pthread_mutex_unlock(&mutex);
+			continue;
+		}
+		/* straight from the kernel's buffers, if they can be mapped */
+		const uint8_t *data;
+		int n = dmx->ReadBuffer(&data, 100);
+		if (n < 0)
+		{
+			if (errno == EOVERFLOW)
+			{
+				carry = 0;
+				overflow();
+			}
+			else if (errno == ENOMEM)
+			{
+				hal_info_c("%s: source %d out of memory\n", __func__, source);
+				fail(ENOMEM);
+				break;
+			}
+			else if (errno != EAGAIN)
+				usleep(10000);
+			continue;
+		}
+		const uint8_t *p = data;
+		const uint8_t *end = data + n;
+		if (carry)
+		{
+			size_t m = std::min((size_t)n, TS_PACKET_SIZE - carry);
+			memcpy(packet + carry, p, m);
+			carry += m;
+			p += m;
+			if (carry == TS_PACKET_SIZE)
+			{
+				if (packet[0] == 0x47)
+					dispatch(packet, TS_PACKET_SIZE);
+				carry = 0;
+			}
+		}
+		p = scan(p, end);
+		if (p < end)
+		{
+			/* keep an incomplete packet only if it starts in sync */
+			const uint8_t *s = (const uint8_t *)memchr(p, 0x47, end - p);
+			if (s)
+			{
+				carry = end - s;
+				memcpy(packet, s, carry);
+			}
+		}
+		dmx->ReleaseBuffer();
+	}
+	hal_info_c("%s: source %d end\n", __func__, source);
+}
+
+/* called with sources_mutex held, after the last reader is gone */
+static void release_source(ts_source *src)
+{
+	pthread_mutex_lock(&src->mutex);
+	src->running = false;
+	pthread_cond_signal(&src->cond);
+	pthread_mutex_unlock(&src->mutex);
+	pthread_join(src->thread, NULL);
+	src->dmx->Stop();
+	delete src->dmx;
+	sources.erase(std::find(sources.begin(), sources.end(), src));
+	hal_info_c("%s: source %d closed\n", __func__, src->source);
+	pthread_cond_destroy(&src->cond);
+	pthread_mutex_destroy(&src->mutex);
+	delete src;
+}
+
+cTSFanout *cTSFanout::Open(int dmx_num, int bufsize_dmx)
+{
+	int source = cDemux::GetSource(dmx_num);
+	ts_source *src = NULL;
+	pthread_mutex_lock(&sources_mutex);
+	for (std::vector<ts_source *>::iterator i = sources.begin(); i != sources.end(); ++i)
+	{
+		if ((*i)->source == source)
+		{
+			src = *i;
+			break;
+		}
+	}
+	if (!src)
+	{
+		src = new ts_source;
+		src->source = source;
+		src->dmx = new cDemux(dmx_num);
+		src->dmx->Open(DMX_TP_CHANNEL, NULL, bufsize_dmx);
+		src->filter_set = false;
+		src->running = true;
+		src->error = 0;
+		memset(src->pidcount, 0, sizeof(src->pidcount));
+		pthread_mutex_init(&src->mutex, NULL);
+		pthread_cond_init(&src->cond, NULL);
+		int ret = pthread_create(&src->thread, 0, execute_fanout_thread, src);
+		if (ret != 0)
+		{
+			errno = ret;
+			hal_info_c("%s: error creating thread! (%m)\n", __func__);
+			delete src->dmx;
+			pthread_cond_destroy(&src->cond);
+			pthread_mutex_destroy(&src->mutex);
+			delete src;
+			pthread_mutex_unlock(&sources_mutex);
+			return NULL;
+		}
+		sources.push_back(src);
+		hal_info_c("%s: new source %d (unit %d)\n", __func__, source, dmx_num);
+	}
+	else
+		hal_info_c("%s: unit %d shares source %d\n", __func__, dmx_num, source);
+	cTSFanout *t = new cTSFanout(src, bufsize_dmx);
+	if (!t->buf)
+	{
+		hal_info_c("%s: unable to allocate buffer! (out of memory)\n", __func__);
+		delete t;
+		t = NULL;
+		if (src->readers.empty())
+			release_source(src);
+	}
+	else
+	{
+		pthread_mutex_lock(&src->mutex);
+		/* a source that already failed fails its new readers as well */
+		t->error = src->error;
+		src->readers.push_back(t);
+		pthread_mutex_unlock(&src->mutex);
+	}
+	pthread_mutex_unlock(&sources_mutex);
+	return t;
+}
+
+void cTSFanout::Close(void)
+{
+	while (!pids.empty())
+		RemovePid(pids.back());
+	pthread_mutex_lock(&sources_mutex);
+	pthread_mutex_lock(&src->mutex);
+	std::vector<cTSFanout *>::iterator i = std::find(src->readers.begin(), src->readers.end(), this);
+	if (i != src->readers.end())
+		src->readers.erase(i);
+	bool last = src->readers.empty();
+	pthread_mutex_unlock(&src->mutex);
+	if (last)
+		release_source(src);
+	pthread_mutex_unlock(&sources_mutex);
+	delete this;
+}
+
+cTSFanout::cTSFanout(struct ts_source *s, int _bufsize)
+{
+	src = s;
+	memset(want, 0, sizeof(want));
+	active = false;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	bufsize = _bufsize > 0 ? _bufsize : 2048 * 1024;
+	buf = (uint8_t *)malloc(bufsize);
+	rpos = 0;
+	fill = 0;
+	overflow = false;
+	error = 0;
+}
+
+cTSFanout::~cTSFanout()
+{
+	free(buf);
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool cTSFanout::AddPid(unsigned short pid)
+{
+	if (pid >= TS_MAX_PID)
+		return false;
+	if (want[pid >> 3] & (1 << (pid & 7)))
+		return true;
+	bool ret = true;
+	pthread_mutex_lock(&src->mutex);
+	if (src->pidcount[pid] == 0)
+	{
+		if (!src->filter_set)
+		{
+			ret = src->dmx->pesFilter(pid);
+			if (ret)
+			{
+				/* so that cDemux::removePid() finds it */
+				pes_pids p;
+				p.fd = src->dmx->getFD();
+				p.pid = pid;
+				src->dmx->pesfds.push_back(p);
+				src->dmx->Start();
+				src->filter_set = true;
+				pthread_cond_signal(&src->cond);
+			}
+		}
+		else
+			ret = src->dmx->addPid(pid);
+	}
+	if (ret)
+	{
+		src->pidcount[pid]++;
+		want[pid >> 3] |= (1 << (pid & 7));
+		pids.push_back(pid);
+	}
+	pthread_mutex_unlock(&src->mutex);
+	hal_debug("%s: pid 0x%04x source %d users %d\n", __func__, pid, src->source, src->pidcount[pid]);
+	return ret;
+}
+
+void cTSFanout::RemovePid(unsigned short pid)
+{
+	if (pid >= TS_MAX_PID || !(want[pid >> 3] & (1 << (pid & 7))))
+		return;
+	pthread_mutex_lock(&src->mutex);
+	want[pid >> 3] &= ~(1 << (pid & 7));
+	pids.erase(std::find(pids.begin(), pids.end(), pid));
+	if (--src->pidcount[pid] == 0)
+		src->dmx->removePid(pid);
+	pthread_mutex_unlock(&src->mutex);
+	hal_debug("%s: pid 0x%04x source %d users %d\n", __func__, pid, src->source, src->pidcount[pid]);
+}
+
+bool cTSFanout::Start(void)
+{
+	pthread_mutex_lock(&mutex);
+	active = true;
+	rpos = 0;
+	fill = 0;
+	overflow = false;
+	pthread_mutex_unlock(&mutex);
+	return true;
+}
+
+bool cTSFanout::Stop(void)
+{
+	pthread_mutex_lock(&mutex);
+	active = false;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+	return true;
+}
+
+/* called with mutex held */
+void cTSFanout::queue(const uint8_t *data, size_t len)
+{
+	if (fill + len > bufsize)
+	{
+		/* reader too slow, drop like the kernel demux does */
+		overflow = true;
+		return;
+	}
+	size_t wpos = (rpos + fill) % bufsize;
+	size_t n = std::min(len, bufsize - wpos);
+	memcpy(buf + wpos, data, n);
+	if (n < len)
+		memcpy(buf, data + n, len - n);
+	fill += len;
+}
+
+int cTSFanout::Read(unsigned char *buff, int len, int timeout)
+{
+	pthread_mutex_lock(&mutex);
+	if (!fill && !overflow && !error && timeout > 0 && active)
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		while (!fill && !overflow && !error && active)
+		{
+			if (pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+				break;
+		}
+	}
+	if (overflow)
+	{
+		overflow = false;
+		pthread_mutex_unlock(&mutex);
+		errno = EOVERFLOW;
+		return -1;
+	}
+	if (!fill && error)
+	{
+		/* the shared reader is gone, nothing more will come */
+		int err = error;
+		pthread_mutex_unlock(&mutex);
+		errno = err;
+		return -1;
+	}
+	size_t n = std::min((size_t)len, fill);
+	size_t m = std::min(n, bufsize - rpos);
+	memcpy(buff, buf + rpos, m);
+	if (m < n)
+		memcpy(buff + m, buf, n - m);
+	rpos = (rpos + n) % bufsize;
+	fill -= n;
+	pthread_mutex_unlock(&mutex);
+	return n;
+}
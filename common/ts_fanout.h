@@ -0,0 +1,77 @@
+/*
+ * shared transport stream reader for concurrent recordings
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TS_FANOUT_H__
+#define __TS_FANOUT_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <vector>
+
+#include "dmx_hal.h"
+
+#define TS_PACKET_SIZE 188
+#define TS_MAX_PID 0x2000
+
+struct ts_source;
+
+/*
+ * All cTSFanout readers on demux units with the same source share one
+ * DMX_TP_CHANNEL cDemux and one thread reading from it. The demux
+ * filters the union of the PIDs of all readers, the thread hands every
+ * reader only the packets of its own PIDs.
+ * The interface mimics the parts of cDemux that cRecord uses.
+ */
+class cTSFanout
+{
+	public:
+		static cTSFanout *Open(int dmx_num, int bufsize_dmx);
+		void Close(void);	/* detaches and deletes the reader */
+
+		bool AddPid(unsigned short pid);
+		void RemovePid(unsigned short pid);
+		bool Start(void);
+		bool Stop(void);
+		/* same semantics as cDemux::Read(): returns -1 / EOVERFLOW once
+		 * after packets had to be dropped because the reader was too slow.
+		 * Returns -1 / ENOMEM on every call once the shared reader ran
+		 * out of memory and stopped. */
+		int Read(unsigned char *buff, int len, int timeout);
+
+		std::vector<unsigned short> pids;
+	private:
+		cTSFanout(struct ts_source *s, int bufsize);
+		~cTSFanout();
+		friend struct ts_source;
+
+		struct ts_source *src;
+		uint8_t want[TS_MAX_PID / 8];
+		bool active;
+
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		uint8_t *buf;
+		size_t bufsize;
+		size_t rpos;
+		size_t fill;
+		bool overflow;
+		int error;		/* sticky, copied from the source */
+		void queue(const uint8_t *data, size_t len);
+};
+
+#endif // __TS_FANOUT_H__
@@ -0,0 +1,366 @@
+/*
+ * keyframe index generation for recordings
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "ts_indexer.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_RECORD, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_RECORD, this, args)
+
+/* bytes of the slice header needed to get at the H.264 slice_type */
+#define H264_SLICE_HDR 5
+
+static bool read_ue(const uint8_t *buf, unsigned int size, unsigned int *bit, unsigned int *val)
+{
+	unsigned int zeros = 0;
+	while (*bit < size * 8 && !(buf[*bit / 8] & (0x80 >> (*bit % 8))))
+	{
+		zeros++;
+		(*bit)++;
+	}
+	if (zeros > 16 || *bit + zeros >= size * 8)
+		return false;
+	(*bit)++;
+	unsigned int v = 0;
+	for (unsigned int i = 0; i < zeros; i++, (*bit)++)
+		v = (v << 1) | ((buf[*bit / 8] >> (7 - *bit % 8)) & 1);
+	*val = (1 << zeros) - 1 + v;
+	return true;
+}
+
+cTSIndexer::cTSIndexer(unsigned short _pid)
+{
+	fd = -1;
+	pid = _pid;
+	codec = TS_INDEX_CODEC_UNKNOWN;
+	pos = 0;
+	carry_len = 0;
+	entries = 0;
+	in_pes = false;
+	pes_done = true;
+	first = false;
+	seq = false;
+	pes_offset = 0;
+	pes_pts = TS_INDEX_NO_PTS;
+	pts_new = false;
+	sc = 0xffffffff;
+	hdr_len = 0;
+	hdr_need = 0;
+}
+
+cTSIndexer::~cTSIndexer()
+{
+	Close();
+}
+
+bool cTSIndexer::Open(int rec_fd)
+{
+	char link[32];
+	char path[PATH_MAX];
+	snprintf(link, sizeof(link), "/proc/self/fd/%d", rec_fd);
+	ssize_t len = readlink(link, path, sizeof(path) - 1);
+	if (len <= 0)
+	{
+		hal_info("%s: readlink %s failed (%m)\n", __func__, link);
+		return false;
+	}
+	path[len] = 0;
+	std::string name = std::string(path) + TS_INDEX_SUFFIX;
+
+	/* recording appended to an existing file => append to its index */
+	off_t start = lseek(rec_fd, 0, SEEK_END);
+	if (start < 0)
+		start = 0;
+	fd = open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (start ? 0 : O_TRUNC), 0644);
+	if (fd < 0)
+	{
+		hal_info("%s: open %s failed (%m)\n", __func__, name.c_str());
+		return false;
+	}
+	pos = start;
+
+	ts_index_header_t h;
+	if (start == 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+		h.magic != TS_INDEX_MAGIC || h.entry_size != sizeof(ts_index_entry_t) || h.pid != pid)
+	{
+		memset(&h, 0, sizeof(h));
+		h.magic = TS_INDEX_MAGIC;
+		h.version = TS_INDEX_VERSION;
+		h.entry_size = sizeof(ts_index_entry_t);
+		h.pid = pid;
+		h.codec = codec;
+		if (ftruncate(fd, 0) || pwrite(fd, &h, sizeof(h), 0) != sizeof(h))
+		{
+			hal_info("%s: write %s failed (%m)\n", __func__, name.c_str());
+			close(fd);
+			fd = -1;
+			return false;
+		}
+	}
+	else
+		codec = h.codec;
+	lseek(fd, 0, SEEK_END);
+	hal_info("%s: %s pid 0x%04x offset %lld\n", __func__, name.c_str(), pid, (long long)start);
+	return true;
+}
+
+void cTSIndexer::Close(void)
+{
+	if (fd < 0)
+		return;
+	hal_info("%s: %u entries\n", __func__, entries);
+	close(fd);
+	fd = -1;
+}
+
+void cTSIndexer::Parse(const uint8_t *data, size_t len)
+{
+	/* complete a packet that was split between two reads */
+	if (carry_len)
+	{
+		size_t n = TS_PACKET_SIZE - carry_len;
+		if (n > len)
+			n = len;
+		memcpy(carry + carry_len, data, n);
+		carry_len += n;
+		data += n;
+		len -= n;
+		pos += n;
+		if (carry_len < TS_PACKET_SIZE)
+			return;
+		carry_len = 0;
+		if (carry[0] == 0x47 && (((carry[1] & 0x1f) << 8) | carry[2]) == pid)
+			packet(carry, pos - TS_PACKET_SIZE);
+	}
+	while (len >= TS_PACKET_SIZE)
+	{
+		if (data[0] == 0x47 && (((data[1] & 0x1f) << 8) | data[2]) == pid)
+			packet(data, pos);
+		data += TS_PACKET_SIZE;
+		len -= TS_PACKET_SIZE;
+		pos += TS_PACKET_SIZE;
+	}
+	if (len)
+	{
+		memcpy(carry, data, len);
+		carry_len = len;
+		pos += len;
+	}
+}
+
+void cTSIndexer::packet(const uint8_t *p, uint64_t offset)
+{
+	/* transport error or scrambled: nothing to parse */
+	if ((p[1] & 0x80) || (p[3] & 0xc0))
+		return;
+	if (!(p[3] & 0x10))
+		return;
+	const uint8_t *payload = p + 4;
+	const uint8_t *end = p + TS_PACKET_SIZE;
+	if (p[3] & 0x20)
+		payload += 1 + p[4];
+	if (payload >= end)
+		return;
+
+	if (p[1] & 0x40)
+	{
+		in_pes = false;
+		/* PES header of a video stream, always within the first packet */
+		if (end - payload < 9 || payload[0] || payload[1] || payload[2] != 1 || (payload[3] & 0xf0) != 0xe0)
+			return;
+		const uint8_t *h = payload;
+		payload += 9 + h[8];
+		if (payload >= end)
+			return;
+		pes_pts = TS_INDEX_NO_PTS;
+		if ((h[7] & 0x80) && h[8] >= 5)
+			pes_pts = ((uint64_t)(h[9] & 0x0e) << 29) | (h[10] << 22) | ((h[11] & 0xfe) << 14) | (h[12] << 7) | (h[13] >> 1);
+		pes_offset = offset;
+		pts_new = pes_pts != TS_INDEX_NO_PTS;
+		in_pes = true;
+		pes_done = false;
+		first = true;
+		seq = false;
+		sc = 0xffffffff;
+		hdr_need = 0;
+	}
+	if (in_pes && !pes_done)
+		scan(payload, end);
+}
+
+void cTSIndexer::scan(const uint8_t *p, const uint8_t *end)
+{
+	while (p < end && !pes_done)
+	{
+		if (hdr_need)
+		{
+			hdr[hdr_len++] = *p++;
+			if (!--hdr_need)
+				start_code();
+			continue;
+		}
+		sc = (sc << 8) | *p++;
+		if ((sc & 0x00ffffff) == 0x000001)
+		{
+			sc = 0xffffffff;
+			hdr_len = 0;
+			/* MPEG-2 start code value, H.264 / HEVC NAL unit header */
+			hdr_need = codec == TS_INDEX_CODEC_H264 ? 1 : 2;
+		}
+	}
+}
+
+/*
+ * Only look at the first start code of a PES: an access unit delimiter,
+ * sequence header or parameter set is what a broadcast stream has there.
+ * Further into the PES most values are valid MPEG-2 slice start codes.
+ */
+bool cTSIndexer::detect(void)
+{
+	if (hdr[0] == 0xb3)
+		codec = TS_INDEX_CODEC_MPEG2;
+	else if (!first)
+		return false;
+	else if (hdr[1] == 0x01 && (hdr[0] == 0x46 || hdr[0] == 0x40))
+		codec = TS_INDEX_CODEC_H265;	/* AUD or VPS */
+	else if (hdr[0] == 0x09 || (hdr[0] & 0x9f) == 0x07)
+		codec = TS_INDEX_CODEC_H264;	/* AUD or SPS */
+	else
+		return false;
+
+	static const char *names[] = { "unknown", "MPEG-2", "H.264", "HEVC" };
+	hal_info("%s: pid 0x%04x is %s video\n", __func__, pid, names[codec]);
+	ts_index_header_t h;
+	if (fd > -1 && pread(fd, &h, sizeof(h), 0) == sizeof(h))
+	{
+		h.codec = codec;
+		if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h))
+			hal_info("%s: header update failed (%m)\n", __func__);
+	}
+	return true;
+}
+
+void cTSIndexer::start_code(void)
+{
+	if (codec == TS_INDEX_CODEC_UNKNOWN && !detect())
+	{
+		pes_done = true;
+		return;
+	}
+	first = false;
+
+	switch (codec)
+	{
+		case TS_INDEX_CODEC_MPEG2:
+			if (hdr[0] == 0xb3)
+				seq = true;
+			else if (hdr[0] == 0x00)
+			{
+				/* picture header: 10 bits temporal_reference, 3 bits picture_coding_type */
+				if (hdr_len < 3)
+				{
+					hdr_need = 3 - hdr_len;
+					return;
+				}
+				if (((hdr[2] >> 3) & 7) == 1)
+					add(seq ? TS_INDEX_PIC_IDR : TS_INDEX_PIC_I);
+				pes_done = true;
+			}
+			else if (hdr[0] >= 0x01 && hdr[0] <= 0xaf)
+				pes_done = true;	/* slice without picture header? */
+			break;
+		case TS_INDEX_CODEC_H264:
+		{
+			int type = hdr[0] & 0x1f;
+			if (type == 5)
+			{
+				add(TS_INDEX_PIC_IDR);
+				pes_done = true;
+			}
+			else if (type == 1)
+			{
+				if (hdr_len < H264_SLICE_HDR)
+				{
+					hdr_need = H264_SLICE_HDR - hdr_len;
+					return;
+				}
+				/* first_mb_in_slice, slice_type */
+				unsigned int bit = 0, first_mb, slice_type;
+				if (read_ue(hdr + 1, hdr_len - 1, &bit, &first_mb) &&
+					read_ue(hdr + 1, hdr_len - 1, &bit, &slice_type) &&
+					(slice_type % 5 == 2 || slice_type % 5 == 4))
+					add(TS_INDEX_PIC_I);
+				pes_done = true;
+			}
+			else if (type >= 2 && type <= 4)
+				pes_done = true;
+			break;
+		}
+		case TS_INDEX_CODEC_H265:
+		{
+			int type = (hdr[0] >> 1) & 0x3f;
+			/* IRAP: 16..18 BLA, 19..20 IDR, 21 CRA */
+			if (type >= 16 && type <= 21)
+			{
+				add(type == 19 || type == 20 ? TS_INDEX_PIC_IDR : TS_INDEX_PIC_CRA);
+				pes_done = true;
+			}
+			else if (type <= 9)
+				pes_done = true;
+			break;
+		}
+	}
+}
+
+void cTSIndexer::add(uint32_t type)
+{
+	if (fd < 0)
+		return;
+	ts_index_entry_t e;
+	memset(&e, 0, sizeof(e));
+	e.offset = pes_offset;
+	e.pts = pes_pts;
+	e.type = type;
+	if (write(fd, &e, sizeof(e)) != sizeof(e))
+	{
+		hal_info("%s: write failed (%m), index disabled\n", __func__);
+		Close();
+		return;
+	}
+	entries++;
+	hal_debug("%s: %s at %" PRIu64 " pts %" PRIu64 "\n", __func__,
+		type == TS_INDEX_PIC_IDR ? "IDR" : type == TS_INDEX_PIC_CRA ? "CRA" : "I", e.offset, e.pts);
+}
+
+bool cTSIndexer::LastPts(uint64_t *offset, uint64_t *pts)
+{
+	if (!pts_new)
+		return false;
+	pts_new = false;
+	*offset = pes_offset;
+	*pts = pes_pts;
+	return true;
+}
@@ -0,0 +1,82 @@
+/*
+ * keyframe index generation for recordings
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TS_INDEXER_H__
+#define __TS_INDEXER_H__
+
+#include <config.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "ts_index.h"
+#include "ts_fanout.h"
+
+/*
+ * Watches the recorded stream for the PES packets of the video PID and
+ * appends an entry to the index file (see ts_index.h) for every I picture.
+ * Only the start of each PES payload is scanned: parsing stops at the
+ * first picture header (MPEG-2) or slice NAL unit (H.264, HEVC), so the
+ * cost per recorded byte stays small. The codec is detected from the
+ * stream.
+ * Without Open() no index is written, the indexer then only tracks the
+ * PTS of the video stream (see LastPts()).
+ */
+class cTSIndexer
+{
+	public:
+		cTSIndexer(unsigned short pid);
+		~cTSIndexer();
+		/* index file name is derived from the name of rec_fd */
+		bool Open(int rec_fd);
+		/* data is exactly what gets written to rec_fd, in order */
+		void Parse(const uint8_t *data, size_t len);
+		void Close(void);
+		unsigned int Entries(void) { return entries; };
+		/* PTS of the latest video PES and the offset of its first
+		 * packet, false if there was none since the last call */
+		bool LastPts(uint64_t *offset, uint64_t *pts);
+	private:
+		int fd;
+		unsigned short pid;
+		int codec;
+		uint64_t pos;		/* file offset of the next byte passed to Parse() */
+		uint8_t carry[TS_PACKET_SIZE];
+		size_t carry_len;
+		unsigned int entries;
+
+		/* current PES of the video PID */
+		bool in_pes;
+		bool pes_done;		/* picture type known, skip the rest */
+		bool first;		/* no start code seen in this PES yet */
+		bool seq;		/* MPEG-2 sequence header seen in this PES */
+		uint64_t pes_offset;
+		uint64_t pes_pts;
+		bool pts_new;
+
+		uint32_t sc;		/* start code shift register */
+		uint8_t hdr[8];		/* bytes following a start code */
+		unsigned int hdr_len;
+		unsigned int hdr_need;
+
+		void packet(const uint8_t *p, uint64_t offset);
+		void scan(const uint8_t *p, const uint8_t *end);
+		void start_code(void);
+		bool detect(void);
+		void add(uint32_t type);
+};
+
+#endif // __TS_INDEXER_H__
@@ -0,0 +1,392 @@
+/*
+ * single program transport stream remuxer for cRecord
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <cstdio>
+#include <cstring>
+
+#include "ts_remux.h"
+#include "section_filter.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_RECORD, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_RECORD, this, args)
+
+#define BIT_SET(a, pid) ((a)[(pid) >> 3] |= (1 << ((pid) & 7)))
+#define BIT_CLR(a, pid) ((a)[(pid) >> 3] &= ~(1 << ((pid) & 7)))
+#define BIT_TST(a, pid) ((a)[(pid) >> 3] & (1 << ((pid) & 7)))
+
+static void append_crc(std::vector<uint8_t> &sec)
+{
+	uint32_t crc = crc32_mpeg(&sec[0], sec.size());
+	sec.push_back(crc >> 24);
+	sec.push_back(crc >> 16);
+	sec.push_back(crc >> 8);
+	sec.push_back(crc);
+}
+
+/* returns true once a complete section is in s->data. Only sections
+ * starting in a packet with payload_unit_start_indicator are collected */
+static bool section_collect(struct ts_section *s, const uint8_t *p)
+{
+	const uint8_t *payload = p + 4;
+	const uint8_t *end = p + TS_PACKET_SIZE;
+	if ((p[1] & 0x80) || !(p[3] & 0x10))
+		return false;
+	if (p[3] & 0x20)
+		payload += 1 + p[4];
+	if (p[1] & 0x40)
+	{
+		if (payload < end)
+			payload += 1 + *payload;	/* pointer_field */
+		s->len = 0;
+		s->need = 0;
+		if (end - payload < 3)
+			return false;
+		unsigned int need = 3 + (((payload[1] & 0x0f) << 8) | payload[2]);
+		if (need > TS_SECTION_MAX || need < 12)
+			return false;
+		s->need = need;
+	}
+	else if (s->len >= s->need)
+		return false;
+	if (payload >= end)
+		return false;
+	unsigned int n = end - payload;
+	if (n > s->need - s->len)
+		n = s->need - s->len;
+	memcpy(s->data + s->len, payload, n);
+	s->len += n;
+	return s->len == s->need && crc32_mpeg(s->data, s->len) == 0;
+}
+
+cTSRemux::cTSRemux(unsigned short service_id)
+{
+	pthread_mutex_init(&mutex, NULL);
+	sid = service_id;
+	pmt_pid = -1;
+	pcr_pid = -1;
+	tsid = 0;
+	memset(es, 0, sizeof(es));
+	memset(pmt_es, 0, sizeof(pmt_es));
+	memset(internal, 0, sizeof(internal));
+	es_changed = false;
+	memset(cc_delta, 0, sizeof(cc_delta));
+	memset(cc_last, -1, sizeof(cc_last));
+	memset(cc_resync, 0, sizeof(cc_resync));
+	pat_in.len = pat_in.need = 0;
+	pmt_in.len = pmt_in.need = 0;
+	pmt_orig.len = pmt_orig.need = 0;
+	pat_version = 0;
+	pmt_version = 0;
+	pat_cc = 0;
+	pmt_cc = 0;
+	buf = NULL;
+	len = room = rpos = wpos = 0;
+	request(0);
+	hal_info("%s: service 0x%04x\n", __func__, sid);
+}
+
+cTSRemux::~cTSRemux()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+void cTSRemux::AddPid(unsigned short pid)
+{
+	if (pid >= TS_MAX_PID)
+		return;
+	pthread_mutex_lock(&mutex);
+	BIT_SET(es, pid);
+	/* continue the counter where the last packet of this PID left off */
+	BIT_SET(cc_resync, pid);
+	es_changed = true;
+	pthread_mutex_unlock(&mutex);
+}
+
+void cTSRemux::RemovePid(unsigned short pid)
+{
+	if (pid >= TS_MAX_PID)
+		return;
+	pthread_mutex_lock(&mutex);
+	BIT_CLR(es, pid);
+	es_changed = true;
+	pthread_mutex_unlock(&mutex);
+}
+
+bool cTSRemux::Internal(unsigned short pid)
+{
+	pthread_mutex_lock(&mutex);
+	bool ret = pid < TS_MAX_PID && BIT_TST(internal, pid);
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+int cTSRemux::NewPid(void)
+{
+	int ret = -1;
+	pthread_mutex_lock(&mutex);
+	if (!pending.empty())
+	{
+		ret = pending.front();
+		pending.erase(pending.begin());
+	}
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+/* called with mutex held */
+void cTSRemux::request(int pid)
+{
+	if (pid < 0 || pid >= TS_MAX_PID - 1 || BIT_TST(internal, pid))
+		return;
+	BIT_SET(internal, pid);
+	pending.push_back(pid);
+}
+
+void cTSRemux::parse_pat(void)
+{
+	const uint8_t *d = pat_in.data;
+	unsigned int n = pat_in.need - 4;
+	if (d[0] != 0x00 || !(d[5] & 0x01))
+		return;
+	int pid = -1;
+	for (unsigned int i = 8; i + 4 <= n; i += 4)
+	{
+		if (((d[i] << 8) | d[i + 1]) == sid)
+		{
+			pid = ((d[i + 2] & 0x1f) << 8) | d[i + 3];
+			break;
+		}
+	}
+	if (pid < 0)
+	{
+		hal_debug("%s: service 0x%04x not in PAT\n", __func__, sid);
+		return;
+	}
+	uint16_t id = (d[3] << 8) | d[4];
+	if (pid == pmt_pid && id == tsid && !pat_sec.empty())
+		return;
+	hal_info("%s: service 0x%04x PMT pid 0x%04x\n", __func__, sid, pid);
+	if (pid != pmt_pid)
+	{
+		pmt_pid = pid;
+		pmt_in.len = pmt_in.need = 0;
+		pmt_orig.len = pmt_orig.need = 0;
+		request(pmt_pid);
+	}
+	tsid = id;
+	build_pat();
+}
+
+void cTSRemux::build_pat(void)
+{
+	std::vector<uint8_t> &s = pat_sec;
+	s.clear();
+	s.push_back(0x00);
+	s.push_back(0xb0);
+	s.push_back(13);
+	s.push_back(tsid >> 8);
+	s.push_back(tsid);
+	s.push_back(0xc1 | (pat_version << 1));
+	s.push_back(0);
+	s.push_back(0);
+	s.push_back(sid >> 8);
+	s.push_back(sid);
+	s.push_back(0xe0 | (pmt_pid >> 8));
+	s.push_back(pmt_pid);
+	append_crc(s);
+	pat_version = (pat_version + 1) & 0x1f;
+}
+
+/* PMT of the service with only the recorded streams */
+void cTSRemux::build_pmt(void)
+{
+	const uint8_t *d = pmt_orig.data;
+	unsigned int n = pmt_orig.need - 4;
+	unsigned int pil = ((d[10] & 0x0f) << 8) | d[11];
+	if (12 + pil > n)
+		return;
+	std::vector<uint8_t> &s = pmt_sec;
+	s.assign(d, d + 12 + pil);
+	memset(pmt_es, 0, sizeof(pmt_es));
+	unsigned int i = 12 + pil;
+	while (i + 5 <= n)
+	{
+		unsigned int pid = ((d[i + 1] & 0x1f) << 8) | d[i + 2];
+		unsigned int eil = ((d[i + 3] & 0x0f) << 8) | d[i + 4];
+		if (i + 5 + eil > n)
+			break;
+		if (BIT_TST(es, pid))
+		{
+			BIT_SET(pmt_es, pid);
+			s.insert(s.end(), d + i, d + i + 5 + eil);
+		}
+		i += 5 + eil;
+	}
+	unsigned int seclen = s.size() - 3 + 4;
+	s[1] = 0xb0 | (seclen >> 8);
+	s[2] = seclen;
+	s[5] = 0xc1 | (pmt_version << 1);
+	s[6] = 0;
+	s[7] = 0;
+	append_crc(s);
+	pmt_version = (pmt_version + 1) & 0x1f;
+
+	int pcr = ((d[8] & 0x1f) << 8) | d[9];
+	if (pcr != pcr_pid)
+	{
+		hal_info("%s: PCR pid 0x%04x\n", __func__, pcr);
+		pcr_pid = pcr;
+		/* keeps the PCR even if ChangePids() drops its stream */
+		request(pcr_pid);
+	}
+	es_changed = false;
+}
+
+void cTSRemux::packetize(unsigned short pid, const std::vector<uint8_t> &sec, uint8_t *cc)
+{
+	size_t done = 0;
+	while (done < sec.size())
+	{
+		uint8_t p[TS_PACKET_SIZE];
+		uint8_t *payload = p + 4;
+		p[0] = 0x47;
+		p[1] = (done ? 0x00 : 0x40) | (pid >> 8);
+		p[2] = pid;
+		p[3] = 0x10 | *cc;
+		*cc = (*cc + 1) & 0x0f;
+		if (!done)
+			*payload++ = 0;	/* pointer_field */
+		size_t n = p + TS_PACKET_SIZE - payload;
+		if (n > sec.size() - done)
+			n = sec.size() - done;
+		memcpy(payload, &sec[done], n);
+		memset(payload + n, 0xff, p + TS_PACKET_SIZE - payload - n);
+		done += n;
+		out.insert(out.end(), p, p + TS_PACKET_SIZE);
+	}
+}
+
+/* replaces the current input packet with generated PAT and / or PMT */
+void cTSRemux::emit(bool pat, bool pmt)
+{
+	size_t count = 0;
+	/* pointer_field + section, 184 bytes per packet */
+	if (pat)
+		count += (pat_sec.size() + TS_PACKET_SIZE - 4) / (TS_PACKET_SIZE - 4);
+	if (pmt)
+		count += (pmt_sec.size() + TS_PACKET_SIZE - 4) / (TS_PACKET_SIZE - 4);
+	size_t size = count * TS_PACKET_SIZE;
+	size_t have = rpos + TS_PACKET_SIZE - wpos;
+	if (size > have)
+	{
+		/* make room by moving the unprocessed input */
+		size_t extra = size - have;
+		if (len + extra > room)
+		{
+			hal_debug("%s: no room for PAT/PMT, skipped\n", __func__);
+			return;
+		}
+		memmove(buf + rpos + TS_PACKET_SIZE + extra, buf + rpos + TS_PACKET_SIZE, len - rpos - TS_PACKET_SIZE);
+		len += extra;
+		rpos += extra;
+	}
+	out.clear();
+	if (pat)
+		packetize(0, pat_sec, &pat_cc);
+	if (pmt)
+		packetize(pmt_pid, pmt_sec, &pmt_cc);
+	memcpy(buf + wpos, &out[0], size);
+	wpos += size;
+}
+
+void cTSRemux::keep(void)
+{
+	if (wpos != rpos)
+		memmove(buf + wpos, buf + rpos, TS_PACKET_SIZE);
+	wpos += TS_PACKET_SIZE;
+}
+
+size_t cTSRemux::Process(uint8_t *_buf, size_t _len, size_t _room)
+{
+	pthread_mutex_lock(&mutex);
+	buf = _buf;
+	len = _len;
+	room = _room;
+	rpos = 0;
+	wpos = 0;
+	while (len - rpos >= TS_PACKET_SIZE)
+	{
+		uint8_t *p = buf + rpos;
+		unsigned int pid = ((p[1] & 0x1f) << 8) | p[2];
+		if (p[0] != 0x47)
+			keep();
+		else if (pid == 0x1fff)
+			;	/* null packet */
+		else if (pid == 0)
+		{
+			if (section_collect(&pat_in, p))
+			{
+				parse_pat();
+				/* the generated PAT takes the place of the original one */
+				if (!pmt_sec.empty())
+					emit(true, false);
+			}
+		}
+		else if ((int)pid == pmt_pid)
+		{
+			if (section_collect(&pmt_in, p) && pmt_in.data[0] == 0x02 && (pmt_in.data[5] & 0x01) &&
+				((pmt_in.data[3] << 8) | pmt_in.data[4]) == sid)
+			{
+				bool first = pmt_sec.empty();
+				if (first || es_changed || pmt_orig.need != pmt_in.need ||
+					memcmp(pmt_orig.data, pmt_in.data, pmt_in.need))
+				{
+					memcpy(pmt_orig.data, pmt_in.data, pmt_in.need);
+					pmt_orig.len = pmt_orig.need = pmt_in.need;
+					build_pmt();
+				}
+				if (!pmt_sec.empty())
+					emit(first, true);
+			}
+		}
+		else if (!pmt_sec.empty() && ((int)pid == pcr_pid || (BIT_TST(es, pid) && BIT_TST(pmt_es, pid))))
+		{
+			uint8_t cc = p[3] & 0x0f;
+			if ((p[3] & 0x10) && BIT_TST(cc_resync, pid))
+			{
+				BIT_CLR(cc_resync, pid);
+				if (cc_last[pid] >= 0)
+					cc_delta[pid] = (cc_last[pid] + 1 - cc) & 0x0f;
+			}
+			cc = (cc + cc_delta[pid]) & 0x0f;
+			p[3] = (p[3] & 0xf0) | cc;
+			if (p[3] & 0x10)
+				cc_last[pid] = cc;
+			keep();
+		}
+		rpos += TS_PACKET_SIZE;
+	}
+	/* a partial packet at the end is passed on unchanged */
+	if (rpos < len)
+	{
+		memmove(buf + wpos, buf + rpos, len - rpos);
+		wpos += len - rpos;
+	}
+	pthread_mutex_unlock(&mutex);
+	return wpos;
+}
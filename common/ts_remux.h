@@ -0,0 +1,110 @@
+/*
+ * single program transport stream remuxer for cRecord
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TS_REMUX_H__
+#define __TS_REMUX_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <vector>
+
+#include "ts_fanout.h"
+
+/* room Process() may need beyond the input for generated PAT / PMT packets */
+#define TS_REMUX_SLACK (4 * TS_PACKET_SIZE)
+
+#define TS_SECTION_MAX 1024
+
+struct ts_section
+{
+	uint8_t data[TS_SECTION_MAX];
+	unsigned int len;
+	unsigned int need;
+};
+
+/*
+ * Turns the recorded packets into a single program TS: PAT and PMT of
+ * the service are replaced by generated ones that list only the
+ * recorded streams, null packets and packets of PIDs that are not part
+ * of the recorded service are dropped, continuity counters of PIDs that
+ * get removed and added again are remapped so that they continue.
+ * Nothing is written before the first PMT was seen, so every file
+ * starts with PAT and PMT.
+ */
+class cTSRemux
+{
+	public:
+		cTSRemux(unsigned short service_id);
+		~cTSRemux();
+
+		/* elementary stream PIDs of the recording */
+		void AddPid(unsigned short pid);
+		void RemovePid(unsigned short pid);
+		/* PAT, PMT and PCR PIDs, which the remuxer adds to the demux itself */
+		bool Internal(unsigned short pid);
+		/* next PID the remuxer needs on the demux, -1 if none */
+		int NewPid(void);
+
+		/* rewrites buf[0..len) in place and returns the new length,
+		 * which can exceed len by up to TS_REMUX_SLACK if room allows */
+		size_t Process(uint8_t *buf, size_t len, size_t room);
+	private:
+		pthread_mutex_t mutex;
+		unsigned short sid;
+		int pmt_pid;
+		int pcr_pid;
+		uint16_t tsid;
+		uint8_t es[TS_MAX_PID / 8];		/* recorded */
+		uint8_t pmt_es[TS_MAX_PID / 8];		/* listed in the PMT */
+		uint8_t internal[TS_MAX_PID / 8];
+		std::vector<unsigned short> pending;
+		bool es_changed;
+
+		/* continuity counter remapping */
+		uint8_t cc_delta[TS_MAX_PID];
+		int8_t cc_last[TS_MAX_PID];
+		uint8_t cc_resync[TS_MAX_PID / 8];
+
+		struct ts_section pat_in;
+		struct ts_section pmt_in;
+		struct ts_section pmt_orig;	/* last complete PMT of the service */
+		uint8_t pat_version;
+		uint8_t pmt_version;
+		uint8_t pat_cc;
+		uint8_t pmt_cc;
+		std::vector<uint8_t> pat_sec;	/* generated sections */
+		std::vector<uint8_t> pmt_sec;
+		std::vector<uint8_t> out;	/* packets to insert */
+
+		/* Process() state */
+		uint8_t *buf;
+		size_t len;
+		size_t room;
+		size_t rpos;
+		size_t wpos;
+
+		void request(int pid);
+		void parse_pat(void);
+		void build_pmt(void);
+		void build_pat(void);
+		void packetize(unsigned short pid, const std::vector<uint8_t> &sec, uint8_t *cc);
+		void emit(bool pat, bool pmt);
+		void keep(void);
+};
+
+#endif // __TS_REMUX_H__
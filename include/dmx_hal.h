@@ -77,16 +77,29 @@ typedef struct
 
 class cRecord;
 class cPlayback;
+class cTSFanout;
+class cSectionSession;
+class cSectionWatch;
+class cDemuxBuffers;
+class cTSAnalyzer;
+struct ts_stats;
 class cDemux
 {
 		friend class cRecord;
 		friend class cPlayback;
+		friend class cTSFanout;
 	public:
 		bool Open(DMX_CHANNEL_TYPE pes_type, void *x = NULL, int y = 0);
 		void Close(void);
 		bool Start(bool record = false);
 		bool Stop(void);
 		int Read(unsigned char *buff, int len, int Timeout = 0);
+		/* one read() without poll(), for callers that wait for the fd
+		 * themselves (cDemuxReactor). The data passes the section cache,
+		 * timing and analyzer as with Read(). 0: nothing new, e.g. an
+		 * unchanged repetition of a section. -1 with errno EAGAIN: no
+		 * data (yet) */
+		int ReadAvailable(unsigned char *buff, int len);
 		bool sectionFilter(unsigned short pid, const unsigned char *const filter, const unsigned char *const mask, int len, int Timeout = 0, const unsigned char *const negmask = NULL);
 		bool pesFilter(const unsigned short pid);
 		void SetSyncMode(AVSYNC_TYPE mode);
@@ -99,10 +112,37 @@ class cDemux
 		static bool SetSource(int unit, int source);
 		static int GetSource(int unit);
 		int getFD(void) { return fd; }; /* needed by cPlayback class */
+		/* DMX_TP_CHANNEL only: the next chunk of data without copying
+		 * it, if the kernel supports memory mapped demux buffers (else
+		 * it is read() into an internal buffer). Same return values as
+		 * Read(), data stays valid until ReleaseBuffer(). Do not mix
+		 * with Read() on the same demux. */
+		int ReadBuffer(const unsigned char **data, int Timeout = 0);
+		void ReleaseBuffer(void);
+		/* Read() skips repetitions of sections that were delivered
+		 * unchanged since the last sectionFilter(). Enabled by default,
+		 * applies on next sectionFilter() */
+		void setSectionCache(bool enable) { section_cache = enable; };
+		/* latest version of a section seen on this demux' source,
+		 * see cSectionCache::Lookup() */
+		int getCachedSection(unsigned short pid, unsigned char table_id, unsigned short ext,
+			unsigned char secnum, unsigned char *buf, int len, unsigned int max_age = 0);
+		/* sectionFilter() shortens the default timeouts to what was
+		 * learned for the transponder of this demux' source, which is
+		 * the transport_stream_id of the last PAT unless set here after
+		 * tuning. 0: back to the PAT. See cSectionTiming.
+		 * Also drops the cached sections of the source */
+		void setTransponder(uint32_t transponder);
+		/* DMX_TP_CHANNEL only: count continuity errors, sync losses,
+		 * overflows etc. of the data read, disabled by default.
+		 * getTSStats() is false if it is not enabled */
+		void setAnalyzer(bool enable);
+		bool getTSStats(struct ts_stats *s);
 		cDemux(int num = 0);
 		~cDemux();
 	private:
-		void removePid(unsigned short Pid); /* needed by cRecord class */
+		void removePid(unsigned short Pid); /* needed by cRecord and cTSFanout class */
+		bool afterRead(unsigned char *buff, int rc);
 		int num;
 		int fd;
 		int buffersize;
@@ -111,6 +151,11 @@ class cDemux
 		std::vector<pes_pids> pesfds;
 		DMX_CHANNEL_TYPE dmx_type;
 		void *pdata;
+		bool section_cache;
+		cSectionSession *sections;	/* NULL: not caching */
+		cSectionWatch *watch;		/* timing samples of the section filter */
+		cDemuxBuffers *buffers;		/* set up by the first ReadBuffer() */
+		cTSAnalyzer *analyzer;		/* NULL: not analyzing */
 };
 
 #endif // __DMX_HAL_H__
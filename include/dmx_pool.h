@@ -0,0 +1,103 @@
+/*
+ * pool of configured demux device fds
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DMX_POOL_H__
+#define __DMX_POOL_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <map>
+#include <vector>
+
+/* idle fds kept per demux device and open mode */
+#define DMX_POOL_IDLE 4
+/* idle fds are closed after this many seconds */
+#define DMX_POOL_IDLE_TIME 30
+/* larger kernel buffers of idle fds are shrunk to this, cDemux' default */
+#define DMX_POOL_IDLE_BUFSIZE 0xffff
+
+/* pseudo requests in the statistics */
+#define DMX_POOL_OPEN 0
+#define DMX_POOL_CLOSE 1
+#define DMX_POOL_REUSE 2
+
+struct dmx_pool_stat
+{
+	unsigned long request;		/* ioctl or DMX_POOL_* */
+	const char *name;
+	unsigned int count;
+	unsigned int failed;
+	uint64_t total_us;
+	unsigned int max_us;
+};
+
+/*
+ * Demux fds handed back by cDemux are stopped and kept open, so the
+ * next filter on the same device does not have to open the device and
+ * set it up again. DMX_SET_SOURCE is done once per device and source,
+ * DMX_SET_BUFFER_SIZE only if the fd has a different size. Idle fds do
+ * not keep large buffers (e.g. of TS taps) and are closed once they were
+ * not used for DMX_POOL_IDLE_TIME, checked on every Get() / Put(). The time of
+ * every open, close and ioctl that goes through the pool is counted per
+ * request.
+ */
+class cDemuxPool
+{
+	public:
+		static cDemuxPool *getInstance();
+
+		/* a stopped fd on /dev/dvb/adapterX/demuxY with the given
+		 * source (-1: do not set) and buffer size (0: do not set),
+		 * -1 on error */
+		int Get(int adapter, int demux, int source, int flags, int buffersize);
+		/* stops the fd and keeps it for Get(), or closes it if it
+		 * can not be reused (e.g. it has mapped buffers) or there are
+		 * DMX_POOL_IDLE idle ones already */
+		void Put(int fd, bool reuse = true);
+
+		/* ioctl() on a demux fd, counted in the statistics */
+		int Ioctl(int fd, unsigned long request, const char *name, unsigned long arg = 0);
+		template <class T> int Ioctl(int fd, unsigned long request, const char *name, T *arg)
+		{
+			return Ioctl(fd, request, name, (unsigned long)arg);
+		}
+
+		void getStats(std::vector<dmx_pool_stat> &out);
+		/* the statistics to the debug log */
+		void Dump(void);
+	private:
+		cDemuxPool();
+		struct slot
+		{
+			int adapter;
+			int demux;
+			int flags;
+			int buffersize;
+			bool idle;
+			int64_t idle_since;	/* us */
+		};
+		pthread_mutex_t mutex;
+		std::map<int, slot> fds;	/* every fd of the pool */
+		std::map<int, int> sources;	/* adapter << 8 | demux => source set */
+		std::map<unsigned long, dmx_pool_stat> stats;
+		void account(unsigned long request, const char *name, int64_t us, bool failed);
+		void expire(void);
+		void close_fd(int fd);
+};
+
+#endif // __DMX_POOL_H__
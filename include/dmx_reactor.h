@@ -0,0 +1,108 @@
+/*
+ * one thread serving many demux filters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DMX_REACTOR_H__
+#define __DMX_REACTOR_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <map>
+#include <vector>
+
+#include "dmx_hal.h"
+
+/* size of the queue for filters without callback */
+#define DMX_REACTOR_QUEUE (256 * 1024)
+
+/*
+ * Called from the reactor thread with every section / PES data read,
+ * or with data == NULL and len = -errno on errors (e.g. -ETIMEDOUT if
+ * the filter timed out). May call Add() and Remove().
+ */
+typedef void (*dmx_reactor_cb)(cDemux *dmx, const unsigned char *data, int len, void *user);
+
+typedef struct
+{
+	unsigned int filters;	/* registered */
+	uint64_t wakeups;	/* epoll_wait() returns */
+	uint64_t reads;		/* sections / PES data read */
+	uint64_t queued;	/* of those put into the queue */
+	uint64_t dropped;	/* not queued, queue was full */
+} dmx_reactor_stats_t;
+
+struct dmx_reactor_filter;
+
+/*
+ * Instead of a thread per filter sleeping in cDemux::Read(), one thread
+ * waits in epoll_wait() for all registered demux filters and reads
+ * whatever is ready. The data goes to a callback, or, for filters
+ * registered without one, into a queue that is read with Get(). The
+ * queue is lock free with the reactor thread as the only producer and
+ * a single consumer thread, GetFD() can be polled for data.
+ *
+ * Set up the filter with cDemux::sectionFilter() / pesFilter() first,
+ * then Add() the demux. Changing the filter may reopen the demux
+ * device, Add() it again afterwards. Remove() it before Close() or
+ * deleting it: once Remove() returned, the demux is not read and its
+ * callback is not called anymore.
+ */
+class cDemuxReactor
+{
+	public:
+		cDemuxReactor();
+		~cDemuxReactor();
+
+		bool Start(void);
+		void Stop(void);
+
+		/* bufsize: largest read, 4096 is enough for sections */
+		bool Add(cDemux *dmx, dmx_reactor_cb cb, void *user, int bufsize = 4096);
+		void Remove(cDemux *dmx);
+
+		/* next queued data, returns the length, 0 on timeout (ms,
+		 * -1 waits forever), len = -errno for errors, as for the callback.
+		 * Data that does not fit into buf is truncated. */
+		int Get(cDemux **dmx, unsigned char *buf, int len, int timeout = -1);
+		/* readable while the queue is not empty */
+		int GetFD(void) { return queue_fd; };
+
+		void GetStats(dmx_reactor_stats_t *s);
+
+		void Run(void);
+	private:
+		int epoll_fd;
+		int wake_fd;
+		int queue_fd;
+		pthread_t thread;
+		bool running;
+		/* recursive, so that callbacks can use Add() / Remove() */
+		pthread_mutex_t mutex;
+		std::map<cDemux *, struct dmx_reactor_filter *> filters;
+		std::vector<struct dmx_reactor_filter *> removed;
+		unsigned char *buf;
+		int bufsize;
+		dmx_reactor_stats_t stats;
+
+		/* single producer / single consumer queue */
+		unsigned char *queue;
+		uint32_t q_head;	/* written by the reactor thread */
+		uint32_t q_tail;	/* written by the consumer */
+		void put(cDemux *dmx, const unsigned char *data, int len);
+};
+
+#endif // __DMX_REACTOR_H__
@@ -0,0 +1,90 @@
+/*
+ * PSI / SI section cache for cDemux
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SECTION_CACHE_H__
+#define __SECTION_CACHE_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <list>
+#include <map>
+#include <vector>
+
+/* memory used for cached sections, least recently seen ones are dropped */
+#define SECTION_CACHE_SIZE (1024 * 1024)
+/* sections remembered per filter, more start the filter over */
+#define SECTION_SESSION_MAX 16384
+
+/*
+ * Latest version of every section seen on any demux, keyed by demux
+ * source, PID, table_id, table_id_extension and section_number. Only
+ * sections with section_syntax_indicator set are cached, a section
+ * counts as changed if its version or CRC differs.
+ * The key does not tell transponders apart. A PAT with another
+ * transport_stream_id than the last one drops everything else cached
+ * for its source, and cDemux::setTransponder() flushes the source after
+ * tuning. Until either happened after a zap, only a max_age passed to
+ * Lookup() keeps out the sections of the old transponder.
+ */
+class cSectionCache
+{
+	public:
+		static cSectionCache *getInstance();
+
+		/* returns false if the section is cached already unchanged */
+		bool Update(int source, unsigned short pid, const unsigned char *sec, int len);
+		/* copies the cached section to buf and returns its length, 0 if
+		 * there is none or it was last seen more than max_age ms ago
+		 * (max_age 0: any age) */
+		int Lookup(int source, unsigned short pid, unsigned char table_id, unsigned short ext,
+			unsigned char secnum, unsigned char *buf, int len, unsigned int max_age = 0);
+		/* -1: all sources */
+		void Flush(int source = -1);
+	private:
+		cSectionCache();
+		struct entry
+		{
+			std::vector<unsigned char> data;
+			uint32_t crc;
+			int64_t seen;		/* ms, monotonic */
+			std::list<uint64_t>::iterator lru;
+		};
+		pthread_mutex_t mutex;
+		std::map<uint64_t, entry> sections;
+		std::map<int, unsigned short> tsid;	/* of the last PAT per source */
+		std::list<uint64_t> lru;	/* most recently seen first */
+		size_t size;
+		void drop(std::map<uint64_t, entry>::iterator i);
+		void flush(int source);
+};
+
+/*
+ * Sections one filter delivered since it was set, used by cDemux::Read()
+ * to skip repetitions of unchanged sections.
+ */
+class cSectionSession
+{
+	public:
+		void Reset(void) { seen.clear(); };
+		/* false if the section was delivered before, unchanged */
+		bool Deliver(int source, unsigned short pid, const unsigned char *sec, int len);
+	private:
+		std::map<uint32_t, uint32_t> seen;	/* table_id, extension, number => CRC */
+};
+
+#endif // __SECTION_CACHE_H__
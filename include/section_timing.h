@@ -0,0 +1,149 @@
+/*
+ * section repetition intervals learned per transponder
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SECTION_TIMING_H__
+#define __SECTION_TIMING_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/* the learned timeout is this many repetition intervals ... */
+#define SECTION_TIMING_FACTOR 3
+/* ... but at least this many ms */
+#define SECTION_TIMING_MIN 500
+/* samples needed before the interval is used */
+#define SECTION_TIMING_SAMPLES 3
+/* the model is written back this often (s) if it changed, and at exit */
+#define SECTION_TIMING_SAVE 600
+/* default file, HAL_SECTION_TIMING overrides it */
+#define SECTION_TIMING_FILE "/var/tuxbox/config/section_timing.conf"
+
+/* transponder of entries that are learned on all transponders */
+#define SECTION_TIMING_ANY 0xffffffff
+
+struct section_timing
+{
+	uint32_t transponder;		/* SECTION_TIMING_ANY: all of them */
+	unsigned short pid;
+	unsigned char table_id;
+	int interval;			/* ms */
+	int samples;
+	int timeout;			/* ms, 0: not learned yet */
+};
+
+/*
+ * Repetition interval of every (transponder, PID, table_id) that cDemux
+ * section filters saw, used to shorten the default timeouts of
+ * sectionFilter() on transponders that repeat their tables faster.
+ * Two kinds of samples feed the model: the time from setting a filter
+ * to its first section (a lower bound of the interval) and the time
+ * between two repetitions of the same section on a running filter.
+ * The timeout is SECTION_TIMING_FACTOR intervals, at least
+ * SECTION_TIMING_MIN and never longer than the default for the table.
+ * A filter that times out anyway doubles it for the next try, up to
+ * the default.
+ * The transponder is the transport_stream_id of the last PAT that was
+ * read on a demux source, unless SetTransponder() was called for it.
+ * Until it is known, the entries learned on all transponders are used.
+ */
+class cSectionTiming
+{
+	public:
+		static cSectionTiming *getInstance();
+
+		/* the timeout for a section filter, at most def_timeout
+		 * (returned unchanged if nothing was learned yet) */
+		int Timeout(int source, unsigned short pid, unsigned char table_id, int def_timeout);
+		/* a section arrived ms after the filter was set (repeat false)
+		 * or after the last repetition of the same section (true) */
+		void Sample(int source, unsigned short pid, unsigned char table_id, int ms, bool repeat);
+		/* a filter that used a learned timeout timed out */
+		void Missed(int source, unsigned short pid, unsigned char table_id);
+
+		/* set by the caller after tuning, e.g. from the frequency.
+		 * 0: take the transport_stream_id of the next PAT again */
+		void SetTransponder(int source, uint32_t transponder);
+		/* a PAT was read on the source */
+		void SetTransportStreamId(int source, unsigned short tsid);
+		/* SECTION_TIMING_ANY if not known */
+		uint32_t GetTransponder(int source);
+
+		/* everything learned so far */
+		void Get(std::vector<section_timing> &out);
+		bool Load(const char *file = NULL);
+		bool Save(const char *file = NULL);
+		void Clear(void);
+
+		/* the thread that saves the model */
+		void Run(void);
+	private:
+		cSectionTiming();
+		struct entry
+		{
+			int repeat;		/* ms, average repetition interval */
+			int first;		/* ms, recent maximum time to the first section */
+			int samples;
+			int missed;
+		};
+		struct source
+		{
+			uint32_t transponder;
+			bool fixed;		/* from SetTransponder() */
+		};
+		pthread_mutex_t mutex;
+		pthread_mutex_t file_mutex;	/* serializes Save() */
+		std::map<uint64_t, entry> entries;
+		std::map<int, source> sources;
+		std::string file;
+		bool dirty;
+		uint32_t transponder(int source);
+		std::map<uint64_t, entry>::iterator lookup(int source, unsigned short pid, unsigned char table_id);
+		static int interval(const entry &e);
+		static int timeout(const entry &e, int def_timeout);
+		bool save(const char *file, const std::map<uint64_t, entry> &e);
+		void startSaver(void);
+		static void save_at_exit(void);
+};
+
+/*
+ * Collects the samples of one section filter for cSectionTiming.
+ */
+class cSectionWatch
+{
+	public:
+		cSectionWatch() { active = false; };
+		void Start(int source, unsigned short pid, unsigned char table_id);
+		void Stop(void) { active = false; };
+		/* a section was read */
+		void Section(const unsigned char *sec, int len);
+		/* the filter timed out */
+		void Timeout(void);
+	private:
+		bool active;
+		bool first;
+		int source;
+		unsigned short pid;
+		unsigned char table_id;
+		int64_t start;			/* ms */
+		std::map<uint32_t, int64_t> last;	/* section => last seen, ms */
+};
+
+#endif // __SECTION_TIMING_H__
@@ -0,0 +1,108 @@
+/*
+ * system time clock recovered from the PCR
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STC_CLOCK_H__
+#define __STC_CLOCK_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <deque>
+
+/* the clock is fitted to the least late PCR of every STC_BUCKET ms
+ * over the last STC_WINDOW buckets */
+#define STC_BUCKET 200
+#define STC_WINDOW 256
+/* buckets and time span (ms) needed before the clock is used */
+#define STC_MIN_SAMPLES 4
+#define STC_MIN_SPAN 500
+/* a PCR this far (ms) off the clock starts over */
+#define STC_MAX_ERROR 500
+/* without PCR for this long (ms), the clock is not used */
+#define STC_TIMEOUT 5000
+
+struct stc_status
+{
+	bool locked;
+	unsigned short pid;
+	int samples;			/* buckets in the window */
+	double drift_ppm;		/* PCR clock against the local clock */
+	double jitter_us;		/* RMS of how late the PCRs arrive */
+	unsigned int discontinuities;	/* restarts of the fit */
+	unsigned int pcr_count;
+};
+
+class cDemux;
+
+/*
+ * The STC of one demux unit, recovered from the PCR of the service.
+ * A thread reads the PCR PID from its own DMX_TP_CHANNEL cDemux and
+ * fits a line through (arrival time, PCR) pairs. PCR packets can only
+ * arrive late, never early: only the least late PCR of each bucket
+ * goes into the fit, and the line is moved up to the least late of all
+ * instead of running through the middle.
+ * getSTC() extrapolates the line, that is one clock_gettime() and no
+ * ioctl per call.
+ * cDemux starts the clock of a unit with the DMX_PCR_ONLY_CHANNEL
+ * filter and uses it in getSTC().
+ */
+class cSTCClock
+{
+	public:
+		static cSTCClock *getInstance(int unit);
+
+		bool Start(unsigned short pcr_pid);
+		void Stop(void);
+		/* 90 kHz, 33 bits like a PTS. false if not locked */
+		bool getSTC(int64_t *stc);
+		void getStatus(struct stc_status *s);
+
+		/* a PCR (27 MHz) that arrived at t_us (monotonic) */
+		void Sample(int64_t pcr, int64_t t_us, bool discontinuity);
+		void Run(void);
+	private:
+		cSTCClock(int unit);
+		int unit;
+		unsigned short pid;
+		cDemux *dmx;
+		bool running;
+		pthread_t thread;
+		pthread_mutex_t mutex;
+
+		struct sample
+		{
+			int64_t t;		/* us */
+			int64_t pcr;		/* 27 MHz, unwrapped */
+		};
+		std::deque<sample> window;
+		int64_t last_raw;		/* -1: none */
+		int64_t last_pcr;		/* unwrapped */
+
+		/* the fitted clock: pcr = ref_pcr + rate * (t - ref_t) */
+		bool locked;
+		int64_t ref_t;
+		double ref_pcr;
+		double rate;			/* 27 MHz ticks per us */
+		double jitter2;			/* us^2, average */
+		unsigned int discontinuities;
+		unsigned int pcr_count;
+
+		void reset(void);
+		void fit(void);
+};
+
+#endif // __STC_CLOCK_H__
@@ -0,0 +1,87 @@
+/*
+ * transport stream integrity counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TS_ANALYZER_H__
+#define __TS_ANALYZER_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <map>
+
+/*
+ * Damage in the stream as received (tuner, dish, cable) shows up in
+ * sync_losses, cc_errors and tei. overflows counts data this box lost
+ * itself because the reader was too slow, e.g. the disk of a recording.
+ */
+struct ts_stats
+{
+	uint64_t packets;
+	uint64_t bytes;
+	unsigned int sync_losses;	/* no sync byte where the next packet should start */
+	uint64_t skipped;		/* bytes skipped to find the sync again */
+	unsigned int cc_errors;		/* continuity_counter jumps */
+	unsigned int tei;		/* packets with transport_error_indicator */
+	uint64_t scrambled;		/* packets with transport_scrambling_control set */
+	unsigned int overflows;		/* data lost before it was read */
+	unsigned int pids;		/* PIDs seen */
+	uint64_t pcr_count;
+	unsigned int pcr_jitter_avg;	/* usec a PCR arrived later than the earliest */
+	unsigned int pcr_jitter_max;	/* usec, including delays in the demux */
+};
+
+/*
+ * Counts what is wrong with the TS packets passed to Process(). Cheap
+ * enough to stay enabled: one lock per call, a strided check for the
+ * sync bytes (memchr() only after a sync loss) and a couple of table
+ * lookups per packet.
+ */
+class cTSAnalyzer
+{
+	public:
+		cTSAnalyzer();
+		~cTSAnalyzer();
+		/* data as read, packets may be split between calls */
+		void Process(const uint8_t *data, size_t len);
+		/* data was lost before it was read: the next continuity
+		 * counter gap on every PID is no stream error */
+		void Overflow(void);
+		void GetStats(struct ts_stats *s);
+		void Reset(void);
+	private:
+		struct pcr_state
+		{
+			int64_t pcr;		/* 27 MHz, the last one */
+			int64_t t0;		/* us, arrival of the first one */
+			int64_t elapsed;	/* us of PCR since the first one */
+			int64_t earliest;	/* us, arrival - PCR of the least late */
+		};
+		pthread_mutex_t mutex;
+		struct ts_stats stats;
+		uint8_t cc[0x2000];		/* 0xff: none yet */
+		uint8_t seen[0x2000 / 8];
+		std::map<unsigned short, pcr_state> pcrs;
+		uint64_t jitter_sum;
+		uint64_t jitter_count;
+		uint8_t carry[188];
+		size_t carry_len;
+		bool synced;
+		void packet(const uint8_t *p, int64_t now);
+		void reset(void);
+};
+
+#endif // __TS_ANALYZER_H__
@@ -0,0 +1,66 @@
+/*
+ * on-disk format of the keyframe index written next to recordings
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TS_INDEX_H__
+#define __TS_INDEX_H__
+
+/* used by cRecord (C++) and libeplayer3 (C) */
+#include <stdint.h>
+
+/*
+ * "foo.ts" gets "foo.ts.idx": a header followed by one entry per
+ * keyframe, in file order. Entries are only ever appended, so a player
+ * can pick up new ones while the recording is still running.
+ * All fields are in host byte order, the file is meant to be read on
+ * the box that wrote it.
+ */
+#define TS_INDEX_SUFFIX ".idx"
+#define TS_INDEX_MAGIC 0x58444954	/* "TIDX" */
+#define TS_INDEX_VERSION 1
+
+#define TS_INDEX_CODEC_UNKNOWN 0
+#define TS_INDEX_CODEC_MPEG2 1
+#define TS_INDEX_CODEC_H264 2
+#define TS_INDEX_CODEC_H265 3
+
+/* ts_index_entry.type */
+#define TS_INDEX_PIC_I 1	/* intra picture, may depend on earlier pictures (open GOP) */
+#define TS_INDEX_PIC_IDR 2	/* random access point (MPEG-2 I after sequence header, H.264/HEVC IDR) */
+#define TS_INDEX_PIC_CRA 3	/* HEVC CRA or BLA: decoding can start here, but the leading
+				 * (RASL) pictures after it reference earlier ones and are lost */
+
+#define TS_INDEX_NO_PTS ((uint64_t)-1)
+
+typedef struct ts_index_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_size;	/* sizeof(ts_index_entry_t) */
+	uint16_t pid;		/* video PID */
+	uint16_t codec;		/* TS_INDEX_CODEC_*, updated once detected */
+	uint32_t reserved;
+} ts_index_header_t;
+
+typedef struct ts_index_entry
+{
+	uint64_t offset;	/* file offset of the TS packet starting the PES */
+	uint64_t pts;		/* 33 bit PTS of the picture, TS_INDEX_NO_PTS if the PES had none */
+	uint32_t type;		/* TS_INDEX_PIC_* */
+	uint32_t reserved;
+} ts_index_entry_t;
+
+#endif // __TS_INDEX_H__
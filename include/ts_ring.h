@@ -0,0 +1,53 @@
+/*
+ * on-disk format of fixed size circular recordings (timeshift)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TS_RING_H__
+#define __TS_RING_H__
+
+/* used by cRecord (C++) and libeplayer3 (C) */
+#include <stdint.h>
+
+/*
+ * The file is TS_RING_HEADER_SIZE bytes of header followed by "size"
+ * bytes of data. The recorded stream is written to it circularly:
+ * stream offset x is at file offset TS_RING_HEADER_SIZE + x % size.
+ * The stream bytes [tail, head) are valid, head - tail <= size.
+ * The writer updates the header after every completed write. A reader
+ * has to check the tail again after reading data, the range may have
+ * been overwritten in the meantime.
+ * All fields are in host byte order, the file is meant to be read on
+ * the box that wrote it.
+ */
+#define TS_RING_MAGIC 0x474e5254	/* "TRNG" */
+#define TS_RING_VERSION 1
+#define TS_RING_HEADER_SIZE 4096
+
+#define TS_RING_NO_PTS ((uint64_t)-1)
+
+typedef struct ts_ring_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;	/* TS_RING_HEADER_SIZE */
+	uint64_t size;		/* of the data area, a multiple of 188 */
+	uint64_t head;		/* stream offset of the end of the written data */
+	uint64_t tail;		/* stream offset of the oldest valid data */
+	uint64_t first_pts;	/* 33 bit video PTS near tail, TS_RING_NO_PTS if unknown */
+	uint64_t last_pts;	/* 33 bit video PTS near head */
+} ts_ring_header_t;
+
+#endif // __TS_RING_H__
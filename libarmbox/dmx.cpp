@@ -25,6 +25,7 @@
 #include <poll.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cstring>
@@ -34,6 +35,12 @@
 #include <OpenThreads/Mutex>
 #include <OpenThreads/ScopedLock>
 #include "dmx_hal.h"
+#include "section_cache.h"
+#include "section_timing.h"
+#include "stc_clock.h"
+#include "ts_analyzer.h"
+#include "dmx_buffers.h"
+#include "dmx_pool.h"
 #include "hal_debug.h"
 
 #include "video_lib.h"
@@ -47,6 +54,9 @@ extern cVideo *videoDecoder;
 #define hal_info_z(args...) _hal_info(HAL_DEBUG_DEMUX, thiz, args)
 #define hal_debug_z(args...) _hal_debug(HAL_DEBUG_DEMUX, thiz, args)
 
+/* every demux ioctl is counted in the statistics of the fd pool */
+#define dmx_ioctl(_fd, _req, _args...) cDemuxPool::getInstance()->Ioctl(_fd, _req, #_req, ##_args)
+
 #define dmx_err(_errfmt, _errstr, _revents) do { \
 		hal_info("%s " _errfmt " fd:%d, ev:0x%x %s pid:0x%04hx flt:0x%02hx\n", \
 			__func__, _errstr, fd, _revents, DMX_T[dmx_type], pid, flt); \
@@ -93,13 +103,6 @@ static int dmx_source[NUM_DEMUX] = { 0, 0, 0, 0 };
 #endif
 #endif
 
-char dmxdev[32];
-static char *devname(int adapter, int demux)
-{
-	snprintf(dmxdev, sizeof(dmxdev), "/dev/dvb/adapter%d/demux%d", adapter, demux);
-	return dmxdev;
-}
-
 /* map the device numbers. */
 #if BOXMODEL_VUULTIMO4K
 #define NUM_DEMUXDEV 24
@@ -111,17 +114,6 @@ static char *devname(int adapter, int demux)
 #endif
 #endif
 
-/* did we already DMX_SET_SOURCE on that demux device? */
-#if BOXMODEL_VUULTIMO4K
-static bool init[NUM_DEMUXDEV] = { false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false };
-#else
-#if BOXMODEL_VUSOLO4K || BOXMODEL_VUDUO4K || BOXMODEL_VUDUO4KSE || BOXMODEL_VUUNO4KSE || BOXMODEL_VUUNO4K
-static bool init[NUM_DEMUXDEV] = { false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false };
-#else
-static bool init[NUM_DEMUXDEV] = { false, false, false, false, false, false, false, false };
-#endif
-#endif
-
 typedef struct dmx_pdata
 {
 	int last_source;
@@ -129,6 +121,13 @@ typedef struct dmx_pdata
 } dmx_pdata;
 #define P ((dmx_pdata *)pdata)
 
+static int64_t time_ms(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
 cDemux::cDemux(int n)
 {
 	if (n < 0 || n >= NUM_DEMUX)
@@ -143,6 +142,11 @@ cDemux::cDemux(int n)
 	P->last_source = -1;
 	P->mutex = new OpenThreads::Mutex;
 	dmx_type = DMX_INVALID;
+	section_cache = true;
+	sections = NULL;
+	watch = NULL;
+	buffers = NULL;
+	analyzer = NULL;
 }
 
 cDemux::~cDemux()
@@ -155,6 +159,9 @@ cDemux::~cDemux()
 	free(P->mutex);
 	free(pdata);
 	pdata = NULL;
+	delete sections;
+	delete watch;
+	delete analyzer;
 }
 
 bool cDemux::Open(DMX_CHANNEL_TYPE pes_type, void * /*hVideoBuffer*/, int uBufferSize)
@@ -181,45 +188,26 @@ static bool _open(cDemux *thiz, int num, int &fd, int &last_source, DMX_CHANNEL_
 	}
 	if (fd > -1)
 	{
-		/* we changed source -> close and reopen the fd */
+		/* we changed source -> take an fd on the other device */
 		hal_debug_z("%s #%d: FD ALREADY OPENED fd = %d lastsource %d devnum %d\n",
 			__func__, num, fd, last_source, devnum);
-		close(fd);
+		cDemuxPool::getInstance()->Put(fd);
 	}
 
 	if (dmx_type != DMX_PSI_CHANNEL)
 		flags |= O_NONBLOCK;
 
-	fd = open(devname(0, devnum), flags);
+	/* probably uBufferSize == 0 means "use default size". TODO: find a reasonable default */
+	if (buffersize == 0)
+		buffersize = 0xffff; // may or may not be reasonable --martii
+	/* the pool does DMX_SET_SOURCE once per device (this should not
+	 * change anything...) and DMX_SET_BUFFER_SIZE only if needed */
+	fd = cDemuxPool::getInstance()->Get(0, devnum, DMX_SOURCE_FRONT0 + devnum, flags, buffersize);
 	if (fd < 0)
-	{
-		hal_info_z("%s %s: %m\n", __FUNCTION__, devname(0, devnum));
 		return false;
-	}
 	hal_debug_z("%s #%d pes_type: %s(%d), uBufferSize: %d fd: %d\n",
 		__func__, num, DMX_T[dmx_type], dmx_type, buffersize, fd);
 
-	/* this would actually need locking, but the worst that weill happen is, that
-	 * we'll DMX_SET_SOURCE twice per device, so don't bother... */
-	if (!init[devnum])
-	{
-		/* this should not change anything... */
-		int n = DMX_SOURCE_FRONT0 + devnum;
-		hal_info_z("%s: setting %s to source %d\n", __func__, devname(0, devnum), n);
-		if (ioctl(fd, DMX_SET_SOURCE, &n) < 0)
-			hal_info_z("%s DMX_SET_SOURCE failed!\n", __func__);
-		else
-			init[devnum] = true;
-	}
-	if (buffersize == 0)
-		buffersize = 0xffff; // may or may not be reasonable --martii
-	if (buffersize > 0)
-	{
-		/* probably uBufferSize == 0 means "use default size". TODO: find a reasonable default */
-		if (ioctl(fd, DMX_SET_BUFFER_SIZE, buffersize) < 0)
-			hal_info_z("%s DMX_SET_BUFFER_SIZE failed (%m)\n", __func__);
-	}
-
 	last_source = devnum;
 	return true;
 }
@@ -234,8 +222,13 @@ void cDemux::Close(void)
 	}
 
 	pesfds.clear();
-	ioctl(fd, DMX_STOP);
-	close(fd);
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Stop();
+	/* the pool stops the filter, an fd with mapped buffers is closed */
+	bool reuse = !(buffers && buffers->isMapped());
+	delete buffers;
+	buffers = NULL;
+	cDemuxPool::getInstance()->Put(fd, reuse);
 	fd = -1;
 }
 
@@ -247,7 +240,9 @@ bool cDemux::Start(bool)
 		hal_info("%s #%d: not open!\n", __FUNCTION__, num);
 		return false;
 	}
-	ioctl(fd, DMX_START);
+	dmx_ioctl(fd, DMX_START);
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Start(pid);
 	return true;
 }
 
@@ -259,7 +254,9 @@ bool cDemux::Stop(void)
 		hal_info("%s #%d: not open!\n", __FUNCTION__, num);
 		return false;
 	}
-	ioctl(fd, DMX_STOP);
+	dmx_ioctl(fd, DMX_STOP);
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Stop();
 	return true;
 }
 
@@ -279,6 +276,7 @@ int cDemux::Read(unsigned char *buff, int len, int timeout)
 	OpenThreads::ScopedLock<OpenThreads::Mutex> m_lock(*P->mutex);
 	int rc;
 	int to = timeout;
+	int64_t deadline = 0;
 	struct pollfd ufds;
 	ufds.fd = fd;
 	ufds.events = POLLIN | POLLPRI | POLLERR;
@@ -346,12 +344,134 @@ retry:
 
 	rc = ::read(fd, buff, len);
 	//fprintf(stderr, "fd %d ret: %d\n", fd, rc);
+	if (!afterRead(buff, rc))
+	{
+		/* unchanged repetition of a section that was delivered before,
+		 * wait for the next one. timeout 0 means wait forever */
+		if (timeout > 0)
+		{
+			if (!deadline)
+				deadline = time_ms() + timeout;
+			to = deadline - time_ms();
+			if (to <= 0)
+				return 0;
+		}
+		goto retry;
+	}
+
+	return rc;
+}
+
+/* everything that has to see the data read, shared by Read() and
+ * ReadAvailable(). false: unchanged repetition of a section */
+bool cDemux::afterRead(unsigned char *buff, int rc)
+{
 	if (rc < 0)
-		dmx_err("read: %s", strerror(errno), 0);
+	{
+		int err = errno;
+		dmx_err("read: %s", strerror(err), 0);
+		if (err == ETIMEDOUT && watch)
+			watch->Timeout();
+		if (err == EOVERFLOW && analyzer)
+			analyzer->Overflow();
+		errno = err;
+		return true;
+	}
+	if (rc == 0)
+		return true;
+	if (watch)
+		watch->Section(buff, rc);
+	if (analyzer)
+		analyzer->Process(buff, rc);
+	return !sections || sections->Deliver(dmx_source[num], pid, buff, rc);
+}
 
+int cDemux::ReadAvailable(unsigned char *buff, int len)
+{
+	if (fd < 0)
+	{
+		errno = EBADF;
+		return -1;
+	}
+	int rc = ::read(fd, buff, len);
+	/* nothing there (yet), not an error */
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return -1;
+	if (!afterRead(buff, rc))
+		return 0;
 	return rc;
 }
 
+int cDemux::getCachedSection(unsigned short _pid, unsigned char table_id, unsigned short ext,
+	unsigned char secnum, unsigned char *buf, int len, unsigned int max_age)
+{
+	return cSectionCache::getInstance()->Lookup(dmx_source[num], _pid, table_id, ext, secnum, buf, len, max_age);
+}
+
+void cDemux::setTransponder(uint32_t transponder)
+{
+	cSectionTiming::getInstance()->SetTransponder(dmx_source[num], transponder);
+	cSectionCache::getInstance()->Flush(dmx_source[num]);
+}
+
+int cDemux::ReadBuffer(const unsigned char **data, int timeout)
+{
+	if (fd < 0 || dmx_type != DMX_TP_CHANNEL)
+	{
+		hal_info("%s #%d: not open or not a TS channel!\n", __func__, num);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!buffers)
+	{
+		buffers = new cDemuxBuffers(fd);
+		if (!buffers->Init())
+		{
+			hal_info("%s #%d: unable to allocate buffer! (out of memory)\n", __func__, num);
+			delete buffers;
+			buffers = NULL;
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	if (buffers->isMapped())
+	{
+		int rc = buffers->Dequeue(data, timeout);
+		if (rc > 0 && analyzer)
+			analyzer->Process(*data, rc);
+		else if (rc < 0 && errno == EOVERFLOW && analyzer)
+			analyzer->Overflow();
+		return rc;
+	}
+	*data = buffers->getReadBuffer();
+	return Read(buffers->getReadBuffer(), DMX_BUFFER_SIZE, timeout);
+}
+
+void cDemux::setAnalyzer(bool enable)
+{
+	if (!enable)
+	{
+		delete analyzer;
+		analyzer = NULL;
+	}
+	else if (!analyzer)
+		analyzer = new cTSAnalyzer;
+}
+
+bool cDemux::getTSStats(struct ts_stats *s)
+{
+	if (!analyzer)
+		return false;
+	analyzer->GetStats(s);
+	return true;
+}
+
+void cDemux::ReleaseBuffer(void)
+{
+	if (buffers && buffers->isMapped())
+		buffers->Queue();
+}
+
 bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filter,
 	const unsigned char *const mask, int len, int timeout,
 	const unsigned char *const negmask)
@@ -360,6 +480,19 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 	memset(&s_flt, 0, sizeof(s_flt));
 	pid = _pid;
 
+	/* only sections that changed since the filter was set are returned */
+	if (section_cache && dmx_type == DMX_PSI_CHANNEL)
+	{
+		if (!sections)
+			sections = new cSectionSession;
+		sections->Reset();
+	}
+	else
+	{
+		delete sections;
+		sections = NULL;
+	}
+
 	_open(this, num, fd, P->last_source, dmx_type, buffersize);
 
 	if (len > DMX_FILTER_SIZE)
@@ -461,7 +594,18 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 	 * and sectionsd EIT-Version change. And they really want no timeout
 	 * if timeout == 0 instead of "default timeout" */
 	if (timeout == 0 && negmask == NULL)
-		s_flt.timeout = to;
+		s_flt.timeout = cSectionTiming::getInstance()->Timeout(dmx_source[num], pid, filter[0], to);
+
+	/* learn how often the table repeats, not from filters that wait
+	 * for a change */
+	if (dmx_type == DMX_PSI_CHANNEL && negmask == NULL && mask[0] == 0xff)
+	{
+		if (!watch)
+			watch = new cSectionWatch;
+		watch->Start(dmx_source[num], pid, filter[0]);
+	}
+	else if (watch)
+		watch->Stop();
 
 	hal_debug("%s #%d pid:0x%04hx fd:%d type:%s len:%d to:%d flags:%x flt[0]:%02x\n",
 		__func__, num, pid, fd, DMX_T[dmx_type], len, s_flt.timeout, s_flt.flags, s_flt.filter.filter[0]);
@@ -482,8 +626,8 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 		fprintf(stderr, "\n");
 	}
 
-	ioctl(fd, DMX_STOP);
-	if (ioctl(fd, DMX_SET_FILTER, &s_flt) < 0)
+	dmx_ioctl(fd, DMX_STOP);
+	if (dmx_ioctl(fd, DMX_SET_FILTER, &s_flt) < 0)
 		return false;
 
 	return true;
@@ -505,6 +649,16 @@ bool cDemux::pesFilter(const unsigned short _pid)
 
 	hal_debug("%s #%d pid: 0x%04hx fd: %d type: %s\n", __FUNCTION__, num, pid, fd, DMX_T[dmx_type]);
 
+	/* _open() reopens the device if the source changed, an fd with
+	 * mapped buffers can not go back to the pool */
+	if (buffers && P->last_source != dmx_source[num])
+	{
+		bool reuse = !buffers->isMapped();
+		delete buffers;
+		buffers = NULL;
+		cDemuxPool::getInstance()->Put(fd, reuse);
+		fd = -1;
+	}
 	_open(this, num, fd, P->last_source, dmx_type, buffersize);
 
 	memset(&p_flt, 0, sizeof(p_flt));
@@ -558,7 +712,13 @@ bool cDemux::pesFilter(const unsigned short _pid)
 			hal_info("%s #%d invalid dmx_type %d!\n", __func__, num, dmx_type);
 			return false;
 	}
-	return (ioctl(fd, DMX_SET_PES_FILTER, &p_flt) >= 0);
+	dmx_ioctl(fd, DMX_STOP);
+	if (dmx_ioctl(fd, DMX_SET_PES_FILTER, &p_flt) < 0)
+		return false;
+	/* the STC follows the PCR of the service */
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Start(pid);
+	return true;
 }
 
 void cDemux::SetSyncMode(AVSYNC_TYPE /*mode*/)
@@ -588,13 +748,23 @@ bool cDemux::addPid(unsigned short Pid)
 		hal_info("%s pes_type %s not implemented yet! pid=%hx\n", __FUNCTION__, DMX_T[dmx_type], Pid);
 		return false;
 	}
+	/* _open() reopens the device if the source changed, an fd with
+	 * mapped buffers can not go back to the pool */
+	if (buffers && P->last_source != dmx_source[num])
+	{
+		bool reuse = !buffers->isMapped();
+		delete buffers;
+		buffers = NULL;
+		cDemuxPool::getInstance()->Put(fd, reuse);
+		fd = -1;
+	}
 	_open(this, num, fd, P->last_source, dmx_type, buffersize);
 	if (fd == -1)
 		hal_info("%s bucketfd not yet opened? pid=%hx\n", __FUNCTION__, Pid);
 	pfd.fd = fd; /* dummy */
 	pfd.pid = Pid;
 	pesfds.push_back(pfd);
-	ret = (ioctl(fd, DMX_ADD_PID, &Pid));
+	ret = (dmx_ioctl(fd, DMX_ADD_PID, &Pid));
 	if (ret < 0)
 		hal_info("%s: DMX_ADD_PID (%m) pid=%hx\n", __func__, Pid);
 	return (ret != -1);
@@ -612,7 +782,7 @@ void cDemux::removePid(unsigned short Pid)
 		if ((*i).pid == Pid)
 		{
 			hal_debug("removePid: removing demux fd %d pid 0x%04x\n", fd, Pid);
-			if (ioctl(fd, DMX_REMOVE_PID, Pid) < 0)
+			if (dmx_ioctl(fd, DMX_REMOVE_PID, &Pid) < 0)
 				hal_info("%s: (DMX_REMOVE_PID, 0x%04hx): %m\n", __func__, Pid);
 			pesfds.erase(i);
 			return; /* TODO: what if the same PID is there multiple times */
@@ -623,6 +793,9 @@ void cDemux::removePid(unsigned short Pid)
 
 void cDemux::getSTC(int64_t *STC)
 {
+	/* the clock recovered from the PCR, if the PCR filter is running */
+	if (cSTCClock::getInstance(num)->getSTC(STC))
+		return;
 	/* apparently I can only get the PTS of the video decoder,
 	 * but that's good enough for dvbsub */
 	hal_debug("%s #%d\n", __func__, num);
@@ -2,30 +2,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sstream>
 
 #include <audio_lib.h>
 #include <video_lib.h>
+#include <hardware_caps.h>
 
 extern "C" {
 #include <common.h>
-	extern OutputHandler_t OutputHandler;
-	extern PlaybackHandler_t PlaybackHandler;
-	extern ContainerHandler_t ContainerHandler;
-	extern ManagerHandler_t ManagerHandler;
-	extern int32_t ffmpeg_av_dict_set(const char *key, const char *value, int32_t flags);
+	extern int32_t ffmpeg_av_dict_set(Context_t *context, const char *key, const char *value, int32_t flags);
 }
 
 #include "playback_libeplayer3.h"
+#include "ts_ring.h"
 #include "hal_debug.h"
 
 #define hal_debug(args...) _hal_debug(HAL_DEBUG_PLAYBACK, this, args)
 #define hal_info(args...)  _hal_info(HAL_DEBUG_PLAYBACK, this, args)
 
-static Context_t *player = NULL;
-
 extern cAudio *audioDecoder;
 extern cVideo *videoDecoder;
 OpenThreads::Mutex cPlayback::mutex;
@@ -58,16 +55,11 @@ bool cPlayback::Open(playmode_t PlayMode)
 
 	if (!player)
 	{
-		player = (Context_t *) malloc(sizeof(Context_t));
+		player = PlaybackCreateContext(decoder);
 	}
 
 	if (player)
 	{
-		player->playback = &PlaybackHandler;
-		player->output = &OutputHandler;
-		player->container = &ContainerHandler;
-		player->manager = &ManagerHandler;
-
 		hal_info("%s - player output name: %s PlayMode: %s\n", __func__, player->output->Name, aPLAYMODE[PlayMode]);
 	}
 
@@ -184,7 +176,7 @@ bool cPlayback::Start(char *filename, int vpid, int vtype, int apid, int ac3, in
 	{
 		printf("Headers List\n%s", headers.c_str());
 		const char hkey[] = "headers";
-		ffmpeg_av_dict_set(hkey, headers.c_str(), 0);
+		ffmpeg_av_dict_set(player, hkey, headers.c_str(), 0);
 	}
 
 	std::string szSecondFile;
@@ -203,6 +195,19 @@ bool cPlayback::Start(char *filename, int vpid, int vtype, int apid, int ac3, in
 			struct stat64 s;
 			if (!stat64(file.c_str(), &s))
 				last_size = s.st_size;
+			/* ring file: position and duration come from its header */
+			if (!fn_ts.empty())
+			{
+				ts_ring_header_t h;
+				if (ring_fd > -1)
+					close(ring_fd);
+				ring_fd = open(fn_ts.c_str(), O_RDONLY | O_CLOEXEC);
+				if (ring_fd > -1 && (pread(ring_fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != TS_RING_MAGIC))
+				{
+					close(ring_fd);
+					ring_fd = -1;
+				}
+			}
 			ret = true;
 			videoDecoder->Stop(false);
 			audioDecoder->Stop();
@@ -319,6 +324,10 @@ bool cPlayback::Stop(void)
 	if (player && player->playback)
 		player->playback->Command(player, PLAYBACK_CLOSE, NULL);
 
+	if (ring_fd > -1)
+		close(ring_fd);
+	ring_fd = -1;
+
 	playing = false;
 	return true;
 }
@@ -472,11 +481,25 @@ void cPlayback::GetPts(uint64_t &pts)
 bool cPlayback::GetPosition(int &position, int &duration, bool isWebChannel)
 {
 	bool got_duration = false;
+	uint64_t ring_first_pts = TS_RING_NO_PTS;
 	hal_debug("%s %d %d\n", __func__, position, duration);
 
+	if (ring_fd > -1)
+	{
+		ts_ring_header_t h;
+		if (pread(ring_fd, &h, sizeof(h), 0) == sizeof(h) &&
+			h.first_pts != TS_RING_NO_PTS && h.last_pts != TS_RING_NO_PTS)
+		{
+			duration = ((h.last_pts - h.first_pts) & 0x1FFFFFFFFULL) / 90;
+			ring_first_pts = h.first_pts;
+			if (!playing)
+				return true;
+			got_duration = true;
+		}
+	}
 	/* hack: if the file is growing (timeshift), then determine its length
 	 * by comparing the mtime with the mtime of the xml file */
-	if (pm == PLAYMODE_TS)
+	else if (pm == PLAYMODE_TS)
 	{
 		struct stat64 s;
 		if (!stat64(fn_ts.c_str(), &s))
@@ -522,6 +545,12 @@ bool cPlayback::GetPosition(int &position, int &duration, bool isWebChannel)
 	{
 		//printf("ERROR: vpts==0");
 	}
+	else if (ring_first_pts != TS_RING_NO_PTS)
+	{
+		/* relative to the oldest data in the ring file */
+		int64_t pts = (vpts - ring_first_pts) & 0x1FFFFFFFFLL;
+		position = pts > 0xFFFFFFFFLL ? 0 : pts / 90;
+	}
 	else
 	{
 		/* workaround for crazy vpts value during timeshift */
@@ -590,59 +619,49 @@ void cPlayback::FindAllPids(uint16_t *apids, unsigned short *ac3flags, uint16_t
 
 	if (player && player->playback && player->playback->isPlaying && player->manager && player->manager->audio)
 	{
-		char **TrackList = NULL;
-		player->manager->audio->Command(player, MANAGER_LIST, &TrackList);
-		if (TrackList != NULL)
+		TrackSnapshot_t *tracks = NULL;
+		player->manager->audio->Command(player, MANAGER_SNAPSHOT, &tracks);
+		if (tracks != NULL)
 		{
-			printf("AudioTrack List\n");
-			int i = 0, j = 0;
-			for (i = 0, j = 0; TrackList[i] != NULL; i += 2, j++)
+			bool changed = tracks->generation != audio_generation;
+			audio_generation = tracks->generation;
+			if (changed)
+				printf("AudioTrack List\n");
+			int j;
+			for (j = 0; j < tracks->count && j < max_numpida; j++)
 			{
-				printf("\t%s - %s\n", TrackList[i], TrackList[i + 1]);
-				if (j < max_numpida)
-				{
-					int _pid;
-					char _lang[strlen(TrackList[i])];
-					if (sscanf(TrackList[i], "%d %s\n", &_pid, _lang) == 2)
-					{
-						apids[j] = _pid;
-						// atUnknown, atMPEG, atMP3, atAC3, atDTS, atAAC, atPCM, atOGG, atFLAC
-						if (!strncmp("A_MPEG/L3", TrackList[i + 1], 9))
-							ac3flags[j] = 3;
-						if (!strncmp("A_MP3", TrackList[i + 1], 5))
-							ac3flags[j] = 4;
-						else if (!strncmp("A_AC3", TrackList[i + 1], 5))
-							ac3flags[j] = 1;
-						else if (!strncmp("A_EAC3", TrackList[i + 1], 6))
-							ac3flags[j] = 7;
-						else if (!strncmp("A_DTS", TrackList[i + 1], 5))
-							ac3flags[j] = 6;
-						else if (!strncmp("A_AAC", TrackList[i + 1], 5))
-							ac3flags[j] = 5;
-						else if (!strncmp("A_PCM", TrackList[i + 1], 5))
-							ac3flags[j] = 0; // todo
-						else if (!strncmp("A_VORBIS", TrackList[i + 1], 8))
-							ac3flags[j] = 0; // todo
-						else if (!strncmp("A_FLAC", TrackList[i + 1], 6))
-							ac3flags[j] = 0; // todo
-						else
-							ac3flags[j] = 0; // todo
-						std::string _language = "";
-						_language += std::string(_lang);
-						if (_language.compare("und") == 0)
-							_language = "Stream " + std::to_string((int)i);
-						//_language += " - ";
-						//_language += "(";
-						//_language += TrackList[i + 1];
-						//_language += ")";
-						language[j] = _language;
-					}
-				}
-				free(TrackList[i]);
-				free(TrackList[i + 1]);
+				const TrackInfo_t *t = &tracks->tracks[j];
+				if (changed)
+					printf("\t%d %s - %s\n", t->Id, t->Name, t->Encoding);
+				apids[j] = t->Id;
+				// atUnknown, atMPEG, atMP3, atAC3, atDTS, atAAC, atPCM, atOGG, atFLAC
+				if (!strncmp("A_MPEG/L3", t->Encoding, 9))
+					ac3flags[j] = 3;
+				if (!strncmp("A_MP3", t->Encoding, 5))
+					ac3flags[j] = 4;
+				else if (!strncmp("A_AC3", t->Encoding, 5))
+					ac3flags[j] = 1;
+				else if (!strncmp("A_EAC3", t->Encoding, 6))
+					ac3flags[j] = 7;
+				else if (!strncmp("A_DTS", t->Encoding, 5))
+					ac3flags[j] = 6;
+				else if (!strncmp("A_AAC", t->Encoding, 5))
+					ac3flags[j] = 5;
+				else if (!strncmp("A_PCM", t->Encoding, 5))
+					ac3flags[j] = 0; // todo
+				else if (!strncmp("A_VORBIS", t->Encoding, 8))
+					ac3flags[j] = 0; // todo
+				else if (!strncmp("A_FLAC", t->Encoding, 6))
+					ac3flags[j] = 0; // todo
+				else
+					ac3flags[j] = 0; // todo
+				std::string _language = t->Name;
+				if (_language.empty() || _language.compare("und") == 0)
+					_language = "Stream " + std::to_string(j);
+				language[j] = _language;
 			}
-			free(TrackList);
 			*numpida = j;
+			releaseTrackSnapshot(tracks);
 		}
 	}
 }
@@ -656,30 +675,25 @@ void cPlayback::FindAllSubtitlePids(int *pids, unsigned int *numpids, std::strin
 
 	if (player && player->manager && player->manager->subtitle)
 	{
-		char **TrackList = NULL;
-		player->manager->subtitle->Command(player, MANAGER_LIST, &TrackList);
-		if (TrackList != NULL)
+		TrackSnapshot_t *tracks = NULL;
+		player->manager->subtitle->Command(player, MANAGER_SNAPSHOT, &tracks);
+		if (tracks != NULL)
 		{
-			printf("SubtitleTrack List\n");
-			int i = 0, j = 0;
-			for (i = 0, j = 0; TrackList[i] != NULL; i += 2, j++)
+			bool changed = tracks->generation != subtitle_generation;
+			subtitle_generation = tracks->generation;
+			if (changed)
+				printf("SubtitleTrack List\n");
+			int j;
+			for (j = 0; j < tracks->count && j < max_numpids; j++)
 			{
-				printf("\t%s - %s\n", TrackList[i], TrackList[i + 1]);
-				if (j < max_numpids)
-				{
-					int _pid;
-					char _lang[strlen(TrackList[i])];
-					if (sscanf(TrackList[i], "%d %s\n", &_pid, _lang) == 2)
-					{
-						pids[j] = _pid;
-						language[j] = std::string(_lang);
-					}
-				}
-				free(TrackList[i]);
-				free(TrackList[i + 1]);
+				const TrackInfo_t *t = &tracks->tracks[j];
+				if (changed)
+					printf("\t%d %s - %s\n", t->Id, t->Name, t->Encoding);
+				pids[j] = t->Id;
+				language[j] = t->Name;
 			}
-			free(TrackList);
 			*numpids = j;
+			releaseTrackSnapshot(tracks);
 		}
 	}
 }
@@ -779,23 +793,25 @@ void cPlayback::GetChapters(std::vector<int> &positions, std::vector<std::string
 
 	if (player && player->manager && player->manager->chapter)
 	{
-		char **TrackList = NULL;
-		player->manager->chapter->Command(player, MANAGER_LIST, &TrackList);
-		if (TrackList != NULL)
+		TrackSnapshot_t *tracks = NULL;
+		player->manager->chapter->Command(player, MANAGER_SNAPSHOT, &tracks);
+		if (tracks != NULL)
 		{
-			printf("%s: Chapter List\n", __func__);
-			int i = 0;
-			for (i = 0; TrackList[i] != NULL; i += 2)
+			bool changed = tracks->generation != chapter_generation;
+			chapter_generation = tracks->generation;
+			if (changed)
+				printf("%s: Chapter List\n", __func__);
+			positions.reserve(tracks->count);
+			titles.reserve(tracks->count);
+			for (int i = 0; i < tracks->count; i++)
 			{
-				printf("\t%s - %s\n", TrackList[i], TrackList[i + 1]);
-				int pos = atoi(TrackList[i]);
-				std::string title(TrackList[i + 1]);
-				positions.push_back(pos);
-				titles.push_back(title);
-				free(TrackList[i]);
-				free(TrackList[i + 1]);
+				const TrackInfo_t *t = &tracks->tracks[i];
+				if (changed)
+					printf("\t%d - %s\n", (int)t->chapter_start, t->Name);
+				positions.push_back((int)t->chapter_start);
+				titles.push_back(t->Name);
 			}
-			free(TrackList);
+			releaseTrackSnapshot(tracks);
 		}
 	}
 }
@@ -833,13 +849,25 @@ void cPlayback::GetMetadata(std::vector<std::string> &keys, std::vector<std::str
 	}
 }
 
-cPlayback::cPlayback(int num __attribute__((unused)))
+cPlayback::cPlayback(int num)
 {
 	hal_info("%s\n", __func__);
+	hw_caps_t *hwcaps = get_hwcaps();
+	if (num < 0 || num > hwcaps->pip_devs)
+	{
+		hal_info("%s: decoder %d out of range, setting to 0\n", __func__, num);
+		decoder = 0;
+	}
+	else
+		decoder = num;
 	playing = false;
 	decoders_closed = false;
 	first = false;
+	ring_fd = -1;
 	player = NULL;
+	audio_generation = 0;
+	subtitle_generation = 0;
+	chapter_generation = 0;
 }
 
 cPlayback::~cPlayback()
@@ -850,7 +878,7 @@ cPlayback::~cPlayback()
 	mutex.lock();
 	if (player)
 	{
-		free(player);
+		PlaybackFreeContext(player);
 		player = NULL;
 	}
 	mutex.unlock();
@@ -12,6 +12,7 @@ typedef enum
 } playmode_t;
 
 struct AVFormatContext;
+struct Context_s;
 
 class cPlayback
 {
@@ -34,8 +35,15 @@ class cPlayback
 		std::string fn_ts;
 		std::string fn_xml;
 		off64_t last_size;
+		int ring_fd;		/* timeshift ring file, see ts_ring.h */
 		int init_jump;
 		AVFormatContext *avft;
+		struct Context_s *player;
+		int decoder;		/* videoN/audioN the output writes to */
+		/* of the track snapshots last listed, 0: none yet */
+		unsigned int audio_generation;
+		unsigned int subtitle_generation;
+		unsigned int chapter_generation;
 		std::string extractParam(const std::string &hdrs, const std::string &paramName);
 	public:
 		cPlayback(int num = 0);
@@ -2,7 +2,9 @@
 #define __RECORD_LIB_H__
 
 #include <semaphore.h>
+#include <pthread.h>
 #include "dmx_hal.h"
+#include "ts_analyzer.h"
 
 #define REC_STATUS_OK 0
 #define REC_STATUS_SLOW 1
@@ -19,20 +21,54 @@ typedef enum
 	RECORD_FAILED_MEMORY	/* out of memory */
 } record_state_t;
 
+typedef struct
+{
+	unsigned int bufsize;	/* size of the record ring buffer */
+	unsigned int fill;	/* bytes currently buffered */
+	unsigned int fill_max;	/* highest fill level seen */
+	unsigned int inflight;	/* writes currently in flight */
+	unsigned int lat_last;	/* latency of the last write, usec */
+	unsigned int lat_avg;	/* moving average of the write latency, usec */
+	unsigned int lat_max;	/* highest write latency, usec */
+	unsigned int overflows;	/* number of times the buffer ran full */
+	uint64_t written;	/* bytes written to disk */
+	uint64_t failed_bytes;	/* bytes given up on after a write error */
+	unsigned int write_errors;	/* writes that failed */
+	uint64_t writes;	/* number of completed writes */
+	uint64_t evicted;	/* bytes dropped from the page cache */
+	uint64_t evict_time;	/* usec spent starting writeback and evicting */
+	unsigned int parts;	/* files of a split recording */
+	bool io_uring;		/* true: io_uring, false: posix aio */
+	struct ts_stats ts;	/* integrity of the recorded stream */
+} record_stats_t;
+
+class cTSFanout;
+class cTSRemux;
 class cRecord
 {
 	private:
 		int file_fd;
 		int dmx_num;
-		cDemux *dmx;
+		cTSFanout *dmx;
+		cTSRemux *remux;
+		pthread_mutex_t dmx_mutex;	/* PID changes from RecordThread and the API */
 		pthread_t record_thread;
 		bool record_thread_running;
 		record_state_t exit_flag;
 		int state;
 		int bufsize;
 		int bufsize_dmx;
+		unsigned int cache_window;
+		uint64_t split_size;
+		uint64_t ring_size;
+		unsigned short video_pid;
+		bool index;
+		bool spts;
+		bool analyze;
 		void (*failureCallback)(void *);
 		void *failureData;
+		pthread_mutex_t stats_mutex;
+		record_stats_t stats;
 
 		sem_t sem;
 #define RECORD_WRITER_CHUNKS 16
@@ -50,6 +86,29 @@ class cRecord
 		int GetStatus();
 		void ResetStatus();
 		bool ChangePids(unsigned short vpid, unsigned short *apids, int numapids);
+		void GetStats(record_stats_t *s);
+		/* amount of recently written data that is kept in the page
+		 * cache, e.g. for timeshift playback. Applies on next Start() */
+		void SetCacheWindow(unsigned int size) { cache_window = size; };
+		/* write a keyframe index (<recording>.idx) for the video PID,
+		 * enabled by default. Applies on next Start() */
+		void SetIndex(bool enable) { index = enable; };
+		/* record a single program TS with generated PAT / PMT for the
+		 * service of the channel id passed to Start(), disabled by
+		 * default. Applies on next Start() */
+		void SetSPTS(bool enable) { spts = enable; };
+		/* continue the recording in <name>.001, <name>.002, ... each
+		 * time the file reaches size bytes, 0 (default) disables.
+		 * Applies on next Start() */
+		void SetSplitSize(uint64_t size) { split_size = size; };
+		/* record into a fixed size file that is overwritten circularly
+		 * (see ts_ring.h), for permanent timeshift. 0 (default) disables,
+		 * no index is written then. Applies on next Start() */
+		void SetRingSize(uint64_t size) { ring_size = size; };
+		/* count continuity errors, sync losses etc. of the recorded
+		 * stream into GetStats(), enabled by default. Applies on next
+		 * Start() */
+		void SetAnalyzer(bool enable) { analyze = enable; };
 
 		void RecordThread();
 		void WriterThread();
@@ -21,87 +21,122 @@
 
 #define FILLBUFSIZE 0
 #define FILLBUFDIFF 1048576
-#define FILLBUFPAKET 5120
-#define FILLBUFSEEKTIME 3 //sec
+/* the network reads start with FILLBUFPAKET bytes and grow up to
+ * FILLBUFPAKET_MAX while they are returned completely */
+#define FILLBUFPAKET 65536
+#define FILLBUFPAKET_MAX 524288
+/* ms a read waits for buffered data before it gives up */
+#define FILLBUFTIMEOUT 20000
 #define TIMEOUT_MAX_ITERS 10
 
-static int ffmpeg_buf_size = FILLBUFSIZE + FILLBUFDIFF;
-static int ffmpeg_buf_seek_time = FILLBUFSEEKTIME;
-static int(*ffmpeg_read_org)(void *opaque, uint8_t *buf, int buf_size) = NULL;
-static int(*ffmpeg_real_read_org)(void *opaque, uint8_t *buf, int buf_size) = NULL;
-
-static int64_t(*ffmpeg_seek_org)(void *opaque, int64_t offset, int whence) = NULL;
-static unsigned char *ffmpeg_buf_read = NULL;
-static unsigned char *ffmpeg_buf_write = NULL;
-static unsigned char *ffmpeg_buf = NULL;
-static pthread_t fillerThread;
-static int hasfillerThreadStarted[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-int hasfillerThreadStartedID = 0;
-static pthread_mutex_t fillermutex;
-static int ffmpeg_buf_valid_size = 0;
-static int ffmpeg_do_seek_ret = 0;
-static int ffmpeg_do_seek = 0;
-static int ffmpeg_buf_stop = 0;
-
-static Context_t *g_context = 0;
-static int64_t playPts = -1;
-static int32_t finishTimeout = 0;
-static int8_t pauseTimeout = 0;
-static int64_t maxInjectedPTS = INVALID_PTS_VALUE;
-
-static int64_t update_max_injected_pts(int64_t pts)
+/* Single producer / single consumer ring: only the filler thread moves
+ * write and reads from the network directly into the buffer, only
+ * ffmpeg_read() and ffmpeg_seek() move read. Neither needs the mutex,
+ * it is only there to sleep on the conditions. The filler leaves
+ * FILLBUFDIFF bytes behind read alone for seeking back. */
+typedef struct FFMPEGBuffer_s
 {
+	int size;
+	int(*read_org)(void *opaque, uint8_t *buf, int buf_size);
+	int(*real_read_org)(void *opaque, uint8_t *buf, int buf_size);
+	int64_t(*seek_org)(void *opaque, int64_t offset, int whence);
+
+	unsigned char *read;
+	unsigned char *write;
+	unsigned char *buf;
+	pthread_t fillerThread;
+	/* 1 running, 2 asked to stop, 0 gone */
+	int hasfillerThreadStarted;
+	pthread_mutex_t fillermutex;
+	pthread_cond_t fillerDataCond;	/* data written, seek done */
+	pthread_cond_t fillerSpaceCond;	/* data read, seek requested */
+	int fillerReaderWaiting;
+	int fillerWriterWaiting;
+	int valid_size;
+	int error;
+	int paket;
+	int do_seek_ret;
+	int do_seek;
+	int stop;
+	/* given up on by ffmpeg_buf_free(), the filler frees it */
+	int abandoned;
+
+	/* statistics, see container_get_fillbufstatus() */
+	uint32_t stalls;
+	uint32_t stall_time;
+	uint32_t full;
+	uint64_t total;
+
+	/* the end of progressive and buffered streams */
+	int64_t playPts;
+	int32_t finishTimeout;
+	int8_t pauseTimeout;
+	int64_t maxInjectedPTS;
+} FFMPEGBuffer_t;
+
+static void ffmpeg_buf_destroy(FFMPEGBuffer_t *b);
+
+#define buf_load(_v) __atomic_load_n(&(_v), __ATOMIC_SEQ_CST)
+#define buf_store(_v, _x) __atomic_store_n(&(_v), (_x), __ATOMIC_SEQ_CST)
+
+static int64_t update_max_injected_pts(FFMPEGContext_t *ff, int64_t pts)
+{
+	FFMPEGBuffer_t *b = ff->buffer;
+
 	if (pts > 0 && pts != INVALID_PTS_VALUE)
 	{
-		if (maxInjectedPTS == INVALID_PTS_VALUE || pts > maxInjectedPTS || PlaybackDieNow(0) == 0)
+		if (b->maxInjectedPTS == INVALID_PTS_VALUE || pts > b->maxInjectedPTS || PlaybackDieNow(ff->context, 0) == 0)
 		{
-			maxInjectedPTS = pts;
+			b->maxInjectedPTS = pts;
 		}
 	}
-	return maxInjectedPTS;
+	return b->maxInjectedPTS;
 }
 
-int64_t get_play_pts()
+static int64_t get_play_pts(FFMPEGContext_t *ff)
 {
-	return playPts;
+	return ff->buffer->playPts;
 }
 
-void reset_finish_timeout()
+static void reset_finish_timeout(FFMPEGContext_t *ff)
 {
-	playPts = -1;
-	finishTimeout = 0;
+	ff->buffer->playPts = -1;
+	ff->buffer->finishTimeout = 0;
 }
 
-void set_pause_timeout(uint8_t pause)
+static void __attribute__((unused)) set_pause_timeout(FFMPEGContext_t *ff, uint8_t pause)
 {
-	reset_finish_timeout();
-	pauseTimeout = pause;
+	reset_finish_timeout(ff);
+	ff->buffer->pauseTimeout = pause;
 }
 
-static int8_t is_finish_timeout()
+static int8_t is_finish_timeout(FFMPEGContext_t *ff)
 {
-	if (finishTimeout > TIMEOUT_MAX_ITERS)
+	if (ff->buffer->finishTimeout > TIMEOUT_MAX_ITERS)
 	{
 		return 1;
 	}
 	return 0;
 }
 
-static void update_finish_timeout()
+static void update_finish_timeout(FFMPEGContext_t *ff)
 {
-	if (pauseTimeout == 0)
+	FFMPEGBuffer_t *b = ff->buffer;
+	Context_t *context = ff->context;
+
+	if (b->pauseTimeout == 0)
 	{
-		int64_t maxInjectedPts = update_max_injected_pts(-1);
+		int64_t maxInjectedPts = update_max_injected_pts(ff, -1);
 		int64_t currPts = -1;
-		int32_t ret = g_context->playback->Command(g_context, PLAYBACK_PTS, &currPts);
-		finishTimeout += 1;
+		int32_t ret = context->playback->Command(context, PLAYBACK_PTS, &currPts);
+		b->finishTimeout += 1;
 
 		if (maxInjectedPts < 0 || maxInjectedPts == INVALID_PTS_VALUE)
 		{
 			maxInjectedPts = 0;
 		}
 
-		//printf("ret[%d] playPts[%" PRId64 "] currPts[%" PRId64 "] maxInjectedPts[%" PRId64 "]\n", ret, playPts, currPts, maxInjectedPts);
+		//printf("ret[%d] playPts[%" PRId64 "] currPts[%" PRId64 "] maxInjectedPts[%" PRId64 "]\n", ret, b->playPts, currPts, maxInjectedPts);
 
 		/* On some STBs PTS readed from decoder is invalid after seek or at start
 		 * this is the reason for additional validation when we what to close immediately
@@ -111,314 +146,418 @@ static void update_finish_timeout()
 		{
 			/* close immediately
 			 */
-			finishTimeout = TIMEOUT_MAX_ITERS + 1;
+			b->finishTimeout = TIMEOUT_MAX_ITERS + 1;
 		}
-		else if (ret == 0 && (playPts != currPts && maxInjectedPts > currPts))
+		else if (ret == 0 && (b->playPts != currPts && maxInjectedPts > currPts))
 		{
-			playPts = currPts;
-			finishTimeout = 0;
+			b->playPts = currPts;
+			b->finishTimeout = 0;
 		}
 	}
 }
 
-static int32_t ffmpeg_read_wrapper_base(void *opaque, uint8_t *buf, int32_t buf_size, uint8_t type)
+static int32_t ffmpeg_read_wrapper_base(FFMPEGContext_t *ff, void *opaque, uint8_t *buf, int32_t buf_size, uint8_t type)
 {
+	FFMPEGBuffer_t *b = ff->buffer;
 	int32_t len = 0;
-	if (PlaybackDieNow(0) == 0)
+	if (PlaybackDieNow(ff->context, 0) == 0)
 	{
-		len = ffmpeg_real_read_org(opaque, buf, buf_size);
-		while (len < buf_size && g_context && PlaybackDieNow(0) == 0)
+		len = b->real_read_org(opaque, buf, buf_size);
+		while (len < buf_size && PlaybackDieNow(ff->context, 0) == 0)
 		{
 			if (type && len > 0)
 			{
 				break;
 			}
 
-			int32_t partLen = ffmpeg_real_read_org(opaque, buf + len, buf_size - len);
+			int32_t partLen = b->real_read_org(opaque, buf + len, buf_size - len);
 			if (partLen > 0)
 			{
 				len += partLen;
-				finishTimeout = 0;
+				b->finishTimeout = 0;
 				continue;
 			}
-			else if (is_finish_timeout())
+			else if (is_finish_timeout(ff))
 			{
 				len = 0;
 				break;
 			}
 
-			update_finish_timeout();
+			update_finish_timeout(ff);
 
 			usleep(100000);
 			continue;
 		}
 	}
-	//printf("len [%d] finishTimeout[%d]\n", len, finishTimeout);
+	//printf("len [%d] finishTimeout[%d]\n", len, b->finishTimeout);
 	return len;
 }
 
 static int32_t ffmpeg_read_wrapper(void *opaque, uint8_t *buf, int32_t buf_size)
 {
+	FFMPEGContext_t *ff = ffmpeg_io_context(opaque);
+
+	if (ff == NULL)
+	{
+		return AVERROR(EIO);
+	}
+
 	if (progressive_playback)
 	{
-		return ffmpeg_read_wrapper_base(opaque, buf, buf_size, 0);
+		return ffmpeg_read_wrapper_base(ff, opaque, buf, buf_size, 0);
 	}
 	else
 	{
 		/* at start it was progressive playback, but dwonload, finished
 		 */
-		return ffmpeg_real_read_org(opaque, buf, buf_size);
+		return ff->buffer->real_read_org(opaque, buf, buf_size);
 	}
 }
 
 #if 0
 static int32_t ffmpeg_read_wrapper2(void *opaque, uint8_t *buf, int32_t buf_size)
 {
-	return ffmpeg_read_wrapper_base(opaque, buf, buf_size, 1);
+	return ffmpeg_read_wrapper_base(ffmpeg_io_context(opaque), opaque, buf, buf_size, 1);
 }
 #endif
 
 //for buffered io
-void getfillerMutex(const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int line __attribute__((unused)))
+static void getfillerMutex(FFMPEGBuffer_t *b, const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int line __attribute__((unused)))
 {
 	ffmpeg_printf(100, "::%d requesting mutex\n", line);
 
-	pthread_mutex_lock(&fillermutex);
+	pthread_mutex_lock(&b->fillermutex);
 
 	ffmpeg_printf(100, "::%d received mutex\n", line);
 }
 
-void releasefillerMutex(const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int line __attribute__((unused)))
+static void releasefillerMutex(FFMPEGBuffer_t *b, const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int line __attribute__((unused)))
 {
-	pthread_mutex_unlock(&fillermutex);
+	pthread_mutex_unlock(&b->fillermutex);
 
 	ffmpeg_printf(100, "::%d released mutex\n", line);
 }
 
 //for buffered io (end)encoding
-#if 0
-static int32_t container_set_ffmpeg_buf_seek_time(int32_t *time)
+static int32_t container_set_ffmpeg_buf_size(FFMPEGContext_t *ff, int32_t *size)
 {
-	ffmpeg_buf_seek_time = (*time);
-	return cERR_CONTAINER_FFMPEG_NO_ERROR;
-}
-#endif
+	FFMPEGBuffer_t *b = ff->buffer;
 
-static int32_t container_set_ffmpeg_buf_size(int32_t *size)
-{
-	if (ffmpeg_buf == NULL)
+	if (b->buf == NULL)
 	{
 		if (*size == 0)
 		{
-			ffmpeg_buf_size = 0;
+			b->size = 0;
 		}
 		else
 		{
-			ffmpeg_buf_size = (*size) + FILLBUFDIFF;
+			b->size = (*size) + FILLBUFDIFF;
 		}
 	}
 
-	ffmpeg_printf(10, "size=%d, buffer size=%d\n", (*size), ffmpeg_buf_size);
+	ffmpeg_printf(10, "size=%d, buffer size=%d\n", (*size), b->size);
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
-static int32_t container_get_ffmpeg_buf_size(int32_t *size)
+static int32_t container_get_ffmpeg_buf_size(FFMPEGContext_t *ff, int32_t *size)
 {
-	*size = ffmpeg_buf_size - FILLBUFDIFF;
+	*size = ff->buffer->size - FILLBUFDIFF;
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
-static int32_t container_get_fillbufstatus(int32_t *size)
+/* bytes between the two positions, in ring order */
+static int32_t ffmpeg_buf_diff(FFMPEGBuffer_t *b, unsigned char *from, unsigned char *to)
 {
-	int32_t rwdiff = 0;
+	int32_t diff = to - from;
+	if (diff < 0)
+	{
+		diff += b->size;
+	}
+	return diff;
+}
+
+static unsigned char *ffmpeg_buf_advance(FFMPEGBuffer_t *b, unsigned char *pos, int32_t len)
+{
+	pos += len;
+	if (pos >= b->buf + b->size)
+	{
+		pos -= b->size;
+	}
+	return pos;
+}
+
+/* sleep until woken up through *waiting or for timeout ms, the caller
+ * checks its condition again afterwards. ready() is checked once more
+ * after *waiting is set, so a wakeup between the caller's check and
+ * the wait is not lost */
+static void ffmpeg_buf_wait(Context_t *context, FFMPEGBuffer_t *b, pthread_cond_t *cond, int *waiting, int (*ready)(FFMPEGBuffer_t *), int32_t timeout)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout / 1000;
+	ts.tv_nsec += (timeout % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
 
-	if (ffmpeg_buf != NULL && ffmpeg_buf_read != NULL && ffmpeg_buf_write != NULL)
+	getfillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+	buf_store(*waiting, 1);
+	if (!ready(b) && PlaybackDieNow(context, 0) == 0)
 	{
-		if (ffmpeg_buf_read < ffmpeg_buf_write)
-			rwdiff = ffmpeg_buf_write - ffmpeg_buf_read;
-		if (ffmpeg_buf_read > ffmpeg_buf_write)
+		pthread_cond_timedwait(cond, &b->fillermutex, &ts);
+	}
+	buf_store(*waiting, 0);
+	releasefillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+}
+
+static void ffmpeg_buf_wakeup(FFMPEGBuffer_t *b, pthread_cond_t *cond, int *waiting)
+{
+	if (buf_load(*waiting))
+	{
+		getfillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+		pthread_cond_signal(cond);
+		releasefillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+	}
+}
+
+static void ffmpeg_buf_wakeup_buffer(FFMPEGBuffer_t *b)
+{
+	getfillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+	pthread_cond_broadcast(&b->fillerDataCond);
+	pthread_cond_broadcast(&b->fillerSpaceCond);
+	releasefillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+}
+
+/* the PlaybackDieNow callback, the buffer may be gone by then */
+static void ffmpeg_buf_wakeup_all(Context_t *context)
+{
+	FFMPEGContext_t *ff;
+
+	pthread_mutex_lock(&ioContextsMutex);
+	for (ff = ioContexts; ff != NULL; ff = ff->ioNext)
+	{
+		if (ff->context == context)
 		{
-			rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-			rwdiff += ffmpeg_buf_write - ffmpeg_buf;
+			ffmpeg_buf_wakeup_buffer(ff->buffer);
 		}
+	}
+	pthread_mutex_unlock(&ioContextsMutex);
+}
+
+/* the reader can go on: data or an error */
+static int ffmpeg_buf_data_ready(FFMPEGBuffer_t *b)
+{
+	return buf_load(b->read) != buf_load(b->write) || buf_load(b->error) != 0;
+}
+
+static int ffmpeg_buf_seek_done(FFMPEGBuffer_t *b)
+{
+	return buf_load(b->do_seek) == 0 || b->hasfillerThreadStarted != 1;
+}
+
+/* the filler can go on: space, a seek or stop request */
+static int ffmpeg_buf_writer_ready(FFMPEGBuffer_t *b)
+{
+	return ffmpeg_buf_diff(b, buf_load(b->read), buf_load(b->write)) < b->size - FILLBUFDIFF - 1 ||
+		buf_load(b->do_seek) != 0 || b->hasfillerThreadStarted != 1;
+}
 
-		*size = rwdiff;
+static int32_t container_get_fillbufstatus(FFMPEGContext_t *ff, ContainerBufferStatus_t *status)
+{
+	FFMPEGBuffer_t *b = ff->buffer;
+
+	memset(status, 0, sizeof(*status));
+
+	if (b->buf != NULL && b->read != NULL && b->write != NULL)
+	{
+		status->size = ffmpeg_buf_diff(b, buf_load(b->read), buf_load(b->write));
+		status->capacity = b->size - FILLBUFDIFF - 1;
+		status->readSize = b->paket;
+		status->stalls = b->stalls;
+		status->stallTime = b->stall_time;
+		status->full = b->full;
+		status->total = b->total;
 	}
+	ffmpeg_cache_status(ff->cache, status);
+	ffmpeg_queue_status(ff->queues, status);
 
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
 #if 0
-static int32_t container_stop_buffer()
+static int32_t container_stop_buffer(FFMPEGContext_t *ff)
 {
-	ffmpeg_buf_stop = 1;
+	ff->buffer->stop = 1;
 	return 0;
 }
 #endif
 
-//flag 0: start direct
-//flag 1: from thread
-static void ffmpeg_filler(Context_t *context, int32_t id, int32_t *inpause, int32_t flag)
+static void ffmpeg_filler(FFMPEGContext_t *ff, FFMPEGBuffer_t *b, int32_t *inpause)
 {
-	int32_t len = 0;
-	int32_t rwdiff = ffmpeg_buf_size;
-	uint8_t buf[FILLBUFPAKET];
+	Context_t *context = ff->context;
+	int32_t full = 0;
 
-	if (ffmpeg_read_org == NULL || ffmpeg_seek_org == NULL)
+	if (b->read_org == NULL || b->seek_org == NULL)
 	{
-		ffmpeg_err("ffmpeg_read_org or ffmpeg_seek_org is NULL\n");
+		ffmpeg_err("read_org or seek_org is NULL\n");
 		return;
 	}
 
-	while ((flag == 0 && avContextTab[0] != NULL && avContextTab[0]->pb != NULL && rwdiff > FILLBUFDIFF) ||
-		(flag == 1 && hasfillerThreadStarted[id] == 1 && avContextTab[0] != NULL && avContextTab[0]->pb != NULL && rwdiff > FILLBUFDIFF))
+	while (b->hasfillerThreadStarted == 1 && ff->avContextTab[0] != NULL && ff->avContextTab[0]->pb != NULL)
 	{
-		if (PlaybackDieNow(0) == 0)
-		{
-			break;
-		}
+		AVIOContext *pb = ff->avContextTab[0]->pb;
 
-		if (flag == 0 && ffmpeg_buf_stop == 1)
+		if (PlaybackDieNow(context, 0) != 0 || b->stop == 1)
 		{
-			ffmpeg_buf_stop = 0;
 			break;
 		}
 
-		getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-		//do a seek
-		if (ffmpeg_do_seek != 0)
+		//do a seek, the reader waits for it
+		int32_t seek = buf_load(b->do_seek);
+		if (seek != 0)
 		{
-			ffmpeg_do_seek_ret = ffmpeg_seek_org(avContextTab[0]->pb->opaque, avContextTab[0]->pb->pos + ffmpeg_do_seek, SEEK_SET);
-			if (ffmpeg_do_seek_ret >= 0)
+			int32_t ret = b->seek_org(pb->opaque, pb->pos + seek, SEEK_SET);
+			if (ret >= 0)
 			{
-				ffmpeg_buf_write = ffmpeg_buf;
-				ffmpeg_buf_read = ffmpeg_buf;
+				buf_store(b->write, b->buf);
+				buf_store(b->read, b->buf);
+				b->valid_size = 0;
 			}
-
-			ffmpeg_do_seek = 0;
+			b->paket = FILLBUFPAKET;
+			b->do_seek_ret = ret;
+			buf_store(b->error, 0);
+			buf_store(b->do_seek, 0);
+			ffmpeg_buf_wakeup_buffer(b);
+			continue;
 		}
 
-		if (ffmpeg_buf_read == ffmpeg_buf_write)
+		unsigned char *wpos = b->write;
+		int32_t size = b->size - FILLBUFDIFF - 1 - ffmpeg_buf_diff(b, buf_load(b->read), wpos);
+		if (size > (b->buf + b->size) - wpos)
 		{
-			ffmpeg_buf_valid_size = 0;
-			rwdiff = ffmpeg_buf_size;
+			size = (b->buf + b->size) - wpos;
 		}
-
-		if (ffmpeg_buf_read < ffmpeg_buf_write)
+		if (size > b->paket)
 		{
-			rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_write;
-			rwdiff += ffmpeg_buf_read - ffmpeg_buf;
+			size = b->paket;
 		}
 
-		if (ffmpeg_buf_read > ffmpeg_buf_write)
+		if (size <= 0)
 		{
-			rwdiff = ffmpeg_buf_read - ffmpeg_buf_write;
-		}
+			if (!full)
+			{
+				b->full++;
+				full = 1;
+			}
 
-		int32_t size = FILLBUFPAKET;
-		if (rwdiff - FILLBUFDIFF < size)
-		{
-			size = (rwdiff - FILLBUFDIFF);
-		}
+			//on long pause the server close the connection, so we use seek to reconnect
+			if (context->playback != NULL && inpause != NULL)
+			{
+				if ((*inpause) == 0 && context->playback->isPaused)
+				{
+					(*inpause) = 1;
+				}
+				else if ((*inpause) == 1 && !context->playback->isPaused)
+				{
+					int32_t buflen = ffmpeg_buf_diff(b, buf_load(b->read), wpos);
+					(*inpause) = 0;
+					b->seek_org(pb->opaque, pb->pos + buflen, SEEK_SET);
+				}
+			}
 
-		if (ffmpeg_buf_write + size > ffmpeg_buf + ffmpeg_buf_size)
-		{
-			size = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_write;
-		}
+			/* time to fill the gaps of the disk cache */
+			if (ffmpeg_cache_idle(ff->cache, pb->opaque))
+			{
+				continue;
+			}
 
-		if (ffmpeg_buf_write == ffmpeg_buf + ffmpeg_buf_size)
-		{
-			ffmpeg_buf_write = ffmpeg_buf;
+			/* the pause check above needs a wakeup now and then */
+			ffmpeg_buf_wait(context, b, &b->fillerSpaceCond, &b->fillerWriterWaiting, ffmpeg_buf_writer_ready, 100);
+			continue;
 		}
+		full = 0;
 
-		releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
+		int32_t len = b->read_org(pb->opaque, wpos, size);
 
-		if (size > 0)
+		if (b->hasfillerThreadStarted != 1)
 		{
-			if (flag == 1 && hasfillerThreadStarted[id] == 2)
-				break;
-
-			len = ffmpeg_read_org(avContextTab[0]->pb->opaque, buf, size);
-
-			if (flag == 1 && hasfillerThreadStarted[id] == 2)
-				break;
+			break;
+		}
 
-			ffmpeg_printf(20, "buffer-status (free buffer=%d)\n", rwdiff - FILLBUFDIFF - len);
+		if (len > 0)
+		{
+			buf_store(b->write, ffmpeg_buf_advance(b, wpos, len));
+			b->total += len;
+			buf_store(b->error, 0);
+			ffmpeg_buf_wakeup(b, &b->fillerDataCond, &b->fillerReaderWaiting);
 
-			getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-			if (len > 0)
+			/* bigger reads while the network keeps up, smaller ones
+			 * when it does not, so the reader gets data early */
+			if (len == b->paket && b->paket < FILLBUFPAKET_MAX)
 			{
-				memcpy(ffmpeg_buf_write, buf, len);
-				ffmpeg_buf_write += len;
+				b->paket *= 2;
 			}
-			else
+			else if (len < b->paket / 4 && b->paket > FILLBUFPAKET)
 			{
-				releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
-				ffmpeg_err("read not ok ret=%d\n", len);
-				break;
+				b->paket /= 2;
 			}
-			releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
+
+			ffmpeg_printf(20, "buffer-status (free buffer=%d)\n", size - len);
 		}
 		else
 		{
-			//on long pause the server close the connection, so we use seek to reconnect
-			if (context != NULL && context->playback != NULL && inpause != NULL)
+			if (buf_load(b->error) != (len ? len : AVERROR_EOF))
 			{
-				if ((*inpause) == 0 && context->playback->isPaused)
-				{
-					(*inpause) = 1;
-				}
-				else if ((*inpause) == 1 && !context->playback->isPaused)
-				{
-					int32_t buflen = 0;
-					(*inpause) = 0;
-
-					getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-					if (ffmpeg_buf_read < ffmpeg_buf_write)
-					{
-						buflen = ffmpeg_buf_write - ffmpeg_buf_read;
-					}
-
-					if (ffmpeg_buf_read > ffmpeg_buf_write)
-					{
-						buflen = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-						buflen += ffmpeg_buf_write - ffmpeg_buf;
-					}
-					ffmpeg_seek_org(avContextTab[0]->pb->opaque, avContextTab[0]->pb->pos + buflen, SEEK_SET);
-					releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
-				}
+				ffmpeg_err("read not ok ret=%d\n", len);
 			}
+			buf_store(b->error, len ? len : AVERROR_EOF);
+			ffmpeg_buf_wakeup(b, &b->fillerDataCond, &b->fillerReaderWaiting);
+			/* retry later, unless a seek comes first */
+			ffmpeg_buf_wait(context, b, &b->fillerSpaceCond, &b->fillerWriterWaiting, ffmpeg_buf_writer_ready, 100);
 		}
 	}
 }
 
-static void ffmpeg_fillerTHREAD(Context_t *context)
+static void ffmpeg_fillerTHREAD(FFMPEGContext_t *ff)
 {
+	FFMPEGBuffer_t *b = ff->buffer;
 	int32_t inpause = 0;
-	int32_t id = hasfillerThreadStartedID;
+	int32_t abandoned;
 
-	ffmpeg_printf(10, "Running ID=%d!\n", id);
+	ffmpeg_printf(10, "Running!\n");
 
-	while (hasfillerThreadStarted[id] == 1)
-	{
-		ffmpeg_filler(context, id, &inpause, 1);
-		usleep(10000);
-	}
+	ffmpeg_filler(ff, b, &inpause);
+
+	getfillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+	b->hasfillerThreadStarted = 0;
+	abandoned = b->abandoned;
+	pthread_cond_broadcast(&b->fillerDataCond);
+	releasefillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
 
-	hasfillerThreadStarted[id] = 0;
+	ffmpeg_printf(10, "terminating\n");
 
-	ffmpeg_printf(10, "terminating ID=%d\n", id);
+	if (abandoned)
+	{
+		/* the context waits for this before it goes away */
+		av_free(b->buf);
+		ffmpeg_buf_destroy(b);
+		__atomic_sub_fetch(&ff->abandonedFillers, 1, __ATOMIC_SEQ_CST);
+	}
 }
 
-static int32_t ffmpeg_start_fillerTHREAD(Context_t *context)
+static int32_t ffmpeg_start_fillerTHREAD(FFMPEGContext_t *ff)
 {
+	FFMPEGBuffer_t *b = ff->buffer;
+	Context_t *context = ff->context;
 	int32_t error;
-	int32_t ret = 0, i = 0;
+	int32_t ret = 0;
 	pthread_attr_t attr;
 
 	ffmpeg_printf(10, "\n");
 
-	if (context && context->playback && context->playback->isPlaying)
+	if (context->playback && context->playback->isPlaying)
 	{
 		ffmpeg_printf(10, "is Playing\n");
 	}
@@ -427,26 +566,17 @@ static int32_t ffmpeg_start_fillerTHREAD(Context_t *context)
 		ffmpeg_printf(10, "is NOT Playing\n");
 	}
 
-	//get filler thread ID
-	//if the thread hangs for long time, we use a new id
-	for (i = 0; i < 10; i++)
-	{
-		if (hasfillerThreadStarted[i] == 0)
-		{
-			hasfillerThreadStartedID = i;
-			break;
-		}
-	}
+	PlaybackDieNowRegisterCallback(context, ffmpeg_buf_wakeup_all);
 
-	if (hasfillerThreadStarted[hasfillerThreadStartedID] == 0)
+	if (b->hasfillerThreadStarted == 0)
 	{
 		pthread_attr_init(&attr);
 		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-		hasfillerThreadStarted[hasfillerThreadStartedID] = 1;
-		if ((error = pthread_create(&fillerThread, &attr, (void *)&ffmpeg_fillerTHREAD, context)) != 0)
+		b->hasfillerThreadStarted = 1;
+		if ((error = pthread_create(&b->fillerThread, &attr, (void *)&ffmpeg_fillerTHREAD, ff)) != 0)
 		{
-			hasfillerThreadStarted[hasfillerThreadStartedID] = 0;
+			b->hasfillerThreadStarted = 0;
 			ffmpeg_printf(10, "Error creating filler thread, error:%d:%s\n", error, strerror(error));
 
 			ret = cERR_CONTAINER_FFMPEG_ERR;
@@ -458,7 +588,7 @@ static int32_t ffmpeg_start_fillerTHREAD(Context_t *context)
 	}
 	else
 	{
-		ffmpeg_printf(10, "All filler thread ID's in use!\n");
+		ffmpeg_printf(10, "filler thread still running!\n");
 
 		ret = cERR_CONTAINER_FFMPEG_ERR;
 	}
@@ -467,104 +597,175 @@ static int32_t ffmpeg_start_fillerTHREAD(Context_t *context)
 	return ret;
 }
 
-static int32_t ffmpeg_read_real(void *opaque __attribute__((unused)), uint8_t *buf, int32_t buf_size)
+/* before the input is closed: the filler must not read from it anymore.
+ * 0 if the thread is gone */
+static int32_t ffmpeg_stop_fillerTHREAD(FFMPEGContext_t *ff)
 {
-	int32_t len = buf_size;
-	int32_t rwdiff = 0;
+	FFMPEGBuffer_t *b = ff->buffer;
+	int32_t wait_time = 20;
 
-	if (buf_size > 0)
+	if (b->buf == NULL || b->hasfillerThreadStarted != 1)
 	{
-		getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
+		return b->hasfillerThreadStarted;
+	}
 
-		if (ffmpeg_buf_read < ffmpeg_buf_write)
-			rwdiff = ffmpeg_buf_write - ffmpeg_buf_read;
-		if (ffmpeg_buf_read > ffmpeg_buf_write)
+	getfillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+	b->hasfillerThreadStarted = 2;
+	pthread_cond_broadcast(&b->fillerSpaceCond);
+	while (b->hasfillerThreadStarted != 0 && (--wait_time) > 0)
+	{
+		/* it may hang in a network read */
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000000;
+		if (ts.tv_nsec >= 1000000000)
 		{
-			rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-			rwdiff += ffmpeg_buf_write - ffmpeg_buf;
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
 		}
-		rwdiff--;
+		pthread_cond_timedwait(&b->fillerDataCond, &b->fillermutex, &ts);
+	}
+	releasefillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
 
-		if (len > rwdiff)
-		{
-			len = rwdiff;
-		}
+	if (b->hasfillerThreadStarted != 0)
+	{
+		ffmpeg_err("filler thread does not terminate\n");
+	}
+	return b->hasfillerThreadStarted;
+}
 
-		if (ffmpeg_buf_read + len > ffmpeg_buf + ffmpeg_buf_size)
-		{
-			len = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-		}
+static int32_t ffmpeg_read_real(FFMPEGBuffer_t *b, uint8_t *buf, int32_t buf_size)
+{
+	unsigned char *rpos = b->read;
+	int32_t len = ffmpeg_buf_diff(b, rpos, buf_load(b->write));
 
-		if (len > 0)
-		{
-			memcpy(buf, ffmpeg_buf_read, len);
-			ffmpeg_buf_read += len;
+	if (len > buf_size)
+	{
+		len = buf_size;
+	}
+
+	if (rpos + len > b->buf + b->size)
+	{
+		len = (b->buf + b->size) - rpos;
+	}
+
+	if (len > 0)
+	{
+		memcpy(buf, rpos, len);
+		buf_store(b->read, ffmpeg_buf_advance(b, rpos, len));
+		ffmpeg_buf_wakeup(b, &b->fillerSpaceCond, &b->fillerWriterWaiting);
 
-			if (ffmpeg_buf_valid_size < FILLBUFDIFF)
+		if (b->valid_size < FILLBUFDIFF)
+		{
+			if (b->valid_size + len > FILLBUFDIFF)
 			{
-				if (ffmpeg_buf_valid_size + len > FILLBUFDIFF)
-				{
-					ffmpeg_buf_valid_size = FILLBUFDIFF;
-				}
-				else
-				{
-					ffmpeg_buf_valid_size += len;
-				}
+				b->valid_size = FILLBUFDIFF;
 			}
-
-			if (ffmpeg_buf_read == ffmpeg_buf + ffmpeg_buf_size)
+			else
 			{
-				ffmpeg_buf_read = ffmpeg_buf;
+				b->valid_size += len;
 			}
 		}
-		else
-		{
-			len = 0;
-		}
-		releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
+	}
+	else
+	{
+		len = 0;
 	}
 
 	return len;
 }
 
+static int64_t ffmpeg_buf_time_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* returns what is buffered as soon as there is something, ffmpeg does
+ * not need the whole buf_size */
 static int32_t ffmpeg_read(void *opaque, uint8_t *buf, int32_t buf_size)
 {
+	FFMPEGContext_t *ff = ffmpeg_io_context(opaque);
+	FFMPEGBuffer_t *b;
+	Context_t *context;
 	int32_t sumlen = 0;
 	int32_t len = 0;
-	int32_t count = 2000;
+	int64_t start = 0;
+
+	if (ff == NULL)
+	{
+		return AVERROR(EIO);
+	}
+	b = ff->buffer;
+	context = ff->context;
 
-	while (sumlen < buf_size && (--count) > 0 && PlaybackDieNow(0) == 0)
+	while (sumlen < buf_size && PlaybackDieNow(context, 0) == 0)
 	{
-		len = ffmpeg_read_real(opaque, buf, buf_size - sumlen);
+		int32_t error = buf_load(b->error);
+
+		/* twice at the end of the buffer */
+		len = ffmpeg_read_real(b, buf, buf_size - sumlen);
 		sumlen += len;
 		buf += len;
-		if (len == 0)
+		if (len > 0)
 		{
-			usleep(10000);
+			continue;
 		}
-	}
 
-	if (count == 0)
-	{
-		if (sumlen == 0)
+		if (sumlen > 0)
 		{
-			ffmpeg_err("Timeout waiting for buffered data (buf_size=%d sumlen=%d)!\n", buf_size, sumlen);
+			break;
 		}
-		else
+
+		/* all data from before the end of the stream was read */
+		if (error == AVERROR_EOF)
+		{
+			sumlen = AVERROR_EOF;
+			break;
+		}
+
+		int64_t now = ffmpeg_buf_time_ms();
+		if (start == 0)
 		{
-			ffmpeg_err("Timeout, not all buffered data availabel (buf_size=%d sumlen=%d)!\n", buf_size, sumlen);
+			start = now;
+			b->stalls++;
 		}
+		else if (now - start > FILLBUFTIMEOUT)
+		{
+			ffmpeg_err("Timeout waiting for buffered data (buf_size=%d)!\n", buf_size);
+			break;
+		}
+
+		ffmpeg_buf_wait(context, b, &b->fillerDataCond, &b->fillerReaderWaiting, ffmpeg_buf_data_ready, 100);
+	}
+
+	if (start != 0)
+	{
+		b->stall_time += ffmpeg_buf_time_ms() - start;
 	}
 
 	return sumlen;
 }
 
-static int64_t ffmpeg_seek(void *opaque __attribute__((unused)), int64_t offset, int32_t whence)
+static int64_t ffmpeg_seek(void *opaque, int64_t offset, int32_t whence)
 {
+	FFMPEGContext_t *ff = ffmpeg_io_context(opaque);
+	FFMPEGBuffer_t *b;
+	Context_t *context;
+	AVIOContext *pb;
 	int64_t diff;
 	int32_t rwdiff = 0;
 	whence &= ~AVSEEK_FORCE;
 
+	if (ff == NULL)
+	{
+		return AVERROR(EIO);
+	}
+	b = ff->buffer;
+	context = ff->context;
+	pb = ff->avContextTab[0]->pb;
+
 	if (whence != SEEK_CUR && whence != SEEK_SET)
 	{
 		return AVERROR(EINVAL);
@@ -576,102 +777,158 @@ static int64_t ffmpeg_seek(void *opaque __attribute__((unused)), int64_t offset,
 	}
 	else
 	{
-		diff = offset - avContextTab[0]->pb->pos;
+		diff = offset - pb->pos;
 	}
 
 	if (diff == 0)
 	{
-		return avContextTab[0]->pb->pos;
-	}
-
-	getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-
-	if (ffmpeg_buf_read < ffmpeg_buf_write)
-	{
-		rwdiff = ffmpeg_buf_write - ffmpeg_buf_read;
+		return pb->pos;
 	}
 
-	if (ffmpeg_buf_read > ffmpeg_buf_write)
-	{
-		rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-		rwdiff += ffmpeg_buf_write - ffmpeg_buf;
-	}
+	rwdiff = ffmpeg_buf_diff(b, b->read, buf_load(b->write));
 
 	if (diff > 0 && diff < rwdiff)
 	{
 		/* can do the seek inside the buffer */
 		ffmpeg_printf(20, "buffer-seek diff=%" PRId64 "\n", diff);
-		if (diff > (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read)
+		buf_store(b->read, ffmpeg_buf_advance(b, b->read, diff));
+		b->valid_size += diff;
+		if (b->valid_size > FILLBUFDIFF)
 		{
-			ffmpeg_buf_read = ffmpeg_buf + (diff - ((ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read));
-		}
-		else
-		{
-			ffmpeg_buf_read = ffmpeg_buf_read + diff;
+			b->valid_size = FILLBUFDIFF;
 		}
+		ffmpeg_buf_wakeup(b, &b->fillerSpaceCond, &b->fillerWriterWaiting);
 	}
-	else if (diff < 0 && diff * -1 < ffmpeg_buf_valid_size)
+	else if (diff < 0 && diff * -1 < b->valid_size)
 	{
-		/* can do the seek inside the buffer */
+		/* can do the seek inside the buffer, the filler does not
+		 * overwrite the last FILLBUFDIFF bytes read */
 		ffmpeg_printf(20, "buffer-seek diff=%" PRId64 "\n", diff);
-		int32_t tmpdiff = diff * -1;
-		if (tmpdiff > ffmpeg_buf_read - ffmpeg_buf)
-		{
-			ffmpeg_buf_read = (ffmpeg_buf + ffmpeg_buf_size) - (tmpdiff - (ffmpeg_buf_read - ffmpeg_buf));
-		}
-		else
-		{
-			ffmpeg_buf_read = ffmpeg_buf_read - tmpdiff;
-		}
+		b->valid_size += diff;
+		buf_store(b->read, ffmpeg_buf_advance(b, b->read, b->size + diff));
 	}
 	else
 	{
-		releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
 		ffmpeg_printf(20, "real-seek diff=%" PRId64 "\n", diff);
 
-		ffmpeg_do_seek_ret = 0;
-		ffmpeg_do_seek = diff;
-		while (ffmpeg_do_seek != 0)
+		if (b->hasfillerThreadStarted != 1)
 		{
-			usleep(100000);
+			ffmpeg_err("no filler thread for seek\n");
+			return AVERROR(EIO);
+		}
+
+		b->do_seek_ret = 0;
+		buf_store(b->do_seek, diff);
+		ffmpeg_buf_wakeup(b, &b->fillerSpaceCond, &b->fillerWriterWaiting);
+		while (buf_load(b->do_seek) != 0 && b->hasfillerThreadStarted == 1)
+		{
+			if (PlaybackDieNow(context, 0) != 0)
+			{
+				/* the filler stops, too */
+				return AVERROR_EXIT;
+			}
+			ffmpeg_buf_wait(context, b, &b->fillerDataCond, &b->fillerReaderWaiting, ffmpeg_buf_seek_done, 100);
 		}
 
-		ffmpeg_do_seek = 0;
-		if (ffmpeg_do_seek_ret < 0)
+		if (b->do_seek_ret < 0)
 		{
-			ffmpeg_err("seek not ok ret=%d\n", ffmpeg_do_seek_ret);
-			return ffmpeg_do_seek_ret;
+			ffmpeg_err("seek not ok ret=%d\n", b->do_seek_ret);
+			return b->do_seek_ret;
 		}
 
-		//fill buffer
-		int32_t count = ffmpeg_buf_seek_time * 10;
-		int32_t size = 0;
+		/* ffmpeg_read() waits for the first data */
+		return pb->pos + diff;
+	}
+
+	return pb->pos + diff;
+}
+
+static void ffmpeg_buf_reset(FFMPEGBuffer_t *b)
+{
+	b->read_org = NULL;
+	b->seek_org = NULL;
+	b->read = NULL;
+	b->write = NULL;
+	b->buf = NULL;
+	b->valid_size = 0;
+	b->error = 0;
+	b->paket = FILLBUFPAKET;
+	b->do_seek_ret = 0;
+	b->do_seek = 0;
+	b->stop = 0;
+	b->stalls = 0;
+	b->stall_time = 0;
+	b->full = 0;
+	b->total = 0;
+}
+
+static FFMPEGBuffer_t *ffmpeg_buf_create();
+
+static void ffmpeg_buf_free(FFMPEGContext_t *ff)
+{
+	FFMPEGBuffer_t *b = ff->buffer;
+
+	/* a filler thread that hangs in a read still writes into it,
+	 * leave it the old buffer and go on with a new one */
+	if (ffmpeg_stop_fillerTHREAD(ff) != 0)
+	{
+		FFMPEGBuffer_t *n = ffmpeg_buf_create();
 
-		container_get_fillbufstatus(&size);
-		while (size < ffmpeg_buf_size - FILLBUFDIFF && (--count) > 0)
+		if (n != NULL)
 		{
-			usleep(100000);
-			container_get_fillbufstatus(&size);
+			n->size = b->size;
+			getfillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+			if (b->hasfillerThreadStarted != 0)
+			{
+				b->abandoned = 1;
+				__atomic_add_fetch(&ff->abandonedFillers, 1, __ATOMIC_SEQ_CST);
+				ff->buffer = n;
+				n = NULL;
+			}
+			releasefillerMutex(b, __FILE__, __FUNCTION__, __LINE__);
+			if (n == NULL)
+			{
+				return;
+			}
+			/* it terminated in between */
+			ffmpeg_buf_destroy(n);
+		}
+		else
+		{
+			ffmpeg_err("filler thread hangs, buffer leaked\n");
+			ffmpeg_buf_reset(b);
+			return;
 		}
+	}
+
+	av_free(b->buf);
+	ffmpeg_buf_reset(b);
+}
 
-		return avContextTab[0]->pb->pos + diff;
+static FFMPEGBuffer_t *ffmpeg_buf_create()
+{
+	FFMPEGBuffer_t *b = calloc(1, sizeof(FFMPEGBuffer_t));
+
+	if (b == NULL)
+	{
+		return NULL;
 	}
 
-	releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
-	return avContextTab[0]->pb->pos + diff;
+	b->size = FILLBUFSIZE + FILLBUFDIFF;
+	b->paket = FILLBUFPAKET;
+	pthread_mutex_init(&b->fillermutex, NULL);
+	pthread_cond_init(&b->fillerDataCond, NULL);
+	pthread_cond_init(&b->fillerSpaceCond, NULL);
+	b->playPts = -1;
+	b->maxInjectedPTS = INVALID_PTS_VALUE;
+	return b;
 }
 
-static void ffmpeg_buf_free()
+/* only once the filler thread is gone */
+static void ffmpeg_buf_destroy(FFMPEGBuffer_t *b)
 {
-	ffmpeg_read_org = NULL;
-	ffmpeg_seek_org = NULL;
-	ffmpeg_buf_read = NULL;
-	ffmpeg_buf_write = NULL;
-	free(ffmpeg_buf);
-	ffmpeg_buf = NULL;
-	ffmpeg_buf_valid_size = 0;
-	ffmpeg_do_seek_ret = 0;
-	ffmpeg_do_seek = 0;
-	ffmpeg_buf_stop = 0;
-	hasfillerThreadStartedID = 0;
+	pthread_cond_destroy(&b->fillerSpaceCond);
+	pthread_cond_destroy(&b->fillerDataCond);
+	pthread_mutex_destroy(&b->fillermutex);
+	free(b);
 }
@@ -0,0 +1,646 @@
+/*
+ * Disk cache for progressive HTTP playback: a sparse file per URL plus
+ * a map of the byte ranges downloaded so far, so seeking back does not
+ * download the movie again.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <dirent.h>
+#include <linux/falloc.h>
+
+#define HTTP_CACHE_MAGIC 0x48435031	/* "HCP1" */
+#define HTTP_CACHE_DEFAULT_SIZE (1024LL * 1024 * 1024)
+/* cached ranges shorter than this are downloaded again instead of
+ * reconnecting twice to skip them */
+#define HTTP_CACHE_MIN_HIT (1024 * 1024)
+/* one background read into a gap while the buffer is full */
+#define HTTP_CACHE_FILL_READ (256 * 1024)
+
+typedef struct HttpCacheRange_s
+{
+	int64_t start;
+	int64_t end;
+	uint32_t used;		/* tick of the last read, for LRU */
+} HttpCacheRange_t;
+
+typedef struct HttpCache_s
+{
+	int fd;
+	char path[PATH_MAX];	/* without the .cache / .map suffix */
+	int64_t size;		/* of the stream */
+	int64_t pos;		/* next byte ffmpeg reads */
+	int64_t netPos;		/* next byte of the connection, -1 unknown */
+	HttpCacheRange_t *ranges;	/* sorted, neither overlapping nor adjacent */
+	uint32_t count;
+	uint32_t alloc;
+	uint32_t tick;
+	int64_t cached;		/* bytes in all ranges */
+	int8_t failed;		/* writing failed, only reading from now on */
+	uint8_t *fillBuf;
+	uint64_t hits;		/* bytes read from the disk */
+	int (*read_org)(void *opaque, uint8_t *buf, int buf_size);
+	int64_t (*seek_org)(void *opaque, int64_t offset, int whence);
+} HttpCache_t;
+
+static char *http_cache_dir = NULL;
+static int64_t http_cache_max = HTTP_CACHE_DEFAULT_SIZE;
+
+/* dir NULL disables the cache. max_size (bytes) caps the whole directory,
+ * the least recently used files and ranges are removed first */
+void ffmpeg_cache_set(const char *dir, int64_t max_size)
+{
+	free(http_cache_dir);
+	http_cache_dir = dir && dir[0] ? strdup(dir) : NULL;
+	http_cache_max = max_size > 0 ? max_size : HTTP_CACHE_DEFAULT_SIZE;
+}
+
+/* index of the range containing pos, else -1 and *next the first one
+ * behind pos (count if none) */
+static int32_t http_cache_find(HttpCache_t *c, int64_t pos, uint32_t *next)
+{
+	uint32_t lo = 0, hi = c->count;
+	while (lo < hi)
+	{
+		uint32_t mid = (lo + hi) / 2;
+		if (c->ranges[mid].end <= pos)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	if (next)
+	{
+		*next = lo;
+	}
+	if (lo < c->count && c->ranges[lo].start <= pos)
+	{
+		return lo;
+	}
+	return -1;
+}
+
+static void http_cache_add(HttpCache_t *c, int64_t start, int64_t end)
+{
+	uint32_t first, last;
+
+	/* all ranges touching [start, end) are merged into the first */
+	http_cache_find(c, start - 1, &first);
+	for (last = first; last < c->count && c->ranges[last].start <= end; last++)
+	{
+		if (c->ranges[last].start < start)
+		{
+			start = c->ranges[last].start;
+		}
+		if (c->ranges[last].end > end)
+		{
+			end = c->ranges[last].end;
+		}
+		c->cached -= c->ranges[last].end - c->ranges[last].start;
+	}
+
+	if (first == last)
+	{
+		if (c->count == c->alloc)
+		{
+			uint32_t alloc = c->alloc ? c->alloc * 2 : 64;
+			HttpCacheRange_t *r = realloc(c->ranges, alloc * sizeof(HttpCacheRange_t));
+			if (r == NULL)
+			{
+				return;
+			}
+			c->ranges = r;
+			c->alloc = alloc;
+		}
+		memmove(&c->ranges[first + 1], &c->ranges[first], (c->count - first) * sizeof(HttpCacheRange_t));
+		c->count++;
+	}
+	else if (last > first + 1)
+	{
+		memmove(&c->ranges[first + 1], &c->ranges[last], (c->count - last) * sizeof(HttpCacheRange_t));
+		c->count -= last - first - 1;
+	}
+
+	c->ranges[first].start = start;
+	c->ranges[first].end = end;
+	c->ranges[first].used = ++c->tick;
+	c->cached += end - start;
+}
+
+static void http_cache_drop(HttpCache_t *c, uint32_t i, int64_t start, int64_t end)
+{
+	HttpCacheRange_t *r = &c->ranges[i];
+
+	if (fallocate(c->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start) != 0)
+	{
+		/* e.g. FAT: the space can only be freed all at once */
+		ffmpeg_printf(10, "cannot punch hole (%s), clearing the cache\n", strerror(errno));
+		if (ftruncate(c->fd, 0) != 0)
+		{
+			ffmpeg_err("ftruncate %s: %s\n", c->path, strerror(errno));
+		}
+		c->count = 0;
+		c->cached = 0;
+		return;
+	}
+
+	c->cached -= end - start;
+	if (start == r->start && end == r->end)
+	{
+		memmove(r, r + 1, (c->count - i - 1) * sizeof(HttpCacheRange_t));
+		c->count--;
+	}
+	else if (start == r->start)
+	{
+		r->start = end;
+	}
+	else
+	{
+		r->end = start;
+	}
+}
+
+/* the size cap: least recently used ranges first, the one being read
+ * only before the read position */
+static void http_cache_evict(HttpCache_t *c)
+{
+	while (c->cached > http_cache_max && c->count > 0)
+	{
+		int32_t current = http_cache_find(c, c->pos, NULL);
+		int32_t lru = -1;
+		uint32_t i;
+
+		for (i = 0; i < c->count; i++)
+		{
+			if ((int32_t)i != current && (lru < 0 || c->ranges[i].used < c->ranges[lru].used))
+			{
+				lru = i;
+			}
+		}
+
+		if (lru >= 0)
+		{
+			http_cache_drop(c, lru, c->ranges[lru].start, c->ranges[lru].end);
+		}
+		else if (current >= 0 && c->ranges[current].start < c->pos)
+		{
+			http_cache_drop(c, current, c->ranges[current].start, c->pos);
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+static void http_cache_store(HttpCache_t *c, int64_t pos, const uint8_t *buf, int32_t len)
+{
+	if (c->failed)
+	{
+		return;
+	}
+
+	if (pwrite(c->fd, buf, len, pos) != len)
+	{
+		ffmpeg_err("write %s: %s, not caching anymore\n", c->path, strerror(errno));
+		c->failed = 1;
+		return;
+	}
+
+	http_cache_add(c, pos, pos + len);
+	http_cache_evict(c);
+}
+
+/* the files of other streams, oldest first, until this one has room */
+static void http_cache_trim_dir(HttpCache_t *c, const char *keep)
+{
+	typedef struct
+	{
+		char name[NAME_MAX + 1];
+		time_t mtime;
+		int64_t bytes;
+	} CacheFile_t;
+
+	DIR *dir = opendir(http_cache_dir);
+	CacheFile_t *files = NULL;
+	uint32_t count = 0, alloc = 0, i;
+	int64_t total = 0;
+	struct dirent *de;
+	char path[PATH_MAX];
+
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	while ((de = readdir(dir)) != NULL)
+	{
+		struct stat st;
+		size_t len = strlen(de->d_name);
+		if (len < 7 || strcmp(de->d_name + len - 6, ".cache") != 0 || strncmp(de->d_name, keep, len - 6) == 0)
+		{
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", http_cache_dir, de->d_name);
+		if (stat(path, &st) != 0)
+		{
+			continue;
+		}
+		if (count == alloc)
+		{
+			alloc = alloc ? alloc * 2 : 16;
+			CacheFile_t *f = realloc(files, alloc * sizeof(CacheFile_t));
+			if (f == NULL)
+			{
+				break;
+			}
+			files = f;
+		}
+		strncpy(files[count].name, de->d_name, NAME_MAX);
+		files[count].name[NAME_MAX] = '\0';
+		files[count].mtime = st.st_mtime;
+		files[count].bytes = (int64_t)st.st_blocks * 512;
+		total += files[count].bytes;
+		count++;
+	}
+	closedir(dir);
+
+	while (total > http_cache_max - c->cached && count > 0)
+	{
+		uint32_t oldest = 0;
+		for (i = 1; i < count; i++)
+		{
+			if (files[i].mtime < files[oldest].mtime)
+			{
+				oldest = i;
+			}
+		}
+		snprintf(path, sizeof(path), "%s/%s", http_cache_dir, files[oldest].name);
+		ffmpeg_printf(10, "removing %s\n", path);
+		unlink(path);
+		strcpy(path + strlen(path) - 6, ".map");
+		unlink(path);
+		total -= files[oldest].bytes;
+		files[oldest] = files[--count];
+	}
+	free(files);
+}
+
+/* the ranges of an earlier playback, if the stream did not change */
+static void http_cache_load_map(HttpCache_t *c)
+{
+	char path[PATH_MAX];
+	uint32_t head[2];
+	int64_t size, r[2];
+
+	if (snprintf(path, sizeof(path), "%s.map", c->path) >= (int)sizeof(path))
+	{
+		return;
+	}
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+	{
+		return;
+	}
+
+	if (fread(head, sizeof(head), 1, f) == 1 && head[0] == HTTP_CACHE_MAGIC &&
+		fread(&size, sizeof(size), 1, f) == 1 && size == c->size)
+	{
+		uint32_t i;
+		for (i = 0; i < head[1] && fread(r, sizeof(r), 1, f) == 1; i++)
+		{
+			if (r[0] >= 0 && r[0] < r[1] && r[1] <= size)
+			{
+				http_cache_add(c, r[0], r[1]);
+			}
+		}
+		ffmpeg_printf(10, "%s: %d ranges, %" PRId64 " bytes cached\n", path, c->count, c->cached);
+	}
+	fclose(f);
+
+	if (c->count == 0 && ftruncate(c->fd, 0) != 0)
+	{
+		ffmpeg_err("ftruncate %s: %s\n", c->path, strerror(errno));
+	}
+}
+
+static void http_cache_save_map(HttpCache_t *c)
+{
+	char path[PATH_MAX];
+	uint32_t head[2] = { HTTP_CACHE_MAGIC, c->count };
+	uint32_t i;
+
+	if (snprintf(path, sizeof(path), "%s.map", c->path) >= (int)sizeof(path))
+	{
+		return;
+	}
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+	{
+		ffmpeg_err("%s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	fwrite(head, sizeof(head), 1, f);
+	fwrite(&c->size, sizeof(c->size), 1, f);
+	for (i = 0; i < c->count; i++)
+	{
+		int64_t r[2] = { c->ranges[i].start, c->ranges[i].end };
+		fwrite(r, sizeof(r), 1, f);
+	}
+	if (fclose(f) != 0)
+	{
+		ffmpeg_err("%s: %s\n", path, strerror(errno));
+	}
+}
+
+static int ffmpeg_cache_read(void *opaque, uint8_t *buf, int buf_size)
+{
+	FFMPEGContext_t *ff = ffmpeg_io_context(opaque);
+	HttpCache_t *c;
+	uint32_t next;
+	int32_t i;
+	int len;
+
+	if (ff == NULL)
+	{
+		return AVERROR(EIO);
+	}
+	c = ff->cache;
+	i = http_cache_find(c, c->pos, &next);
+
+	/* from the disk, unless the connection is right here anyway and
+	 * the cached range is short */
+	if (i >= 0 && (c->netPos != c->pos || c->ranges[i].end - c->pos >= HTTP_CACHE_MIN_HIT))
+	{
+		len = buf_size;
+		if (len > c->ranges[i].end - c->pos)
+		{
+			len = c->ranges[i].end - c->pos;
+		}
+		len = pread(c->fd, buf, len, c->pos);
+		if (len > 0)
+		{
+			c->pos += len;
+			c->ranges[i].used = ++c->tick;
+			c->hits += len;
+			return len;
+		}
+		ffmpeg_err("read %s: %s\n", c->path, strerror(errno));
+	}
+
+	if (c->netPos != c->pos)
+	{
+		int64_t ret = c->seek_org(opaque, c->pos, SEEK_SET);
+		if (ret < 0)
+		{
+			c->netPos = -1;
+			return ret;
+		}
+		c->netPos = c->pos;
+	}
+
+	/* stop in front of the next range worth reading from the disk */
+	len = buf_size;
+	if (i < 0 && next < c->count && c->ranges[next].end - c->ranges[next].start >= HTTP_CACHE_MIN_HIT &&
+		c->ranges[next].start - c->pos < len)
+	{
+		len = c->ranges[next].start - c->pos;
+	}
+
+	len = c->read_org(opaque, buf, len);
+	if (len > 0)
+	{
+		http_cache_store(c, c->pos, buf, len);
+		c->pos += len;
+		c->netPos += len;
+	}
+	return len;
+}
+
+/* only moves the read position, the connection follows on demand */
+static int64_t ffmpeg_cache_seek(void *opaque, int64_t offset, int whence)
+{
+	FFMPEGContext_t *ff = ffmpeg_io_context(opaque);
+	HttpCache_t *c;
+
+	if (ff == NULL)
+	{
+		return AVERROR(EIO);
+	}
+	c = ff->cache;
+
+	if (whence & AVSEEK_SIZE)
+	{
+		return c->size;
+	}
+
+	switch (whence & ~AVSEEK_FORCE)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			offset += c->pos;
+			break;
+		case SEEK_END:
+			offset += c->size;
+			break;
+		default:
+			return AVERROR(EINVAL);
+	}
+
+	if (offset < 0 || offset > c->size)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	c->pos = offset;
+	return offset;
+}
+
+/* called by the filler while the RAM buffer is full: downloads the gap
+ * after the read position, at the end of the stream the first gap from
+ * the start. 0 if there was nothing to do */
+static int32_t ffmpeg_cache_idle(HttpCache_t *c, void *opaque)
+{
+	int64_t gap = c->pos;
+	uint32_t next;
+	int32_t i;
+
+	if (c->fd < 0 || c->failed || c->cached + HTTP_CACHE_FILL_READ > http_cache_max)
+	{
+		return 0;
+	}
+
+	i = http_cache_find(c, gap, &next);
+	if (i >= 0)
+	{
+		gap = c->ranges[i].end;
+		next = i + 1;
+	}
+	if (gap >= c->size)
+	{
+		if (c->count == 0 || c->ranges[0].start > 0)
+		{
+			gap = 0;
+			next = 0;
+		}
+		else if (c->ranges[0].end < c->size)
+		{
+			gap = c->ranges[0].end;
+			next = 1;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	int32_t len = HTTP_CACHE_FILL_READ;
+	int64_t end = next < c->count ? c->ranges[next].start : c->size;
+	if (len > end - gap)
+	{
+		len = end - gap;
+	}
+
+	if (c->netPos != gap)
+	{
+		if (c->seek_org(opaque, gap, SEEK_SET) < 0)
+		{
+			c->netPos = -1;
+			return 0;
+		}
+		c->netPos = gap;
+	}
+
+	len = c->read_org(opaque, c->fillBuf, len);
+	if (len <= 0)
+	{
+		c->netPos = -1;
+		return 0;
+	}
+
+	http_cache_store(c, gap, c->fillBuf, len);
+	c->netPos += len;
+	return 1;
+}
+
+/* puts the cache between ffmpeg and the network for progressive HTTP
+ * streams of known size */
+static void ffmpeg_cache_open(HttpCache_t *c, const char *filename, AVIOContext *pb)
+{
+	const char *dir = http_cache_dir ? http_cache_dir : getenv("HAL_HTTP_CACHE");
+	char path[PATH_MAX];
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const char *p;
+
+	if (dir == NULL || c->fd >= 0 || pb->seek == NULL ||
+		(strncmp(filename, "http://", 7) != 0 && strncmp(filename, "https://", 8) != 0) ||
+		strstr(filename, ".m3u8") || strstr(filename, ".mpd"))
+	{
+		return;
+	}
+
+	int64_t size = pb->seek(pb->opaque, 0, AVSEEK_SIZE);
+	if (size <= 0)
+	{
+		ffmpeg_printf(10, "size unknown, not caching\n");
+		return;
+	}
+
+	if (http_cache_dir == NULL)
+	{
+		http_cache_dir = strdup(dir);
+	}
+
+	/* FNV-1a of the URL */
+	for (p = filename; *p; p++)
+	{
+		hash = (hash ^ (uint8_t)*p) * 0x100000001b3ULL;
+	}
+	if (snprintf(c->path, sizeof(c->path), "%s/%016" PRIx64, http_cache_dir, hash) >= (int)sizeof(c->path) ||
+		snprintf(path, sizeof(path), "%s.cache", c->path) >= (int)sizeof(path))
+	{
+		ffmpeg_err("cache directory name too long\n");
+		c->path[0] = '\0';
+		return;
+	}
+
+	c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	c->fillBuf = malloc(HTTP_CACHE_FILL_READ);
+	if (c->fd < 0 || c->fillBuf == NULL)
+	{
+		ffmpeg_err("%s: %s\n", path, strerror(errno));
+		if (c->fd >= 0)
+		{
+			close(c->fd);
+		}
+		free(c->fillBuf);
+		memset(c, 0, sizeof(*c));
+		c->fd = -1;
+		return;
+	}
+	/* for the LRU order of the files */
+	futimens(c->fd, NULL);
+
+	c->size = size;
+	c->pos = pb->pos;
+	c->netPos = pb->pos;
+	http_cache_load_map(c);
+	http_cache_trim_dir(c, strrchr(c->path, '/') + 1);
+
+	c->read_org = pb->read_packet;
+	c->seek_org = pb->seek;
+	pb->read_packet = ffmpeg_cache_read;
+	pb->seek = ffmpeg_cache_seek;
+
+	ffmpeg_printf(10, "caching %s in %s\n", filename, path);
+}
+
+static void ffmpeg_cache_status(HttpCache_t *c, ContainerBufferStatus_t *status)
+{
+	status->cacheSize = c->cached;
+	status->cacheHits = c->hits;
+}
+
+static void ffmpeg_cache_close(HttpCache_t *c)
+{
+	if (c->fd < 0)
+	{
+		return;
+	}
+
+	http_cache_save_map(c);
+	close(c->fd);
+	free(c->ranges);
+	free(c->fillBuf);
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+}
+
+static HttpCache_t *ffmpeg_cache_create()
+{
+	HttpCache_t *c = calloc(1, sizeof(HttpCache_t));
+
+	if (c != NULL)
+	{
+		c->fd = -1;
+	}
+	return c;
+}
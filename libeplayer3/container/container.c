@@ -105,6 +105,13 @@ static int Command(Context_t *context, ContainerCmd_t command, void *argument __
 		}
 		case CONTAINER_DEL:
 		{
+			int i;
+
+			/* the containers drop what they keep for the context */
+			for (i = 0; AvailableContainer[i] != NULL; i++)
+			{
+				AvailableContainer[i]->Command(context, CONTAINER_DEL, NULL);
+			}
 			context->container->selectedContainer = NULL;
 			break;
 		}
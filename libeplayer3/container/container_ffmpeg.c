@@ -21,6 +21,10 @@
 
 /* Support Large File */
 #define _FILE_OFFSET_BITS 64
+/* fallocate() for the disk cache */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 
 /* ***************************** */
 /* Includes                      */
@@ -37,6 +41,7 @@
 #include <string.h>
 
 #include <sys/stat.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/poll.h>
@@ -83,44 +88,73 @@
 /* ***************************** */
 typedef enum {RTMP_NATIVE, RTMP_LIBRTMP, RTMP_NONE} eRTMPProtoImplType;
 
-/* ***************************** */
-/* Variables                     */
-/* ***************************** */
+/* The state of one playback, context->ffmpeg. Created by the first
+ * command for it and freed by CONTAINER_DEL, see ffmpeg_context_create().
+ * The parts below are kept by the files included further down. */
+typedef struct FFMPEGContext_s
+{
+	Context_t *context;
+
+	pthread_mutex_t mutex;
+
+	pthread_t PlayThread;
+	int32_t hasPlayThreadStarted;
+	/* until FFMPEGThread is done with this, it still runs after it
+	 * cleared hasPlayThreadStarted */
+	int32_t playThreadRunning;
+	int32_t terminating;
+
+	AVFormatContext *avContextTab[IPTV_AV_CONTEXT_MAX_NUM];
+	int32_t use_custom_io[IPTV_AV_CONTEXT_MAX_NUM];
+	struct CustomIOCtx_t *custom_io_tab[IPTV_AV_CONTEXT_MAX_NUM];
+	AVDictionary *avio_opts;
 
-static pthread_mutex_t mutex;
+	int64_t latestPts;
 
-static pthread_t PlayThread;
-static int32_t hasPlayThreadStarted = 0;
+	int32_t restart_audio_resampling;
 
-static AVFormatContext *avContextTab[IPTV_AV_CONTEXT_MAX_NUM] = {NULL, NULL};
-static int32_t use_custom_io[IPTV_AV_CONTEXT_MAX_NUM] = {0, 0};
-static AVDictionary *g_avio_opts = NULL;
+	off_t seek_target_bytes;
+	int32_t do_seek_target_bytes;
 
-static int64_t latestPts = 0;
+	int64_t seek_target_seconds;
+	int8_t do_seek_target_seconds;
+	int64_t prev_seek_time_sec;
 
-static int32_t restart_audio_resampling = 0;
+	int32_t seek_target_flag;
 
-static off_t seek_target_bytes = 0;
-static int32_t do_seek_target_bytes = 0;
+	struct HttpCache_s *cache;
+	struct CodecCtxStoreItem_s *codecCtxStore;
+	struct PacketQueues_s *queues;
+	struct FFMPEGBuffer_s *buffer;
+	/* filler threads left hanging with their buffer, see ffmpeg_buf_free() */
+	int32_t abandonedFillers;
+	struct TsIndex_s *index;
 
-static int64_t seek_target_seconds = 0;
-static int8_t do_seek_target_seconds = 0;
-static int64_t prev_seek_time_sec = -1;
+	/* pb->opaque of the inputs while their AVIO callbacks are
+	 * wrapped, see ffmpeg_io_context() */
+	void *ioOpaque[IPTV_AV_CONTEXT_MAX_NUM];
+	struct FFMPEGContext_s *ioNext;
+} FFMPEGContext_t;
 
-static int32_t seek_target_flag = 0;
+/* ***************************** */
+/* Variables                     */
+/* ***************************** */
 
-static int32_t mutexInitialized = 0;
+/* the playbacks with wrapped AVIO callbacks */
+static pthread_mutex_t ioContextsMutex = PTHREAD_MUTEX_INITIALIZER;
+static FFMPEGContext_t *ioContexts = NULL;
 
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
-static int32_t container_ffmpeg_seek_bytes(off_t pos);
+static int32_t container_ffmpeg_seek_bytes(FFMPEGContext_t *ff, off_t pos);
 static int32_t container_ffmpeg_seek(Context_t *context, int64_t sec, uint8_t absolute);
 static int32_t container_ffmpeg_get_length(Context_t *context, int64_t *length);
-static int64_t calcPts(uint32_t avContextIdx, AVStream *stream, int64_t pts);
+static int64_t calcPts(FFMPEGContext_t *ff, uint32_t avContextIdx, AVStream *stream, int64_t pts);
 static int64_t doCalcPts(int64_t start_time, const AVRational time_base, int64_t pts);
-void LinuxDvbBuffSetStamp(void *stamp);
+void LinuxDvbBuffSetStamp(Context_t *context, void *stamp);
 static int32_t container_ffmpeg_stop(Context_t *context);
+static FFMPEGContext_t *ffmpeg_context_create(Context_t *context);
 
 static char *g_graphic_sub_path;
 
@@ -157,29 +191,18 @@ void progressive_playback_set(int32_t val)
 	progressive_playback = val;
 }
 
-static void initMutex(void)
-{
-	pthread_mutex_init(&mutex, NULL);
-	mutexInitialized = 1;
-}
-
-static void getMutex(const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int32_t line __attribute__((unused)))
+static void getMutex(FFMPEGContext_t *ff, const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int32_t line __attribute__((unused)))
 {
 	ffmpeg_printf(100, "::%d requesting mutex\n", line);
 
-	if (!mutexInitialized)
-	{
-		initMutex();
-	}
-
-	pthread_mutex_lock(&mutex);
+	pthread_mutex_lock(&ff->mutex);
 
 	ffmpeg_printf(100, "::%d received mutex\n", line);
 }
 
-static void releaseMutex(const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int32_t line __attribute__((unused)))
+static void releaseMutex(FFMPEGContext_t *ff, const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int32_t line __attribute__((unused)))
 {
-	pthread_mutex_unlock(&mutex);
+	pthread_mutex_unlock(&ff->mutex);
 
 	ffmpeg_printf(100, "::%d released mutex\n", line);
 }
@@ -192,14 +215,86 @@ static int32_t Write(Write_FN WriteFun, Context_t *context, void *privateData, i
 	 * avformat structures, during write time
 	 */
 	int32_t ret = 0;
-	releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+	releaseMutex(context->ffmpeg, __FILE__, __FUNCTION__, __LINE__);
 	ret = WriteFun(context, privateData);
-	getMutex(__FILE__, __FUNCTION__, __LINE__);
+	getMutex(context->ffmpeg, __FILE__, __FUNCTION__, __LINE__);
 	return ret;
 }
 
-#include "buff_ffmpeg.c"
+/* the wrapped AVIO callbacks only get the opaque of their input */
+static FFMPEGContext_t *ffmpeg_io_context(void *opaque)
+{
+	FFMPEGContext_t *ff;
+	int32_t i;
+
+	if (opaque == NULL)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&ioContextsMutex);
+	for (ff = ioContexts; ff != NULL; ff = ff->ioNext)
+	{
+		for (i = 0; i < IPTV_AV_CONTEXT_MAX_NUM; i++)
+		{
+			if (ff->ioOpaque[i] == opaque)
+			{
+				break;
+			}
+		}
+		if (i < IPTV_AV_CONTEXT_MAX_NUM)
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ioContextsMutex);
+
+	return ff;
+}
+
+static void ffmpeg_io_register(FFMPEGContext_t *ff, int32_t AVIdx, void *opaque)
+{
+	FFMPEGContext_t *p;
+
+	pthread_mutex_lock(&ioContextsMutex);
+	ff->ioOpaque[AVIdx] = opaque;
+	for (p = ioContexts; p != NULL; p = p->ioNext)
+	{
+		if (p == ff)
+		{
+			break;
+		}
+	}
+	if (p == NULL)
+	{
+		ff->ioNext = ioContexts;
+		ioContexts = ff;
+	}
+	pthread_mutex_unlock(&ioContextsMutex);
+}
+
+static void ffmpeg_io_unregister(FFMPEGContext_t *ff)
+{
+	FFMPEGContext_t **p;
+
+	pthread_mutex_lock(&ioContextsMutex);
+	for (p = &ioContexts; *p != NULL; p = &(*p)->ioNext)
+	{
+		if (*p == ff)
+		{
+			*p = ff->ioNext;
+			break;
+		}
+	}
+	memset(ff->ioOpaque, 0, sizeof(ff->ioOpaque));
+	ff->ioNext = NULL;
+	pthread_mutex_unlock(&ioContextsMutex);
+}
+
+#include "cache_ffmpeg.c"
 #include "wrapped_ffmpeg.c"
+#include "queue_ffmpeg.c"
+#include "buff_ffmpeg.c"
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
 #include "mpeg4p2_ffmpeg.c"
 #endif
@@ -208,6 +303,9 @@ static int32_t Write(Write_FN WriteFun, Context_t *context, void *privateData, i
 #include "flv2mpeg4_ffmpeg.c"
 #endif
 
+#include "index_ffmpeg.c"
+#include "ts_ring.h"
+
 /* This is also bad solution
  * such configuration should passed maybe
  * via struct
@@ -330,9 +428,15 @@ void flv2mpeg4_converter_set(const int32_t val)
 	flv2mpeg4_converter = val;
 }
 
-int32_t ffmpeg_av_dict_set(const char *key, const char *value, int32_t flags)
+int32_t ffmpeg_av_dict_set(Context_t *context, const char *key, const char *value, int32_t flags)
 {
-	return av_dict_set(&g_avio_opts, key, value, flags);
+	FFMPEGContext_t *ff = ffmpeg_context_create(context);
+
+	if (ff == NULL)
+	{
+		return AVERROR(ENOMEM);
+	}
+	return av_dict_set(&ff->avio_opts, key, value, flags);
 }
 
 static char *Codec2Encoding(int32_t codec_id, int32_t media_type, uint8_t *extradata, int extradata_size, int profile __attribute__((unused)), int32_t *version)
@@ -540,7 +644,7 @@ static int64_t doCalcPts(int64_t start_time, const AVRational time_base, int64_t
 	return pts;
 }
 
-static int64_t calcPts(uint32_t avContextIdx, AVStream *stream, int64_t pts)
+static int64_t calcPts(FFMPEGContext_t *ff, uint32_t avContextIdx, AVStream *stream, int64_t pts)
 {
 	if (!stream || pts == (int64_t)AV_NOPTS_VALUE)
 	{
@@ -548,7 +652,19 @@ static int64_t calcPts(uint32_t avContextIdx, AVStream *stream, int64_t pts)
 		return INVALID_PTS_VALUE;
 	}
 
-	return doCalcPts(avContextTab[avContextIdx]->start_time, stream->time_base, pts);
+	return doCalcPts(ff->avContextTab[avContextIdx]->start_time, stream->time_base, pts);
+}
+
+/* the decoding time of a packet, or the presentation time without it */
+static int64_t calcDts(FFMPEGContext_t *ff, uint32_t avContextIdx, AVPacket *packet)
+{
+	int64_t dts = packet->dts != (int64_t)AV_NOPTS_VALUE ? packet->dts : packet->pts;
+	if (dts == (int64_t)AV_NOPTS_VALUE)
+	{
+		return INVALID_PTS_VALUE;
+	}
+
+	return calcPts(ff, avContextIdx, ff->avContextTab[avContextIdx]->streams[packet->stream_index], dts);
 }
 
 /* search for metatdata in context and stream
@@ -590,13 +706,16 @@ static char *searchMeta(void *metadata, char *ourTag)
 /* Worker Thread                */
 /* **************************** */
 
-static void FFMPEGThread(Context_t *context)
+/* writes what FFMPEGThread queued to the decoders */
+static void FFMPEGInjectThread(Context_t *context)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	char threadname[17];
 	strncpy(threadname, __func__, sizeof(threadname));
 	threadname[16] = 0;
 	prctl(PR_SET_NAME, (unsigned long)&threadname);
 	AVPacket packet;
+	PacketQueueNode_t *node;
 
 	int64_t currentVideoPts = -1;
 	int64_t currentAudioPts = -1;
@@ -607,21 +726,14 @@ static void FFMPEGThread(Context_t *context)
 	int64_t lastVideoDts = -1;
 	int64_t lastAudioDts = -1;
 
-	int64_t multiContextLastPts[IPTV_AV_CONTEXT_MAX_NUM] = {INVALID_PTS_VALUE, INVALID_PTS_VALUE};
-
-	int64_t showtime = 0;
-	int64_t bofcount = 0;
 	AudioVideoOut_t avOut;
 
-	g_context = context;
-
 	SwrContext *swr = NULL;
 	AVFrame *decoded_frame = NULL;
 	int32_t out_sample_rate = 44100;
 	int32_t out_channels = 2;
 	uint64_t out_channel_layout = AV_CH_LAYOUT_STEREO;
-	uint32_t cAVIdx = 0;
-	void *stamp = 0;
+	uint32_t serial = ffmpeg_queue_serial(ff->queues);
 
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
 #ifdef __sh__
@@ -634,716 +746,888 @@ static void FFMPEGThread(Context_t *context)
 	Flv2Mpeg4Context flv2mpeg4_context;
 	memset(&flv2mpeg4_context, 0, sizeof(Flv2Mpeg4Context));
 #endif
-	ffmpeg_printf(10, "\n");
-
-	while (context->playback->isCreationPhase)
-	{
-		ffmpeg_printf(10, "Thread waiting for end of init phase...\n");
-		usleep(1000);
-	}
-	ffmpeg_printf(10, "Running!\n");
 
 	uint32_t bufferSize = 0;
 	context->output->Command(context, OUTPUT_GET_BUFFER_SIZE, &bufferSize);
 	ffmpeg_printf(10, "bufferSize [%u]\n", bufferSize);
 
-	int8_t isWaitingForFinish = 0;
-
-	while (context && context->playback && context->playback->isPlaying)
+	while ((node = ffmpeg_queue_get(context)) != NULL)
 	{
-		/* When user press PAUSE we call pause on AUDIO and VIDEO decoders,
-		 * we will not wait here because we can still fill
-		 * DVB drivers buffers at PAUSE time
-		 *
-		 */
+		uint32_t cAVIdx = node->avIdx;
+		int32_t pid = node->pid;
+		void *stamp = node->stamp;
+		uint32_t nodeSerial = node->serial;
+		wrapped_packet_move_ref(&packet, &node->packet);
+		free(node);
+
 #ifdef __sh__
 		/* ST DVB drivers skip data if they are written during pause
 		 * so, we must wait here if there is not buffering queue
 		 */
-		if (bufferSize == 0 && context->playback->isPaused)
+		while (bufferSize == 0 && context->playback->isPaused && context->playback->isPlaying && PlaybackDieNow(context, 0) == 0)
 		{
 			ffmpeg_printf(20, "paused\n");
-			reset_finish_timeout();
 			usleep(10000);
-			continue;
 		}
 #endif
 
-		if (context->playback->isSeeking)
+		getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+
+		/* read before a seek, the decoders were cleared for it */
+		if (nodeSerial != ffmpeg_queue_serial(ff->queues) || stamp != context->playback->stamp)
 		{
-			ffmpeg_printf(10, "seeking\n");
-			reset_finish_timeout();
-			usleep(10000);
+			wrapped_packet_unref(&packet);
+			releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 			continue;
 		}
 
-		getMutex(__FILE__, __FUNCTION__, __LINE__);
-
-		if (!context->playback || !context->playback->isPlaying)
+		if (nodeSerial != serial)
 		{
-			releaseMutex(__FILE__, __FUNCTION__, __LINE__);
-			if (!isWaitingForFinish)
-			{
-				reset_finish_timeout();
-			}
-			continue;
+			serial = nodeSerial;
+			currentVideoPts = -1;
+			currentAudioPts = -1;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
+			mpeg4p2_context_reset(mpeg4p2_context);
+#endif
+#ifdef HAVE_FLV2MPEG4_CONVERTER
+			flv2mpeg4_context_reset(&flv2mpeg4_context);
+#endif
 		}
 
-		if (context->playback->BackWard && av_gettime() >= showtime)
+		if (bufferSize > 0)
 		{
-			context->output->Command(context, OUTPUT_CLEAR, "video");
-
-			if (bofcount == 1)
-			{
-				showtime = av_gettime();
-				usleep(100000);
-				continue;
-			}
+			LinuxDvbBuffSetStamp(context, stamp);
+		}
 
-			if (avContextTab[0]->iformat->flags & AVFMT_TS_DISCONT)
-			{
-				off_t pos = avio_tell(avContextTab[0]->pb);
+		int64_t pts            = 0;
+		int64_t dts            = 0;
+		Track_t *videoTrack    = NULL;
+		Track_t *audioTrack    = NULL;
 
-				if (pos > 0)
-				{
-					float br;
-					if (avContextTab[0]->bit_rate)
-						br = avContextTab[0]->bit_rate / 8.0;
-					else
-						br = 180000.0;
-					seek_target_bytes = (double)pos + (double)context->playback->Speed * 8.0 * br;
-					if (seek_target_bytes < 0)
-						seek_target_bytes = 1;
-					do_seek_target_bytes = 1;
-				}
-			}
-			else
-			{
-				int64_t currPts = -1;
-				context->playback->Command(context, PLAYBACK_PTS, &currPts);
-				seek_target_seconds = ((double)currPts / 90000.0 + context->playback->Speed) * AV_TIME_BASE;
-				if (seek_target_seconds < 0)
-					seek_target_seconds = AV_TIME_BASE;
-				do_seek_target_seconds = 1;
-			}
-			showtime = av_gettime() + 300000;   //jump back every 300ms
+		if (context->manager->video->Command(context, MANAGER_GET_TRACK, &videoTrack) < 0)
+		{
+			ffmpeg_err("error getting video track\n");
 		}
-		else
+
+		if (context->manager->audio->Command(context, MANAGER_GET_TRACK, &audioTrack) < 0)
 		{
-			bofcount = 0;
+			ffmpeg_err("error getting audio track\n");
 		}
 
-		if (do_seek_target_seconds || do_seek_target_bytes)
+		if (videoTrack && (videoTrack->AVIdx == (int)cAVIdx) && (videoTrack->Id == pid))
 		{
-			int res = -1;
-			isWaitingForFinish = 0;
-			if (do_seek_target_seconds)
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
+			AVCodecContext *codec_context = videoTrack->avCodecCtx;
+			if (codec_context && codec_context->codec_id == AV_CODEC_ID_MPEG4 && NULL != mpeg4p2_context)
 			{
-				ffmpeg_printf(10, "seek_target_seconds[%" PRId64 "]\n", seek_target_seconds);
-				uint32_t i = 0;
-				for (; i < IPTV_AV_CONTEXT_MAX_NUM; i += 1)
+				mpeg4p2_write_packet(context, mpeg4p2_context, videoTrack, cAVIdx, &currentVideoPts, &ff->latestPts, &packet);
+				update_max_injected_pts(ff, ff->latestPts);
+			}
+			else
+#endif
+#ifdef HAVE_FLV2MPEG4_CONVERTER
+				if (get_codecpar(ff->avContextTab[cAVIdx]->streams[packet.stream_index])->codec_id == AV_CODEC_ID_FLV1 && memcmp(videoTrack->Encoding, "V_MPEG4", 7) == 0)
 				{
-					multiContextLastPts[i] = INVALID_PTS_VALUE;
-					if (NULL != avContextTab[i])
+					flv2mpeg4_write_packet(context, &flv2mpeg4_context, videoTrack, cAVIdx, &currentVideoPts, &ff->latestPts, &packet);
+					update_max_injected_pts(ff, ff->latestPts);
+				}
+				else
+#endif
+				{
+					bool skipPacket = false;
+					currentVideoPts = videoTrack->pts = pts = calcPts(ff, cAVIdx, videoTrack->stream, packet.pts);
+					videoTrack->dts = dts = calcPts(ff, cAVIdx, videoTrack->stream, packet.dts);
+
+					if ((currentVideoPts != INVALID_PTS_VALUE) && (currentVideoPts > ff->latestPts))
 					{
-						if (i == 1)
+						ff->latestPts = currentVideoPts;
+						update_max_injected_pts(ff, ff->latestPts);
+					}
+
+					if (context->playback->isTSLiveMode)
+					{
+						if (dts != INVALID_PTS_VALUE)
 						{
-							prev_seek_time_sec = seek_target_seconds;
+							if (dts > lastVideoDts)
+							{
+								lastVideoDts = dts;
+							}
+							else
+							{
+								// skip already injected VIDEO packet
+								ffmpeg_printf(200, "skip already injected VIDEO packet\n");
+								skipPacket = true;
+							}
 						}
-						if (avContextTab[i]->start_time != AV_NOPTS_VALUE)
+						else
 						{
-							seek_target_seconds += avContextTab[i]->start_time;
+							// skip VIDEO packet with unknown DTS
+							ffmpeg_printf(200, "skip VIDEO packet with unknown DTS\n");
+							skipPacket = true;
 						}
-						res = avformat_seek_file(avContextTab[i], -1, INT64_MIN, seek_target_seconds, INT64_MAX, 0);
-						if (res < 0 && context->playback->BackWard)
-							bofcount = 1;
 					}
-					else
+
+					if (context->playback->BackWard && ff->index->trickPos >= 0)
 					{
-						break;
+						/* index trick play: only the keyframe we jumped to */
+						skipPacket = !ff->index->trickFrame;
+						ff->index->trickFrame = 0;
 					}
-				}
-				reset_finish_timeout();
-			}
-			else
-			{
-				container_ffmpeg_seek_bytes(seek_target_bytes);
-			}
-			do_seek_target_seconds = 0;
-			do_seek_target_bytes = 0;
 
-			restart_audio_resampling = 1;
-			currentVideoPts = -1;
-			currentAudioPts = -1;
-			latestPts = 0;
-			seek_target_flag = 0;
+					if (skipPacket)
+					{
+						wrapped_packet_unref(&packet);
+						releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+						continue;
+					}
 
-			// flush streams
-			uint32_t i = 0;
-			for (i = 0; i < IPTV_AV_CONTEXT_MAX_NUM; i += 1)
-			{
-				if (NULL != avContextTab[i])
-				{
-					if (i != 1)
+					ffmpeg_printf(200, "VideoTrack index = %d %" PRId64 "\n", pid, currentVideoPts);
+
+					avOut.data       = packet.data;
+					avOut.len        = packet.size;
+					avOut.pts        = pts;
+					avOut.dts        = dts;
+					avOut.extradata  = videoTrack->extraData;
+					avOut.extralen   = videoTrack->extraSize;
+					avOut.frameRate  = videoTrack->frame_rate;
+					avOut.timeScale  = videoTrack->TimeScale;
+					avOut.width      = videoTrack->width;
+					avOut.height     = videoTrack->height;
+					avOut.type       = "video";
+					avOut.track      = videoTrack;
+					avOut.infoFlags  = 0;
+
+					if (ff->avContextTab[cAVIdx]->iformat->flags & AVFMT_TS_DISCONT)
 					{
-						wrapped_avcodec_flush_buffers(i);
+						avOut.infoFlags = 1; // TS container
+					}
+
+					if (Write(context->output->video->Write, context, &avOut, pts) < 0)
+					{
+						ffmpeg_err("writing data to video device failed\n");
 					}
 				}
-				else
-				{
-					break;
-				}
-			}
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
-			mpeg4p2_context_reset(mpeg4p2_context);
-#endif
-#ifdef HAVE_FLV2MPEG4_CONVERTER
-			flv2mpeg4_context_reset(&flv2mpeg4_context);
-#endif
 		}
-
-		int ffmpegStatus = 0;
-		if (!isWaitingForFinish)
+		else if (audioTrack && (audioTrack->AVIdx == (int)cAVIdx) && (audioTrack->Id == pid))
 		{
-			if (NULL != avContextTab[1])
+			uint8_t skipPacket = 0;
+			currentAudioPts = audioTrack->pts = pts = calcPts(ff, cAVIdx, audioTrack->stream, packet.pts);
+			dts = calcPts(ff, cAVIdx, audioTrack->stream, packet.dts);
+
+			if ((currentAudioPts != INVALID_PTS_VALUE) && (currentAudioPts > ff->latestPts) && (!videoTrack))
+			{
+				ff->latestPts = currentAudioPts;
+				update_max_injected_pts(ff, ff->latestPts);
+			}
+
+			if (context->playback->isTSLiveMode)
 			{
-				if (prev_seek_time_sec >= 0)
+				if (dts != INVALID_PTS_VALUE)
 				{
-					if (multiContextLastPts[0] != INVALID_PTS_VALUE)
+					if (dts > lastAudioDts)
 					{
-						int64_t target = av_rescale(multiContextLastPts[0], AV_TIME_BASE, 90000);
-						avformat_seek_file(avContextTab[1], -1, INT64_MIN, target, INT64_MAX, 0);
-						prev_seek_time_sec = -1;
-						wrapped_avcodec_flush_buffers(1);
-						cAVIdx = 1;
+						lastAudioDts = dts;
 					}
 					else
 					{
-						cAVIdx = 0;
+						// skip already injected AUDIO packet
+						ffmpeg_printf(200, "skip already injected AUDIO packet\n");
+						skipPacket = 1;
 					}
 				}
 				else
 				{
-					if (multiContextLastPts[0] != INVALID_PTS_VALUE && multiContextLastPts[1] != INVALID_PTS_VALUE)
-					{
-						cAVIdx = multiContextLastPts[0] < multiContextLastPts[1] ? 0 : 1;
-					}
-					else
-					{
-						cAVIdx = !cAVIdx;
-					}
+					// skip AUDIO packet with unknown PTS
+					ffmpeg_printf(200, "skip AUDIO packet with unknown PTS\n");
+					skipPacket = 1;
 				}
 			}
-			else
+
+			if (skipPacket)
 			{
-				cAVIdx = 0;
+				wrapped_packet_unref(&packet);
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+				continue;
 			}
-		}
-
-		if (bufferSize > 0)
-		{
-			LinuxDvbBuffSetStamp(stamp);
-		}
-
-		if (!isWaitingForFinish)
-		{
-			releaseMutex(__FILE__, __FUNCTION__, __LINE__);
-			ffmpegStatus = av_read_frame(avContextTab[cAVIdx], &packet);
-			getMutex(__FILE__, __FUNCTION__, __LINE__);
-		}
 
-		if (!isWaitingForFinish && (ffmpegStatus == 0))
-		{
-			int64_t pts            = 0;
-			int64_t dts            = 0;
-			Track_t *videoTrack    = NULL;
-			Track_t *audioTrack    = NULL;
-			Track_t *subtitleTrack = NULL;
-
-			context->playback->readCount += packet.size;
-
-			int32_t pid = avContextTab[cAVIdx]->streams[packet.stream_index]->id;
+			pcmPrivateData_t pcmExtradata;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+			pcmExtradata.channels              = get_codecpar(audioTrack->stream)->ch_layout.nb_channels;
+#else
+			pcmExtradata.channels              = get_codecpar(audioTrack->stream)->channels;
+#endif
+			pcmExtradata.bits_per_coded_sample = get_codecpar(audioTrack->stream)->bits_per_coded_sample;
+			pcmExtradata.sample_rate           = get_codecpar(audioTrack->stream)->sample_rate;
+			pcmExtradata.bit_rate              = get_codecpar(audioTrack->stream)->bit_rate;
+			pcmExtradata.block_align           = get_codecpar(audioTrack->stream)->block_align;
+			pcmExtradata.frame_size            = get_codecpar(audioTrack->stream)->frame_size;
 
-			multiContextLastPts[cAVIdx] = calcPts(cAVIdx, avContextTab[cAVIdx]->streams[packet.stream_index], packet.pts);
-			ffmpeg_printf(200, "Ctx %d PTS: %"PRId64" PTS[1] %"PRId64"\n", cAVIdx, multiContextLastPts[cAVIdx], multiContextLastPts[1]);
+			pcmExtradata.codec_id              = get_codecpar(audioTrack->stream)->codec_id;
+			pcmExtradata.bResampling           = ff->restart_audio_resampling;
 
-			reset_finish_timeout();
+			uint8_t *pAudioExtradata           = get_codecpar(audioTrack->stream)->extradata;
+			uint32_t audioExtradataSize        = get_codecpar(audioTrack->stream)->extradata_size;
 
-			if (avContextTab[cAVIdx]->streams[packet.stream_index]->discard != AVDISCARD_ALL)
+			ffmpeg_printf(200, "AudioTrack index = %d\n", pid);
+			if (audioTrack->inject_raw_pcm == 1)
 			{
-				if (context->manager->video->Command(context, MANAGER_GET_TRACK, &videoTrack) < 0)
+				ffmpeg_printf(200, "write audio raw pcm\n");
+				ff->restart_audio_resampling = 0;
+
+				avOut.data       = packet.data;
+				avOut.len        = packet.size;
+				avOut.pts        = pts;
+				avOut.extradata  = (uint8_t *) &pcmExtradata;
+				avOut.extralen   = sizeof(pcmExtradata);
+				avOut.frameRate  = 0;
+				avOut.timeScale  = 0;
+				avOut.width      = 0;
+				avOut.height     = 0;
+				avOut.type       = "audio";
+				avOut.track      = audioTrack;
+
+				if (Write(context->output->audio->Write, context, &avOut, pts) < 0)
 				{
-					ffmpeg_err("error getting video track\n");
-				}
-
-				if (context->manager->audio->Command(context, MANAGER_GET_TRACK, &audioTrack) < 0)
-				{
-					ffmpeg_err("error getting audio track\n");
-				}
-
-				if (context->manager->subtitle->Command(context, MANAGER_GET_TRACK, &subtitleTrack) < 0)
-				{
-					ffmpeg_err("error getting subtitle track\n");
+					ffmpeg_err("(raw pcm) writing data to audio device failed\n");
 				}
 			}
-			else
+			else if (audioTrack->inject_as_pcm == 1 && audioTrack->avCodecCtx)
 			{
-				ffmpeg_printf(1, "SKIP DISCARDED PACKET packed_size[%d] stream_index[%d] pid[%d]\n", packet.size, (int)packet.stream_index, pid);
-			}
-
-			ffmpeg_printf(200, "packet.size %d - index %d\n", packet.size, pid);
+				AVCodecContext *c = audioTrack->avCodecCtx;
 
-			if (videoTrack && (videoTrack->AVIdx == (int)cAVIdx) && (videoTrack->Id == pid))
-			{
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
-				AVCodecContext *codec_context = videoTrack->avCodecCtx;
-				if (codec_context && codec_context->codec_id == AV_CODEC_ID_MPEG4 && NULL != mpeg4p2_context)
+				if (ff->restart_audio_resampling)
 				{
-					mpeg4p2_write_packet(context, mpeg4p2_context, videoTrack, cAVIdx, &currentVideoPts, &latestPts, &packet);
-					update_max_injected_pts(latestPts);
+					ff->restart_audio_resampling = 0;
+					if (swr)
+					{
+						swr_free(&swr);
+						swr = NULL;
+					}
+					if (decoded_frame)
+					{
+						wrapped_frame_free(&decoded_frame);
+						decoded_frame = NULL;
+					}
 				}
-				else
+
+#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
+				while (packet.size > 0 || (!packet.size && !packet.data))
+#else
+				while (packet.size > 0)
 #endif
-#ifdef HAVE_FLV2MPEG4_CONVERTER
-					if (get_codecpar(avContextTab[cAVIdx]->streams[packet.stream_index])->codec_id == AV_CODEC_ID_FLV1 && memcmp(videoTrack->Encoding, "V_MPEG4", 7) == 0)
+				{
+					if (ff->do_seek_target_seconds || ff->do_seek_target_bytes || ffmpeg_queue_serial(ff->queues) != serial)
 					{
-						flv2mpeg4_write_packet(context, &flv2mpeg4_context, videoTrack, cAVIdx, &currentVideoPts, &latestPts, &packet);
-						update_max_injected_pts(latestPts);
+						break;
+					}
+
+					if (!decoded_frame)
+					{
+						decoded_frame = wrapped_frame_alloc();
+						if (!decoded_frame)
+						{
+							ffmpeg_err("out of memory\n");
+							exit(1);
+						}
 					}
 					else
-#endif
 					{
-						bool skipPacket = false;
-						currentVideoPts = videoTrack->pts = pts = calcPts(cAVIdx, videoTrack->stream, packet.pts);
-						videoTrack->dts = dts = calcPts(cAVIdx, videoTrack->stream, packet.dts);
+						wrapped_frame_unref(decoded_frame);
+					}
+#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
+					int ret = avcodec_send_packet(c, &packet);
+					if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+					{
+						ff->restart_audio_resampling = 1;
+						break;
+					}
 
-						if ((currentVideoPts != INVALID_PTS_VALUE) && (currentVideoPts > latestPts))
+					if (ret >= 0)
+					{
+						packet.size = 0;
+					}
+
+					ret = avcodec_receive_frame(c, decoded_frame);
+					if (ret < 0)
+					{
+						if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
 						{
-							latestPts = currentVideoPts;
-							update_max_injected_pts(latestPts);
+							ff->restart_audio_resampling = 1;
+							break;
+						}
+						else
+						{
+							continue;
 						}
+					}
+#else
+					int32_t got_frame = 0;
+					int32_t len = avcodec_decode_audio4(c, decoded_frame, &got_frame, &packet);
+					if (len < 0)
+					{
+						ffmpeg_err("avcodec_decode_audio4: %d\n", len);
+						break;
+					}
+
+					packet.data += len;
+					packet.size -= len;
 
-						if (context->playback->isTSLiveMode)
+					if (!got_frame)
+					{
+						continue;
+					}
+#endif
+
+					int32_t e = 0;
+					if (!swr)
+					{
+						if (insert_pcm_as_lpcm)
 						{
-							if (dts != INVALID_PTS_VALUE)
-							{
-								if (dts > lastVideoDts)
-								{
-									lastVideoDts = dts;
-								}
-								else
-								{
-									// skip already injected VIDEO packet
-									ffmpeg_printf(200, "skip already injected VIDEO packet\n");
-									skipPacket = true;
-								}
-							}
-							else
+							out_sample_rate = 48000;
+						}
+						else
+						{
+							int32_t rates[] = { 48000, 96000, 192000, 44100, 88200, 176400, 0 };
+							int32_t *rate = rates;
+							int32_t in_rate = c->sample_rate;
+							while (*rate && ((*rate / in_rate) * in_rate != *rate) && (in_rate / *rate) * *rate != in_rate)
 							{
-								// skip VIDEO packet with unknown DTS
-								ffmpeg_printf(200, "skip VIDEO packet with unknown DTS\n");
-								skipPacket = true;
+								rate++;
 							}
+							out_sample_rate = *rate ? *rate : 44100;
 						}
 
-						if (skipPacket)
+						swr = swr_alloc();
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+						out_channels = c->ch_layout.nb_channels;
+
+						if (c->ch_layout.u.mask == 0)
 						{
-							wrapped_packet_unref(&packet);
-							releaseMutex(__FILE__, __FUNCTION__, __LINE__);
-							continue;
+							av_channel_layout_default(&c->ch_layout, c->ch_layout.nb_channels);
 						}
 
-						ffmpeg_printf(200, "VideoTrack index = %d %" PRId64 "\n", pid, currentVideoPts);
-
-						avOut.data       = packet.data;
-						avOut.len        = packet.size;
-						avOut.pts        = pts;
-						avOut.dts        = dts;
-						avOut.extradata  = videoTrack->extraData;
-						avOut.extralen   = videoTrack->extraSize;
-						avOut.frameRate  = videoTrack->frame_rate;
-						avOut.timeScale  = videoTrack->TimeScale;
-						avOut.width      = videoTrack->width;
-						avOut.height     = videoTrack->height;
-						avOut.type       = "video";
-						avOut.infoFlags  = 0;
-
-						if (avContextTab[cAVIdx]->iformat->flags & AVFMT_TS_DISCONT)
+						out_channel_layout = c->ch_layout.u.mask;
+#else
+						out_channels = c->channels;
+
+						if (c->channel_layout == 0)
 						{
-							avOut.infoFlags = 1; // TS container
+							c->channel_layout = av_get_default_channel_layout(c->channels);
 						}
 
-						if (Write(context->output->video->Write, context, &avOut, pts) < 0)
+						out_channel_layout = c->channel_layout;
+#endif
+						uint8_t downmix = stereo_software_decoder && out_channels > 2 ? 1 : 0;
+#ifdef __sh__
+						// player2 won't play mono
+						if (out_channel_layout == AV_CH_LAYOUT_MONO)
 						{
-							ffmpeg_err("writing data to video device failed\n");
+							downmix = 1;
 						}
-					}
-			}
-			else if (audioTrack && (audioTrack->AVIdx == (int)cAVIdx) && (audioTrack->Id == pid))
-			{
-				uint8_t skipPacket = 0;
-				currentAudioPts = audioTrack->pts = pts = calcPts(cAVIdx, audioTrack->stream, packet.pts);
-				dts = calcPts(cAVIdx, audioTrack->stream, packet.dts);
-
-				if ((currentAudioPts != INVALID_PTS_VALUE) && (currentAudioPts > latestPts) && (!videoTrack))
-				{
-					latestPts = currentAudioPts;
-					update_max_injected_pts(latestPts);
-				}
-
-				if (context->playback->isTSLiveMode)
-				{
-					if (dts != INVALID_PTS_VALUE)
-					{
-						if (dts > lastAudioDts)
+#endif
+						if (downmix)
 						{
-							lastAudioDts = dts;
+							out_channel_layout = AV_CH_LAYOUT_STEREO_DOWNMIX;
+							out_channels = 2;
 						}
-						else
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+						av_opt_set_int(swr, "in_channel_layout",    c->ch_layout.u.mask,  0);
+#else
+						av_opt_set_int(swr, "in_channel_layout",    c->channel_layout,  0);
+#endif
+						av_opt_set_int(swr, "out_channel_layout",   out_channel_layout, 0);
+						av_opt_set_int(swr, "in_sample_rate",       c->sample_rate,     0);
+						av_opt_set_int(swr, "out_sample_rate",      out_sample_rate,    0);
+						av_opt_set_int(swr, "in_sample_fmt",        c->sample_fmt,      0);
+						av_opt_set_int(swr, "out_sample_fmt",       AV_SAMPLE_FMT_S16,  0);
+
+						e = swr_init(swr);
+						if (e < 0)
 						{
-							// skip already injected AUDIO packet
-							ffmpeg_printf(200, "skip already injected AUDIO packet\n");
-							skipPacket = 1;
+							ffmpeg_err("swr_init: %d (icl=%d ocl=%d isr=%d osr=%d isf=%d osf=%d\n",
+								-e, (int32_t)c->channel_layout, (int32_t)out_channel_layout, c->sample_rate, out_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S16);
+							swr_free(&swr);
+							swr = NULL;
 						}
 					}
-					else
+
+					uint8_t *output[8] = {NULL};
+					int32_t in_samples = decoded_frame->nb_samples;
+					int32_t out_samples = av_rescale_rnd(swr_get_delay(swr, c->sample_rate) + in_samples, out_sample_rate, c->sample_rate, AV_ROUND_UP);
+					e = av_samples_alloc(&output[0], NULL, out_channels, out_samples, AV_SAMPLE_FMT_S16, 1);
+					if (e < 0)
 					{
-						// skip AUDIO packet with unknown PTS
-						ffmpeg_printf(200, "skip AUDIO packet with unknown PTS\n");
-						skipPacket = 1;
+						ffmpeg_err("av_samples_alloc: %d\n", -e);
+						continue;
 					}
-				}
-
-				if (skipPacket)
-				{
-					wrapped_packet_unref(&packet);
-					releaseMutex(__FILE__, __FUNCTION__, __LINE__);
-					continue;
-				}
-
-				pcmPrivateData_t pcmExtradata;
+					int64_t next_in_pts = av_rescale(wrapped_frame_get_best_effort_timestamp(decoded_frame),
+							((AVStream *) audioTrack->stream)->time_base.num * (int64_t)out_sample_rate * c->sample_rate,
+							((AVStream *) audioTrack->stream)->time_base.den);
+					int64_t next_out_pts = av_rescale(swr_next_pts(swr, next_in_pts),
+							((AVStream *) audioTrack->stream)->time_base.den,
+							((AVStream *) audioTrack->stream)->time_base.num * (int64_t)out_sample_rate * c->sample_rate);
+
+					currentAudioPts = audioTrack->pts = pts = calcPts(ff, cAVIdx, audioTrack->stream, next_out_pts);
+					out_samples = swr_convert(swr, &output[0], out_samples, (const uint8_t **) &decoded_frame->data[0], in_samples);
+
+					//////////////////////////////////////////////////////////////////////
+					// Update pcmExtradata according to decode parameters
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-				pcmExtradata.channels              = get_codecpar(audioTrack->stream)->ch_layout.nb_channels;
+					pcmExtradata.channels              = c->ch_layout.nb_channels;
 #else
-				pcmExtradata.channels              = get_codecpar(audioTrack->stream)->channels;
+					pcmExtradata.channels              = av_get_channel_layout_nb_channels(out_channel_layout);
+#endif
+					pcmExtradata.bits_per_coded_sample = 16;
+					pcmExtradata.sample_rate           = out_sample_rate;
+					// The data described by the sample format is always in native-endian order
+#ifdef WORDS_BIGENDIAN
+					pcmExtradata.codec_id       = AV_CODEC_ID_PCM_S16BE;
+#else
+					pcmExtradata.codec_id       = AV_CODEC_ID_PCM_S16LE;
 #endif
-				pcmExtradata.bits_per_coded_sample = get_codecpar(audioTrack->stream)->bits_per_coded_sample;
-				pcmExtradata.sample_rate           = get_codecpar(audioTrack->stream)->sample_rate;
-				pcmExtradata.bit_rate              = get_codecpar(audioTrack->stream)->bit_rate;
-				pcmExtradata.block_align           = get_codecpar(audioTrack->stream)->block_align;
-				pcmExtradata.frame_size            = get_codecpar(audioTrack->stream)->frame_size;
-
-				pcmExtradata.codec_id              = get_codecpar(audioTrack->stream)->codec_id;
-				pcmExtradata.bResampling           = restart_audio_resampling;
 
-				uint8_t *pAudioExtradata           = get_codecpar(audioTrack->stream)->extradata;
-				uint32_t audioExtradataSize        = get_codecpar(audioTrack->stream)->extradata_size;
+					//////////////////////////////////////////////////////////////////////
 
-				ffmpeg_printf(200, "AudioTrack index = %d\n", pid);
-				if (audioTrack->inject_raw_pcm == 1)
-				{
-					ffmpeg_printf(200, "write audio raw pcm\n");
-					restart_audio_resampling = 0;
+					avOut.data       = output[0];
+					avOut.len        = out_samples * sizeof(int16_t) * out_channels;
 
-					avOut.data       = packet.data;
-					avOut.len        = packet.size;
 					avOut.pts        = pts;
-					avOut.extradata  = (uint8_t *) &pcmExtradata;
+					avOut.extradata  = (unsigned char *) &pcmExtradata;
 					avOut.extralen   = sizeof(pcmExtradata);
 					avOut.frameRate  = 0;
 					avOut.timeScale  = 0;
 					avOut.width      = 0;
 					avOut.height     = 0;
 					avOut.type       = "audio";
+					avOut.track      = audioTrack;
 
-					if (Write(context->output->audio->Write, context, &avOut, pts) < 0)
+					if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
 					{
-						ffmpeg_err("(raw pcm) writing data to audio device failed\n");
+						ffmpeg_err("writing data to audio device failed\n");
 					}
+					av_freep(&output[0]);
 				}
-				else if (audioTrack->inject_as_pcm == 1 && audioTrack->avCodecCtx)
+			}
+			else if (audioTrack->have_aacheader == 1)
+			{
+				ffmpeg_printf(200, "write audio aac\n");
+				ffmpeg_printf(200, "> %hhx %hhx %hhx %hhx %x %hhx %hhx\n", packet.data[0], packet.data[1], packet.data[2], packet.data[3], packet.data[4], packet.data[5], packet.data[6]);
+
+				avOut.data       = packet.data;
+				avOut.len        = packet.size;
+				avOut.pts        = pts;
+				avOut.extradata  = audioTrack->aacbuf;
+				avOut.extralen   = audioTrack->aacbuflen;
+				avOut.frameRate  = 0;
+				avOut.timeScale  = 0;
+				avOut.width      = 0;
+				avOut.height     = 0;
+				avOut.type       = "audio";
+				avOut.track      = audioTrack;
+
+				if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
+				{
+					ffmpeg_err("(aac) writing data to audio device failed\n");
+				}
+			}
+			else if (pcmExtradata.codec_id == AV_CODEC_ID_VORBIS || pcmExtradata.codec_id == AV_CODEC_ID_OPUS ||
+				pcmExtradata.codec_id == AV_CODEC_ID_WMAV1 || pcmExtradata.codec_id == AV_CODEC_ID_WMAV2 ||
+				pcmExtradata.codec_id == AV_CODEC_ID_WMAPRO || pcmExtradata.codec_id == AV_CODEC_ID_WMALOSSLESS)
+			{
+				avOut.data       = packet.data;
+				avOut.len        = packet.size;
+				avOut.pts        = pts;
+				avOut.extradata  = (uint8_t *) &pcmExtradata;
+				avOut.extralen   = sizeof(pcmExtradata);
+				avOut.frameRate  = 0;
+				avOut.timeScale  = 0;
+				avOut.width      = 0;
+				avOut.height     = 0;
+				avOut.type       = "audio";
+				avOut.track      = audioTrack;
+
+				pcmExtradata.private_data = pAudioExtradata;
+				pcmExtradata.private_size = audioExtradataSize;
+
+				if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
 				{
-					AVCodecContext *c = audioTrack->avCodecCtx;
+					ffmpeg_err("writing data to audio device failed\n");
+				}
+			}
+			else
+			{
+				avOut.data       = packet.data;
+				avOut.len        = packet.size;
+				avOut.pts        = pts;
+				avOut.extradata  = pAudioExtradata;
+				avOut.extralen   = audioExtradataSize;
+				avOut.frameRate  = 0;
+				avOut.timeScale  = 0;
+				avOut.width      = 0;
+				avOut.height     = 0;
+				avOut.type       = "audio";
+				avOut.track      = audioTrack;
+
+				if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
+				{
+					ffmpeg_err("writing data to audio device failed\n");
+				}
+			}
+		}
+		wrapped_packet_unref(&packet);
+		releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+	}
 
-					if (restart_audio_resampling)
-					{
-						restart_audio_resampling = 0;
-						if (swr)
-						{
-							swr_free(&swr);
-							swr = NULL;
-						}
-						if (decoded_frame)
-						{
-							wrapped_frame_free(&decoded_frame);
-							decoded_frame = NULL;
-						}
-					}
+	if (swr)
+	{
+		swr_free(&swr);
+	}
 
-#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
-					while (packet.size > 0 || (!packet.size && !packet.data))
-#else
-					while (packet.size > 0)
+	if (decoded_frame)
+	{
+		wrapped_frame_free(&decoded_frame);
+	}
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
+	mpeg4p2_context_close(mpeg4p2_context);
 #endif
-					{
-						if (do_seek_target_seconds || do_seek_target_bytes)
-						{
-							break;
-						}
 
-						if (!decoded_frame)
-						{
-							decoded_frame = wrapped_frame_alloc();
-							if (!decoded_frame)
-							{
-								ffmpeg_err("out of memory\n");
-								exit(1);
-							}
-						}
-						else
-						{
-							wrapped_frame_unref(decoded_frame);
-						}
-#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
-						int ret = avcodec_send_packet(c, &packet);
-						if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
-						{
-							restart_audio_resampling = 1;
-							break;
-						}
+	ffmpeg_printf(10, "terminating\n");
+}
 
-						if (ret >= 0)
-						{
-							packet.size = 0;
-						}
+static void FFMPEGThread(Context_t *context)
+{
+	FFMPEGContext_t *ff = context->ffmpeg;
+	char threadname[17];
+	strncpy(threadname, __func__, sizeof(threadname));
+	threadname[16] = 0;
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	AVPacket packet;
 
-						ret = avcodec_receive_frame(c, decoded_frame);
-						if (ret < 0)
-						{
-							if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
-							{
-								restart_audio_resampling = 1;
-								break;
-							}
-							else
-							{
-								continue;
-							}
-						}
-#else
-						int32_t got_frame = 0;
-						int32_t len = avcodec_decode_audio4(c, decoded_frame, &got_frame, &packet);
-						if (len < 0)
-						{
-							ffmpeg_err("avcodec_decode_audio4: %d\n", len);
-							break;
-						}
+	int64_t multiContextLastPts[IPTV_AV_CONTEXT_MAX_NUM] = {INVALID_PTS_VALUE, INVALID_PTS_VALUE};
 
-						packet.data += len;
-						packet.size -= len;
+	int64_t showtime = 0;
+	int64_t bofcount = 0;
 
-						if (!got_frame)
-						{
-							continue;
-						}
-#endif
+	uint32_t cAVIdx = 0;
+	void *stamp = 0;
+	pthread_t injectThread;
+	int32_t error = 0;
 
-						int32_t e = 0;
-						if (!swr)
-						{
-							if (insert_pcm_as_lpcm)
-							{
-								out_sample_rate = 48000;
-							}
-							else
-							{
-								int32_t rates[] = { 48000, 96000, 192000, 44100, 88200, 176400, 0 };
-								int32_t *rate = rates;
-								int32_t in_rate = c->sample_rate;
-								while (*rate && ((*rate / in_rate) * in_rate != *rate) && (in_rate / *rate) * *rate != in_rate)
-								{
-									rate++;
-								}
-								out_sample_rate = *rate ? *rate : 44100;
-							}
+	ffmpeg_printf(10, "\n");
 
-							swr = swr_alloc();
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-							out_channels = c->ch_layout.nb_channels;
+	while (context->playback->isCreationPhase)
+	{
+		ffmpeg_printf(10, "Thread waiting for end of init phase...\n");
+		usleep(1000);
+	}
+	ffmpeg_printf(10, "Running!\n");
 
-							if (c->ch_layout.u.mask == 0)
-							{
-								av_channel_layout_default(&c->ch_layout, c->ch_layout.nb_channels);
-							}
+	uint32_t bufferSize = 0;
+	context->output->Command(context, OUTPUT_GET_BUFFER_SIZE, &bufferSize);
 
-							out_channel_layout = c->ch_layout.u.mask;
-#else
-							out_channels = c->channels;
+	/* the decoders are written from a thread of their own, so that a
+	 * slow read does not starve them and a full decoder does not stop
+	 * the reads */
+	ffmpeg_queue_start(ff->queues);
+	if ((error = pthread_create(&injectThread, NULL, (void *)&FFMPEGInjectThread, context)) != 0)
+	{
+		ffmpeg_err("Creating inject thread, error:%d:%s\n", error, strerror(error));
+	}
 
-							if (c->channel_layout == 0)
-							{
-								c->channel_layout = av_get_default_channel_layout(c->channels);
-							}
+	int8_t isWaitingForFinish = 0;
 
-							out_channel_layout = c->channel_layout;
-#endif
-							uint8_t downmix = stereo_software_decoder && out_channels > 2 ? 1 : 0;
+	while (error == 0 && context && context->playback && context->playback->isPlaying)
+	{
+		/* When user press PAUSE we call pause on AUDIO and VIDEO decoders,
+		 * we will not wait here because we can still fill
+		 * DVB drivers buffers at PAUSE time
+		 *
+		 */
 #ifdef __sh__
-							// player2 won't play mono
-							if (out_channel_layout == AV_CH_LAYOUT_MONO)
-							{
-								downmix = 1;
-							}
-#endif
-							if (downmix)
-							{
-								out_channel_layout = AV_CH_LAYOUT_STEREO_DOWNMIX;
-								out_channels = 2;
-							}
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-							av_opt_set_int(swr, "in_channel_layout",    c->ch_layout.u.mask,  0);
-#else
-							av_opt_set_int(swr, "in_channel_layout",    c->channel_layout,  0);
+		/* ST DVB drivers skip data if they are written during pause
+		 * so, we must wait here if there is not buffering queue
+		 */
+		if (bufferSize == 0 && context->playback->isPaused)
+		{
+			ffmpeg_printf(20, "paused\n");
+			reset_finish_timeout(ff);
+			usleep(10000);
+			continue;
+		}
 #endif
-							av_opt_set_int(swr, "out_channel_layout",   out_channel_layout, 0);
-							av_opt_set_int(swr, "in_sample_rate",       c->sample_rate,     0);
-							av_opt_set_int(swr, "out_sample_rate",      out_sample_rate,    0);
-							av_opt_set_int(swr, "in_sample_fmt",        c->sample_fmt,      0);
-							av_opt_set_int(swr, "out_sample_fmt",       AV_SAMPLE_FMT_S16,  0);
-
-							e = swr_init(swr);
-							if (e < 0)
-							{
-								ffmpeg_err("swr_init: %d (icl=%d ocl=%d isr=%d osr=%d isf=%d osf=%d\n",
-									-e, (int32_t)c->channel_layout, (int32_t)out_channel_layout, c->sample_rate, out_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S16);
-								swr_free(&swr);
-								swr = NULL;
-							}
-						}
 
-						uint8_t *output[8] = {NULL};
-						int32_t in_samples = decoded_frame->nb_samples;
-						int32_t out_samples = av_rescale_rnd(swr_get_delay(swr, c->sample_rate) + in_samples, out_sample_rate, c->sample_rate, AV_ROUND_UP);
-						e = av_samples_alloc(&output[0], NULL, out_channels, out_samples, AV_SAMPLE_FMT_S16, 1);
-						if (e < 0)
-						{
-							ffmpeg_err("av_samples_alloc: %d\n", -e);
-							continue;
-						}
-						int64_t next_in_pts = av_rescale(wrapped_frame_get_best_effort_timestamp(decoded_frame),
-								((AVStream *) audioTrack->stream)->time_base.num * (int64_t)out_sample_rate * c->sample_rate,
-								((AVStream *) audioTrack->stream)->time_base.den);
-						int64_t next_out_pts = av_rescale(swr_next_pts(swr, next_in_pts),
-								((AVStream *) audioTrack->stream)->time_base.den,
-								((AVStream *) audioTrack->stream)->time_base.num * (int64_t)out_sample_rate * c->sample_rate);
-
-						currentAudioPts = audioTrack->pts = pts = calcPts(cAVIdx, audioTrack->stream, next_out_pts);
-						out_samples = swr_convert(swr, &output[0], out_samples, (const uint8_t **) &decoded_frame->data[0], in_samples);
-
-						//////////////////////////////////////////////////////////////////////
-						// Update pcmExtradata according to decode parameters
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-						pcmExtradata.channels              = c->ch_layout.nb_channels;
-#else
-						pcmExtradata.channels              = av_get_channel_layout_nb_channels(out_channel_layout);
-#endif
-						pcmExtradata.bits_per_coded_sample = 16;
-						pcmExtradata.sample_rate           = out_sample_rate;
-						// The data described by the sample format is always in native-endian order
-#ifdef WORDS_BIGENDIAN
-						pcmExtradata.codec_id       = AV_CODEC_ID_PCM_S16BE;
-#else
-						pcmExtradata.codec_id       = AV_CODEC_ID_PCM_S16LE;
-#endif
+		if (context->playback->isSeeking)
+		{
+			ffmpeg_printf(10, "seeking\n");
+			reset_finish_timeout(ff);
+			usleep(10000);
+			continue;
+		}
 
-						//////////////////////////////////////////////////////////////////////
+		getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
-						avOut.data       = output[0];
-						avOut.len        = out_samples * sizeof(int16_t) * out_channels;
+		if (!context->playback || !context->playback->isPlaying)
+		{
+			releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+			if (!isWaitingForFinish)
+			{
+				reset_finish_timeout(ff);
+			}
+			continue;
+		}
+
+		if (context->playback->BackWard && av_gettime() >= showtime)
+		{
+			context->output->Command(context, OUTPUT_CLEAR, "video");
+
+			if (bofcount == 1)
+			{
+				showtime = av_gettime();
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+				usleep(100000);
+				continue;
+			}
+
+			int32_t idx = -1;
+			if (ff->index->fd >= 0)
+			{
+				/* step back from keyframe to keyframe, at least one per jump */
+				int64_t currPts = -1;
+				context->playback->Command(context, PLAYBACK_PTS, &currPts);
+				if (currPts >= 0)
+				{
+					idx = ts_index_find(ff->index, currPts + (int64_t)context->playback->Speed * 90000);
+				}
+				if (ff->index->trickPos >= 0 && (idx < 0 || idx >= ff->index->trickPos))
+				{
+					idx = ff->index->trickPos - 1;
+				}
+				if (idx < 0 && ff->index->trickPos == 0)
+				{
+					bofcount = 1;
+				}
+			}
 
-						avOut.pts        = pts;
-						avOut.extradata  = (unsigned char *) &pcmExtradata;
-						avOut.extralen   = sizeof(pcmExtradata);
-						avOut.frameRate  = 0;
-						avOut.timeScale  = 0;
-						avOut.width      = 0;
-						avOut.height     = 0;
-						avOut.type       = "audio";
+			if (idx >= 0)
+			{
+				ff->index->trickPos = idx;
+				ff->index->trickFrame = 1;
+				ff->seek_target_bytes = ff->index->entries[idx].offset;
+				ff->do_seek_target_bytes = 1;
+			}
+			else if (ff->avContextTab[0]->iformat->flags & AVFMT_TS_DISCONT)
+			{
+				off_t pos = avio_tell(ff->avContextTab[0]->pb);
 
-						if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
+				if (pos > 0)
+				{
+					float br;
+					if (ff->avContextTab[0]->bit_rate)
+						br = ff->avContextTab[0]->bit_rate / 8.0;
+					else
+						br = 180000.0;
+					ff->seek_target_bytes = (double)pos + (double)context->playback->Speed * 8.0 * br;
+					if (ff->seek_target_bytes < 0)
+						ff->seek_target_bytes = 1;
+					ff->do_seek_target_bytes = 1;
+				}
+			}
+			else
+			{
+				int64_t currPts = -1;
+				context->playback->Command(context, PLAYBACK_PTS, &currPts);
+				ff->seek_target_seconds = ((double)currPts / 90000.0 + context->playback->Speed) * AV_TIME_BASE;
+				if (ff->seek_target_seconds < 0)
+					ff->seek_target_seconds = AV_TIME_BASE;
+				ff->do_seek_target_seconds = 1;
+			}
+			showtime = av_gettime() + 300000;   //jump back every 300ms
+		}
+		else
+		{
+			bofcount = 0;
+			if (!context->playback->BackWard)
+			{
+				ff->index->trickPos = -1;
+			}
+		}
+
+		if (ff->do_seek_target_seconds || ff->do_seek_target_bytes)
+		{
+			int res = -1;
+			isWaitingForFinish = 0;
+			if (ff->do_seek_target_seconds)
+			{
+				ffmpeg_printf(10, "seek_target_seconds[%" PRId64 "]\n", ff->seek_target_seconds);
+				uint32_t i = 0;
+				for (; i < IPTV_AV_CONTEXT_MAX_NUM; i += 1)
+				{
+					multiContextLastPts[i] = INVALID_PTS_VALUE;
+					if (NULL != ff->avContextTab[i])
+					{
+						if (i == 1)
+						{
+							ff->prev_seek_time_sec = ff->seek_target_seconds;
+						}
+						if (ff->avContextTab[i]->start_time != AV_NOPTS_VALUE)
 						{
-							ffmpeg_err("writing data to audio device failed\n");
+							ff->seek_target_seconds += ff->avContextTab[i]->start_time;
 						}
-						av_freep(&output[0]);
+						int32_t idx = i == 0 ? ts_index_find(ff->index, av_rescale(ff->seek_target_seconds, 90000, AV_TIME_BASE)) : -1;
+						if (idx >= 0)
+						{
+							idx = ts_index_seek_entry(ff->index, idx);
+							ffmpeg_printf(10, "index seek to keyframe %d at %" PRIu64 "\n", idx, ff->index->entries[idx].offset);
+							res = container_ffmpeg_seek_bytes(ff, ff->index->entries[idx].offset);
+						}
+						else
+						{
+							res = avformat_seek_file(ff->avContextTab[i], -1, INT64_MIN, ff->seek_target_seconds, INT64_MAX, 0);
+						}
+						if (res < 0 && context->playback->BackWard)
+							bofcount = 1;
+					}
+					else
+					{
+						break;
 					}
 				}
-				else if (audioTrack->have_aacheader == 1)
-				{
-					ffmpeg_printf(200, "write audio aac\n");
-					ffmpeg_printf(200, "> %hhx %hhx %hhx %hhx %x %hhx %hhx\n", packet.data[0], packet.data[1], packet.data[2], packet.data[3], packet.data[4], packet.data[5], packet.data[6]);
+				reset_finish_timeout(ff);
+			}
+			else
+			{
+				container_ffmpeg_seek_bytes(ff, ff->seek_target_bytes);
+			}
+			ff->do_seek_target_seconds = 0;
+			ff->do_seek_target_bytes = 0;
 
-					avOut.data       = packet.data;
-					avOut.len        = packet.size;
-					avOut.pts        = pts;
-					avOut.extradata  = audioTrack->aacbuf;
-					avOut.extralen   = audioTrack->aacbuflen;
-					avOut.frameRate  = 0;
-					avOut.timeScale  = 0;
-					avOut.width      = 0;
-					avOut.height     = 0;
-					avOut.type       = "audio";
+			ff->restart_audio_resampling = 1;
+			ff->latestPts = 0;
+			ff->seek_target_flag = 0;
+			ffmpeg_queue_flush(ff->queues);
 
-					if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
+			// flush streams
+			uint32_t i = 0;
+			for (i = 0; i < IPTV_AV_CONTEXT_MAX_NUM; i += 1)
+			{
+				if (NULL != ff->avContextTab[i])
+				{
+					if (i != 1)
 					{
-						ffmpeg_err("(aac) writing data to audio device failed\n");
+						wrapped_avcodec_flush_buffers(ff, i);
 					}
 				}
-				else if (pcmExtradata.codec_id == AV_CODEC_ID_VORBIS || pcmExtradata.codec_id == AV_CODEC_ID_OPUS ||
-					pcmExtradata.codec_id == AV_CODEC_ID_WMAV1 || pcmExtradata.codec_id == AV_CODEC_ID_WMAV2 ||
-					pcmExtradata.codec_id == AV_CODEC_ID_WMAPRO || pcmExtradata.codec_id == AV_CODEC_ID_WMALOSSLESS)
+				else
 				{
-					avOut.data       = packet.data;
-					avOut.len        = packet.size;
-					avOut.pts        = pts;
-					avOut.extradata  = (uint8_t *) &pcmExtradata;
-					avOut.extralen   = sizeof(pcmExtradata);
-					avOut.frameRate  = 0;
-					avOut.timeScale  = 0;
-					avOut.width      = 0;
-					avOut.height     = 0;
-					avOut.type       = "audio";
-
-					pcmExtradata.private_data = pAudioExtradata;
-					pcmExtradata.private_size = audioExtradataSize;
+					break;
+				}
+			}
+		}
 
-					if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
+		int ffmpegStatus = 0;
+		if (!isWaitingForFinish)
+		{
+			if (NULL != ff->avContextTab[1])
+			{
+				if (ff->prev_seek_time_sec >= 0)
+				{
+					if (multiContextLastPts[0] != INVALID_PTS_VALUE)
 					{
-						ffmpeg_err("writing data to audio device failed\n");
+						int64_t target = av_rescale(multiContextLastPts[0], AV_TIME_BASE, 90000);
+						avformat_seek_file(ff->avContextTab[1], -1, INT64_MIN, target, INT64_MAX, 0);
+						ff->prev_seek_time_sec = -1;
+						wrapped_avcodec_flush_buffers(ff, 1);
+						cAVIdx = 1;
+					}
+					else
+					{
+						cAVIdx = 0;
+					}
+				}
+				else
+				{
+					if (multiContextLastPts[0] != INVALID_PTS_VALUE && multiContextLastPts[1] != INVALID_PTS_VALUE)
+					{
+						cAVIdx = multiContextLastPts[0] < multiContextLastPts[1] ? 0 : 1;
+					}
+					else
+					{
+						cAVIdx = !cAVIdx;
 					}
 				}
-				else
+			}
+			else
+			{
+				cAVIdx = 0;
+			}
+		}
+
+		if (!isWaitingForFinish)
+		{
+			/* packets read across a seek are dropped by the stamp */
+			stamp = context->playback->stamp;
+			releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+			ffmpegStatus = av_read_frame(ff->avContextTab[cAVIdx], &packet);
+			getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+		}
+
+		if (!isWaitingForFinish && (ffmpegStatus == 0))
+		{
+			int64_t pts            = 0;
+			Track_t *videoTrack    = NULL;
+			Track_t *audioTrack    = NULL;
+			Track_t *subtitleTrack = NULL;
+
+			context->playback->readCount += packet.size;
+
+			int32_t pid = ff->avContextTab[cAVIdx]->streams[packet.stream_index]->id;
+
+			multiContextLastPts[cAVIdx] = calcPts(ff, cAVIdx, ff->avContextTab[cAVIdx]->streams[packet.stream_index], packet.pts);
+			ffmpeg_printf(200, "Ctx %d PTS: %"PRId64" PTS[1] %"PRId64"\n", cAVIdx, multiContextLastPts[cAVIdx], multiContextLastPts[1]);
+
+			reset_finish_timeout(ff);
+
+			if (ff->avContextTab[cAVIdx]->streams[packet.stream_index]->discard != AVDISCARD_ALL)
+			{
+				if (context->manager->video->Command(context, MANAGER_GET_TRACK, &videoTrack) < 0)
+				{
+					ffmpeg_err("error getting video track\n");
+				}
+
+				if (context->manager->audio->Command(context, MANAGER_GET_TRACK, &audioTrack) < 0)
 				{
-					avOut.data       = packet.data;
-					avOut.len        = packet.size;
-					avOut.pts        = pts;
-					avOut.extradata  = pAudioExtradata;
-					avOut.extralen   = audioExtradataSize;
-					avOut.frameRate  = 0;
-					avOut.timeScale  = 0;
-					avOut.width      = 0;
-					avOut.height     = 0;
-					avOut.type       = "audio";
+					ffmpeg_err("error getting audio track\n");
+				}
 
-					if (!context->playback->BackWard && Write(context->output->audio->Write, context, &avOut, pts) < 0)
-					{
-						ffmpeg_err("writing data to audio device failed\n");
-					}
+				if (context->manager->subtitle->Command(context, MANAGER_GET_TRACK, &subtitleTrack) < 0)
+				{
+					ffmpeg_err("error getting subtitle track\n");
 				}
 			}
+			else
+			{
+				ffmpeg_printf(1, "SKIP DISCARDED PACKET packed_size[%d] stream_index[%d] pid[%d]\n", packet.size, (int)packet.stream_index, pid);
+			}
+
+			ffmpeg_printf(200, "packet.size %d - index %d\n", packet.size, pid);
+
+			if (videoTrack && (videoTrack->AVIdx == (int)cAVIdx) && (videoTrack->Id == pid))
+			{
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+				ffmpeg_queue_put(context, &ff->queues->video, &packet, cAVIdx, pid, calcDts(ff, cAVIdx, &packet), stamp);
+				getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+			}
+			else if (audioTrack && (audioTrack->AVIdx == (int)cAVIdx) && (audioTrack->Id == pid))
+			{
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+				ffmpeg_queue_put(context, &ff->queues->audio, &packet, cAVIdx, pid, calcDts(ff, cAVIdx, &packet), stamp);
+				getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+			}
 			else if (subtitleTrack && (subtitleTrack->Id == pid))
 			{
 				int64_t duration = -1;
-				pts = calcPts(cAVIdx, subtitleTrack->stream, packet.pts);
+				pts = calcPts(ff, cAVIdx, subtitleTrack->stream, packet.pts);
 				AVStream *stream = subtitleTrack->stream;
 
 				if (packet.duration != 0)
@@ -1380,7 +1664,7 @@ static void FFMPEGThread(Context_t *context)
 		{
 			if (0 != ffmpegStatus)
 			{
-				static char errbuf[256];
+				char errbuf[256];
 
 				if (av_strerror(ffmpegStatus, errbuf, sizeof(errbuf)) == 0)
 				{
@@ -1397,11 +1681,21 @@ static void FFMPEGThread(Context_t *context)
 				ffmpegStatus = 0;
 			}
 
-			if (!is_finish_timeout() && !context->playback->isTSLiveMode)
+			if (!ffmpeg_queue_empty(ff->queues))
+			{
+				/* the decoders did not get everything yet */
+				isWaitingForFinish = 1;
+				reset_finish_timeout(ff);
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+				usleep(10000);
+				continue;
+			}
+
+			if (!is_finish_timeout(ff) && !context->playback->isTSLiveMode)
 			{
 				isWaitingForFinish = 1;
-				update_finish_timeout();
-				releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+				update_finish_timeout(ff);
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 				usleep(100000);
 				continue;
 			}
@@ -1410,17 +1704,17 @@ static void FFMPEGThread(Context_t *context)
 				uint8_t bEndProcess = 1;
 				if (context->playback->isTSLiveMode)
 				{
-					seek_target_bytes = 0;
-					do_seek_target_bytes = 1;
+					ff->seek_target_bytes = 0;
+					ff->do_seek_target_bytes = 1;
 					bEndProcess = 0;
 				}
 				else if (context->playback->isLoopMode == 1)
 				{
 					int64_t tmpLength = 0;
-					if (container_ffmpeg_get_length(context, &tmpLength) == 0 && tmpLength > 0 && get_play_pts() > 0)
+					if (container_ffmpeg_get_length(context, &tmpLength) == 0 && tmpLength > 0 && get_play_pts(ff) > 0)
 					{
-						seek_target_seconds = 0;
-						do_seek_target_seconds = 1;
+						ff->seek_target_seconds = 0;
+						ff->do_seek_target_seconds = 1;
 						bEndProcess = 0;
 						context->output->Command(context, OUTPUT_CLEAR, NULL);
 						context->output->Command(context, OUTPUT_PLAY, NULL);
@@ -1431,7 +1725,7 @@ static void FFMPEGThread(Context_t *context)
 				// av_read_frame failed
 				ffmpeg_err("no data ->end of file reached ? \n");
 				wrapped_packet_unref(&packet);
-				releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+				releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 				if (bEndProcess)
 				{
 					break; // while
@@ -1443,28 +1737,21 @@ static void FFMPEGThread(Context_t *context)
 			}
 		}
 		wrapped_packet_unref(&packet);
-		releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+		releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 	} /* while */
 
-	if (swr)
-	{
-		swr_free(&swr);
-	}
-
-	if (decoded_frame)
+	ffmpeg_queue_stop(ff->queues);
+	if (error == 0)
 	{
-		wrapped_frame_free(&decoded_frame);
+		pthread_join(injectThread, NULL);
 	}
+	ffmpeg_queue_flush(ff->queues);
 
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
-	mpeg4p2_context_close(mpeg4p2_context);
-#endif
-
-	hasPlayThreadStarted = 0;
+	ff->hasPlayThreadStarted = 0;
 	context->playback->isPlaying = 0;
-	seek_target_seconds = 0;
-	do_seek_target_seconds = 0;
-	PlaybackDieNow(1);
+	ff->seek_target_seconds = 0;
+	ff->do_seek_target_seconds = 0;
+	PlaybackDieNow(context, 1);
 
 	if (context && context->playback)
 	{
@@ -1472,17 +1759,18 @@ static void FFMPEGThread(Context_t *context)
 	}
 
 	ffmpeg_printf(10, "terminating\n");
+	/* the last access, the context may be freed now */
+	__atomic_store_n(&ff->playThreadRunning, 0, __ATOMIC_SEQ_CST);
 }
 
 /* **************************** */
 /* Container part for ffmpeg    */
 /* **************************** */
 
-static int32_t terminating = 0;
 static int32_t interrupt_cb(void *ctx)
 {
-	PlaybackHandler_t *p = (PlaybackHandler_t *)ctx;
-	return p->abortRequested || PlaybackDieNow(0);
+	Context_t *context = (Context_t *)ctx;
+	return context->playback->abortRequested || PlaybackDieNow(context, 0);
 }
 
 #ifdef USE_CUSTOM_IO
@@ -1496,16 +1784,277 @@ typedef struct CustomIOCtx_t
 	uint64_t iFileSize;
 	char *szMoovAtomFile;
 	uint64_t iMoovAtomOffset;
+
+	/* recording split into name, name.001, name.002, ... */
+	uint32_t iParts;		/* 0: not split */
+	uint32_t iPart;			/* part pFile belongs to */
+	int64_t *pPartStart;		/* offset of each part in the whole stream */
+
+	/* circular timeshift file, see ts_ring.h */
+	uint64_t iRingSize;		/* 0: not a ring file */
+	uint64_t iRingBase;		/* ring stream offset of position 0 */
 } CustomIOCtx_t;
 
-CustomIOCtx_t *custom_io_tab[IPTV_AV_CONTEXT_MAX_NUM] = {NULL, NULL};
+static void split_part_name(CustomIOCtx_t *io, uint32_t part, char *name, size_t size)
+{
+	if (part == 0)
+	{
+		snprintf(name, size, "%s", io->szFile);
+	}
+	else
+	{
+		snprintf(name, size, "%s.%03u", io->szFile, part);
+	}
+}
+
+static int64_t split_part_size(CustomIOCtx_t *io, uint32_t part)
+{
+	char name[PATH_MAX];
+	struct stat st;
+
+	split_part_name(io, part, name, sizeof(name));
+	if (stat(name, &st) != 0)
+	{
+		return -1;
+	}
+	return st.st_size;
+}
+
+/* looks for parts added since the last call, the recording may still be running */
+static void split_scan(CustomIOCtx_t *io)
+{
+	while (1)
+	{
+		int64_t size = split_part_size(io, io->iParts);
+		if (size < 0)
+		{
+			break;
+		}
+		int64_t *start = realloc(io->pPartStart, (io->iParts + 1) * sizeof(int64_t));
+		if (start == NULL)
+		{
+			break;
+		}
+		io->pPartStart = start;
+		if (io->iParts == 0)
+		{
+			start[0] = 0;
+		}
+		else
+		{
+			/* the previous part is complete now */
+			start[io->iParts] = start[io->iParts - 1] + split_part_size(io, io->iParts - 1);
+		}
+		io->iParts++;
+	}
+}
+
+static int split_open_part(CustomIOCtx_t *io, uint32_t part)
+{
+	char name[PATH_MAX];
+	FILE *f;
+
+	if (part == io->iPart && io->pFile)
+	{
+		return 0;
+	}
+	split_part_name(io, part, name, sizeof(name));
+	f = fopen(name, "rb");
+	if (f == NULL)
+	{
+		ffmpeg_err("cannot open %s\n", name);
+		return -1;
+	}
+	if (io->pFile)
+	{
+		fclose(io->pFile);
+	}
+	io->pFile = f;
+	io->iPart = part;
+	ffmpeg_printf(10, "part %u: %s\n", part, name);
+	return 0;
+}
+
+static int split_read(CustomIOCtx_t *io, uint8_t *buffer, int lSize)
+{
+	int ret = 0;
+	while (ret < lSize)
+	{
+		clearerr(io->pFile);
+		size_t n = fread(buffer + ret, 1, lSize - ret, io->pFile);
+		ret += n;
+		io->iOffset += n;
+		if (ret == lSize)
+		{
+			break;
+		}
+		if (io->iPart + 1 >= io->iParts)
+		{
+			split_scan(io);
+		}
+		if (io->iPart + 1 >= io->iParts || split_open_part(io, io->iPart + 1))
+		{
+			break;
+		}
+	}
+	return ret;
+}
+
+static int64_t split_seek(CustomIOCtx_t *io, int64_t pos, int whence)
+{
+	uint32_t last;
+	int64_t size;
+
+	split_scan(io);
+	last = io->iParts - 1;
+	size = io->pPartStart[last] + split_part_size(io, last);
+
+	switch (whence)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			pos += io->iOffset;
+			break;
+		case SEEK_END:
+			pos += size;
+			break;
+		case AVSEEK_SIZE:
+			return size;
+		default:
+			return -1;
+	}
+	if (pos < 0)
+	{
+		return -1;
+	}
+
+	uint32_t part = last;
+	while (part > 0 && io->pPartStart[part] > pos)
+	{
+		part--;
+	}
+	if (split_open_part(io, part) || fseeko(io->pFile, (off_t)(pos - io->pPartStart[part]), SEEK_SET))
+	{
+		return -1;
+	}
+	io->iOffset = pos;
+	return pos;
+}
+
+static int ring_header(CustomIOCtx_t *io, ts_ring_header_t *h)
+{
+	if (pread(fileno(io->pFile), h, sizeof(*h), 0) != sizeof(*h) ||
+		h->magic != TS_RING_MAGIC || h->header_size != TS_RING_HEADER_SIZE || h->size == 0)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static int ring_read(CustomIOCtx_t *io, uint8_t *buffer, int lSize)
+{
+	ts_ring_header_t h;
+
+	while (1)
+	{
+		if (ring_header(io, &h))
+		{
+			return -1;
+		}
+		uint64_t pos = io->iRingBase + io->iOffset;
+		if (pos < h.tail)
+		{
+			/* overwritten already, continue with the oldest data */
+			ffmpeg_printf(10, "ring: skipping %" PRIu64 " bytes\n", h.tail - pos);
+			pos = h.tail;
+			io->iOffset = pos - io->iRingBase;
+		}
+		if (pos >= h.head)
+		{
+			return 0;
+		}
+		uint64_t len = h.head - pos;
+		uint64_t wrap = h.size - pos % h.size;
+		if (len > wrap)
+		{
+			len = wrap;
+		}
+		if (len > (uint64_t)lSize)
+		{
+			len = lSize;
+		}
+		ssize_t n = pread(fileno(io->pFile), buffer, len, TS_RING_HEADER_SIZE + pos % h.size);
+		if (n <= 0)
+		{
+			return n;
+		}
+		/* the writer may have overtaken us while reading */
+		if (ring_header(io, &h) == 0 && pos < h.tail)
+		{
+			continue;
+		}
+		io->iOffset += n;
+		return n;
+	}
+}
+
+static int64_t ring_seek(CustomIOCtx_t *io, int64_t pos, int whence)
+{
+	ts_ring_header_t h;
+
+	if (ring_header(io, &h))
+	{
+		return -1;
+	}
+	int64_t size = h.head - io->iRingBase;
+
+	switch (whence)
+	{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			pos += io->iOffset;
+			break;
+		case SEEK_END:
+			pos += size;
+			break;
+		case AVSEEK_SIZE:
+			return size;
+		default:
+			return -1;
+	}
+	if (pos < 0)
+	{
+		return -1;
+	}
+	/* positions that were overwritten meanwhile are mapped to the tail on read */
+	io->iOffset = pos;
+	return pos;
+}
 
 int SAM_ReadFunc(void *ptr, uint8_t *buffer, int lSize)
 {
 	CustomIOCtx_t *io = (CustomIOCtx_t *)ptr;
 	int ret = 0;
 
-	if (!io->pMoovFile)
+	if (io->iRingSize)
+	{
+		ret = ring_read(io, buffer, lSize);
+#if (LIBAVFORMAT_VERSION_MAJOR > 58) || ((LIBAVFORMAT_VERSION_MAJOR == 58) && (LIBAVFORMAT_VERSION_MINOR > 79))
+		if (ret == 0)
+			ret = AVERROR_EOF;
+#endif
+	}
+	else if (io->iParts)
+	{
+		ret = split_read(io, buffer, lSize);
+#if (LIBAVFORMAT_VERSION_MAJOR > 58) || ((LIBAVFORMAT_VERSION_MAJOR == 58) && (LIBAVFORMAT_VERSION_MINOR > 79))
+		if (ret == 0)
+			ret = AVERROR_EOF;
+#endif
+	}
+	else if (!io->pMoovFile)
 	{
 		ret = (int)fread((void *) buffer, (size_t) 1, (size_t) lSize, io->pFile);
 #if (LIBAVFORMAT_VERSION_MAJOR > 58) || ((LIBAVFORMAT_VERSION_MAJOR == 58) && (LIBAVFORMAT_VERSION_MINOR > 79))
@@ -1547,7 +2096,15 @@ int64_t SAM_SeekFunc(void *ptr, int64_t pos, int whence)
 {
 	CustomIOCtx_t *io = (CustomIOCtx_t *)ptr;
 	int64_t ret = -1;
-	if (!io->pMoovFile)
+	if (io->iRingSize)
+	{
+		ret = ring_seek(io, pos, whence);
+	}
+	else if (io->iParts)
+	{
+		ret = split_seek(io, pos, whence);
+	}
+	else if (!io->pMoovFile)
 	{
 		if (AVSEEK_SIZE != whence)
 		{
@@ -1613,6 +2170,24 @@ AVIOContext *container_ffmpeg_get_avio_context(CustomIOCtx_t *custom_io, size_t
 		return NULL;
 	}
 
+	/* circular timeshift file, or a recording split by size into name.001, ... */
+	if (!custom_io->szMoovAtomFile || custom_io->szMoovAtomFile[0] == '\0')
+	{
+		ts_ring_header_t h;
+		if (ring_header(custom_io, &h) == 0)
+		{
+			/* position 0 is the oldest data at the time of opening */
+			custom_io->iRingSize = h.size;
+			custom_io->iRingBase = h.tail;
+			ffmpeg_printf(10, "ring file, size %" PRIu64 " data %" PRIu64 "..%" PRIu64 "\n", h.size, h.tail, h.head);
+		}
+		else if (split_part_size(custom_io, 1) >= 0)
+		{
+			split_scan(custom_io);
+			ffmpeg_printf(10, "split recording, %u parts\n", custom_io->iParts);
+		}
+	}
+
 	if (custom_io->szMoovAtomFile && custom_io->szMoovAtomFile[0] != '\0')
 	{
 		if (strstr(custom_io->szMoovAtomFile, "file://") == custom_io->szMoovAtomFile)
@@ -1646,40 +2221,41 @@ AVIOContext *container_ffmpeg_get_avio_context(CustomIOCtx_t *custom_io, size_t
 
 int32_t container_ffmpeg_init_av_context(Context_t *context, char *filename, uint64_t fileSize, char *moovAtomFile, uint64_t moovAtomOffset, int32_t AVIdx)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	int32_t err = 0;
 	AVInputFormat *fmt = NULL;
-	avContextTab[AVIdx] = avformat_alloc_context();
-	if (avContextTab[AVIdx] != NULL)
+	ff->avContextTab[AVIdx] = avformat_alloc_context();
+	if (ff->avContextTab[AVIdx] != NULL)
 	{
-		avContextTab[AVIdx]->interrupt_callback.callback = interrupt_cb;
-		avContextTab[AVIdx]->interrupt_callback.opaque = context->playback;
+		ff->avContextTab[AVIdx]->interrupt_callback.callback = interrupt_cb;
+		ff->avContextTab[AVIdx]->interrupt_callback.opaque = context;
 	}
 #ifdef USE_CUSTOM_IO
 	if (strstr(filename, "://") == 0 || strncmp(filename, "file://", 7) == 0)
 	{
 		AVIOContext *avio_ctx = NULL;
-		custom_io_tab[AVIdx] = malloc(sizeof(CustomIOCtx_t));
+		ff->custom_io_tab[AVIdx] = malloc(sizeof(CustomIOCtx_t));
 
-		memset(custom_io_tab[AVIdx], 0x00, sizeof(CustomIOCtx_t));
+		memset(ff->custom_io_tab[AVIdx], 0x00, sizeof(CustomIOCtx_t));
 
-		custom_io_tab[AVIdx]->szFile = filename;
-		custom_io_tab[AVIdx]->iFileSize = fileSize;
-		custom_io_tab[AVIdx]->szMoovAtomFile = moovAtomFile;
-		custom_io_tab[AVIdx]->iMoovAtomOffset = moovAtomOffset;
+		ff->custom_io_tab[AVIdx]->szFile = filename;
+		ff->custom_io_tab[AVIdx]->iFileSize = fileSize;
+		ff->custom_io_tab[AVIdx]->szMoovAtomFile = moovAtomFile;
+		ff->custom_io_tab[AVIdx]->iMoovAtomOffset = moovAtomOffset;
 
-		avio_ctx = container_ffmpeg_get_avio_context(custom_io_tab[AVIdx], 4096);
+		avio_ctx = container_ffmpeg_get_avio_context(ff->custom_io_tab[AVIdx], 4096);
 		if (avio_ctx)
 		{
-			if (avContextTab[AVIdx])
+			if (ff->avContextTab[AVIdx])
 			{
-				avContextTab[AVIdx]->pb = avio_ctx;
-				use_custom_io[AVIdx] = 1;
+				ff->avContextTab[AVIdx]->pb = avio_ctx;
+				ff->use_custom_io[AVIdx] = 1;
 			}
 		}
 		else
 		{
-			free(custom_io_tab[AVIdx]);
-			custom_io_tab[AVIdx] = NULL;
+			free(ff->custom_io_tab[AVIdx]);
+			ff->custom_io_tab[AVIdx] = NULL;
 			return cERR_CONTAINER_FFMPEG_OPEN;
 		}
 	}
@@ -1687,7 +2263,7 @@ int32_t container_ffmpeg_init_av_context(Context_t *context, char *filename, uin
 
 	AVDictionary *avio_opts = NULL;
 	AVDictionary **pavio_opts = NULL;
-	av_dict_copy(&avio_opts, g_avio_opts, 0);
+	av_dict_copy(&avio_opts, ff->avio_opts, 0);
 
 	eRTMPProtoImplType rtmpProtoImplType = RTMP_NONE;
 	uint8_t numOfRTMPImpl = 0;
@@ -1917,14 +2493,14 @@ int32_t container_ffmpeg_init_av_context(Context_t *context, char *filename, uin
 
 	pavio_opts = &avio_opts;
 
-	if (avContextTab[AVIdx] != NULL && ((err = avformat_open_input(&avContextTab[AVIdx], filename, fmt, pavio_opts)) != 0))
+	if (ff->avContextTab[AVIdx] != NULL && ((err = avformat_open_input(&ff->avContextTab[AVIdx], filename, fmt, pavio_opts)) != 0))
 	{
 		if (rtmp_proto_impl == 0 && //err == AVERROR_UNKNOWN &&
 			rtmpProtoImplType == RTMP_NATIVE &&
 			numOfRTMPImpl > 1)
 		{
 			// retry with librtmp
-			err = avformat_open_input(&avContextTab[AVIdx], filename + 2, fmt, pavio_opts);
+			err = avformat_open_input(&ff->avContextTab[AVIdx], filename + 2, fmt, pavio_opts);
 			// filename2 - another memory leak, and also only once, so does not matter
 		}
 
@@ -1940,68 +2516,80 @@ int32_t container_ffmpeg_init_av_context(Context_t *context, char *filename, uin
 			{
 				av_dict_free(&avio_opts);
 			}
-			releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+			releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 			return cERR_CONTAINER_FFMPEG_OPEN;
 		}
 	}
-	if (avContextTab[AVIdx] != NULL)
+	if (ff->avContextTab[AVIdx] != NULL)
 	{
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 0, 100)
-		avContextTab[AVIdx]->iformat->flags |= AVFMT_SEEK_TO_PTS;
+		ff->avContextTab[AVIdx]->iformat->flags |= AVFMT_SEEK_TO_PTS;
 #endif
-		avContextTab[AVIdx]->flags = AVFMT_FLAG_GENPTS;
+		ff->avContextTab[AVIdx]->flags = AVFMT_FLAG_GENPTS;
 	}
 	printf("minimal Probe: %d\n", context->playback->noprobe);
 
 	if (context->playback->noprobe)
 	{
-		wrapped_set_max_analyze_duration(avContextTab[AVIdx], 1);
+		wrapped_set_max_analyze_duration(ff->avContextTab[AVIdx], 1);
 	}
 
 	if ((strstr(filename, "127.0.0.1") == 0) || (strstr(filename, "localhost") == 0))
 	{
 		ffmpeg_printf(20, "find_streaminfo\n");
 
-		if (avformat_find_stream_info(avContextTab[AVIdx], NULL) < 0)
+		if (avformat_find_stream_info(ff->avContextTab[AVIdx], NULL) < 0)
 		{
 			ffmpeg_err("Error avformat_find_stream_info\n");
 		}
 	}
 //for buffered io
-	if (avContextTab[AVIdx] != NULL && avContextTab[AVIdx]->pb != NULL && !context->playback->isTSLiveMode)
+	if (ff->avContextTab[AVIdx] != NULL && ff->avContextTab[AVIdx]->pb != NULL && !context->playback->isTSLiveMode)
 	{
-		ffmpeg_real_read_org = avContextTab[AVIdx]->pb->read_packet;
+		FFMPEGBuffer_t *b = ff->buffer;
+
+		b->real_read_org = ff->avContextTab[AVIdx]->pb->read_packet;
 
 		if (AVIdx == 0 && strstr(filename, "://") != 0 && strncmp(filename, "file://", 7) != 0)
 		{
-			if (ffmpeg_buf_size > 0 && ffmpeg_buf_size > FILLBUFDIFF + FILLBUFPAKET)
+			ffmpeg_io_register(ff, AVIdx, ff->avContextTab[AVIdx]->pb->opaque);
+			ffmpeg_cache_open(ff->cache, filename, ff->avContextTab[AVIdx]->pb);
+
+			if (b->size > 0 && b->size > FILLBUFDIFF + FILLBUFPAKET)
 			{
-				if (avContextTab[AVIdx] != NULL && avContextTab[AVIdx]->pb != NULL)
+				if (ff->avContextTab[AVIdx] != NULL && ff->avContextTab[AVIdx]->pb != NULL)
 				{
-					ffmpeg_buf = av_malloc(ffmpeg_buf_size);
+					b->buf = av_malloc(b->size);
 
-					if (ffmpeg_buf != NULL)
+					if (b->buf != NULL)
 					{
-						ffmpeg_printf(10, "buffer size=%d\n", ffmpeg_buf_size);
-
-						ffmpeg_read_org = avContextTab[AVIdx]->pb->read_packet;
-						avContextTab[AVIdx]->pb->read_packet = ffmpeg_read;
-						ffmpeg_seek_org = avContextTab[AVIdx]->pb->seek;
-						avContextTab[AVIdx]->pb->seek = ffmpeg_seek;
-						ffmpeg_buf_read = ffmpeg_buf;
-						ffmpeg_buf_write = ffmpeg_buf;
-
-						//fill buffer
-						ffmpeg_filler(context, -1, NULL, 0);
-						ffmpeg_start_fillerTHREAD(context);
+						ffmpeg_printf(10, "buffer size=%d\n", b->size);
+
+						b->read_org = ff->avContextTab[AVIdx]->pb->read_packet;
+						ff->avContextTab[AVIdx]->pb->read_packet = ffmpeg_read;
+						b->seek_org = ff->avContextTab[AVIdx]->pb->seek;
+						ff->avContextTab[AVIdx]->pb->seek = ffmpeg_seek;
+						b->read = b->buf;
+						b->write = b->buf;
+
+						//the first read waits for the filler, not for a full buffer
+						if (ffmpeg_start_fillerTHREAD(ff) != cERR_CONTAINER_FFMPEG_NO_ERROR)
+						{
+							ff->avContextTab[AVIdx]->pb->read_packet = b->read_org;
+							ff->avContextTab[AVIdx]->pb->seek = b->seek_org;
+							ffmpeg_buf_free(ff);
+						}
 					}
 				}
 			}
 		}
 		else if (progressive_playback)
 		{
-			if (avContextTab[AVIdx] != NULL)
-				avContextTab[AVIdx]->pb->read_packet = ffmpeg_read_wrapper;
+			if (ff->avContextTab[AVIdx] != NULL)
+			{
+				ffmpeg_io_register(ff, AVIdx, ff->avContextTab[AVIdx]->pb->opaque);
+				ff->avContextTab[AVIdx]->pb->read_packet = ffmpeg_read_wrapper;
+			}
 		}
 	}
 	if (avio_opts != NULL)
@@ -2015,6 +2603,7 @@ int32_t container_ffmpeg_init_av_context(Context_t *context, char *filename, uin
 
 int32_t container_ffmpeg_init(Context_t *context, PlayFiles_t *playFilesNames)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	//int32_t err = 0;
 
 	ffmpeg_printf(10, ">\n");
@@ -2066,6 +2655,12 @@ int32_t container_ffmpeg_init(Context_t *context, PlayFiles_t *playFilesNames)
 		return res;
 	}
 
+#ifdef USE_CUSTOM_IO
+	/* offsets of a ring file wrap, it has no index */
+	if (!ff->custom_io_tab[0] || !ff->custom_io_tab[0]->iRingSize)
+#endif
+		ts_index_open(ff->index, playFilesNames->szFirstFile);
+
 	if (playFilesNames->szSecondFile && playFilesNames->szSecondFile[0] != '\0')
 	{
 		res = container_ffmpeg_init_av_context(context, playFilesNames->szSecondFile, playFilesNames->iSecondFileSize, \
@@ -2077,24 +2672,30 @@ int32_t container_ffmpeg_init(Context_t *context, PlayFiles_t *playFilesNames)
 		return res;
 	}
 
-	terminating = 0;
-	latestPts = 0;
+	ff->terminating = 0;
+	ff->latestPts = 0;
 	res = container_ffmpeg_update_tracks(context, playFilesNames->szFirstFile, 1);
 	return res;
 }
 
 int32_t container_ffmpeg_update_tracks(Context_t *context, char *filename, int32_t initial)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	Track_t *currAudioTrack = NULL;
 	Track_t *currSubtitleTrack = NULL;
 	uint32_t addedVideoTracksCount = 0;
 
-	if (terminating)
+	if (ff == NULL)
+	{
+		return cERR_CONTAINER_FFMPEG_NULL;
+	}
+
+	if (ff->terminating)
 	{
 		return cERR_CONTAINER_FFMPEG_NO_ERROR;
 	}
 
-	getMutex(__FILE__, __FUNCTION__, __LINE__);
+	getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
 	if (initial && context->manager->subtitle)
 	{
@@ -2124,18 +2725,18 @@ int32_t container_ffmpeg_update_tracks(Context_t *context, char *filename, int32
 #endif
 
 	ffmpeg_printf(20, "dump format\n");
-	if ((avContextTab[0] != NULL) && (FFMPEG_DEBUG_LEVEL > 0))
-		av_dump_format(avContextTab[0], 0, filename, 0);
+	if ((ff->avContextTab[0] != NULL) && (FFMPEG_DEBUG_LEVEL > 0))
+		av_dump_format(ff->avContextTab[0], 0, filename, 0);
 
 	uint32_t cAVIdx = 0;
 
 	for (cAVIdx = 0; cAVIdx < IPTV_AV_CONTEXT_MAX_NUM; cAVIdx += 1)
 	{
-		if (NULL == avContextTab[cAVIdx])
+		if (NULL == ff->avContextTab[cAVIdx])
 		{
 			break;
 		}
-		AVFormatContext *avContext = avContextTab[cAVIdx];
+		AVFormatContext *avContext = ff->avContextTab[cAVIdx];
 		uint32_t *stream_index = NULL;
 		uint32_t nb_stream_indexes = 0;
 
@@ -2346,7 +2947,7 @@ int32_t container_ffmpeg_update_tracks(Context_t *context, char *filename, int32
 						{
 							if (get_codecpar(stream)->codec_id == AV_CODEC_ID_MPEG4)
 							{
-								track.avCodecCtx = wrapped_avcodec_get_context(cAVIdx, stream);
+								track.avCodecCtx = wrapped_avcodec_get_context(ff, cAVIdx, stream);
 							}
 							ffmpeg_printf(1, "cAVIdx[%d]: MANAGER_ADD track VIDEO\n", cAVIdx);
 							if (context->manager->video->Command(context, MANAGER_ADD, &track) < 0)
@@ -2402,7 +3003,7 @@ int32_t container_ffmpeg_update_tracks(Context_t *context, char *filename, int32
 						if (!strncmp(encoding, "A_IPCM", 6) || !strncmp(encoding, "A_LPCM", 6))
 						{
 							track.inject_as_pcm = 1;
-							track.avCodecCtx = wrapped_avcodec_get_context(cAVIdx, stream);
+							track.avCodecCtx = wrapped_avcodec_get_context(ff, cAVIdx, stream);
 							if (track.avCodecCtx)
 							{
 								ffmpeg_printf(10, " Handle inject_as_pcm = %d\n", track.inject_as_pcm);
@@ -2774,13 +3375,14 @@ int32_t container_ffmpeg_update_tracks(Context_t *context, char *filename, int32
 		}
 	}
 
-	releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+	releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
 static int32_t container_ffmpeg_play(Context_t *context)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	int32_t error = 0;
 	int32_t ret = 0;
 	pthread_attr_t attr;
@@ -2796,21 +3398,23 @@ static int32_t container_ffmpeg_play(Context_t *context)
 		ffmpeg_printf(10, "is NOT Playing\n");
 	}
 
-	if (hasPlayThreadStarted == 0)
+	if (ff->hasPlayThreadStarted == 0)
 	{
 		pthread_attr_init(&attr);
 		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-		if ((error = pthread_create(&PlayThread, &attr, (void *)&FFMPEGThread, context)) != 0)
+		ff->playThreadRunning = 1;
+		if ((error = pthread_create(&ff->PlayThread, &attr, (void *)&FFMPEGThread, context)) != 0)
 		{
 			ffmpeg_printf(10, "Error creating thread, error:%d:%s\n", error, strerror(error));
-			hasPlayThreadStarted = 0;
+			ff->playThreadRunning = 0;
+			ff->hasPlayThreadStarted = 0;
 			ret = cERR_CONTAINER_FFMPEG_ERR;
 		}
 		else
 		{
 			ffmpeg_printf(10, "Created thread\n");
-			hasPlayThreadStarted = 1;
+			ff->hasPlayThreadStarted = 1;
 		}
 	}
 	else
@@ -2826,6 +3430,7 @@ static int32_t container_ffmpeg_play(Context_t *context)
 
 static int32_t container_ffmpeg_stop(Context_t *context)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	int32_t ret = cERR_CONTAINER_FFMPEG_NO_ERROR;
 	int32_t wait_time = 50;
 	/* we give 5s max. to close otherwise we will force close
@@ -2840,7 +3445,7 @@ static int32_t container_ffmpeg_stop(Context_t *context)
 		context->playback->isPlaying = 0;
 	}
 
-	while ((hasPlayThreadStarted != 0) && (--wait_time) > 0)
+	while ((ff->hasPlayThreadStarted != 0) && (--wait_time) > 0)
 	{
 		ffmpeg_printf(10, "Waiting for ffmpeg thread to terminate itself, will try another %d times\n", wait_time);
 		usleep(100000);
@@ -2858,41 +3463,44 @@ static int32_t container_ffmpeg_stop(Context_t *context)
 		return ret;
 	}
 
-	hasPlayThreadStarted = 0;
-	terminating = 1;
+	ff->hasPlayThreadStarted = 0;
+	ff->terminating = 1;
+
+	ffmpeg_stop_fillerTHREAD(ff);
 
-	getMutex(__FILE__, __FUNCTION__, __LINE__);
+	getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
-	free_all_stored_avcodec_context();
+	free_all_stored_avcodec_context(ff);
 
 	uint32_t i = 0;
 	for (i = 0; i < IPTV_AV_CONTEXT_MAX_NUM; i += 1)
 	{
-		if (NULL != avContextTab[i])
+		if (NULL != ff->avContextTab[i])
 		{
-			if (0 != use_custom_io[i])
+			if (0 != ff->use_custom_io[i])
 			{
 				/*
 				 * Free custom IO independently to avoid segfault/bus error
 				 * avformat_close_input do not expect custom io, so it try
 				 * to release incorrectly
 				 */
-				CustomIOCtx_t *io = (CustomIOCtx_t *)avContextTab[i]->pb->opaque;
+				CustomIOCtx_t *io = (CustomIOCtx_t *)ff->avContextTab[i]->pb->opaque;
 				if (io->pFile)
 					fclose(io->pFile);
 				if (io->pMoovFile)
 					fclose(io->pMoovFile);
-				if (custom_io_tab[i] != NULL)
+				free(io->pPartStart);
+				if (ff->custom_io_tab[i] != NULL)
 				{
-					free(custom_io_tab[i]);
-					custom_io_tab[i] = NULL;
+					free(ff->custom_io_tab[i]);
+					ff->custom_io_tab[i] = NULL;
 				}
-				av_freep(&(avContextTab[i]->pb->buffer));
-				av_freep(&(avContextTab[i]->pb));
-				use_custom_io[i] = 0;
+				av_freep(&(ff->avContextTab[i]->pb->buffer));
+				av_freep(&(ff->avContextTab[i]->pb));
+				ff->use_custom_io[i] = 0;
 			}
-			avformat_close_input(&avContextTab[i]);
-			avContextTab[i] = NULL;
+			avformat_close_input(&ff->avContextTab[i]);
+			ff->avContextTab[i] = NULL;
 		}
 		else
 		{
@@ -2900,24 +3508,27 @@ static int32_t container_ffmpeg_stop(Context_t *context)
 		}
 	}
 
-	if (g_avio_opts != NULL)
+	if (ff->avio_opts != NULL)
 	{
-		av_dict_free(&g_avio_opts);
+		av_dict_free(&ff->avio_opts);
 	}
 
 	avformat_network_deinit();
-	ffmpeg_buf_free();
+	ffmpeg_buf_free(ff);
+	ffmpeg_cache_close(ff->cache);
+	ts_index_close(ff->index);
+	ffmpeg_io_unregister(ff);
 
-	releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+	releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
 	ffmpeg_printf(10, "ret %d\n", ret);
 	return ret;
 }
 
-static int32_t container_ffmpeg_seek_bytes(off_t pos)
+static int32_t container_ffmpeg_seek_bytes(FFMPEGContext_t *ff, off_t pos)
 {
 	int32_t flag = AVSEEK_FLAG_BYTE;
-	off_t current_pos = avio_tell(avContextTab[0]->pb);
+	off_t current_pos = avio_tell(ff->avContextTab[0]->pb);
 
 	ffmpeg_printf(20, "seeking to position %" PRId64 " (bytes)\n", pos);
 
@@ -2926,23 +3537,24 @@ static int32_t container_ffmpeg_seek_bytes(off_t pos)
 		flag |= AVSEEK_FLAG_BACKWARD;
 	}
 
-	if (avformat_seek_file(avContextTab[0], -1, INT64_MIN, pos, INT64_MAX, flag) < 0)
+	if (avformat_seek_file(ff->avContextTab[0], -1, INT64_MIN, pos, INT64_MAX, flag) < 0)
 	{
 		ffmpeg_err("Error seeking\n");
 		return cERR_CONTAINER_FFMPEG_ERR;
 	}
 
-	ffmpeg_printf(30, "current_pos after seek %" PRId64 "\n", avio_tell(avContextTab[0]->pb));
+	ffmpeg_printf(30, "current_pos after seek %" PRId64 "\n", avio_tell(ff->avContextTab[0]->pb));
 
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
 static int32_t container_ffmpeg_seek(Context_t *context, int64_t sec, uint8_t absolute)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	Track_t *videoTrack = NULL;
 	Track_t *audioTrack = NULL;
 //	Track_t *current = NULL;
-	seek_target_flag = 0;
+	ff->seek_target_flag = 0;
 
 	sec *= AV_TIME_BASE;
 
@@ -3001,25 +3613,26 @@ static int32_t container_ffmpeg_seek(Context_t *context, int64_t sec, uint8_t ab
 
 	if (sec < 0)
 	{
-		seek_target_flag |= AVSEEK_FLAG_BACKWARD;
+		ff->seek_target_flag |= AVSEEK_FLAG_BACKWARD;
 	}
 
 	if (!context->playback || !context->playback->isPlaying)
 	{
-		releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+		releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 		return cERR_CONTAINER_FFMPEG_NO_ERROR;
 	}
 
-	ffmpeg_printf(10, "iformat->flags 0x%08x\n", avContextTab[0]->iformat->flags);
+	ffmpeg_printf(10, "iformat->flags 0x%08x\n", ff->avContextTab[0]->iformat->flags);
 
-	seek_target_seconds = sec;
-	do_seek_target_seconds = 1;
+	ff->seek_target_seconds = sec;
+	ff->do_seek_target_seconds = 1;
 
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
 static int32_t container_ffmpeg_get_length(Context_t *context, int64_t *length)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	ffmpeg_printf(50, "\n");
 	Track_t *videoTrack = NULL;
 	Track_t *audioTrack = NULL;
@@ -3058,9 +3671,9 @@ static int32_t container_ffmpeg_get_length(Context_t *context, int64_t *length)
 	}
 	else
 	{
-		if (avContextTab[0] != NULL)
+		if (ff->avContextTab[0] != NULL)
 		{
-			*length = avContextTab[0]->duration / 1000;
+			*length = ff->avContextTab[0]->duration / 1000;
 		}
 		else
 		{
@@ -3074,8 +3687,9 @@ static int32_t container_ffmpeg_get_length(Context_t *context, int64_t *length)
 
 static int32_t container_ffmpeg_switch_audio(Context_t *context, int32_t *arg __attribute__((unused)))
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	ffmpeg_printf(10, "track %d\n", *arg);
-	getMutex(__FILE__, __FUNCTION__, __LINE__);
+	getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
 	if (context->manager->audio)
 	{
@@ -3097,7 +3711,7 @@ static int32_t container_ffmpeg_switch_audio(Context_t *context, int32_t *arg __
 			}
 		}
 	}
-	releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+	releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 
 	/* Hellmaster1024: nothing to do here! */
 	int64_t sec = -3;
@@ -3129,13 +3743,14 @@ static int32_t container_ffmpeg_switch_subtitle(Context_t *context, int32_t *arg
  */
 static int32_t container_ffmpeg_get_info(Context_t *context, char **infoString)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	Track_t *videoTrack = NULL;
 	Track_t *audioTrack = NULL;
 	char     *meta = NULL;
 
 	ffmpeg_printf(20, ">\n");
 
-	if (avContextTab[0] != NULL)
+	if (ff->avContextTab[0] != NULL)
 	{
 		if ((infoString == NULL) || (*infoString == NULL))
 		{
@@ -3148,7 +3763,7 @@ static int32_t container_ffmpeg_get_info(Context_t *context, char **infoString)
 		context->manager->video->Command(context, MANAGER_GET_TRACK, &videoTrack);
 		context->manager->audio->Command(context, MANAGER_GET_TRACK, &audioTrack);
 
-		if ((meta = searchMeta(avContextTab[0]->metadata, *infoString)) == NULL)
+		if ((meta = searchMeta(ff->avContextTab[0]->metadata, *infoString)) == NULL)
 		{
 			if (audioTrack != NULL)
 			{
@@ -3183,6 +3798,7 @@ static int32_t container_ffmpeg_get_info(Context_t *context, char **infoString)
 
 static int container_ffmpeg_get_metadata(Context_t *context, char ***p)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	Track_t *videoTrack = NULL;
 	Track_t *audioTrack = NULL;
 	AVDictionaryEntry *tag = NULL;
@@ -3204,8 +3820,8 @@ static int container_ffmpeg_get_metadata(Context_t *context, char ***p)
 	context->manager->video->Command(context, MANAGER_GET_TRACK, &videoTrack);
 	context->manager->audio->Command(context, MANAGER_GET_TRACK, &audioTrack);
 
-	if (avContextTab[0]->metadata)
-		psize += av_dict_count(avContextTab[0]->metadata);
+	if (ff->avContextTab[0]->metadata)
+		psize += av_dict_count(ff->avContextTab[0]->metadata);
 	if (videoTrack)
 		psize += av_dict_count(((AVStream *)(videoTrack->stream))->metadata);
 	if (audioTrack)
@@ -3219,8 +3835,8 @@ static int container_ffmpeg_get_metadata(Context_t *context, char ***p)
 	}
 	pp = *p;
 
-	if (avContextTab[0]->metadata)
-		while ((tag = av_dict_get(avContextTab[0]->metadata, "", tag, AV_DICT_IGNORE_SUFFIX)))
+	if (ff->avContextTab[0]->metadata)
+		while ((tag = av_dict_get(ff->avContextTab[0]->metadata, "", tag, AV_DICT_IGNORE_SUFFIX)))
 		{
 			*pp++ = strdup(tag->key);
 			*pp++ = strdup(tag->value);
@@ -3249,12 +3865,12 @@ static int container_ffmpeg_get_metadata(Context_t *context, char ***p)
 
 	// find the first attached picture, if available
 	unlink("/tmp/.id3coverart");
-	for (unsigned int i = 0; i < avContextTab[0]->nb_streams; i++)
+	for (unsigned int i = 0; i < ff->avContextTab[0]->nb_streams; i++)
 	{
-		if (avContextTab[0]->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC)
+		if (ff->avContextTab[0]->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC)
 		{
 			AVPacket *pkt = NULL;
-			pkt = av_packet_clone(&avContextTab[0]->streams[i]->attached_pic);
+			pkt = av_packet_clone(&ff->avContextTab[0]->streams[i]->attached_pic);
 			FILE *cover_art = fopen("/tmp/.id3coverart", "wb");
 			if (cover_art)
 			{
@@ -3271,24 +3887,25 @@ static int container_ffmpeg_get_metadata(Context_t *context, char ***p)
 
 static int container_ffmpeg_av_context(Context_t *context, AVFormatContext *ext_avContext)
 {
+	FFMPEGContext_t *ff = context->ffmpeg;
 	if (!context)
 	{
 		fprintf(stderr, "BUG %s:%d\n", __func__, __LINE__);
 		return cERR_CONTAINER_FFMPEG_ERR;
 	}
-	if (avContextTab[0] != NULL)
+	if (ff->avContextTab[0] != NULL)
 	{
-		getMutex(__FILE__, __FUNCTION__, __LINE__);
-		ext_avContext->streams = avContextTab[0]->streams;
-		ext_avContext->nb_streams = avContextTab[0]->nb_streams;
-		releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+		getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+		ext_avContext->streams = ff->avContextTab[0]->streams;
+		ext_avContext->nb_streams = ff->avContextTab[0]->nb_streams;
+		releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 	}
-	else if ((avContextTab[0] == NULL) && (avContextTab[1] != NULL))
+	else if ((ff->avContextTab[0] == NULL) && (ff->avContextTab[1] != NULL))
 	{
-		getMutex(__FILE__, __FUNCTION__, __LINE__);
-		ext_avContext->streams = avContextTab[1]->streams;
-		ext_avContext->nb_streams = avContextTab[1]->nb_streams;
-		releaseMutex(__FILE__, __FUNCTION__, __LINE__);
+		getMutex(ff, __FILE__, __FUNCTION__, __LINE__);
+		ext_avContext->streams = ff->avContextTab[1]->streams;
+		ext_avContext->nb_streams = ff->avContextTab[1]->nb_streams;
+		releaseMutex(ff, __FILE__, __FUNCTION__, __LINE__);
 	}
 	else
 	{
@@ -3299,18 +3916,120 @@ static int container_ffmpeg_av_context(Context_t *context, AVFormatContext *ext_
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
+static FFMPEGContext_t *ffmpeg_context_create(Context_t *context)
+{
+	FFMPEGContext_t *ff = context->ffmpeg;
+
+	if (ff != NULL)
+	{
+		return ff;
+	}
+
+	ff = calloc(1, sizeof(FFMPEGContext_t));
+	if (ff == NULL)
+	{
+		ffmpeg_err("out of memory\n");
+		return NULL;
+	}
+
+	ff->context = context;
+	pthread_mutex_init(&ff->mutex, NULL);
+	ff->prev_seek_time_sec = -1;
+	ff->cache = ffmpeg_cache_create();
+	ff->queues = ffmpeg_queue_create();
+	ff->buffer = ffmpeg_buf_create();
+	ff->index = ts_index_create();
+
+	if (ff->cache == NULL || ff->queues == NULL || ff->buffer == NULL || ff->index == NULL)
+	{
+		ffmpeg_err("out of memory\n");
+		free(ff->cache);
+		if (ff->queues)
+		{
+			ffmpeg_queue_free(ff->queues);
+		}
+		if (ff->buffer)
+		{
+			ffmpeg_buf_destroy(ff->buffer);
+		}
+		free(ff->index);
+		pthread_mutex_destroy(&ff->mutex);
+		free(ff);
+		return NULL;
+	}
+
+	context->ffmpeg = ff;
+	return ff;
+}
+
+/* CONTAINER_DEL, after the playback was stopped */
+static void ffmpeg_context_free(Context_t *context)
+{
+	FFMPEGContext_t *ff = context->ffmpeg;
+	int32_t wait_time = 50;
+
+	if (ff == NULL)
+	{
+		return;
+	}
+
+	ffmpeg_stop_fillerTHREAD(ff);
+
+	/* the threads still use it, give them 5s like container_ffmpeg_stop() */
+	while ((__atomic_load_n(&ff->playThreadRunning, __ATOMIC_SEQ_CST) ||
+			__atomic_load_n(&ff->abandonedFillers, __ATOMIC_SEQ_CST) ||
+			ff->buffer->hasfillerThreadStarted != 0) && (--wait_time) > 0)
+	{
+		usleep(100000);
+	}
+
+	context->ffmpeg = NULL;
+
+	if (wait_time == 0)
+	{
+		ffmpeg_err("threads do not terminate, ffmpeg context %p is not freed\n", ff);
+		return;
+	}
+
+	ffmpeg_io_unregister(ff);
+	ffmpeg_buf_free(ff);
+	ffmpeg_buf_destroy(ff->buffer);
+	ffmpeg_cache_close(ff->cache);
+	free(ff->cache);
+	ffmpeg_queue_free(ff->queues);
+	ts_index_close(ff->index);
+	free(ff->index);
+	free_all_stored_avcodec_context(ff);
+	av_dict_free(&ff->avio_opts);
+	pthread_mutex_destroy(&ff->mutex);
+	free(ff);
+}
+
 static int32_t Command(Context_t *context, ContainerCmd_t command, void *argument)
 {
 	int ret = cERR_CONTAINER_FFMPEG_NO_ERROR;
+	FFMPEGContext_t *ff;
 
 	ffmpeg_printf(50, "Command %d\n", command);
 
+	if (command == CONTAINER_DEL)
+	{
+		ffmpeg_context_free(context);
+		return cERR_CONTAINER_FFMPEG_NO_ERROR;
+	}
+
+	ff = ffmpeg_context_create(context);
+	if (ff == NULL)
+	{
+		return cERR_CONTAINER_FFMPEG_NOMEM;
+	}
+
 	if (command != CONTAINER_SET_BUFFER_SEEK_TIME &&
 		command != CONTAINER_SET_BUFFER_SIZE &&
 		command != CONTAINER_GET_BUFFER_SIZE &&
 		command != CONTAINER_GET_BUFFER_STATUS &&
 		command != CONTAINER_STOP_BUFFER &&
-		command != CONTAINER_INIT && !avContextTab[0])
+		command != CONTAINER_INIT && !ff->avContextTab[0])
 	{
 		return cERR_CONTAINER_FFMPEG_ERR;
 	}
@@ -3367,26 +4086,31 @@ static int32_t Command(Context_t *context, ContainerCmd_t command, void *argumen
 		}
 		case CONTAINER_STATUS:
 		{
-			*((int32_t *)argument) = hasPlayThreadStarted;
+			*((int32_t *)argument) = ff->hasPlayThreadStarted;
 			break;
 		}
 		case CONTAINER_LAST_PTS:
 		{
-			*((int64_t *)argument) = latestPts;
+			*((int64_t *)argument) = ff->latestPts;
 			break;
 		}
 		case CONTAINER_SET_BUFFER_SIZE:
 		{
-			ret = container_set_ffmpeg_buf_size((int32_t *) argument);
+			ret = container_set_ffmpeg_buf_size(ff, (int32_t *) argument);
 			break;
 		}
 		case CONTAINER_GET_BUFFER_SIZE:
 		{
 			int32_t size = 0;
-			ret = container_get_ffmpeg_buf_size(&size);
+			ret = container_get_ffmpeg_buf_size(ff, &size);
 			*((int32_t *)argument) = size;
 			break;
 		}
+		case CONTAINER_GET_BUFFER_STATUS:
+		{
+			ret = container_get_fillbufstatus(ff, (ContainerBufferStatus_t *)argument);
+			break;
+		}
 		case CONTAINER_GET_METADATA:
 		{
 			ret = container_ffmpeg_get_metadata(context, (char ***)argument);
@@ -35,6 +35,7 @@ static int flv2mpeg4_context_write_packet_cb(void *usr_data, int keyframe __attr
 	avOut.width      = ctx->track->width;
 	avOut.height     = ctx->track->height;
 	avOut.type       = "video";
+	avOut.track      = ctx->track;
 
 	if (Write(ctx->out_ctx->output->video->Write, ctx->out_ctx, &avOut, avOut.pts) < 0)
 	{
@@ -76,12 +77,12 @@ static int flv2mpeg4_write_packet(Context_t *out_ctx, Flv2Mpeg4Context *mpeg4p2_
 		flv2mpeg4_prepare_extra_data(mpeg4p2_ctx->ctx);
 	}
 
-	*pts_current = track->pts = calcPts(cAVIdx, track->stream, pkt->pts);
+	*pts_current = track->pts = calcPts(out_ctx->ffmpeg, cAVIdx, track->stream, pkt->pts);
 	if ((*pts_current > *pts_latest) && (*pts_current != INVALID_PTS_VALUE))
 	{
 		*pts_latest = *pts_current;
 	}
-	track->dts = calcPts(cAVIdx, track->stream, pkt->dts);
+	track->dts = calcPts(out_ctx->ffmpeg, cAVIdx, track->stream, pkt->dts);
 
 	mpeg4p2_ctx->out_ctx = out_ctx;
 	mpeg4p2_ctx->track = track;
@@ -0,0 +1,224 @@
+/*
+ * Keyframe index of recordings (see ts_index.h), used for seeking and
+ * for backward trick play instead of bitrate based byte estimates.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include "ts_index.h"
+
+#define TS_INDEX_PTS_MASK 0x1FFFFFFFFLL
+/* how far (90 kHz) a seek may go back to start at an IDR instead of a CRA */
+#define TS_INDEX_IDR_RANGE (5 * 90000)
+
+typedef struct TsIndex_s
+{
+	int fd;
+	ts_index_entry_t *entries;
+	uint32_t count;
+	uint32_t size;
+	off_t readPos;		/* bytes of the index file consumed */
+	uint64_t firstPts;
+	int32_t trickPos;	/* entry of the last backward jump, -1 if none */
+	int8_t trickFrame;	/* first video packet after the jump still to show */
+} TsIndex_t;
+
+/* picks up entries appended since the last call, the recording
+ * may still be running (timeshift) */
+static void ts_index_update(TsIndex_t *ti)
+{
+	struct stat st;
+
+	if (ti->fd < 0 || fstat(ti->fd, &st) != 0)
+	{
+		return;
+	}
+
+	uint32_t n = (st.st_size - ti->readPos) / sizeof(ts_index_entry_t);
+	if (n == 0)
+	{
+		return;
+	}
+
+	if (ti->count + n > ti->size)
+	{
+		uint32_t size = ti->size ? ti->size : 1024;
+		while (size < ti->count + n)
+		{
+			size *= 2;
+		}
+		ts_index_entry_t *entries = realloc(ti->entries, size * sizeof(ts_index_entry_t));
+		if (entries == NULL)
+		{
+			ffmpeg_err("out of memory\n");
+			return;
+		}
+		ti->entries = entries;
+		ti->size = size;
+	}
+
+	ssize_t len = pread(ti->fd, ti->entries + ti->count, n * sizeof(ts_index_entry_t), ti->readPos);
+	if (len <= 0)
+	{
+		return;
+	}
+	n = len / sizeof(ts_index_entry_t);
+	ti->readPos += n * sizeof(ts_index_entry_t);
+
+	/* entries without PTS are of no use for seeking */
+	uint32_t i;
+	for (i = 0; i < n; i++)
+	{
+		ts_index_entry_t *e = &ti->entries[ti->count + i];
+		if (e->pts != TS_INDEX_NO_PTS)
+		{
+			ti->entries[ti->count++] = *e;
+		}
+	}
+	if (ti->count)
+	{
+		ti->firstPts = ti->entries[0].pts;
+	}
+	ffmpeg_printf(20, "index entries %u\n", ti->count);
+}
+
+static void ts_index_close(TsIndex_t *ti)
+{
+	if (ti->fd >= 0)
+	{
+		close(ti->fd);
+	}
+	free(ti->entries);
+	memset(ti, 0, sizeof(*ti));
+	ti->fd = -1;
+	ti->trickPos = -1;
+}
+
+static void ts_index_open(TsIndex_t *ti, const char *filename)
+{
+	ts_index_header_t header;
+	char *path;
+
+	ts_index_close(ti);
+
+	if (strncmp(filename, "file://", 7) == 0)
+	{
+		filename += 7;
+	}
+	else if (strstr(filename, "://"))
+	{
+		return;
+	}
+
+	path = malloc(strlen(filename) + sizeof(TS_INDEX_SUFFIX));
+	if (path == NULL)
+	{
+		return;
+	}
+	strcpy(path, filename);
+	strcat(path, TS_INDEX_SUFFIX);
+	ti->fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (ti->fd < 0)
+	{
+		ffmpeg_printf(10, "no index %s\n", path);
+		free(path);
+		return;
+	}
+
+	if (read(ti->fd, &header, sizeof(header)) != sizeof(header) ||
+		header.magic != TS_INDEX_MAGIC || header.entry_size != sizeof(ts_index_entry_t))
+	{
+		ffmpeg_err("invalid index %s\n", path);
+		free(path);
+		ts_index_close(ti);
+		return;
+	}
+	ffmpeg_printf(10, "index %s pid 0x%04x codec %d\n", path, header.pid, header.codec);
+	free(path);
+
+	ti->readPos = sizeof(header);
+	ts_index_update(ti);
+}
+
+/* index of the last keyframe with a PTS <= pts, -1 if there is no index */
+static int32_t ts_index_find(TsIndex_t *ti, int64_t pts)
+{
+	ts_index_update(ti);
+
+	if (ti->count == 0)
+	{
+		return -1;
+	}
+
+	uint64_t target = (pts - ti->firstPts) & TS_INDEX_PTS_MASK;
+	if (target > TS_INDEX_PTS_MASK / 2)
+	{
+		/* before the first keyframe */
+		return 0;
+	}
+
+	uint32_t lo = 0;
+	uint32_t hi = ti->count;
+	while (hi - lo > 1)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (((ti->entries[mid].pts - ti->firstPts) & TS_INDEX_PTS_MASK) <= target)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* A seek starts decoding at entry idx. Rather go back to an IDR shortly
+ * before it than start at an HEVC CRA or BLA, the pictures leading it
+ * would be lost or shown corrupt. Trick play shows single pictures and
+ * does not need this. */
+static int32_t ts_index_seek_entry(TsIndex_t *ti, int32_t idx)
+{
+	int32_t i;
+
+	for (i = idx; i >= 0; i--)
+	{
+		if (((ti->entries[idx].pts - ti->entries[i].pts) & TS_INDEX_PTS_MASK) > TS_INDEX_IDR_RANGE)
+		{
+			break;
+		}
+
+		if (ti->entries[i].type != TS_INDEX_PIC_CRA)
+		{
+			return i;
+		}
+	}
+	return idx;
+}
+
+static TsIndex_t *ts_index_create()
+{
+	TsIndex_t *ti = calloc(1, sizeof(TsIndex_t));
+
+	if (ti != NULL)
+	{
+		ti->fd = -1;
+		ti->trickPos = -1;
+	}
+	return ti;
+}
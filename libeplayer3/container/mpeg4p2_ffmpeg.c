@@ -51,6 +51,7 @@ static void mpeg4p2_write(Context_t *ctx, Mpeg4P2Context *mpeg4p2_ctx, Track_t *
 	avOut.width      = track->width;
 	avOut.height     = track->height;
 	avOut.type       = "video";
+	avOut.track      = track;
 
 	if (Write(ctx->output->video->Write, ctx, &avOut, avOut.pts) < 0)
 	{
@@ -107,7 +108,7 @@ static int mpeg4p2_write_packet(Context_t *ctx, Mpeg4P2Context *mpeg4p2_ctx, Tra
 			{
 				while ((ret = av_bsf_receive_packet(mpeg4p2_ctx->ctx, pkt)) == 0)
 				{
-					mpeg4p2_write(ctx, mpeg4p2_ctx, track, avContextTab[cAVIdx]->start_time, pts_current, pts_latest, pkt);
+					mpeg4p2_write(ctx, mpeg4p2_ctx, track, ctx->ffmpeg->avContextTab[cAVIdx]->start_time, pts_current, pts_latest, pkt);
 				}
 
 				if (ret == AVERROR(EAGAIN))
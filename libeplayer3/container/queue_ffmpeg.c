@@ -0,0 +1,316 @@
+/*
+ * Packet queues between the demuxer and the decoder injection
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/* FFMPEGThread reads the packets and queues them here, FFMPEGInjectThread
+ * takes them out and writes them to the decoders. Audio and video have a
+ * queue each, bounded in bytes and in the time between the oldest and the
+ * newest packet: enough to ride out a network hiccup or a decoder that
+ * does not take data for a moment, not so much that the reads run far
+ * ahead of the playback. */
+#define PACKET_QUEUE_VIDEO_BYTES (8 * 1024 * 1024)
+#define PACKET_QUEUE_AUDIO_BYTES (1024 * 1024)
+/* 90 kHz */
+#define PACKET_QUEUE_TIME (2 * 90000)
+/* a larger span is a timestamp jump, not a deep queue */
+#define PACKET_QUEUE_TIME_JUMP (10 * 90000)
+/* ms between checks of the playback state while waiting */
+#define PACKET_QUEUE_WAIT 100
+
+typedef struct PacketQueueNode_s
+{
+	AVPacket packet;
+	uint32_t avIdx;
+	int32_t pid;
+	int64_t dts;		/* 90 kHz, INVALID_PTS_VALUE if unknown */
+	void *stamp;		/* context->playback->stamp when it was read */
+	uint32_t serial;	/* PacketQueues_t serial when it was queued */
+	struct PacketQueueNode_s *next;
+} PacketQueueNode_t;
+
+typedef struct PacketQueue_s
+{
+	PacketQueueNode_t *head;
+	PacketQueueNode_t *tail;
+	uint32_t bytes;
+	uint32_t maxBytes;
+	int64_t headDts;	/* the oldest known dts still queued */
+	int64_t tailDts;	/* the newest */
+} PacketQueue_t;
+
+typedef struct PacketQueues_s
+{
+	PacketQueue_t video;
+	PacketQueue_t audio;
+	pthread_mutex_t mutex;
+	pthread_cond_t dataCond;
+	pthread_cond_t spaceCond;
+	/* bumped by every flush */
+	uint32_t serial;
+	int8_t stop;
+} PacketQueues_t;
+
+/* called with pq->mutex held */
+static void ffmpeg_queue_wait(PacketQueues_t *pq, pthread_cond_t *cond)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += PACKET_QUEUE_WAIT * 1000000;
+	if (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(cond, &pq->mutex, &ts);
+}
+
+static int64_t ffmpeg_queue_time(PacketQueue_t *q)
+{
+	if (q->headDts == INVALID_PTS_VALUE || q->tailDts == INVALID_PTS_VALUE)
+	{
+		return 0;
+	}
+
+	int64_t t = (q->tailDts - q->headDts) & 0x1FFFFFFFFull;
+	return t < PACKET_QUEUE_TIME_JUMP ? t : 0;
+}
+
+static int ffmpeg_queue_full(PacketQueue_t *q)
+{
+	return q->bytes >= q->maxBytes || ffmpeg_queue_time(q) >= PACKET_QUEUE_TIME;
+}
+
+static PacketQueueNode_t *ffmpeg_queue_pop(PacketQueue_t *q)
+{
+	PacketQueueNode_t *node = q->head;
+
+	q->head = node->next;
+	if (q->head == NULL)
+	{
+		q->tail = NULL;
+		q->headDts = INVALID_PTS_VALUE;
+		q->tailDts = INVALID_PTS_VALUE;
+	}
+	else if (q->head->dts != INVALID_PTS_VALUE)
+	{
+		q->headDts = q->head->dts;
+	}
+	q->bytes -= node->packet.size;
+	node->next = NULL;
+	return node;
+}
+
+/* the queue to take the next packet from: the head with the lower dts,
+ * so that the decoders get audio and video interleaved */
+static PacketQueue_t *ffmpeg_queue_next(PacketQueues_t *pq)
+{
+	PacketQueueNode_t *v = pq->video.head;
+	PacketQueueNode_t *a = pq->audio.head;
+
+	if (v == NULL || a == NULL)
+	{
+		return v ? &pq->video : (a ? &pq->audio : NULL);
+	}
+
+	if (v->dts == INVALID_PTS_VALUE || a->dts == INVALID_PTS_VALUE)
+	{
+		return v->dts == INVALID_PTS_VALUE ? &pq->video : &pq->audio;
+	}
+
+	/* the audio is later if it is less than half the 33 bit range ahead */
+	return ((a->dts - v->dts) & 0x1FFFFFFFFull) < 0x100000000ull ? &pq->video : &pq->audio;
+}
+
+/* Takes the packet over, even if it is dropped. Waits while the queue is
+ * full, unless the playback stops or seeks, the packet is stale then. */
+static int32_t ffmpeg_queue_put(Context_t *context, PacketQueue_t *q, AVPacket *packet, uint32_t avIdx, int32_t pid, int64_t dts, void *stamp)
+{
+	PacketQueues_t *pq = context->ffmpeg->queues;
+	PacketQueueNode_t *node = malloc(sizeof(PacketQueueNode_t));
+	if (node == NULL)
+	{
+		ffmpeg_err("out of memory\n");
+		wrapped_packet_unref(packet);
+		return -1;
+	}
+
+	wrapped_packet_move_ref(&node->packet, packet);
+	node->avIdx = avIdx;
+	node->pid = pid;
+	node->dts = dts;
+	node->stamp = stamp;
+	node->next = NULL;
+
+	pthread_mutex_lock(&pq->mutex);
+	while (ffmpeg_queue_full(q) && !pq->stop && PlaybackDieNow(context, 0) == 0 &&
+		context->playback->isPlaying && context->playback->stamp == stamp)
+	{
+		ffmpeg_queue_wait(pq, &pq->spaceCond);
+	}
+
+	if (ffmpeg_queue_full(q))
+	{
+		pthread_mutex_unlock(&pq->mutex);
+		wrapped_packet_unref(&node->packet);
+		free(node);
+		return -1;
+	}
+
+	node->serial = pq->serial;
+	if (q->tail)
+	{
+		q->tail->next = node;
+	}
+	else
+	{
+		q->head = node;
+	}
+	q->tail = node;
+	q->bytes += node->packet.size;
+	if (dts != INVALID_PTS_VALUE)
+	{
+		if (q->headDts == INVALID_PTS_VALUE)
+		{
+			q->headDts = dts;
+		}
+		q->tailDts = dts;
+	}
+	pthread_cond_signal(&pq->dataCond);
+	pthread_mutex_unlock(&pq->mutex);
+	return 0;
+}
+
+/* waits for the next packet, NULL when the playback ends */
+static PacketQueueNode_t *ffmpeg_queue_get(Context_t *context)
+{
+	PacketQueues_t *pq = context->ffmpeg->queues;
+	PacketQueueNode_t *node = NULL;
+
+	pthread_mutex_lock(&pq->mutex);
+	while (!pq->stop && PlaybackDieNow(context, 0) == 0 && context->playback->isPlaying)
+	{
+		PacketQueue_t *q = ffmpeg_queue_next(pq);
+		if (q)
+		{
+			node = ffmpeg_queue_pop(q);
+			pthread_cond_signal(&pq->spaceCond);
+			break;
+		}
+		ffmpeg_queue_wait(pq, &pq->dataCond);
+	}
+	pthread_mutex_unlock(&pq->mutex);
+	return node;
+}
+
+/* Drops everything queued. A packet the injection already took out is
+ * recognised by its serial, so after a seek nothing from before it
+ * reaches the decoders. */
+static void ffmpeg_queue_flush(PacketQueues_t *pq)
+{
+	PacketQueue_t *queues[] = { &pq->video, &pq->audio };
+	uint32_t i;
+
+	pthread_mutex_lock(&pq->mutex);
+	for (i = 0; i < sizeof(queues) / sizeof(queues[0]); i++)
+	{
+		while (queues[i]->head)
+		{
+			PacketQueueNode_t *node = ffmpeg_queue_pop(queues[i]);
+			wrapped_packet_unref(&node->packet);
+			free(node);
+		}
+	}
+	pq->serial++;
+	pthread_cond_broadcast(&pq->spaceCond);
+	pthread_mutex_unlock(&pq->mutex);
+}
+
+static uint32_t ffmpeg_queue_serial(PacketQueues_t *pq)
+{
+	pthread_mutex_lock(&pq->mutex);
+	uint32_t serial = pq->serial;
+	pthread_mutex_unlock(&pq->mutex);
+	return serial;
+}
+
+static int ffmpeg_queue_empty(PacketQueues_t *pq)
+{
+	pthread_mutex_lock(&pq->mutex);
+	int empty = pq->video.head == NULL && pq->audio.head == NULL;
+	pthread_mutex_unlock(&pq->mutex);
+	return empty;
+}
+
+static void ffmpeg_queue_start(PacketQueues_t *pq)
+{
+	pthread_mutex_lock(&pq->mutex);
+	pq->stop = 0;
+	pthread_mutex_unlock(&pq->mutex);
+}
+
+/* wakes both sides up for the end of the playback */
+static void ffmpeg_queue_stop(PacketQueues_t *pq)
+{
+	pthread_mutex_lock(&pq->mutex);
+	pq->stop = 1;
+	pthread_cond_broadcast(&pq->dataCond);
+	pthread_cond_broadcast(&pq->spaceCond);
+	pthread_mutex_unlock(&pq->mutex);
+}
+
+static void ffmpeg_queue_status(PacketQueues_t *pq, ContainerBufferStatus_t *status)
+{
+	pthread_mutex_lock(&pq->mutex);
+	status->videoQueueBytes = pq->video.bytes;
+	status->videoQueueTime = ffmpeg_queue_time(&pq->video) / 90;
+	status->audioQueueBytes = pq->audio.bytes;
+	status->audioQueueTime = ffmpeg_queue_time(&pq->audio) / 90;
+	pthread_mutex_unlock(&pq->mutex);
+}
+
+static PacketQueues_t *ffmpeg_queue_create()
+{
+	PacketQueues_t *pq = calloc(1, sizeof(PacketQueues_t));
+
+	if (pq == NULL)
+	{
+		return NULL;
+	}
+
+	pq->video.maxBytes = PACKET_QUEUE_VIDEO_BYTES;
+	pq->video.headDts = INVALID_PTS_VALUE;
+	pq->video.tailDts = INVALID_PTS_VALUE;
+	pq->audio.maxBytes = PACKET_QUEUE_AUDIO_BYTES;
+	pq->audio.headDts = INVALID_PTS_VALUE;
+	pq->audio.tailDts = INVALID_PTS_VALUE;
+	pthread_mutex_init(&pq->mutex, NULL);
+	pthread_cond_init(&pq->dataCond, NULL);
+	pthread_cond_init(&pq->spaceCond, NULL);
+	return pq;
+}
+
+/* nobody may wait on them anymore */
+static void ffmpeg_queue_free(PacketQueues_t *pq)
+{
+	ffmpeg_queue_flush(pq);
+	pthread_cond_destroy(&pq->spaceCond);
+	pthread_cond_destroy(&pq->dataCond);
+	pthread_mutex_destroy(&pq->mutex);
+	free(pq);
+}
@@ -41,6 +41,18 @@ static void wrapped_packet_unref(void *param)
 #endif
 }
 
+static void wrapped_packet_move_ref(AVPacket *dst, AVPacket *src)
+{
+#if (LIBAVCODEC_VERSION_MAJOR > 56)
+	av_packet_move_ref(dst, src);
+#else
+	*dst = *src;
+	av_init_packet(src);
+	src->data = NULL;
+	src->size = 0;
+#endif
+}
+
 static void wrapped_set_max_analyze_duration(void *param, int val __attribute__((unused)))
 {
 #if (LIBAVFORMAT_VERSION_MAJOR > 55) && (LIBAVFORMAT_VERSION_MAJOR < 56)
@@ -90,11 +102,9 @@ typedef struct CodecCtxStoreItem_s
 	void *next;
 } CodecCtxStoreItem_t;
 
-static CodecCtxStoreItem_t *g_codecCtxStoreListHead = NULL;
-
-AVCodecContext *restore_avcodec_context(uint32_t cAVIdx, int32_t id)
+AVCodecContext *restore_avcodec_context(FFMPEGContext_t *ff, uint32_t cAVIdx, int32_t id)
 {
-	CodecCtxStoreItem_t *ptr = g_codecCtxStoreListHead;
+	CodecCtxStoreItem_t *ptr = ff->codecCtxStore;
 	while (ptr != NULL)
 	{
 		if (ptr->cAVIdx == cAVIdx && ptr->id == id)
@@ -106,17 +116,17 @@ AVCodecContext *restore_avcodec_context(uint32_t cAVIdx, int32_t id)
 	return NULL;
 }
 
-void free_all_stored_avcodec_context()
+void free_all_stored_avcodec_context(FFMPEGContext_t *ff)
 {
-	while (g_codecCtxStoreListHead != NULL)
+	while (ff->codecCtxStore != NULL)
 	{
-		CodecCtxStoreItem_t *ptr = g_codecCtxStoreListHead->next;
-		free(g_codecCtxStoreListHead);
-		g_codecCtxStoreListHead = ptr;
+		CodecCtxStoreItem_t *ptr = ff->codecCtxStore->next;
+		free(ff->codecCtxStore);
+		ff->codecCtxStore = ptr;
 	}
 }
 
-int store_avcodec_context(AVCodecContext *avCodecCtx __attribute__((unused)), uint32_t cAVIdx __attribute__((unused)), int id __attribute__((unused)))
+int store_avcodec_context(FFMPEGContext_t *ff, AVCodecContext *avCodecCtx __attribute__((unused)), uint32_t cAVIdx __attribute__((unused)), int id __attribute__((unused)))
 {
 	CodecCtxStoreItem_t *ptr = malloc(sizeof(CodecCtxStoreItem_t));
 	if (!ptr)
@@ -125,21 +135,21 @@ int store_avcodec_context(AVCodecContext *avCodecCtx __attribute__((unused)), ui
 	}
 
 	memset(ptr, 0x00, sizeof(CodecCtxStoreItem_t));
-	ptr->next = g_codecCtxStoreListHead;
-	g_codecCtxStoreListHead = ptr;
+	ptr->next = ff->codecCtxStore;
+	ff->codecCtxStore = ptr;
 
 	return 0;
 }
 #else
-void free_all_stored_avcodec_context()
+void free_all_stored_avcodec_context(FFMPEGContext_t *ff __attribute__((unused)))
 {
 }
 #endif
 
-static AVCodecContext *wrapped_avcodec_get_context(uint32_t cAVIdx, AVStream *stream)
+static AVCodecContext *wrapped_avcodec_get_context(FFMPEGContext_t *ff, uint32_t cAVIdx, AVStream *stream)
 {
 #if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
-	AVCodecContext *avCodecCtx = restore_avcodec_context(cAVIdx, stream->id);
+	AVCodecContext *avCodecCtx = restore_avcodec_context(ff, cAVIdx, stream->id);
 	if (!avCodecCtx)
 	{
 		avCodecCtx = avcodec_alloc_context3(NULL);
@@ -160,7 +170,7 @@ static AVCodecContext *wrapped_avcodec_get_context(uint32_t cAVIdx, AVStream *st
 #else
 		avCodecCtx->pkt_timebase = stream->time_base;
 #endif
-		store_avcodec_context(avCodecCtx, cAVIdx, stream->id);
+		store_avcodec_context(ff, avCodecCtx, cAVIdx, stream->id);
 	}
 
 	return avCodecCtx;
@@ -169,10 +179,10 @@ static AVCodecContext *wrapped_avcodec_get_context(uint32_t cAVIdx, AVStream *st
 #endif
 }
 
-static void wrapped_avcodec_flush_buffers(uint32_t cAVIdx)
+static void wrapped_avcodec_flush_buffers(FFMPEGContext_t *ff, uint32_t cAVIdx)
 {
 #if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
-	CodecCtxStoreItem_t *ptr = g_codecCtxStoreListHead;
+	CodecCtxStoreItem_t *ptr = ff->codecCtxStore;
 	while (ptr != NULL)
 	{
 		if (ptr->cAVIdx == cAVIdx && ptr->avCodecCtx && ptr->avCodecCtx->codec)
@@ -183,11 +193,11 @@ static void wrapped_avcodec_flush_buffers(uint32_t cAVIdx)
 	}
 #else
 	uint32_t j;
-	for (j = 0; j < avContextTab[cAVIdx]->nb_streams; j++)
+	for (j = 0; j < ff->avContextTab[cAVIdx]->nb_streams; j++)
 	{
-		if (avContextTab[cAVIdx]->streams[j]->codec && avContextTab[cAVIdx]->streams[j]->codec->codec)
+		if (ff->avContextTab[cAVIdx]->streams[j]->codec && ff->avContextTab[cAVIdx]->streams[j]->codec->codec)
 		{
-			avcodec_flush_buffers(avContextTab[cAVIdx]->streams[j]->codec);
+			avcodec_flush_buffers(ff->avContextTab[cAVIdx]->streams[j]->codec);
 		}
 	}
 #endif
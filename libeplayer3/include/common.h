@@ -27,8 +27,33 @@ typedef struct Context_s
 	ContainerHandler_t  *container;
 	OutputHandler_t     *output;
 	ManagerHandler_t    *manager;
+
+	/* the decoders this playback writes to: videoN and audioN */
+	int32_t             decoder;
+	/* per playback state of the outputs and the write buffering, created
+	 * and freed by them, NULL until then */
+	struct LinuxDvbOutput_s *dvbOutput;
+	struct LinuxDvbBuffer_s *dvbBuffer;
+	struct SubtitleOutput_s *subtitleOutput;
+	/* the size of the write buffering, 0 for none, set before the open */
+	uint32_t            dvbBufferSize;
+	/* the state of the ffmpeg container, created by its first command
+	 * and freed by CONTAINER_DEL */
+	struct FFMPEGContext_s *ffmpeg;
+
+	/* the tracks of the managers */
+	TrackList_t         audioTracks;
+	TrackList_t         videoTracks;
+	TrackList_t         subtitleTracks;
+	TrackList_t         chapterTracks;
 } Context_t;
 
+/* A context for one playback on the decoders videoN and audioN, with
+ * its own copies of the handlers, so that several can play at the same
+ * time. Free it when the playback is closed. */
+Context_t *PlaybackCreateContext(int32_t decoder);
+void PlaybackFreeContext(Context_t *context);
+
 int container_ffmpeg_update_tracks(Context_t *context, char *filename, int initial);
 
 const char *GetGraphicSubPath();
@@ -2,6 +2,7 @@
 #define CONTAINER_H_
 
 #include <stdio.h>
+#include <stdint.h>
 
 typedef enum
 {
@@ -29,6 +30,24 @@ typedef enum
 	CONTAINER_GET_AVFCONTEXT
 } ContainerCmd_t;
 
+/* CONTAINER_GET_BUFFER_STATUS, the network part for buffered streams only */
+typedef struct ContainerBufferStatus_s
+{
+	int32_t size;		/* bytes buffered ahead of the reader */
+	int32_t capacity;	/* bytes that can be buffered ahead */
+	int32_t readSize;	/* current size of the network reads */
+	uint32_t stalls;	/* reads that had to wait for the network */
+	uint32_t stallTime;	/* ms spent waiting in them */
+	uint32_t full;		/* times the buffer ran full */
+	uint64_t total;		/* bytes read from the network */
+	int64_t cacheSize;	/* bytes in the disk cache, see ffmpeg_cache_set() */
+	uint64_t cacheHits;	/* bytes read from it */
+	int32_t videoQueueBytes;	/* demuxed, not yet written to the decoder */
+	int32_t videoQueueTime;		/* ms between the oldest and newest of them */
+	int32_t audioQueueBytes;
+	int32_t audioQueueTime;
+} ContainerBufferStatus_t;
+
 struct Context_s;
 typedef struct Context_s Context_t;
 
@@ -49,4 +68,6 @@ typedef struct ContainerHandler_s
 	int (* Command)(Context_t *, ContainerCmd_t, void *);
 } ContainerHandler_t;
 
+extern ContainerHandler_t ContainerHandler;
+
 #endif
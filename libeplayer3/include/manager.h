@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <libavutil/avutil.h>
 #include <libavutil/time.h>
@@ -29,7 +30,8 @@ typedef enum
 	MANAGER_UPDATED_TRACK_INFO,
 	MANAGER_REGISTER_UPDATED_TRACK_INFO,
 	MANAGER_REF_LIST,
-	MANAGER_REF_LIST_SIZE
+	MANAGER_REF_LIST_SIZE,
+	MANAGER_SNAPSHOT
 } ManagerCmd_t;
 
 typedef enum
@@ -85,6 +87,10 @@ typedef struct Track_s
 	int                   pending;
 	long long int         chapter_start;
 	long long int         chapter_end;
+
+	/* output writer for Encoding, looked up by the output on the
+	 * first packet of the track */
+	struct Writer_s      *writer;
 } Track_t;
 
 typedef struct TrackDescription_s
@@ -101,6 +107,50 @@ typedef struct TrackDescription_s
 
 } TrackDescription_t;
 
+/* one track of a TrackSnapshot_t */
+typedef struct TrackInfo_s
+{
+	int32_t               Id;
+	const char           *Name;
+	const char           *Encoding;
+	/* chapters only, ms */
+	int64_t               chapter_start;
+} TrackInfo_t;
+
+/* The tracks MANAGER_LIST would list, without the strings to parse.
+ * Built in one piece when the tracks change and never modified after
+ * that; generation counts up with every new one, so a caller that has
+ * seen it before can skip the rest. MANAGER_SNAPSHOT hands out a
+ * reference, drop it with releaseTrackSnapshot(). */
+typedef struct TrackSnapshot_s
+{
+	uint32_t              generation;
+	int32_t               refs;
+	int32_t               count;
+	TrackInfo_t           tracks[];
+} TrackSnapshot_t;
+
+/* the current snapshot of a manager */
+typedef struct TrackSnapshotCache_s
+{
+	pthread_mutex_t       mutex;
+	TrackSnapshot_t      *current;
+	uint32_t              generation;
+	/* set when a track is replaced, which the ids do not show */
+	int                   invalid;
+} TrackSnapshotCache_t;
+
+/* the tracks of one manager in one playback */
+typedef struct TrackList_s
+{
+	Track_t              *Tracks;
+	int                   TrackCount;
+	int                   CurrentTrack;
+	TrackSnapshotCache_t  Snapshot;
+	/* MANAGER_REGISTER_UPDATED_TRACK_INFO, video only */
+	void (* updatedTrackInfoFnc)(void);
+} TrackList_t;
+
 struct Context_s;
 typedef struct Context_s Context_t;
 
@@ -121,7 +171,16 @@ typedef struct ManagerHandler_s
 	Manager_t *chapter;
 } ManagerHandler_t;
 
+extern ManagerHandler_t ManagerHandler;
+
 void freeTrack(Track_t *track);
 void copyTrack(Track_t *to, Track_t *from);
 
+void initTrackList(TrackList_t *list, int current);
+void freeTrackList(TrackList_t *list);
+
+TrackSnapshot_t *getTrackSnapshot(TrackSnapshotCache_t *cache, Track_t *tracks, int32_t count);
+void invalidateTrackSnapshot(TrackSnapshotCache_t *cache);
+void releaseTrackSnapshot(TrackSnapshot_t *snapshot);
+
 #endif
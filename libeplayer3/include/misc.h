@@ -41,7 +41,6 @@ typedef enum
 
 void PutBits(BitPacker_t *ld, uint32_t code, uint32_t length);
 void FlushBits(BitPacker_t *ld);
-int8_t PlaybackDieNow(int8_t val);
 stb_type_t GetSTBType();
 
 /* ***************************** */
@@ -76,4 +75,16 @@ static inline uint16_t ReadUInt16(uint8_t *buffer)
 	return num;
 }
 
+/* FNV-1a, to notice changed data without keeping a copy of it */
+static inline uint32_t HashData(const uint8_t *data, uint32_t len)
+{
+	uint32_t hash = 2166136261u;
+	uint32_t i;
+	for (i = 0; i < len; i++)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
 #endif // _exteplayer3_misc_
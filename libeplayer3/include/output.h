@@ -52,6 +52,10 @@ typedef struct
 	uint32_t         infoFlags;
 
 	char            *type;
+
+	/* the track the data belongs to, lets the output skip looking up
+	 * the writer by the encoding; NULL: the current track of type */
+	struct Track_s  *track;
 } AudioVideoOut_t;
 
 typedef struct
@@ -97,4 +101,6 @@ typedef struct OutputHandler_s
 	int32_t (* Command)(Context_t *, OutputCmd_t, void *);
 } OutputHandler_t;
 
+extern OutputHandler_t OutputHandler;
+
 #endif
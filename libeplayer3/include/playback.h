@@ -3,9 +3,18 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 
-typedef void(* PlaybackDieNowCallback)();
-bool PlaybackDieNowRegisterCallback(PlaybackDieNowCallback callback);
+struct Context_s;
+typedef struct Context_s Context_t;
+
+#define MAX_PLAYBACK_DIE_NOW_CALLBACKS 10
+
+/* val 1: stop the playback of context, 2: it is closed, 0: only query */
+int8_t PlaybackDieNow(Context_t *context, int8_t val);
+
+typedef void(* PlaybackDieNowCallback)(Context_t *);
+bool PlaybackDieNowRegisterCallback(Context_t *context, PlaybackDieNowCallback callback);
 
 typedef enum
 {
@@ -31,9 +40,6 @@ typedef enum
 	PLAYBACK_METADATA
 } PlaybackCmd_t;
 
-struct Context_s;
-typedef struct Context_s Context_t;
-
 typedef struct PlaybackHandler_s
 {
 	char *Name;
@@ -69,6 +75,16 @@ typedef struct PlaybackHandler_s
 	uint32_t httpTimeout; // in ms
 
 	void *stamp;
+
+	/* PlaybackDieNow() and who it wakes up */
+	int8_t dieNow;
+	PlaybackDieNowCallback dieNowCallbacks[MAX_PLAYBACK_DIE_NOW_CALLBACKS];
+
+	pthread_t supervisorThread;
+	int hasThreadStarted;
 } PlaybackHandler_t;
 
+/* the template every context copies, see PlaybackCreateContext() */
+extern PlaybackHandler_t PlaybackHandler;
+
 #endif
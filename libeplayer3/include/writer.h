@@ -7,10 +7,11 @@
 #include "common.h"
 
 typedef enum { eNone, eAudio, eVideo} eWriterType_t;
-typedef ssize_t (* WriteV_t)(int, const struct iovec *, int);
+typedef ssize_t (* WriteV_t)(Context_t *, int, const struct iovec *, int);
 
 typedef struct
 {
+	Context_t             *context;
 	int                    fd;
 	uint8_t               *data;
 	unsigned int           len;
@@ -25,6 +26,7 @@ typedef struct
 	unsigned char          Version;
 	unsigned int           InfoFlags;
 	WriteV_t               WriteV;
+	void                  *state;         /* of the writer, for this decoder */
 } WriterAVCallData_t;
 
 typedef struct WriterCaps_s
@@ -38,11 +40,16 @@ typedef struct WriterCaps_s
 	int            dvbCodecType;  /* For mipsel */
 } WriterCaps_t;
 
+/* Writers that keep state between frames get stateSize bytes of it per
+ * decoder, zeroed and passed to reset() before the first write, and to
+ * freeState() (if set) before it is freed. */
 typedef struct Writer_s
 {
-	int (* reset)();
+	int (* reset)(void *state);
 	int (* writeData)(WriterAVCallData_t *);
 	WriterCaps_t *caps;
+	size_t stateSize;
+	void (* freeState)(void *state);
 } Writer_t;
 
 extern Writer_t WriterAudioLPCM;
@@ -91,13 +98,40 @@ Writer_t *getWriter(char *encoding);
 
 Writer_t *getDefaultVideoWriter();
 Writer_t *getDefaultAudioWriter();
-ssize_t write_with_retry(int fd, const void *buf, int size);
-ssize_t writev_with_retry(int fd, const struct iovec *iov, int ic);
+ssize_t write_with_retry(Context_t *context, int fd, const void *buf, int size);
+ssize_t writev_with_retry(Context_t *context, int fd, const struct iovec *iov, int ic);
 
 ssize_t WriteWithRetry(Context_t *context, int pipefd, int fd, void *pDVBMtx, const void *buf, int size);
 void FlushPipe(int pipefd);
 
-ssize_t WriteExt(WriteV_t _call, int fd, void *data, size_t size);
+ssize_t WriteExt(WriteV_t _call, Context_t *context, int fd, void *data, size_t size);
+
+/* The iovecs of one or more PES packets, for payloads with a varying
+ * number of pieces like NAL units. Grows as needed, small pieces are copied
+ * into one entry and a PES never takes more entries than a writev() accepts,
+ * so IOVecWrite() only splits between PES packets. Meant to be kept by the
+ * writer and reused for every frame. */
+typedef struct IOVecBuilder_s
+{
+	struct iovec *iov;
+	int32_t       count;
+	int32_t       size;
+	int32_t      *pes;          /* first entry of each PES */
+	int32_t       pesCount;
+	int32_t       pesSize;
+	uint8_t      *scratch;      /* the copied pieces */
+	uint32_t      scratchLen;
+	uint32_t      scratchSize;
+} IOVecBuilder_t;
+
+void IOVecReset(IOVecBuilder_t *b);
+void IOVecFree(IOVecBuilder_t *b);
+/* adds the PES header, its length is set when it is known */
+int32_t IOVecPesStart(IOVecBuilder_t *b, uint8_t *header);
+void IOVecPesHeaderLen(IOVecBuilder_t *b, size_t len);
+/* data must stay valid until IOVecWrite(), it may be copied */
+int32_t IOVecAdd(IOVecBuilder_t *b, const void *data, size_t len);
+ssize_t IOVecWrite(IOVecBuilder_t *b, WriteV_t _call, Context_t *context, int fd);
 
 // Subtitles
 
@@ -129,12 +163,14 @@ typedef struct
 	int height;
 } WriterSubCallData_t;
 
+/* *state is the state of the writer for one playback, NULL until the
+ * writer creates it, and again after close() */
 typedef struct SubWriter_s
 {
-	int32_t (* open)(SubtitleCodecId_t codecId, uint8_t *extradata, int extradata_size);
-	int32_t (* close)();
-	int32_t (* reset)();
-	int32_t (* write)(WriterSubCallData_t *);
+	int32_t (* open)(void **state, SubtitleCodecId_t codecId, uint8_t *extradata, int extradata_size);
+	int32_t (* close)(void **state);
+	int32_t (* reset)(void **state);
+	int32_t (* write)(void **state, WriterSubCallData_t *);
 } SubWriter_t;
 
 extern SubWriter_t WriterSubPGS;
@@ -47,7 +47,7 @@
 #define DUMP_BOOL(x) x == 0 ? "false"  : "true"
 #define IPTV_MAX_FILE_PATH 1024
 
-extern int ffmpeg_av_dict_set(const char *key, const char *value, int flags);
+extern int ffmpeg_av_dict_set(Context_t *context, const char *key, const char *value, int flags);
 extern void aac_software_decoder_set(const int32_t val);
 extern void aac_latm_software_decoder_set(const int32_t val);
 extern void dts_software_decoder_set(const int32_t val);
@@ -67,11 +67,7 @@ extern void pcm_resampling_set(int32_t val);
 extern void stereo_software_decoder_set(int32_t val);
 extern void insert_pcm_as_lpcm_set(int32_t val);
 extern void progressive_playback_set(int32_t val);
-
-extern OutputHandler_t         OutputHandler;
-extern PlaybackHandler_t       PlaybackHandler;
-extern ContainerHandler_t      ContainerHandler;
-extern ManagerHandler_t        ManagerHandler;
+extern void ffmpeg_cache_set(const char *dir, int64_t max_size);
 
 static Context_t *g_player = NULL;
 
@@ -110,7 +106,7 @@ int32_t GetGraphicWindowHeight()
 	return g_windows_height;
 }
 
-static void TerminateWakeUp()
+static void TerminateWakeUp(Context_t *context __attribute__((unused)))
 {
 	int ret = write(g_pfd[1], "x", 1);
 	if (ret != 1)
@@ -166,7 +162,7 @@ static void *TermThreadFun(void *arg __attribute__((unused)))
 	if (FD_ISSET(fd, &readfds))
 	{
 		pthread_mutex_lock(&playbackStartMtx);
-		PlaybackDieNow(1);
+		PlaybackDieNow(g_player, 1);
 		if (isPlaybackStarted)
 			TerminateAllSockets();
 		else
@@ -412,7 +408,9 @@ static int ParseParams(int argc, char *argv[], PlayFiles_t *playbackFiles, int *
 {
 	int ret = 0;
 	int c;
-	while ((c = getopt(argc, argv, "G:W:H:A:V:U:we3dlsrimva:n:x:u:c:h:o:p:P:t:9:0:1:4:f:b:F:S:O:T:")) != -1)
+	const char *cacheDir = NULL;
+	int64_t cacheSize = 0;
+	while ((c = getopt(argc, argv, "G:W:H:A:V:U:we3dlsrimva:n:x:u:c:h:o:p:P:t:9:0:1:4:f:b:F:S:O:T:C:M:")) != -1)
 	{
 		switch (c)
 		{
@@ -512,32 +510,32 @@ static int ParseParams(int argc, char *argv[], PlayFiles_t *playbackFiles, int *
 				}
 				break;
 			case 'h':
-				ffmpeg_av_dict_set("headers", optarg, 0);
+				ffmpeg_av_dict_set(g_player, "headers", optarg, 0);
 				break;
 			case 'u':
-				ffmpeg_av_dict_set("user-agent", optarg, 0);
+				ffmpeg_av_dict_set(g_player, "user-agent", optarg, 0);
 				break;
 			case 'c':
 				printf("For now cookies should be set via headers option!\n");
-				ffmpeg_av_dict_set("cookies", optarg, 0);
+				ffmpeg_av_dict_set(g_player, "cookies", optarg, 0);
 				break;
 			case 'i':
 				printf("Play in (infinity) loop.\n");
-				PlaybackHandler.isLoopMode = 1;
+				g_player->playback->isLoopMode = 1;
 				break;
 			case 'v':
 				printf("Use live TS stream mode.\n");
-				PlaybackHandler.isTSLiveMode = 1;
+				g_player->playback->isTSLiveMode = 1;
 				break;
 			case 'n':
 				printf("Force rtmp protocol implementation\n");
 				rtmp_proto_impl_set(atoi(optarg));
 				break;
 			case '0':
-				ffmpeg_av_dict_set("video_rep_index", optarg, 0);
+				ffmpeg_av_dict_set(g_player, "video_rep_index", optarg, 0);
 				break;
 			case '1':
-				ffmpeg_av_dict_set("audio_rep_index", optarg, 0);
+				ffmpeg_av_dict_set(g_player, "audio_rep_index", optarg, 0);
 				break;
 			case '4':
 #ifdef HAVE_FLV2MPEG4_CONVERTER
@@ -552,7 +550,7 @@ static int ParseParams(int argc, char *argv[], PlayFiles_t *playbackFiles, int *
 				{
 					*ffval = '\0';
 					ffval += 1;
-					ffmpeg_av_dict_set(ffopt, ffval, 0);
+					ffmpeg_av_dict_set(g_player, ffopt, ffval, 0);
 				}
 				free(ffopt);
 				break;
@@ -577,8 +575,14 @@ static int ParseParams(int argc, char *argv[], PlayFiles_t *playbackFiles, int *
 				}
 				break;
 			case 'T':
-				PlaybackHandler.httpTimeout = (uint32_t) strtoul(optarg, NULL, 10);
-				printf("Setting http timeout to %u ms\n", PlaybackHandler.httpTimeout);
+				g_player->playback->httpTimeout = (uint32_t) strtoul(optarg, NULL, 10);
+				printf("Setting http timeout to %u ms\n", g_player->playback->httpTimeout);
+				break;
+			case 'C':
+				cacheDir = optarg;
+				break;
+			case 'M':
+				cacheSize = 1024LL * 1024 * atoi(optarg);
 				break;
 
 			default:
@@ -587,6 +591,11 @@ static int ParseParams(int argc, char *argv[], PlayFiles_t *playbackFiles, int *
 		}
 	}
 
+	if (cacheDir != NULL)
+	{
+		ffmpeg_cache_set(cacheDir, cacheSize);
+	}
+
 	if (ret == 0 && optind < argc)
 	{
 		ret = 0;
@@ -632,6 +641,14 @@ int main(int argc, char *argv[])
 	PlayFiles_t playbackFiles;
 	memset(&playbackFiles, 0x00, sizeof(playbackFiles));
 
+	/* the options go straight into it */
+	g_player = PlaybackCreateContext(0);
+	if (NULL == g_player)
+	{
+		printf("g_player allocate error\n");
+		exit(1);
+	}
+
 	if (0 != ParseParams(argc, argv, &playbackFiles, &audioTrackIdx, &subtitleTrackIdx, &linuxDvbBufferSizeMB))
 	{
 		printf("Usage: exteplayer3 filePath [-u user-agent] [-c cookies] [-h headers] [-p prio] [-a] [-d] [-w] [-l] [-s] [-i] [-t audioTrackId] [-9 subtitleTrackId] [-x separateAudioUri] plabackUri\n");
@@ -654,6 +671,8 @@ int main(int argc, char *argv[])
 		printf("[-v] switch to live TS stream mode\n");
 		printf("[-n 0|1|2] rtmp force protocol implementation auto(0) native/ffmpeg(1) or librtmp(2)\n");
 		printf("[-o 0|1] set progressive download\n");
+		printf("[-C dir] disk cache for HTTP streams, seeking back is served from it\n");
+		printf("[-M size] disk cache size in MB, default 1024\n");
 		printf("[-p value] nice value\n");
 		printf("[-P value] select Program ID from multi-service stream\n");
 		printf("[-t id] audio track ID switched on at start\n");
@@ -674,13 +693,6 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	g_player = malloc(sizeof(Context_t));
-	if (NULL == g_player)
-	{
-		printf("g_player allocate error\n");
-		exit(1);
-	}
-
 	pthread_mutex_init(&playbackStartMtx, NULL);
 	do
 	{
@@ -711,11 +723,6 @@ int main(int argc, char *argv[])
 	}
 	while (0);
 
-	g_player->playback    = &PlaybackHandler;
-	g_player->output      = &OutputHandler;
-	g_player->container   = &ContainerHandler;
-	g_player->manager     = &ManagerHandler;
-
 	// make sure to kill myself when parent dies
 	prctl(PR_SET_PDEATHSIG, SIGKILL);
 
@@ -740,10 +747,7 @@ int main(int argc, char *argv[])
 	E2iSendMsg("{\"PLAYBACK_OPEN\":{\"OutputName\":\"%s\", \"file\":\"%s\", \"sts\":%d}}\n", g_player->output->Name, playbackFiles.szFirstFile, commandRetVal);
 	if (commandRetVal < 0)
 	{
-		if (NULL != g_player)
-		{
-			free(g_player);
-		}
+		PlaybackFreeContext(g_player);
 		return 10;
 	}
 
@@ -759,7 +763,7 @@ int main(int argc, char *argv[])
 
 		if (g_player->playback->isPlaying)
 		{
-			PlaybackDieNowRegisterCallback(TerminateWakeUp);
+			PlaybackDieNowRegisterCallback(g_player, TerminateWakeUp);
 
 			HandleTracks(g_player->manager->video, (PlaybackCmd_t) -1, "vc");
 			HandleTracks(g_player->manager->audio, (PlaybackCmd_t) -1, "al");
@@ -781,7 +785,7 @@ int main(int argc, char *argv[])
 			HandleTracks(g_player->manager->subtitle, (PlaybackCmd_t) -1, "sc");
 		}
 
-		while (g_player->playback->isPlaying && PlaybackDieNow(0) == 0)
+		while (g_player->playback->isPlaying && PlaybackDieNow(g_player, 0) == 0)
 		{
 			/* we made fgets non blocking */
 			if (NULL == fgets(argvBuff, sizeof(argvBuff) - 1, stdin))
@@ -965,7 +969,7 @@ int main(int argc, char *argv[])
 
 						if (g_player->container && g_player->container->selectedContainer)
 						{
-							commandRetVal = g_player->container->selectedContainer->Command((Context_t *)g_player->container, CONTAINER_LAST_PTS, &lastPts);
+							commandRetVal = g_player->container->selectedContainer->Command(g_player, CONTAINER_LAST_PTS, &lastPts);
 						}
 
 						if (commandRetVal == 0 && lastPts != INVALID_PTS_VALUE)
@@ -1017,10 +1021,7 @@ int main(int argc, char *argv[])
 		g_player->output->Command(g_player, OUTPUT_CLOSE, NULL);
 	}
 
-	if (NULL != g_player)
-	{
-		free(g_player);
-	}
+	PlaybackFreeContext(g_player);
 
 	if (isTermThreadStarted && write(g_pfd[1], "x", 1) == 1)
 	{
@@ -46,10 +46,6 @@
 /* Variables                     */
 /* ***************************** */
 
-static Track_t *Tracks = NULL;
-static int TrackCount = 0;
-static int CurrentTrack = 0;    //TRACK[0] as default.
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -58,21 +54,23 @@ static int CurrentTrack = 0;    //TRACK[0] as default.
 /* Functions                     */
 /* ***************************** */
 
-static int ManagerAdd(Context_t *context __attribute__((unused)), Track_t track)
+static int ManagerAdd(Context_t *context, Track_t track)
 {
+	TrackList_t *list = &context->chapterTracks;
+
 	chapter_mgr_printf(10, "name=\"%s\" encoding=\"%s\" id=%d\n", track.Name, track.Encoding, track.Id);
 
-	if (Tracks == NULL)
+	if (list->Tracks == NULL)
 	{
-		Tracks = malloc(sizeof(Track_t) * TRACKWRAP);
+		list->Tracks = malloc(sizeof(Track_t) * TRACKWRAP);
 		int i;
 		for (i = 0; i < TRACKWRAP; i++)
 		{
-			Tracks[i].Id = -1;
+			list->Tracks[i].Id = -1;
 		}
 	}
 
-	if (Tracks == NULL)
+	if (list->Tracks == NULL)
 	{
 		chapter_mgr_err("malloc failed\n");
 		return cERR_CHAPTER_MGR_ERROR;
@@ -81,22 +79,22 @@ static int ManagerAdd(Context_t *context __attribute__((unused)), Track_t track)
 	int i;
 	for (i = 0; i < TRACKWRAP; i++)
 	{
-		if (Tracks[i].Id == track.Id)
+		if (list->Tracks[i].Id == track.Id)
 		{
-			Tracks[i].pending = 0;
+			list->Tracks[i].pending = 0;
 			return cERR_CHAPTER_MGR_NO_ERROR;
 		}
 	}
 
-	if (TrackCount < TRACKWRAP)
+	if (list->TrackCount < TRACKWRAP)
 	{
-		copyTrack(&Tracks[TrackCount], &track);
+		copyTrack(&list->Tracks[list->TrackCount], &track);
 
-		TrackCount++;
+		list->TrackCount++;
 	}
 	else
 	{
-		chapter_mgr_err("TrackCount out if range %d - %d\n", TrackCount, TRACKWRAP);
+		chapter_mgr_err("TrackCount out if range %d - %d\n", list->TrackCount, TRACKWRAP);
 		return cERR_CHAPTER_MGR_ERROR;
 	}
 
@@ -105,16 +103,17 @@ static int ManagerAdd(Context_t *context __attribute__((unused)), Track_t track)
 	return cERR_CHAPTER_MGR_NO_ERROR;
 }
 
-static char **ManagerList(Context_t *context __attribute__((unused)))
+static char **ManagerList(Context_t *context)
 {
+	TrackList_t *list = &context->chapterTracks;
 	int i = 0, j = 0;
 	char **tracklist = NULL;
 
 	chapter_mgr_printf(10, "\n");
 
-	if (Tracks != NULL)
+	if (list->Tracks != NULL)
 	{
-		tracklist = malloc(sizeof(char *) * ((TrackCount * 2) + 1));
+		tracklist = malloc(sizeof(char *) * ((list->TrackCount * 2) + 1));
 
 		if (tracklist == NULL)
 		{
@@ -122,40 +121,42 @@ static char **ManagerList(Context_t *context __attribute__((unused)))
 			return NULL;
 		}
 
-		for (i = 0, j = 0; i < TrackCount; i++, j += 2)
+		for (i = 0, j = 0; i < list->TrackCount; i++, j += 2)
 		{
-			if (Tracks[i].pending)
+			if (list->Tracks[i].pending)
 			{
 				continue;
 			}
 
 			char tmp[20];
-			snprintf(tmp, sizeof(tmp), "%d", (int)Tracks[i].chapter_start);
+			snprintf(tmp, sizeof(tmp), "%d", (int)list->Tracks[i].chapter_start);
 			tracklist[j] = strdup(tmp);
-			tracklist[j + 1] = strdup(Tracks[i].Name);
+			tracklist[j + 1] = strdup(list->Tracks[i].Name);
 		}
 		tracklist[j] = NULL;
 	}
 
-	chapter_mgr_printf(10, "return %p (%d - %d)\n", tracklist, j, TrackCount);
+	chapter_mgr_printf(10, "return %p (%d - %d)\n", tracklist, j, list->TrackCount);
 
 	return tracklist;
 }
 
-static int ManagerDel(Context_t *context __attribute__((unused)))
+static int ManagerDel(Context_t *context)
 {
+	TrackList_t *list = &context->chapterTracks;
 	int i = 0;
 
 	chapter_mgr_printf(10, "\n");
 
-	if (Tracks != NULL)
+	if (list->Tracks != NULL)
 	{
-		for (i = 0; i < TrackCount; i++)
+		for (i = 0; i < list->TrackCount; i++)
 		{
-			freeTrack(&Tracks[i]);
+			freeTrack(&list->Tracks[i]);
 		}
-		free(Tracks);
-		Tracks = NULL;
+		free(list->Tracks);
+		list->Tracks = NULL;
+		invalidateTrackSnapshot(&list->Snapshot);
 	}
 	else
 	{
@@ -163,8 +164,8 @@ static int ManagerDel(Context_t *context __attribute__((unused)))
 		return cERR_CHAPTER_MGR_ERROR;
 	}
 
-	TrackCount = 0;
-	CurrentTrack = 0;
+	list->TrackCount = 0;
+	list->CurrentTrack = 0;
 
 	chapter_mgr_printf(10, "return no error\n");
 
@@ -173,6 +174,7 @@ static int ManagerDel(Context_t *context __attribute__((unused)))
 
 static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 {
+	TrackList_t *list = &context->chapterTracks;
 	int ret = cERR_CHAPTER_MGR_NO_ERROR;
 
 	chapter_mgr_printf(10, "\n");
@@ -191,6 +193,12 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 			*((char ***) argument) = (char **) ManagerList(context);
 			break;
 		}
+		case MANAGER_SNAPSHOT:
+		{
+			container_ffmpeg_update_tracks(context, context->playback->uri, 0);
+			*((TrackSnapshot_t **)argument) = getTrackSnapshot(&list->Snapshot, list->Tracks, list->TrackCount);
+			break;
+		}
 		case MANAGER_DEL:
 		{
 			ret = ManagerDel(context);
@@ -199,9 +207,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		case MANAGER_INIT_UPDATE:
 		{
 			int i;
-			for (i = 0; i < TrackCount; i++)
+			for (i = 0; i < list->TrackCount; i++)
 			{
-				Tracks[i].pending = 1;
+				list->Tracks[i].pending = 1;
 			}
 			break;
 		}
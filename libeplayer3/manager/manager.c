@@ -122,3 +122,165 @@ void freeTrack(Track_t *track)
 		}
 	}
 }
+
+/* current: the track selected by default, -1 for none */
+void initTrackList(TrackList_t *list, int current)
+{
+	list->Tracks = NULL;
+	list->TrackCount = 0;
+	list->CurrentTrack = current;
+	pthread_mutex_init(&list->Snapshot.mutex, NULL);
+	list->Snapshot.current = NULL;
+	list->Snapshot.generation = 0;
+	list->Snapshot.invalid = 0;
+	list->updatedTrackInfoFnc = NULL;
+}
+
+void freeTrackList(TrackList_t *list)
+{
+	int i;
+
+	if (list->Tracks != NULL)
+	{
+		for (i = 0; i < list->TrackCount; i++)
+		{
+			freeTrack(&list->Tracks[i]);
+		}
+		free(list->Tracks);
+		list->Tracks = NULL;
+	}
+	list->TrackCount = 0;
+
+	if (list->Snapshot.current != NULL)
+	{
+		releaseTrackSnapshot(list->Snapshot.current);
+		list->Snapshot.current = NULL;
+	}
+	pthread_mutex_destroy(&list->Snapshot.mutex);
+}
+
+/* the listed tracks still are the ones in snapshot */
+static int snapshotMatches(TrackSnapshot_t *snapshot, Track_t *tracks, int32_t count)
+{
+	int32_t i, j = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if (tracks[i].pending)
+		{
+			continue;
+		}
+
+		if (j >= snapshot->count || snapshot->tracks[j].Id != tracks[i].Id)
+		{
+			return 0;
+		}
+		j++;
+	}
+
+	return j == snapshot->count;
+}
+
+static TrackSnapshot_t *buildSnapshot(Track_t *tracks, int32_t count, uint32_t generation)
+{
+	TrackSnapshot_t *snapshot;
+	size_t size = sizeof(TrackSnapshot_t);
+	int32_t i, n = 0;
+	char *str;
+
+	for (i = 0; i < count; i++)
+	{
+		if (tracks[i].pending)
+		{
+			continue;
+		}
+
+		size += sizeof(TrackInfo_t);
+		size += strlen(tracks[i].Name ? tracks[i].Name : "") + 1;
+		size += strlen(tracks[i].Encoding ? tracks[i].Encoding : "") + 1;
+		n++;
+	}
+
+	snapshot = malloc(size);
+	if (snapshot == NULL)
+	{
+		return NULL;
+	}
+
+	snapshot->generation = generation;
+	snapshot->refs = 1;
+	snapshot->count = n;
+	str = (char *)&snapshot->tracks[n];
+
+	for (i = 0, n = 0; i < count; i++)
+	{
+		if (tracks[i].pending)
+		{
+			continue;
+		}
+
+		TrackInfo_t *info = &snapshot->tracks[n++];
+		info->Id = tracks[i].Id;
+		info->chapter_start = tracks[i].chapter_start;
+		info->Name = str;
+		str = stpcpy(str, tracks[i].Name ? tracks[i].Name : "") + 1;
+		info->Encoding = str;
+		str = stpcpy(str, tracks[i].Encoding ? tracks[i].Encoding : "") + 1;
+	}
+
+	return snapshot;
+}
+
+/* A reference to the snapshot of tracks, the one handed out before as
+ * long as the listed tracks stay the same. NULL if out of memory. */
+TrackSnapshot_t *getTrackSnapshot(TrackSnapshotCache_t *cache, Track_t *tracks, int32_t count)
+{
+	TrackSnapshot_t *snapshot;
+
+	if (tracks == NULL)
+	{
+		count = 0;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+
+	if (cache->current == NULL || cache->invalid || !snapshotMatches(cache->current, tracks, count))
+	{
+		snapshot = buildSnapshot(tracks, count, cache->generation + 1);
+		if (snapshot != NULL)
+		{
+			if (cache->current != NULL)
+			{
+				releaseTrackSnapshot(cache->current);
+			}
+			cache->current = snapshot;
+			cache->generation = snapshot->generation;
+			cache->invalid = 0;
+		}
+	}
+
+	snapshot = cache->current;
+	if (snapshot != NULL)
+	{
+		__atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+
+	return snapshot;
+}
+
+void invalidateTrackSnapshot(TrackSnapshotCache_t *cache)
+{
+	pthread_mutex_lock(&cache->mutex);
+	cache->invalid = 1;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+void releaseTrackSnapshot(TrackSnapshot_t *snapshot)
+{
+	if (snapshot != NULL && __atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		free(snapshot);
+	}
+}
@@ -46,10 +46,6 @@
 /* Variables                     */
 /* ***************************** */
 
-static Track_t *Tracks = NULL;
-static int TrackCount = 0;
-static int CurrentTrack = -1;   //no as default.
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -58,21 +54,23 @@ static int CurrentTrack = -1;   //no as default.
 /* Functions                     */
 /* ***************************** */
 
-static int ManagerAdd(Context_t *context __attribute__((unused)), Track_t track)
+static int ManagerAdd(Context_t *context, Track_t track)
 {
+	TrackList_t *list = &context->subtitleTracks;
+
 	subtitle_mgr_printf(10, "%s %s %d\n", track.Name, track.Encoding, track.Id);
 
-	if (Tracks == NULL)
+	if (list->Tracks == NULL)
 	{
-		Tracks = malloc(sizeof(Track_t) * TRACKWRAP);
+		list->Tracks = malloc(sizeof(Track_t) * TRACKWRAP);
 		int i;
 		for (i = 0; i < TRACKWRAP; i++)
 		{
-			Tracks[i].Id = -1;
+			list->Tracks[i].Id = -1;
 		}
 	}
 
-	if (Tracks == NULL)
+	if (list->Tracks == NULL)
 	{
 		subtitle_mgr_err("malloc failed\n");
 		return cERR_SUBTITLE_MGR_ERROR;
@@ -81,25 +79,25 @@ static int ManagerAdd(Context_t *context __attribute__((unused)), Track_t track)
 	int i;
 	for (i = 0; i < TRACKWRAP; i++)
 	{
-		if (Tracks[i].Id == track.Id)
+		if (list->Tracks[i].Id == track.Id)
 		{
-			Tracks[i].pending = 0;
+			list->Tracks[i].pending = 0;
 			return cERR_SUBTITLE_MGR_NO_ERROR;
 		}
 	}
 
-	if (TrackCount < TRACKWRAP)
+	if (list->TrackCount < TRACKWRAP)
 	{
-		copyTrack(&Tracks[TrackCount], &track);
-		TrackCount++;
+		copyTrack(&list->Tracks[list->TrackCount], &track);
+		list->TrackCount++;
 	}
 	else
 	{
-		subtitle_mgr_err("TrackCount out if range %d - %d\n", TrackCount, TRACKWRAP);
+		subtitle_mgr_err("TrackCount out if range %d - %d\n", list->TrackCount, TRACKWRAP);
 		return cERR_SUBTITLE_MGR_ERROR;
 	}
 
-	if (TrackCount > 0)
+	if (list->TrackCount > 0)
 	{
 		context->playback->isSubtitle = 1;
 	}
@@ -109,16 +107,17 @@ static int ManagerAdd(Context_t *context __attribute__((unused)), Track_t track)
 	return cERR_SUBTITLE_MGR_NO_ERROR;
 }
 
-static char **ManagerList(Context_t *context __attribute__((unused)))
+static char **ManagerList(Context_t *context)
 {
+	TrackList_t *list = &context->subtitleTracks;
 	int i = 0, j = 0;
 	char **tracklist = NULL;
 
 	subtitle_mgr_printf(10, "\n");
 
-	if (Tracks != NULL)
+	if (list->Tracks != NULL)
 	{
-		tracklist = malloc(sizeof(char *) * ((TrackCount * 2) + 1));
+		tracklist = malloc(sizeof(char *) * ((list->TrackCount * 2) + 1));
 
 		if (tracklist == NULL)
 		{
@@ -126,42 +125,44 @@ static char **ManagerList(Context_t *context __attribute__((unused)))
 			return NULL;
 		}
 
-		for (i = 0, j = 0; i < TrackCount; i++, j += 2)
+		for (i = 0, j = 0; i < list->TrackCount; i++, j += 2)
 		{
-			if (Tracks[i].pending)
+			if (list->Tracks[i].pending)
 			{
 				continue;
 			}
 
-			size_t len = strlen(Tracks[i].Name) + 20;
+			size_t len = strlen(list->Tracks[i].Name) + 20;
 			char tmp[len];
-			snprintf(tmp, len, "%d %s", Tracks[i].Id, Tracks[i].Name);
+			snprintf(tmp, len, "%d %s", list->Tracks[i].Id, list->Tracks[i].Name);
 			tracklist[j] = strdup(tmp);
-			tracklist[j + 1] = strdup(Tracks[i].Encoding);
+			tracklist[j + 1] = strdup(list->Tracks[i].Encoding);
 		}
 		tracklist[j] = NULL;
 	}
 
-	subtitle_mgr_printf(10, "return %p (%d - %d)\n", tracklist, j, TrackCount);
+	subtitle_mgr_printf(10, "return %p (%d - %d)\n", tracklist, j, list->TrackCount);
 
 	return tracklist;
 }
 
-static int ManagerDel(Context_t *context __attribute__((unused)))
+static int ManagerDel(Context_t *context)
 {
+	TrackList_t *list = &context->subtitleTracks;
 	int i = 0;
 
 	subtitle_mgr_printf(10, "\n");
 
-	if (Tracks != NULL)
+	if (list->Tracks != NULL)
 	{
-		for (i = 0; i < TrackCount; i++)
+		for (i = 0; i < list->TrackCount; i++)
 		{
-			freeTrack(&Tracks[i]);
+			freeTrack(&list->Tracks[i]);
 		}
 
-		free(Tracks);
-		Tracks = NULL;
+		free(list->Tracks);
+		list->Tracks = NULL;
+		invalidateTrackSnapshot(&list->Snapshot);
 	}
 	else
 	{
@@ -169,8 +170,8 @@ static int ManagerDel(Context_t *context __attribute__((unused)))
 		return cERR_SUBTITLE_MGR_ERROR;
 	}
 
-	TrackCount = 0;
-	CurrentTrack = -1;
+	list->TrackCount = 0;
+	list->CurrentTrack = -1;
 //	context->playback->isSubtitle = 0;
 
 	subtitle_mgr_printf(10, "return no error\n");
@@ -180,6 +181,7 @@ static int ManagerDel(Context_t *context __attribute__((unused)))
 
 static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 {
+	TrackList_t *list = &context->subtitleTracks;
 	int ret = cERR_SUBTITLE_MGR_NO_ERROR;
 
 	subtitle_mgr_printf(50, "%d\n", command);
@@ -198,13 +200,19 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 			*((char ***)argument) = (char **)ManagerList(context);
 			break;
 		}
+		case MANAGER_SNAPSHOT:
+		{
+			container_ffmpeg_update_tracks(context, context->playback->uri, 0);
+			*((TrackSnapshot_t **)argument) = getTrackSnapshot(&list->Snapshot, list->Tracks, list->TrackCount);
+			break;
+		}
 		case MANAGER_GET:
 		{
 			subtitle_mgr_printf(20, "MANAGER_GET\n");
 
-			if (TrackCount > 0 && CurrentTrack >= 0)
+			if (list->TrackCount > 0 && list->CurrentTrack >= 0)
 			{
-				*((int *)argument) = (int)Tracks[CurrentTrack].Id;
+				*((int *)argument) = (int)list->Tracks[list->CurrentTrack].Id;
 			}
 			else
 			{
@@ -214,16 +222,16 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GET_TRACK_DESC:
 		{
-			if ((TrackCount > 0) && (CurrentTrack >= 0))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0))
 			{
 				TrackDescription_t *track =  malloc(sizeof(TrackDescription_t));
 				*((TrackDescription_t **)argument) = track;
 				if (track)
 				{
 					memset(track, 0, sizeof(TrackDescription_t));
-					track->Id       = Tracks[CurrentTrack].Id;
-					track->Name     = strdup(Tracks[CurrentTrack].Name);
-					track->Encoding = strdup(Tracks[CurrentTrack].Encoding);
+					track->Id       = list->Tracks[list->CurrentTrack].Id;
+					track->Name     = strdup(list->Tracks[list->CurrentTrack].Name);
+					track->Encoding = strdup(list->Tracks[list->CurrentTrack].Encoding);
 				}
 			}
 			else
@@ -236,9 +244,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		{
 			subtitle_mgr_printf(20, "MANAGER_GET_TRACK\n");
 
-			if ((TrackCount > 0) && (CurrentTrack >= 0))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0))
 			{
-				*((Track_t **)argument) = (Track_t *) &Tracks[CurrentTrack];
+				*((Track_t **)argument) = (Track_t *) &list->Tracks[list->CurrentTrack];
 			}
 			else
 			{
@@ -248,9 +256,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GETENCODING:
 		{
-			if (TrackCount > 0 && CurrentTrack >= 0)
+			if (list->TrackCount > 0 && list->CurrentTrack >= 0)
 			{
-				*((char **)argument) = (char *)strdup(Tracks[CurrentTrack].Encoding);
+				*((char **)argument) = (char *)strdup(list->Tracks[list->CurrentTrack].Encoding);
 			}
 			else
 			{
@@ -260,9 +268,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GETNAME:
 		{
-			if (TrackCount > 0 && CurrentTrack >= 0)
+			if (list->TrackCount > 0 && list->CurrentTrack >= 0)
 			{
-				*((char **)argument) = (char *)strdup(Tracks[CurrentTrack].Name);
+				*((char **)argument) = (char *)strdup(list->Tracks[list->CurrentTrack].Name);
 			}
 			else
 			{
@@ -278,20 +286,20 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 
 			if (*((int *)argument) < 0)
 			{
-				CurrentTrack = -1;
+				list->CurrentTrack = -1;
 				break;
 			}
 
-			for (i = 0; i < TrackCount; i++)
+			for (i = 0; i < list->TrackCount; i++)
 			{
-				if (Tracks[i].Id == *((int *)argument))
+				if (list->Tracks[i].Id == *((int *)argument))
 				{
-					CurrentTrack = i;
+					list->CurrentTrack = i;
 					break;
 				}
 			}
 
-			if (i == TrackCount)
+			if (i == list->TrackCount)
 			{
 				subtitle_mgr_err("track id %d unknown\n", *((int *)argument));
 				ret = cERR_SUBTITLE_MGR_ERROR;
@@ -306,9 +314,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		case MANAGER_INIT_UPDATE:
 		{
 			int i;
-			for (i = 0; i < TrackCount; i++)
+			for (i = 0; i < list->TrackCount; i++)
 			{
-				Tracks[i].pending = 1;
+				list->Tracks[i].pending = 1;
 			}
 			break;
 		}
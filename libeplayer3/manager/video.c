@@ -46,12 +46,6 @@
 /* Variables                     */
 /* ***************************** */
 
-static Track_t *Tracks = NULL;
-static int TrackCount = 0;
-static int CurrentTrack = 0;    //TRACK[0] as default.
-
-static void (* updatedTrackInfoFnc)(void) = NULL;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -62,19 +56,21 @@ static void (* updatedTrackInfoFnc)(void) = NULL;
 
 static int ManagerAdd(Context_t *context, Track_t track)
 {
+	TrackList_t *list = &context->videoTracks;
+
 	video_mgr_printf(10, "\n");
 
-	if (Tracks == NULL)
+	if (list->Tracks == NULL)
 	{
-		Tracks = malloc(sizeof(Track_t) * TRACKWRAP);
+		list->Tracks = malloc(sizeof(Track_t) * TRACKWRAP);
 		int i;
 		for (i = 0; i < TRACKWRAP; i++)
 		{
-			Tracks[i].Id = -1;
+			list->Tracks[i].Id = -1;
 		}
 	}
 
-	if (Tracks == NULL)
+	if (list->Tracks == NULL)
 	{
 		video_mgr_err("malloc failed\n");
 		return cERR_VIDEO_MGR_ERROR;
@@ -83,25 +79,25 @@ static int ManagerAdd(Context_t *context, Track_t track)
 	int i;
 	for (i = 0; i < TRACKWRAP; i++)
 	{
-		if (Tracks[i].Id == track.Id)
+		if (list->Tracks[i].Id == track.Id)
 		{
-			Tracks[i].pending = 0;
+			list->Tracks[i].pending = 0;
 			return cERR_VIDEO_MGR_NO_ERROR;
 		}
 	}
 
-	if (TrackCount < TRACKWRAP)
+	if (list->TrackCount < TRACKWRAP)
 	{
-		copyTrack(&Tracks[TrackCount], &track);
-		TrackCount++;
+		copyTrack(&list->Tracks[list->TrackCount], &track);
+		list->TrackCount++;
 	}
 	else
 	{
-		video_mgr_err("TrackCount out if range %d - %d\n", TrackCount, TRACKWRAP);
+		video_mgr_err("TrackCount out if range %d - %d\n", list->TrackCount, TRACKWRAP);
 		return cERR_VIDEO_MGR_ERROR;
 	}
 
-	if (TrackCount > 0)
+	if (list->TrackCount > 0)
 	{
 		context->playback->isVideo = 1;
 	}
@@ -111,16 +107,17 @@ static int ManagerAdd(Context_t *context, Track_t track)
 	return cERR_VIDEO_MGR_NO_ERROR;
 }
 
-static TrackDescription_t *ManagerList(Context_t *context __attribute__((unused)))
+static TrackDescription_t *ManagerList(Context_t *context)
 {
+	TrackList_t *list = &context->videoTracks;
 	int i = 0;
 	TrackDescription_t *tracklist = NULL;
 
 	video_mgr_printf(10, "\n");
 
-	if (Tracks != NULL)
+	if (list->Tracks != NULL)
 	{
-		tracklist = malloc(sizeof(TrackDescription_t) * ((TrackCount) + 1));
+		tracklist = malloc(sizeof(TrackDescription_t) * ((list->TrackCount) + 1));
 
 		if (tracklist == NULL)
 		{
@@ -129,40 +126,41 @@ static TrackDescription_t *ManagerList(Context_t *context __attribute__((unused)
 		}
 
 		int j = 0;
-		for (i = 0; i < TrackCount; ++i)
+		for (i = 0; i < list->TrackCount; ++i)
 		{
-			if (Tracks[i].pending || Tracks[i].Id < 0)
+			if (list->Tracks[i].pending || list->Tracks[i].Id < 0)
 			{
 				continue;
 			}
 
-			tracklist[j].Id = Tracks[i].Id;
-			tracklist[j].Name = strdup(Tracks[i].Name);
-			tracklist[j].Encoding = strdup(Tracks[i].Encoding);
+			tracklist[j].Id = list->Tracks[i].Id;
+			tracklist[j].Name = strdup(list->Tracks[i].Name);
+			tracklist[j].Encoding = strdup(list->Tracks[i].Encoding);
 			++j;
 		}
 		tracklist[j].Id = -1;
 	}
 
-	video_mgr_printf(10, "return %p %d\n", tracklist, TrackCount);
+	video_mgr_printf(10, "return %p %d\n", tracklist, list->TrackCount);
 
 	return tracklist;
 }
 
 static int ManagerDel(Context_t *context)
 {
+	TrackList_t *list = &context->videoTracks;
 	int i = 0;
 
 	video_mgr_printf(10, "\n");
 
-	if (Tracks != NULL)
+	if (list->Tracks != NULL)
 	{
-		for (i = 0; i < TrackCount; i++)
+		for (i = 0; i < list->TrackCount; i++)
 		{
-			freeTrack(&Tracks[i]);
+			freeTrack(&list->Tracks[i]);
 		}
-		free(Tracks);
-		Tracks = NULL;
+		free(list->Tracks);
+		list->Tracks = NULL;
 	}
 	else
 	{
@@ -170,8 +168,8 @@ static int ManagerDel(Context_t *context)
 		return cERR_VIDEO_MGR_ERROR;
 	}
 
-	TrackCount = 0;
-	CurrentTrack = 0;
+	list->TrackCount = 0;
+	list->CurrentTrack = 0;
 	context->playback->isVideo = 0;
 
 	video_mgr_printf(10, "return no error\n");
@@ -180,6 +178,7 @@ static int ManagerDel(Context_t *context)
 
 static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 {
+	TrackList_t *list = &context->videoTracks;
 	int ret = cERR_VIDEO_MGR_NO_ERROR;
 
 	video_mgr_printf(10, "\n");
@@ -200,9 +199,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GET:
 		{
-			if ((TrackCount > 0) && (CurrentTrack >= 0))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0))
 			{
-				*((int *)argument) = (int)Tracks[CurrentTrack].Id;
+				*((int *)argument) = (int)list->Tracks[list->CurrentTrack].Id;
 			}
 			else
 			{
@@ -212,21 +211,21 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GET_TRACK_DESC:
 		{
-			if ((TrackCount > 0) && (CurrentTrack >= 0))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0))
 			{
 				TrackDescription_t *track =  malloc(sizeof(TrackDescription_t));
 				*((TrackDescription_t **)argument) = track;
 				if (track)
 				{
 					memset(track, 0, sizeof(TrackDescription_t));
-					track->Id                   = Tracks[CurrentTrack].Id;
-					track->Name                 = strdup(Tracks[CurrentTrack].Name);
-					track->Encoding             = strdup(Tracks[CurrentTrack].Encoding);
-					track->frame_rate           = Tracks[CurrentTrack].frame_rate;
-					track->width                = Tracks[CurrentTrack].width;
-					track->height               = Tracks[CurrentTrack].height;
-					track->aspect_ratio_num     = Tracks[CurrentTrack].aspect_ratio_num;
-					track->aspect_ratio_den     = Tracks[CurrentTrack].aspect_ratio_den;
+					track->Id                   = list->Tracks[list->CurrentTrack].Id;
+					track->Name                 = strdup(list->Tracks[list->CurrentTrack].Name);
+					track->Encoding             = strdup(list->Tracks[list->CurrentTrack].Encoding);
+					track->frame_rate           = list->Tracks[list->CurrentTrack].frame_rate;
+					track->width                = list->Tracks[list->CurrentTrack].width;
+					track->height               = list->Tracks[list->CurrentTrack].height;
+					track->aspect_ratio_num     = list->Tracks[list->CurrentTrack].aspect_ratio_num;
+					track->aspect_ratio_den     = list->Tracks[list->CurrentTrack].aspect_ratio_den;
 					context->output->video->Command(context, OUTPUT_GET_PROGRESSIVE, &(track->progressive));
 				}
 			}
@@ -240,9 +239,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		{
 			video_mgr_printf(20, "MANAGER_GET_TRACK\n");
 
-			if ((TrackCount > 0) && (CurrentTrack >= 0))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0))
 			{
-				*((Track_t **)argument) = (Track_t *) &Tracks[CurrentTrack];
+				*((Track_t **)argument) = (Track_t *) &list->Tracks[list->CurrentTrack];
 			}
 			else
 			{
@@ -252,9 +251,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GETENCODING:
 		{
-			if ((TrackCount > 0) && (CurrentTrack >= 0) && (Tracks[CurrentTrack].Encoding != NULL))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0) && (list->Tracks[list->CurrentTrack].Encoding != NULL))
 			{
-				*((char **)argument) = (char *)strdup(Tracks[CurrentTrack].Encoding);
+				*((char **)argument) = (char *)strdup(list->Tracks[list->CurrentTrack].Encoding);
 			}
 			else
 			{
@@ -264,9 +263,9 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		}
 		case MANAGER_GETNAME:
 		{
-			if ((TrackCount > 0) && (CurrentTrack >= 0) && (Tracks[CurrentTrack].Name != NULL))
+			if ((list->TrackCount > 0) && (list->CurrentTrack >= 0) && (list->Tracks[list->CurrentTrack].Name != NULL))
 			{
-				*((char **)argument) = (char *)strdup(Tracks[CurrentTrack].Name);
+				*((char **)argument) = (char *)strdup(list->Tracks[list->CurrentTrack].Name);
 			}
 			else
 			{
@@ -277,16 +276,16 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		case MANAGER_SET:
 		{
 			int i;
-			for (i = 0; i < TrackCount; i++)
+			for (i = 0; i < list->TrackCount; i++)
 			{
-				if (Tracks[i].Id == *((int *)argument))
+				if (list->Tracks[i].Id == *((int *)argument))
 				{
-					CurrentTrack = i;
+					list->CurrentTrack = i;
 					break;
 				}
 			}
 
-			if (i == TrackCount)
+			if (i == list->TrackCount)
 			{
 				video_mgr_err("track id %d unknown\n", *((int *)argument));
 				ret = cERR_VIDEO_MGR_ERROR;
@@ -301,21 +300,21 @@ static int Command(Context_t *context, ManagerCmd_t command, void *argument)
 		case MANAGER_INIT_UPDATE:
 		{
 			int i;
-			for (i = 0; i < TrackCount; i++)
+			for (i = 0; i < list->TrackCount; i++)
 			{
-				Tracks[i].pending = 1;
+				list->Tracks[i].pending = 1;
 			}
 			break;
 		}
 		case MANAGER_UPDATED_TRACK_INFO:
 		{
-			if (updatedTrackInfoFnc != NULL)
-				updatedTrackInfoFnc();
+			if (list->updatedTrackInfoFnc != NULL)
+				list->updatedTrackInfoFnc();
 			break;
 		}
 		case MANAGER_REGISTER_UPDATED_TRACK_INFO:
 		{
-			updatedTrackInfoFnc = (void (*)(void))argument;
+			list->updatedTrackInfoFnc = (void (*)(void))argument;
 			break;
 		}
 		default:
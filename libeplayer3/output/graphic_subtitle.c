@@ -66,8 +66,6 @@ typedef struct
 /* Variables                     */
 /* ***************************** */
 
-static decoder_sys_t *g_sys;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -133,16 +131,19 @@ static void RemoveAllRegularFiles(const char *mainDir, const char *filePattern)
 /* Functions                     */
 /* ***************************** */
 
-static int32_t Reset()
+static int32_t Reset(void **state)
 {
-	if (g_sys)
-		avcodec_flush_buffers(g_sys->p_context);
+	decoder_sys_t *p_sys = *state;
+
+	if (p_sys)
+		avcodec_flush_buffers(p_sys->p_context);
 	RemoveAllRegularFiles(GetGraphicSubPath(), "[0-9]*_[0-9]*_[0-9]*.png");
 	return 0;
 }
 
-static int32_t Open(SubtitleCodecId_t codecId, uint8_t *extradata, int extradata_size)
+static int32_t Open(void **state, SubtitleCodecId_t codecId, uint8_t *extradata, int extradata_size)
 {
+	decoder_sys_t *p_sys;
 	enum AVCodecID avCodecId = AV_CODEC_ID_NONE;
 	const AVCodec *codec;
 	bool b_need_ephemer = false;
@@ -167,24 +168,24 @@ static int32_t Open(SubtitleCodecId_t codecId, uint8_t *extradata, int extradata
 
 	codec = avcodec_find_decoder(avCodecId);
 	AVCodecContext *context = avcodec_alloc_context3(codec);
-	Reset();
+	Reset(state);
 
 	if (context == NULL)
 		return -1;
 
-	g_sys = malloc(sizeof(*g_sys));
+	p_sys = malloc(sizeof(*p_sys));
 
-	if (g_sys == NULL)
+	if (p_sys == NULL)
 	{
 		avcodec_free_context(&context);
 		return -1;
 	}
 
-	g_sys->p_context = context;
-	g_sys->p_codec = codec;
+	p_sys->p_context = context;
+	p_sys->p_codec = codec;
 	/* this mean that new subtitles atom overwrite the previous one */
-	g_sys->b_need_ephemer = b_need_ephemer;
-	g_sys->p_swctx = NULL;
+	p_sys->b_need_ephemer = b_need_ephemer;
+	p_sys->p_swctx = NULL;
 	/* */
 	context->extradata = extradata;
 	context->extradata_size = extradata_size;
@@ -194,10 +195,11 @@ static int32_t Open(SubtitleCodecId_t codecId, uint8_t *extradata, int extradata
 
 	if (ret < 0)
 	{
-		free(g_sys);
+		free(p_sys);
 		avcodec_free_context(&context);
 		return -1;
 	}
+	*state = p_sys;
 
 	/* Lazy PNG plugin init */
 	ret = PNGPlugin_init();
@@ -209,11 +211,13 @@ static int32_t Open(SubtitleCodecId_t codecId, uint8_t *extradata, int extradata
 	return 0;
 }
 
-static int32_t Close()
+static int32_t Close(void **state)
 {
-	if (g_sys)
+	decoder_sys_t *p_sys = *state;
+
+	if (p_sys)
 	{
-		AVCodecContext *ctx = g_sys->p_context;
+		AVCodecContext *ctx = p_sys->p_context;
 		if (ctx)
 		{
 			/* extradata is not allocated by us */
@@ -221,22 +225,23 @@ static int32_t Close()
 			ctx->extradata_size = 0;
 			avcodec_free_context(&ctx);
 		}
-		sws_freeContext(g_sys->p_swctx);
-		free(g_sys);
-		g_sys = NULL;
+		sws_freeContext(p_sys->p_swctx);
+		free(p_sys);
+		*state = NULL;
 	}
-	Reset();
+	Reset(state);
 	return 0;
 }
 
-static int32_t Write(WriterSubCallData_t *subPacket)
+static int32_t Write(void **state, WriterSubCallData_t *subPacket)
 {
 	if (!subPacket)
 		return -1;
 
-	if (!g_sys)
-		if (Open(subPacket->codecId, subPacket->private_data, subPacket->private_size))
+	if (!*state)
+		if (Open(state, subPacket->codecId, subPacket->private_data, subPacket->private_size))
 			return -1;
+	decoder_sys_t *p_sys = *state;
 	AVSubtitle subtitle;
 	memset(&subtitle, 0, sizeof(subtitle));
 	AVPacket *pkt;
@@ -245,9 +250,9 @@ static int32_t Write(WriterSubCallData_t *subPacket)
 	pkt->size = subPacket->len;
 	pkt->pts  = subPacket->pts;
 	int has_subtitle = 0;
-	//int used = avcodec_decode_subtitle2(g_sys->p_context, &subtitle, &has_subtitle, &pkt);
-	uint32_t width = g_sys->p_context->width > 0 ? g_sys->p_context->width : subPacket->width;
-	uint32_t height = g_sys->p_context->height > 0 ? g_sys->p_context->height : subPacket->height;
+	//int used = avcodec_decode_subtitle2(p_sys->p_context, &subtitle, &has_subtitle, &pkt);
+	uint32_t width = p_sys->p_context->width > 0 ? p_sys->p_context->width : subPacket->width;
+	uint32_t height = p_sys->p_context->height > 0 ? p_sys->p_context->height : subPacket->height;
 
 	if (has_subtitle && width > 0 && height > 0)
 	{
@@ -292,8 +297,8 @@ static int32_t Write(WriterSubCallData_t *subPacket)
 						break;
 					}
 
-					g_sys->p_swctx = sws_getCachedContext(g_sys->p_swctx, rec->w, rec->h, AV_PIX_FMT_PAL8, desc_tab[j].w, desc_tab[j].h, AV_PIX_FMT_RGBA, SWS_BICUBIC, NULL, NULL, NULL); // SWS_FAST_BILINEAR
-					sws_scale(g_sys->p_swctx, (const uint8_t *const *)rec->data, rec->linesize, 0, rec->h, data, linesize);
+					p_sys->p_swctx = sws_getCachedContext(p_sys->p_swctx, rec->w, rec->h, AV_PIX_FMT_PAL8, desc_tab[j].w, desc_tab[j].h, AV_PIX_FMT_RGBA, SWS_BICUBIC, NULL, NULL, NULL); // SWS_FAST_BILINEAR
+					sws_scale(p_sys->p_swctx, (const uint8_t *const *)rec->data, rec->linesize, 0, rec->h, data, linesize);
 
 					if (PNGPlugin_saveRGBAImage(filepath, &(data[0][0]), desc_tab[j].w, desc_tab[j].h) == 0)
 					{
@@ -312,7 +317,7 @@ static int32_t Write(WriterSubCallData_t *subPacket)
 		E2iStartMsg();
 		E2iSendMsg("{\"s_a\":{\"id\":%d,\"s\":%"PRId64, subPacket->trackId, startTimestamp);
 
-		if (g_sys->b_need_ephemer)
+		if (p_sys->b_need_ephemer)
 			E2iSendMsg(",\"e\":null,\"r\":[");
 		else
 			E2iSendMsg(",\"e\":%"PRId64",\"r\":[", endTimestamp);
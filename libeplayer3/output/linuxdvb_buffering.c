@@ -50,47 +50,76 @@ typedef enum OutputType_e
 	OUTPUT_VIDEO,
 } OutputType_t;
 
+/* a record in the ring, followed by its data */
 typedef struct BufferingNode_s
 {
 	uint32_t dataSize;
 	OutputType_t dataType;
 	void *stamp;
-	struct BufferingNode_s *next;
 } BufferingNode_t;
 
+/* The buffering of one playback, in context->dvbBuffer. The buffers are
+ * never freed, a late BufferingWriteV() only finds them stopped, and the
+ * ring is kept for the next playback.
+ *
+ * The queue is one preallocated ring of records, each kept contiguous: a
+ * record that does not fit before the end starts at 0 and ringWrap marks
+ * where the data before it ends. The thread writes the record at ringNext
+ * straight from the ring, ringRead only moves past it when the write is
+ * done, so [ringRead, ringWrite) is never overwritten. */
+typedef struct LinuxDvbBuffer_s
+{
+	bool initialized;
+	bool inUse;
+	Context_t *context;
+	pthread_t thread;
+	pthread_mutex_t mtx;
+	pthread_cond_t exitCond;
+	pthread_cond_t dataConsumedCond;
+	pthread_cond_t writeFinishedCond;
+	pthread_cond_t dataAddedCond;
+	bool hasThreadStarted;
+	bool stop;
+
+	uint8_t *ring;
+	uint32_t ringSize;
+	uint32_t ringRead;
+	uint32_t ringNext;
+	uint32_t ringWrite;
+	uint32_t ringWrap;
+
+	int videofd;
+	int audiofd;
+	int pfd[2];
+
+	pthread_mutex_t *pDVBMtx;
+
+	bool duringWrite;
+	bool signalWriteFinish;
+
+	void *writeStamp;
+} LinuxDvbBuffer_t;
+
 /* ***************************** */
 /* Makros/Constants              */
 /* ***************************** */
 #define cERR_LINUX_DVB_BUFFERING_NO_ERROR      0
 #define cERR_LINUX_DVB_BUFFERING_ERROR        -1
 
+/* records start aligned, for the header */
+#define BUFFERING_ALIGN(x) (((x) + 7) & ~7u)
+#define BUFFERING_NO_WRAP  UINT32_MAX
+
+/* playbacks with buffered output at the same time */
+#define MAX_BUFFERS 4
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static pthread_t bufferingThread;
-static pthread_mutex_t bufferingMtx;
-static pthread_cond_t  bufferingExitCond;
-static pthread_cond_t  bufferingDataConsumedCond;
-static pthread_cond_t  bufferingWriteFinishedCond;
-static pthread_cond_t  bufferingdDataAddedCond;
-static bool hasBufferingThreadStarted = false;
-static BufferingNode_t *bufferingQueueHead = NULL;
-static BufferingNode_t *bufferingQueueTail = NULL;
-
-static uint32_t maxBufferingDataSize = 0;
-static uint32_t bufferingDataSize = 0;
-
-static int videofd = -1;
-static int audiofd = -1;
-static int g_pfd[2] = {-1, -1};
-
-static pthread_mutex_t *g_pDVBMtx = NULL;
-
-static bool g_bDuringWrite = false;
-static bool g_bSignalWriteFinish = false;
-
-static void *g_pWriteStamp = NULL;
+/* the buffers of all playbacks, reused */
+static pthread_mutex_t buffersMtx = PTHREAD_MUTEX_INITIALIZER;
+static LinuxDvbBuffer_t buffers[MAX_BUFFERS];
 
 /* ***************************** */
 /* Prototypes                    */
@@ -100,225 +129,319 @@ static void *g_pWriteStamp = NULL;
 /* MISC Functions                */
 /* ***************************** */
 
-static void WriteWakeUp()
+/* called with buf->mtx held, the offset to put a record of size at,
+ * or -1 if there is no room for it yet */
+static int64_t RingReserve(LinuxDvbBuffer_t *buf, uint32_t size)
+{
+	if (buf->ringRead == buf->ringWrite && buf->ringNext == buf->ringWrite)
+	{
+		/* empty and nothing in the write */
+		buf->ringRead = buf->ringNext = buf->ringWrite = 0;
+		buf->ringWrap = BUFFERING_NO_WRAP;
+	}
+
+	if (buf->ringWrite >= buf->ringRead)
+	{
+		if (size <= buf->ringSize - buf->ringWrite)
+		{
+			return buf->ringWrite;
+		}
+		/* at the start, not up to ringRead: equal positions are empty */
+		if (size < buf->ringRead)
+		{
+			buf->ringWrap = buf->ringWrite;
+			return 0;
+		}
+		return -1;
+	}
+
+	if (size < buf->ringRead - buf->ringWrite)
+	{
+		return buf->ringWrite;
+	}
+	return -1;
+}
+
+static void BufferWakeUp(LinuxDvbBuffer_t *buf)
 {
-	int ret = write(g_pfd[1], "x", 1);
+	int ret = write(buf->pfd[1], "x", 1);
 	if (ret != 1)
 	{
 		buff_printf(20, "WriteWakeUp write return %d\n", ret);
 	}
 }
 
-/* ***************************** */
-/* Worker Thread                 */
-/* ***************************** */
+/* the PlaybackDieNow callback */
+static void WriteWakeUp(Context_t *context)
+{
+	pthread_mutex_lock(&buffersMtx);
+	if (context->dvbBuffer && context->dvbBuffer->inUse)
+	{
+		BufferWakeUp(context->dvbBuffer);
+	}
+	pthread_mutex_unlock(&buffersMtx);
+}
 
-static void LinuxDvbBuffThread(Context_t *context)
+/* a buffer not used by a playback or a thread */
+static LinuxDvbBuffer_t *BufferCreate(Context_t *context)
 {
+	int i;
 	int flags = 0;
-	static BufferingNode_t *nodePtr = NULL;
-	buff_printf(20, "ENTER\n");
+	LinuxDvbBuffer_t *buf = NULL;
 
-	if (pipe(g_pfd) == -1)
+	pthread_mutex_lock(&buffersMtx);
+	for (i = 0; i < MAX_BUFFERS; i++)
 	{
-		buff_err("critical error\n");
+		if (!buffers[i].inUse && !buffers[i].hasThreadStarted)
+		{
+			buf = &buffers[i];
+			break;
+		}
 	}
-
-	/* Make read and write ends of pipe nonblocking */
-	if ((flags = fcntl(g_pfd[0], F_GETFL)) == -1)
+	if (buf == NULL)
 	{
-		buff_err("critical error\n");
+		pthread_mutex_unlock(&buffersMtx);
+		buff_err("too many buffered playbacks\n");
+		return NULL;
 	}
 
-	/* Make read end nonblocking */
-	flags |= O_NONBLOCK;
-	if (fcntl(g_pfd[0], F_SETFL, flags) == -1)
+	if (!buf->initialized)
 	{
-		buff_err("critical error\n");
-	}
+		/* init synchronization prymitives, before the thread waits on them */
+		pthread_mutex_init(&buf->mtx, NULL);
 
-	if ((flags = fcntl(g_pfd[1], F_GETFL)) == -1)
-	{
-		buff_err("critical error\n");
+		pthread_cond_init(&buf->exitCond, NULL);
+		pthread_cond_init(&buf->dataConsumedCond, NULL);
+		pthread_cond_init(&buf->writeFinishedCond, NULL);
+		pthread_cond_init(&buf->dataAddedCond, NULL);
+
+		if (pipe(buf->pfd) == -1)
+		{
+			buff_err("critical error\n");
+		}
+
+		/* Make read and write ends of pipe nonblocking */
+		for (i = 0; i < 2; i++)
+		{
+			if ((flags = fcntl(buf->pfd[i], F_GETFL)) == -1 ||
+				fcntl(buf->pfd[i], F_SETFL, flags | O_NONBLOCK) == -1)
+			{
+				buff_err("critical error\n");
+			}
+		}
+		buf->initialized = true;
 	}
 
-	/* Make write end nonblocking */
-	flags |= O_NONBLOCK;
-	if (fcntl(g_pfd[1], F_SETFL, flags) == -1)
+	if (buf->ringSize != context->dvbBufferSize)
 	{
-		buff_err("critical error\n");
+		free(buf->ring);
+		buf->ringSize = 0;
+		buf->ring = malloc(context->dvbBufferSize);
+		if (buf->ring == NULL)
+		{
+			pthread_mutex_unlock(&buffersMtx);
+			buff_err("OUT OF MEM\n");
+			return NULL;
+		}
+		buf->ringSize = context->dvbBufferSize;
 	}
 
-	PlaybackDieNowRegisterCallback(WriteWakeUp);
+	FlushPipe(buf->pfd[0]);
+	pthread_mutex_lock(&buf->mtx);
+	buf->context = context;
+	buf->videofd = -1;
+	buf->audiofd = -1;
+	buf->stop = false;
+	buf->duringWrite = false;
+	buf->signalWriteFinish = false;
+	buf->writeStamp = NULL;
+	buf->ringRead = buf->ringNext = buf->ringWrite = 0;
+	buf->ringWrap = BUFFERING_NO_WRAP;
+	pthread_mutex_unlock(&buf->mtx);
+	buf->inUse = true;
+	pthread_mutex_unlock(&buffersMtx);
+
+	return buf;
+}
 
-	while (PlaybackDieNow(0) == 0)
+/* ***************************** */
+/* Worker Thread                 */
+/* ***************************** */
+
+static void LinuxDvbBuffThread(LinuxDvbBuffer_t *buf)
+{
+	Context_t *context = buf->context;
+	BufferingNode_t *nodePtr = NULL;
+	buff_printf(20, "ENTER\n");
+
+	PlaybackDieNowRegisterCallback(context, WriteWakeUp);
+
+	while (PlaybackDieNow(context, 0) == 0 && !buf->stop)
 	{
-		pthread_mutex_lock(&bufferingMtx);
-		g_bDuringWrite = false;
-		if (g_bSignalWriteFinish)
+		pthread_mutex_lock(&buf->mtx);
+		buf->duringWrite = false;
+		if (buf->signalWriteFinish)
 		{
-			pthread_cond_signal(&bufferingWriteFinishedCond);
-			g_bSignalWriteFinish = false;
+			pthread_cond_signal(&buf->writeFinishedCond);
+			buf->signalWriteFinish = false;
 		}
-		if (nodePtr)
+		if (buf->ringRead != buf->ringNext)
 		{
-			free(nodePtr);
-			nodePtr = NULL;
+			/* the record written last, or the ones dropped by a flush */
+			buf->ringRead = buf->ringNext;
 			/* signal that we free some space in queue */
-			pthread_cond_signal(&bufferingDataConsumedCond);
+			pthread_cond_signal(&buf->dataConsumedCond);
 		}
 
-		if (!bufferingQueueHead)
+		if (buf->stop)
 		{
-			assert(bufferingQueueTail == NULL);
+			pthread_mutex_unlock(&buf->mtx);
+			break;
+		}
 
+		if (buf->ringNext == buf->ringWrite)
+		{
 			/* Queue is empty we need to wait for data to be added */
-			pthread_cond_wait(&bufferingdDataAddedCond, &bufferingMtx);
-			pthread_mutex_unlock(&bufferingMtx);
-			continue; /* To check PlaybackDieNow(0) */
+			pthread_cond_wait(&buf->dataAddedCond, &buf->mtx);
+			pthread_mutex_unlock(&buf->mtx);
+			continue; /* To check PlaybackDieNow() */
 		}
-		else
-		{
-			nodePtr = bufferingQueueHead;
-			bufferingQueueHead = bufferingQueueHead->next;
-			if (bufferingQueueHead == NULL)
-			{
-				bufferingQueueTail = NULL;
-			}
 
-			if (bufferingDataSize >= (nodePtr->dataSize + sizeof(BufferingNode_t)))
-			{
-				bufferingDataSize -= (nodePtr->dataSize + sizeof(BufferingNode_t));
-			}
-			else
-			{
-				assert(bufferingDataSize == 0);
-				bufferingDataSize = 0;
-			}
+		if (buf->ringNext == buf->ringWrap)
+		{
+			buf->ringRead = buf->ringNext = 0;
+			buf->ringWrap = BUFFERING_NO_WRAP;
 		}
+		nodePtr = (BufferingNode_t *)(buf->ring + buf->ringNext);
+		buf->ringNext += BUFFERING_ALIGN(sizeof(BufferingNode_t) + nodePtr->dataSize);
 
 		/* We will write data without mutex
 		 * this have some disadvantage because we can
 		 * write some portion of data after LinuxDvbBuffFlush,
 		 * for example after seek.
 		 */
-		if (nodePtr && !context->playback->isSeeking && context->playback->stamp == nodePtr->stamp)
+		if (!context->playback->isSeeking && context->playback->stamp == nodePtr->stamp)
 		{
 			/* Write data to valid output */
 			uint8_t *dataPtr = (uint8_t *)nodePtr + sizeof(BufferingNode_t);
-			int fd = nodePtr->dataType == OUTPUT_VIDEO ? videofd : audiofd;
-			g_bDuringWrite = true;
-			pthread_mutex_unlock(&bufferingMtx);
-			if (0 != WriteWithRetry(context, g_pfd[0], fd, g_pDVBMtx, dataPtr, nodePtr->dataSize))
+			int fd = nodePtr->dataType == OUTPUT_VIDEO ? buf->videofd : buf->audiofd;
+			buf->duringWrite = true;
+			pthread_mutex_unlock(&buf->mtx);
+			if (0 != WriteWithRetry(context, buf->pfd[0], fd, buf->pDVBMtx, dataPtr, nodePtr->dataSize))
 			{
 				buff_err("Something is WRONG\n");
 			}
 		}
 		else
 		{
-			pthread_mutex_unlock(&bufferingMtx);
+			pthread_mutex_unlock(&buf->mtx);
 		}
 	}
 
-	pthread_mutex_lock(&bufferingMtx);
-	pthread_cond_signal(&bufferingExitCond);
-	pthread_mutex_unlock(&bufferingMtx);
-
 	buff_printf(20, "EXIT\n");
-	hasBufferingThreadStarted = false;
 
-	close(g_pfd[0]);
-	close(g_pfd[1]);
-	g_pfd[0] = -1;
-	g_pfd[1] = -1;
+	/* the buffer can be used for the next playback now */
+	pthread_mutex_lock(&buffersMtx);
+	pthread_mutex_lock(&buf->mtx);
+	buf->hasThreadStarted = false;
+	pthread_cond_signal(&buf->exitCond);
+	pthread_mutex_unlock(&buf->mtx);
+	pthread_mutex_unlock(&buffersMtx);
 }
 
-int32_t LinuxDvbBuffSetSize(const uint32_t bufferSize)
+int32_t LinuxDvbBuffSetSize(Context_t *context, const uint32_t bufferSize)
 {
-	maxBufferingDataSize = bufferSize;
+	context->dvbBufferSize = bufferSize;
 	return cERR_LINUX_DVB_BUFFERING_NO_ERROR;
 }
 
-uint32_t LinuxDvbBuffGetSize()
+uint32_t LinuxDvbBuffGetSize(Context_t *context)
 {
-	return maxBufferingDataSize;
+	return context->dvbBufferSize;
 }
 
 int32_t LinuxDvbBuffOpen(Context_t *context, char *type, int outfd, void *mtx)
 {
 	int32_t error = 0;
 	int32_t ret = cERR_LINUX_DVB_BUFFERING_NO_ERROR;
+	LinuxDvbBuffer_t *buf = context->dvbBuffer;
 
 	buff_printf(10, "\n");
 
-	if (!hasBufferingThreadStarted)
+	if (buf == NULL)
+	{
+		buf = BufferCreate(context);
+		if (buf == NULL)
+		{
+			return cERR_LINUX_DVB_BUFFERING_ERROR;
+		}
+		context->dvbBuffer = buf;
+	}
+
+	if (!buf->hasThreadStarted)
 	{
 		pthread_attr_t attr;
 		pthread_attr_init(&attr);
 		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-		g_pDVBMtx = mtx;
+		buf->pDVBMtx = mtx;
+		buf->stop = false;
+		pthread_mutex_lock(&buffersMtx);
+		buf->hasThreadStarted = true;
+		pthread_mutex_unlock(&buffersMtx);
 
-		if ((error = pthread_create(&bufferingThread, &attr, (void *)&LinuxDvbBuffThread, context)) != 0)
+		if ((error = pthread_create(&buf->thread, &attr, (void *)&LinuxDvbBuffThread, buf)) != 0)
 		{
 			buff_printf(10, "Creating thread, error:%d:%s\n", error, strerror(error));
 
-			hasBufferingThreadStarted = false;
-			ret = cERR_LINUX_DVB_BUFFERING_ERROR;
+			pthread_mutex_lock(&buffersMtx);
+			buf->hasThreadStarted = false;
+			pthread_mutex_unlock(&buffersMtx);
+			return cERR_LINUX_DVB_BUFFERING_ERROR;
 		}
-		else
-		{
-			buff_printf(10, "Created thread\n");
-			hasBufferingThreadStarted = true;
 
-			/* init synchronization prymitives */
-			pthread_mutex_init(&bufferingMtx, NULL);
-
-			pthread_cond_init(&bufferingExitCond, NULL);
-			pthread_cond_init(&bufferingDataConsumedCond, NULL);
-			pthread_cond_init(&bufferingWriteFinishedCond, NULL);
-			pthread_cond_init(&bufferingdDataAddedCond, NULL);
-		}
+		buff_printf(10, "Created thread\n");
 	}
 
-	if (!ret)
+	if (!strcmp("video", type) && buf->videofd == -1)
 	{
-		if (!strcmp("video", type) && videofd == -1)
-		{
-			videofd = outfd;
-		}
-		else if (!strcmp("audio", type) && audiofd == -1)
-		{
-			audiofd = outfd;
-		}
-		else
-		{
-			ret = cERR_LINUX_DVB_BUFFERING_ERROR;
-		}
+		buf->videofd = outfd;
+	}
+	else if (!strcmp("audio", type) && buf->audiofd == -1)
+	{
+		buf->audiofd = outfd;
+	}
+	else
+	{
+		ret = cERR_LINUX_DVB_BUFFERING_ERROR;
 	}
 
 	buff_printf(10, "exiting with value %d\n", ret);
 	return ret;
 }
 
-int32_t LinuxDvbBuffClose(Context_t *context __attribute__((unused)))
+int32_t LinuxDvbBuffClose(Context_t *context)
 {
 	int32_t ret = 0;
+	LinuxDvbBuffer_t *buf = context->dvbBuffer;
 
 	buff_printf(10, "\n");
-	videofd = -1;
-	audiofd = -1;
 
-	if (hasBufferingThreadStarted)
+	if (buf)
 	{
 		struct timespec max_wait = {0, 0};
 
-		/* WakeUp if we are waiting in the write */
-		WriteWakeUp();
+		pthread_mutex_lock(&buf->mtx);
+		buf->videofd = -1;
+		buf->audiofd = -1;
+		buf->stop = true;
+		/* wake up if thread is waiting for data, or a write for space */
+		pthread_cond_signal(&buf->dataAddedCond);
+		pthread_cond_broadcast(&buf->dataConsumedCond);
+		pthread_mutex_unlock(&buf->mtx);
 
-		pthread_mutex_lock(&bufferingMtx);
-		/* wake up if thread is waiting for data */
-		pthread_cond_signal(&bufferingdDataAddedCond);
+		/* WakeUp if we are waiting in the write */
+		BufferWakeUp(buf);
 
 		/* wait for thread end */
 #if 0
@@ -328,101 +451,120 @@ int32_t LinuxDvbBuffClose(Context_t *context __attribute__((unused)))
 #else
 		max_wait.tv_sec = time(NULL) + 2;
 #endif
-		pthread_cond_timedwait(&bufferingExitCond, &bufferingMtx, &max_wait);
-		pthread_mutex_unlock(&bufferingMtx);
-
-		if (!hasBufferingThreadStarted)
+		pthread_mutex_lock(&buf->mtx);
+		while (buf->hasThreadStarted)
+		{
+			if (pthread_cond_timedwait(&buf->exitCond, &buf->mtx, &max_wait) == ETIMEDOUT)
+			{
+				break;
+			}
+		}
+		if (buf->hasThreadStarted)
 		{
-			/* destroy synchronization prymitives?
-			 * for a moment, we'll exit linux process,
-			 * so the system will do this for us
-			 */
-			/*
-			pthread_mutex_destroy(&bufferingMtx);
-			pthread_cond_destroy(&bufferingDataConsumedCond);
-			pthread_cond_destroy(&bufferingWriteFinishedCond);
-			pthread_cond_destroy(&bufferingdDataAddedCond);
-			*/
+			/* still in a write, the buffer is used again when it ends */
+			buff_err("buffering thread did not stop\n");
+			ret = cERR_LINUX_DVB_BUFFERING_ERROR;
 		}
-	}
+		pthread_mutex_unlock(&buf->mtx);
 
-	ret = hasBufferingThreadStarted ? cERR_LINUX_DVB_BUFFERING_ERROR : cERR_LINUX_DVB_BUFFERING_NO_ERROR;
+		pthread_mutex_lock(&buffersMtx);
+		buf->inUse = false;
+		pthread_mutex_unlock(&buffersMtx);
+		context->dvbBuffer = NULL;
+	}
 
 	buff_printf(10, "exiting with value %d\n", ret);
 	return ret;
 }
 
-int32_t LinuxDvbBuffFlush(Context_t *context __attribute__((unused)))
+int32_t LinuxDvbBuffFlush(Context_t *context)
 {
-	static BufferingNode_t *nodePtr = NULL;
-	buff_printf(40, "ENTER bufferingQueueHead[%p]\n", bufferingQueueHead);
+	LinuxDvbBuffer_t *buf = context->dvbBuffer;
+	buff_printf(40, "ENTER\n");
 
-	/* signal if we are waiting for write to DVB decoders */
-	WriteWakeUp();
+	if (buf == NULL)
+	{
+		return 0;
+	}
 
-	pthread_mutex_lock(&bufferingMtx);
-	while (bufferingQueueHead)
+	/* signal if we are waiting for write to DVB decoders */
+	BufferWakeUp(buf);
+
+	pthread_mutex_lock(&buf->mtx);
+	buff_printf(40, "ringRead [%u] ringWrite [%u]\n", buf->ringRead, buf->ringWrite);
+	/* drop everything not taken yet, the record in the write is
+	 * released by the thread when it is done */
+	buf->ringNext = buf->ringWrite;
+	buf->ringWrap = BUFFERING_NO_WRAP;
+	if (!buf->duringWrite)
 	{
-		nodePtr = bufferingQueueHead;
-		bufferingQueueHead = nodePtr->next;
-		bufferingDataSize -= (nodePtr->dataSize + sizeof(BufferingNode_t));
-		free(nodePtr);
+		buf->ringRead = buf->ringNext = buf->ringWrite = 0;
 	}
-	bufferingQueueHead = NULL;
-	bufferingQueueTail = NULL;
-	buff_printf(40, "bufferingDataSize [%u]\n", bufferingDataSize);
-	assert(bufferingDataSize == 0);
-	bufferingDataSize = 0;
 
 	/* signal that queue is empty */
-	pthread_cond_signal(&bufferingDataConsumedCond);
+	pthread_cond_signal(&buf->dataConsumedCond);
 
-	while (g_bDuringWrite && !PlaybackDieNow(0))
+	while (buf->duringWrite && !PlaybackDieNow(context, 0))
 	{
-		g_bSignalWriteFinish = true;
-		pthread_cond_wait(&bufferingWriteFinishedCond, &bufferingMtx);
+		buf->signalWriteFinish = true;
+		pthread_cond_wait(&buf->writeFinishedCond, &buf->mtx);
 	}
-	pthread_mutex_unlock(&bufferingMtx);
+	pthread_mutex_unlock(&buf->mtx);
 	buff_printf(40, "EXIT\n");
 
 	return 0;
 }
 
-int32_t LinuxDvbBuffResume(Context_t *context __attribute__((unused)))
+int32_t LinuxDvbBuffResume(Context_t *context)
 {
 	/* signal if we are waiting for write to DVB decoders
 	 *
 	 */
-	WriteWakeUp();
+	if (context->dvbBuffer)
+	{
+		BufferWakeUp(context->dvbBuffer);
+	}
 
 	return 0;
 }
 
-void LinuxDvbBuffSetStamp(void *stamp)
+void LinuxDvbBuffSetStamp(Context_t *context, void *stamp)
 {
-	g_pWriteStamp = stamp;
+	if (context->dvbBuffer)
+	{
+		context->dvbBuffer->writeStamp = stamp;
+	}
 }
 
-ssize_t BufferingWriteV(int fd, const struct iovec *iov, int ic)
+ssize_t BufferingWriteV(Context_t *context, int fd, const struct iovec *iov, int ic)
 {
 	OutputType_t dataType = OUTPUT_UNK;
+	LinuxDvbBuffer_t *buf = NULL;
 	BufferingNode_t *nodePtr = NULL;
 	uint8_t *dataPtr = NULL;
 	uint32_t chunkSize = 0;
+	uint32_t recordSize = 0;
 	int i = 0;
 
 	buff_printf(60, "ENTER\n");
-	if (fd == videofd)
+	pthread_mutex_lock(&buffersMtx);
+	buf = context->dvbBuffer;
+	if (buf && buf->inUse)
 	{
-		buff_printf(60, "VIDEO\n");
-		dataType = OUTPUT_VIDEO;
-	}
-	else if (fd == audiofd)
-	{
-		buff_printf(60, "AUDIO\n");
-		dataType = OUTPUT_AUDIO;
+		if (fd == buf->videofd)
+		{
+			buff_printf(60, "VIDEO\n");
+			dataType = OUTPUT_VIDEO;
+		}
+		else if (fd == buf->audiofd)
+		{
+			buff_printf(60, "AUDIO\n");
+			dataType = OUTPUT_AUDIO;
+		}
 	}
-	else
+	pthread_mutex_unlock(&buffersMtx);
+
+	if (dataType == OUTPUT_UNK)
 	{
 		buff_err("Unknown output type\n");
 		return cERR_LINUX_DVB_BUFFERING_ERROR;
@@ -432,59 +574,47 @@ ssize_t BufferingWriteV(int fd, const struct iovec *iov, int ic)
 	{
 		chunkSize += iov[i].iov_len;
 	}
-	chunkSize += sizeof(BufferingNode_t);
+	recordSize = BUFFERING_ALIGN(sizeof(BufferingNode_t) + chunkSize);
 
-	/* Allocate memory for queue node + data */
-	nodePtr = malloc(chunkSize);
-	if (!nodePtr)
+	pthread_mutex_lock(&buf->mtx);
+	if (recordSize > buf->ringSize)
 	{
-		buff_err("OUT OF MEM\n");
+		pthread_mutex_unlock(&buf->mtx);
+		buff_err("chunk of %u does not fit into the buffer of %u\n", chunkSize, buf->ringSize);
 		return cERR_LINUX_DVB_BUFFERING_ERROR;
 	}
 
-	/* Copy data to new buffer */
-	dataPtr = (uint8_t *)nodePtr + sizeof(BufferingNode_t);
-	for (i = 0; i < ic; ++i)
-	{
-		memcpy(dataPtr, iov[i].iov_base, iov[i].iov_len);
-		dataPtr += iov[i].iov_len;
-	}
-
-	pthread_mutex_lock(&bufferingMtx);
-	while (PlaybackDieNow(0) == 0)
+	while (PlaybackDieNow(context, 0) == 0 && !buf->stop)
 	{
-		if (bufferingDataSize + chunkSize >= maxBufferingDataSize)
+		int64_t pos = RingReserve(buf, recordSize);
+		if (pos < 0)
 		{
 			/* Buffering queue is full we need wait for space*/
-			pthread_cond_wait(&bufferingDataConsumedCond, &bufferingMtx);
+			pthread_cond_wait(&buf->dataConsumedCond, &buf->mtx);
 		}
 		else
 		{
-			/* Add chunk to buffering queue */
-			if (bufferingQueueHead == NULL)
-			{
-				bufferingQueueHead = nodePtr;
-				bufferingQueueTail = nodePtr;
-			}
-			else
-			{
-				bufferingQueueTail->next = nodePtr;
-				bufferingQueueTail = nodePtr;
-			}
-
-			bufferingDataSize += chunkSize;
-			chunkSize -= sizeof(BufferingNode_t);
+			/* Add chunk to buffering queue, copied with the mutex
+			 * held as a flush may reset the ring any time */
+			nodePtr = (BufferingNode_t *)(buf->ring + pos);
 			nodePtr->dataSize = chunkSize;
 			nodePtr->dataType = dataType;
-			nodePtr->stamp = g_pWriteStamp;
-			nodePtr->next = NULL;
+			nodePtr->stamp = buf->writeStamp;
+
+			dataPtr = (uint8_t *)nodePtr + sizeof(BufferingNode_t);
+			for (i = 0; i < ic; ++i)
+			{
+				memcpy(dataPtr, iov[i].iov_base, iov[i].iov_len);
+				dataPtr += iov[i].iov_len;
+			}
+			buf->ringWrite = pos + recordSize;
 
 			/* signal that we added some data to queue */
-			pthread_cond_signal(&bufferingdDataAddedCond);
+			pthread_cond_signal(&buf->dataAddedCond);
 			break;
 		}
 	}
-	pthread_mutex_unlock(&bufferingMtx);
+	pthread_mutex_unlock(&buf->mtx);
 	buff_printf(60, "EXIT\n");
 	return chunkSize;
 }
@@ -59,11 +59,8 @@
 #define cERR_LINUXDVB_NO_ERROR      0
 #define cERR_LINUXDVB_ERROR        -1
 
-static const char VIDEODEV[] = "/dev/dvb/adapter0/video0";
-static const char AUDIODEV[] = "/dev/dvb/adapter0/audio0";
-
-static int videofd = -1;
-static int audiofd = -1;
+#define VIDEODEV "/dev/dvb/adapter0/video%d"
+#define AUDIODEV "/dev/dvb/adapter0/audio%d"
 
 struct DVBApiVideoInfo_s
 {
@@ -72,12 +69,28 @@ struct DVBApiVideoInfo_s
 	int frame_rate;
 	int width, height;
 };
-static struct DVBApiVideoInfo_s videoInfo = {-1, -1, -1, -1, -1};
 
-unsigned long long int sCURRENT_PTS = 0;
-bool isBufferedOutput = false;
+/* the writer last used for a decoder and its state */
+typedef struct WriterSlot_s
+{
+	Writer_t *writer;
+	void *state;
+} WriterSlot_t;
 
-pthread_mutex_t LinuxDVBmutex;
+/* the decoders of one playback, context->dvbOutput */
+typedef struct LinuxDvbOutput_s
+{
+	int videofd;
+	int audiofd;
+	struct DVBApiVideoInfo_s videoInfo;
+	unsigned long long int currentPts;
+	WriterSlot_t videoWriter;
+	WriterSlot_t audioWriter;
+	pthread_mutex_t mutex;
+} LinuxDvbOutput_t;
+
+/* set once by OUTPUT_SET_BUFFER_SIZE, before the decoders are opened */
+#define isBufferedOutput(context) ((context)->dvbBufferSize > 0)
 
 /* ***************************** */
 /* Prototypes                    */
@@ -87,9 +100,9 @@ int32_t LinuxDvbBuffClose(Context_t *context);
 int32_t LinuxDvbBuffFlush(Context_t *context);
 int32_t LinuxDvbBuffResume(Context_t *context);
 
-ssize_t BufferingWriteV(int fd, const struct iovec *iov, int ic);
-int32_t LinuxDvbBuffSetSize(const uint32_t bufferSize);
-uint32_t LinuxDvbBuffGetSize();
+ssize_t BufferingWriteV(Context_t *context, int fd, const struct iovec *iov, int ic);
+int32_t LinuxDvbBuffSetSize(Context_t *context, const uint32_t bufferSize);
+uint32_t LinuxDvbBuffGetSize(Context_t *context);
 
 int LinuxDvbStop(Context_t *context, char *type);
 
@@ -97,8 +110,81 @@ int LinuxDvbStop(Context_t *context, char *type);
 /* MISC Functions                */
 /* ***************************** */
 
-#define getLinuxDVBMutex() pthread_mutex_lock(&LinuxDVBmutex)
-#define releaseLinuxDVBMutex() pthread_mutex_unlock(&LinuxDVBmutex)
+#define getLinuxDVBMutex(dvb) pthread_mutex_lock(&(dvb)->mutex)
+#define releaseLinuxDVBMutex(dvb) pthread_mutex_unlock(&(dvb)->mutex)
+
+static LinuxDvbOutput_t *getOutput(Context_t *context)
+{
+	if (context->dvbOutput == NULL)
+	{
+		LinuxDvbOutput_t *dvb = calloc(1, sizeof(LinuxDvbOutput_t));
+		if (dvb == NULL)
+		{
+			linuxdvb_err("out of memory\n");
+			return NULL;
+		}
+		dvb->videofd = -1;
+		dvb->audiofd = -1;
+		memset(&dvb->videoInfo, -1, sizeof(dvb->videoInfo));
+		pthread_mutex_init(&dvb->mutex, NULL);
+		context->dvbOutput = dvb;
+	}
+	return context->dvbOutput;
+}
+
+static void releaseWriter(WriterSlot_t *slot)
+{
+	if (slot->state)
+	{
+		if (slot->writer->freeState)
+		{
+			slot->writer->freeState(slot->state);
+		}
+		free(slot->state);
+		slot->state = NULL;
+	}
+	slot->writer = NULL;
+}
+
+/* Makes writer the one of the decoder, with fresh state if it changes,
+ * the state of the previous one is released. Called with the mutex held. */
+static int selectWriter(WriterSlot_t *slot, Writer_t *writer)
+{
+	if (slot->writer == writer)
+	{
+		return cERR_LINUXDVB_NO_ERROR;
+	}
+
+	releaseWriter(slot);
+
+	if (writer->stateSize)
+	{
+		slot->state = calloc(1, writer->stateSize);
+		if (slot->state == NULL)
+		{
+			linuxdvb_err("out of memory\n");
+			return cERR_LINUXDVB_ERROR;
+		}
+	}
+	slot->writer = writer;
+	writer->reset(slot->state);
+
+	return cERR_LINUXDVB_NO_ERROR;
+}
+
+static void freeOutput(Context_t *context)
+{
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
+
+	if (dvb && dvb->videofd == -1 && dvb->audiofd == -1)
+	{
+		releaseWriter(&dvb->videoWriter);
+		releaseWriter(&dvb->audioWriter);
+		pthread_mutex_destroy(&dvb->mutex);
+		free(dvb);
+		context->dvbOutput = NULL;
+	}
+}
 
 static int LinuxDvbMapBypassMode(int bypass, bool primary)
 {
@@ -159,68 +245,72 @@ static int LinuxDvbMapStreamType(int streamtype, bool primary)
 	return streamtype;
 }
 
-int LinuxDvbOpen(Context_t *context __attribute__((unused)), char *type)
+int LinuxDvbOpen(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
+	char dev[32];
 	uint8_t video = !strcmp("video", type);
 	uint8_t audio = !strcmp("audio", type);
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	if (video && videofd < 0)
+	if (video && dvb->videofd < 0)
 	{
-		videofd = open(VIDEODEV, O_RDWR | O_CLOEXEC);
+		snprintf(dev, sizeof(dev), VIDEODEV, context->decoder);
+		dvb->videofd = open(dev, O_RDWR | O_CLOEXEC);
 
-		if (videofd < 0)
+		if (dvb->videofd < 0)
 		{
-			linuxdvb_err("failed to open %s - errno %d, %s\n", VIDEODEV, errno, strerror(errno));
+			linuxdvb_err("failed to open %s - errno %d, %s\n", dev, errno, strerror(errno));
 			return cERR_LINUXDVB_ERROR;
 		}
 
-		if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
+		if (ioctl(dvb->videofd, VIDEO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("VIDEO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(videofd, VIDEO_SELECT_SOURCE, (void *)VIDEO_SOURCE_MEMORY) == -1)
+		if (ioctl(dvb->videofd, VIDEO_SELECT_SOURCE, (void *)VIDEO_SOURCE_MEMORY) == -1)
 		{
 			linuxdvb_err("VIDEO_SELECT_SOURCE: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(videofd, VIDEO_FREEZE) == -1)
+		if (ioctl(dvb->videofd, VIDEO_FREEZE) == -1)
 		{
 			linuxdvb_err("VIDEO_FREEZE: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (isBufferedOutput)
-			LinuxDvbBuffOpen(context, type, videofd, &LinuxDVBmutex);
+		if (isBufferedOutput(context))
+			LinuxDvbBuffOpen(context, type, dvb->videofd, &dvb->mutex);
 	}
-	if (audio && audiofd < 0)
+	if (audio && dvb->audiofd < 0)
 	{
-		audiofd = open(AUDIODEV, O_RDWR | O_CLOEXEC);
+		snprintf(dev, sizeof(dev), AUDIODEV, context->decoder);
+		dvb->audiofd = open(dev, O_RDWR | O_CLOEXEC);
 
-		if (audiofd < 0)
+		if (dvb->audiofd < 0)
 		{
-			linuxdvb_err("failed to open %s - errno %d, %s\n", AUDIODEV, errno, strerror(errno));
+			linuxdvb_err("failed to open %s - errno %d, %s\n", dev, errno, strerror(errno));
 			return cERR_LINUXDVB_ERROR;
 		}
 
-		if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("AUDIO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(audiofd, AUDIO_SELECT_SOURCE, AUDIO_SOURCE_MEMORY) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_SELECT_SOURCE, AUDIO_SOURCE_MEMORY) == -1)
 		{
 			linuxdvb_err("AUDIO_SELECT_SOURCE: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(audiofd, AUDIO_PAUSE) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_PAUSE) == -1)
 		{
 			linuxdvb_err("AUDIO_PAUSE: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (isBufferedOutput)
-			LinuxDvbBuffOpen(context, type, audiofd, &LinuxDVBmutex);
+		if (isBufferedOutput(context))
+			LinuxDvbBuffOpen(context, type, dvb->audiofd, &dvb->mutex);
 	}
 
 	return cERR_LINUXDVB_NO_ERROR;
@@ -228,6 +318,7 @@ int LinuxDvbOpen(Context_t *context __attribute__((unused)), char *type)
 
 int LinuxDvbClose(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	uint8_t video = !strcmp("video", type);
 	uint8_t audio = !strcmp("audio", type);
 
@@ -239,28 +330,29 @@ int LinuxDvbClose(Context_t *context, char *type)
 	 */
 	LinuxDvbStop(context, type);
 
-	getLinuxDVBMutex();
+	getLinuxDVBMutex(dvb);
 
-	if (isBufferedOutput)
+	if (isBufferedOutput(context))
 		LinuxDvbBuffClose(context);
 
-	if (video && videofd != -1)
+	if (video && dvb->videofd != -1)
 	{
-		close(videofd);
-		videofd = -1;
+		close(dvb->videofd);
+		dvb->videofd = -1;
 	}
-	if (audio && audiofd != -1)
+	if (audio && dvb->audiofd != -1)
 	{
-		close(audiofd);
-		audiofd = -1;
+		close(dvb->audiofd);
+		dvb->audiofd = -1;
 	}
 
-	releaseLinuxDVBMutex();
+	releaseLinuxDVBMutex(dvb);
 	return cERR_LINUXDVB_NO_ERROR;
 }
 
 int LinuxDvbPlay(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int ret = cERR_LINUXDVB_NO_ERROR;
 	Writer_t *writer;
 
@@ -269,7 +361,7 @@ int LinuxDvbPlay(Context_t *context, char *type)
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	if (video && videofd != -1)
+	if (video && dvb->videofd != -1)
 	{
 		char *Encoding = NULL;
 		context->manager->video->Command(context, MANAGER_GETENCODING, &Encoding);
@@ -286,10 +378,10 @@ int LinuxDvbPlay(Context_t *context, char *type)
 		else
 		{
 			linuxdvb_printf(20, "found writer %s for encoding %s\n", writer->caps->name, Encoding);
-			ret = ioctl(videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, true));
+			ret = ioctl(dvb->videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, true));
 
 			if (ret < 0)
-				ret = ioctl(videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, false));
+				ret = ioctl(dvb->videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, false));
 
 			if (ret < 0)
 			{
@@ -299,23 +391,23 @@ int LinuxDvbPlay(Context_t *context, char *type)
 		}
 		free(Encoding);
 
-		if (0 != ioctl(videofd, VIDEO_PLAY))
+		if (0 != ioctl(dvb->videofd, VIDEO_PLAY))
 		{
 			linuxdvb_err("VIDEO_PLAY: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 
-		if (ioctl(videofd, VIDEO_CONTINUE) == -1)
+		if (ioctl(dvb->videofd, VIDEO_CONTINUE) == -1)
 		{
 			linuxdvb_err("VIDEO_CONTINUE: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
+		if (ioctl(dvb->videofd, VIDEO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("VIDEO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 		}
 	}
-	if (audio && audiofd != -1)
+	if (audio && dvb->audiofd != -1)
 	{
 		char *Encoding = NULL;
 		context->manager->audio->Command(context, MANAGER_GETENCODING, &Encoding);
@@ -332,10 +424,10 @@ int LinuxDvbPlay(Context_t *context, char *type)
 		else
 		{
 			linuxdvb_printf(20, "found writer %s for encoding %s\n", writer->caps->name, Encoding);
-			ret = ioctl(audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, true));
+			ret = ioctl(dvb->audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, true));
 
 			if (ret < 0)
-				ret = ioctl(audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, false));
+				ret = ioctl(dvb->audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, false));
 
 			if (ret < 0)
 			{
@@ -344,13 +436,13 @@ int LinuxDvbPlay(Context_t *context, char *type)
 			}
 		}
 
-		if (ioctl(audiofd, AUDIO_PLAY) < 0)
+		if (ioctl(dvb->audiofd, AUDIO_PLAY) < 0)
 		{
 			linuxdvb_err("AUDIO_PLAY: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 
-		if (ioctl(audiofd, AUDIO_CONTINUE) < 0)
+		if (ioctl(dvb->audiofd, AUDIO_CONTINUE) < 0)
 		{
 			linuxdvb_err("AUDIO_CONTINUE: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
@@ -362,119 +454,122 @@ int LinuxDvbPlay(Context_t *context, char *type)
 	return ret;
 }
 
-int LinuxDvbStop(Context_t *context __attribute__((unused)), char *type)
+int LinuxDvbStop(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int ret = cERR_LINUXDVB_NO_ERROR;
 	unsigned char video = !strcmp("video", type);
 	unsigned char audio = !strcmp("audio", type);
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	getLinuxDVBMutex();
+	getLinuxDVBMutex(dvb);
 
-	if (video && videofd != -1)
+	if (video && dvb->videofd != -1)
 	{
-		if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
+		if (ioctl(dvb->videofd, VIDEO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("VIDEO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(videofd, VIDEO_STOP) == -1)
+		if (ioctl(dvb->videofd, VIDEO_STOP) == -1)
 		{
 			linuxdvb_err("VIDEO_STOP: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 
-		ioctl(videofd, VIDEO_SLOWMOTION, 0);
-		ioctl(videofd, VIDEO_FAST_FORWARD, 0);
-		ioctl(videofd, VIDEO_SELECT_SOURCE, VIDEO_SOURCE_DEMUX);
+		ioctl(dvb->videofd, VIDEO_SLOWMOTION, 0);
+		ioctl(dvb->videofd, VIDEO_FAST_FORWARD, 0);
+		ioctl(dvb->videofd, VIDEO_SELECT_SOURCE, VIDEO_SOURCE_DEMUX);
 	}
 
-	if (audio && audiofd != -1)
+	if (audio && dvb->audiofd != -1)
 	{
-		if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("AUDIO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 		}
 
-		if (ioctl(audiofd, AUDIO_STOP) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_STOP) == -1)
 		{
 			linuxdvb_err("AUDIO_STOP: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
-		ioctl(audiofd, AUDIO_SELECT_SOURCE, AUDIO_SOURCE_DEMUX);
+		ioctl(dvb->audiofd, AUDIO_SELECT_SOURCE, AUDIO_SOURCE_DEMUX);
 	}
 
-	releaseLinuxDVBMutex();
+	releaseLinuxDVBMutex(dvb);
 
 	return ret;
 }
 
-int LinuxDvbPause(Context_t *context __attribute__((unused)), char *type)
+int LinuxDvbPause(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_NO_ERROR;
 	uint8_t video = !strcmp("video", type);
 	uint8_t audio = !strcmp("audio", type);
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	getLinuxDVBMutex();
+	getLinuxDVBMutex(dvb);
 
-	if (video && videofd != -1)
+	if (video && dvb->videofd != -1)
 	{
-		if (ioctl(videofd, VIDEO_FREEZE, NULL) == -1)
+		if (ioctl(dvb->videofd, VIDEO_FREEZE, NULL) == -1)
 		{
 			linuxdvb_err("VIDEO_FREEZE: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 	}
 
-	if (audio && audiofd != -1)
+	if (audio && dvb->audiofd != -1)
 	{
-		if (ioctl(audiofd, AUDIO_PAUSE, NULL) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_PAUSE, NULL) == -1)
 		{
 			linuxdvb_err("AUDIO_PAUSE: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 	}
 
-	releaseLinuxDVBMutex();
+	releaseLinuxDVBMutex(dvb);
 
 	return ret;
 }
 
-int LinuxDvbContinue(Context_t *context __attribute__((unused)), char *type)
+int LinuxDvbContinue(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_NO_ERROR;
 	uint8_t video = !strcmp("video", type);
 	uint8_t audio = !strcmp("audio", type);
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	if (video && videofd != -1)
+	if (video && dvb->videofd != -1)
 	{
 		if (context->playback->isForwarding == 0)
 		{
-			ioctl(videofd, VIDEO_FAST_FORWARD, 0);
+			ioctl(dvb->videofd, VIDEO_FAST_FORWARD, 0);
 		}
 
-		if (ioctl(videofd, VIDEO_CONTINUE, NULL) == -1)
+		if (ioctl(dvb->videofd, VIDEO_CONTINUE, NULL) == -1)
 		{
 			linuxdvb_err("VIDEO_CONTINUE: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 	}
 
-	if (audio && audiofd != -1)
+	if (audio && dvb->audiofd != -1)
 	{
-		if (ioctl(audiofd, AUDIO_CONTINUE, NULL) == -1)
+		if (ioctl(dvb->audiofd, AUDIO_CONTINUE, NULL) == -1)
 		{
 			linuxdvb_err("AUDIO_CONTINUE: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 	}
 
-	if (isBufferedOutput)
+	if (isBufferedOutput(context))
 		LinuxDvbBuffResume(context);
 
 	linuxdvb_printf(10, "exiting\n");
@@ -482,17 +577,18 @@ int LinuxDvbContinue(Context_t *context __attribute__((unused)), char *type)
 	return ret;
 }
 
-int LinuxDvbAudioMute(Context_t *context __attribute__((unused)), char *flag)
+int LinuxDvbAudioMute(Context_t *context, char *flag)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int ret = cERR_LINUXDVB_NO_ERROR;
 
 	linuxdvb_printf(10, "\n");
 
-	if (audiofd != -1)
+	if (dvb->audiofd != -1)
 	{
 		if (*flag == '1')
 		{
-			if (ioctl(audiofd, AUDIO_SET_MUTE, 1) == -1)
+			if (ioctl(dvb->audiofd, AUDIO_SET_MUTE, 1) == -1)
 			{
 				linuxdvb_err("AUDIO_SET_MUTE: ERROR %d, %s\n", errno, strerror(errno));
 				ret = cERR_LINUXDVB_ERROR;
@@ -500,7 +596,7 @@ int LinuxDvbAudioMute(Context_t *context __attribute__((unused)), char *flag)
 		}
 		else
 		{
-			if (ioctl(audiofd, AUDIO_SET_MUTE, 0) == -1)
+			if (ioctl(dvb->audiofd, AUDIO_SET_MUTE, 0) == -1)
 			{
 				linuxdvb_err("AUDIO_SET_MUTE: ERROR %d, %s\n", errno, strerror(errno));
 				ret = cERR_LINUXDVB_ERROR;
@@ -520,6 +616,7 @@ int LinuxDvbFlush(Context_t *context __attribute__((unused)), char *type __attri
 
 int LinuxDvbFastForward(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_NO_ERROR;
 	uint8_t video = !strcmp("video", type);
 	uint8_t audio = !strcmp("audio", type);
@@ -528,22 +625,22 @@ int LinuxDvbFastForward(Context_t *context, char *type)
 
 	linuxdvb_printf(10, "v%d a%d speed %d\n", video, audio, context->playback->Speed);
 
-	if (video && videofd != -1)
+	if (video && dvb->videofd != -1)
 	{
-		getLinuxDVBMutex();
+		getLinuxDVBMutex(dvb);
 		// konfetti comment: speed is a value given in skipped frames
-		if (ioctl(videofd, VIDEO_FAST_FORWARD, context->playback->Speed) == -1)
+		if (ioctl(dvb->videofd, VIDEO_FAST_FORWARD, context->playback->Speed) == -1)
 		{
 			linuxdvb_err("VIDEO_FAST_FORWARD: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 
-		if (ioctl(videofd, VIDEO_CONTINUE, NULL) == -1)
+		if (ioctl(dvb->videofd, VIDEO_CONTINUE, NULL) == -1)
 		{
 			linuxdvb_err("VIDEO_CONTINUE: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 	}
 
 	linuxdvb_printf(10, "exiting with value %d\n", ret);
@@ -552,6 +649,7 @@ int LinuxDvbFastForward(Context_t *context, char *type)
 
 int LinuxDvbSlowMotion(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_NO_ERROR;
 
 	uint8_t video = !strcmp("video", type);
@@ -559,20 +657,20 @@ int LinuxDvbSlowMotion(Context_t *context, char *type)
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	if ((video && videofd != -1) || (audio && audiofd != -1))
+	if ((video && dvb->videofd != -1) || (audio && dvb->audiofd != -1))
 	{
-		getLinuxDVBMutex();
+		getLinuxDVBMutex(dvb);
 
-		if (video && videofd != -1)
+		if (video && dvb->videofd != -1)
 		{
-			if (ioctl(videofd, VIDEO_SLOWMOTION, context->playback->SlowMotion) == -1)
+			if (ioctl(dvb->videofd, VIDEO_SLOWMOTION, context->playback->SlowMotion) == -1)
 			{
 				linuxdvb_err("VIDEO_SLOWMOTION: ERROR %d, %s\n", errno, strerror(errno));
 				ret = cERR_LINUXDVB_ERROR;
 			}
 		}
 
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 	}
 
 	linuxdvb_printf(10, "exiting with value %d\n", ret);
@@ -580,8 +678,9 @@ int LinuxDvbSlowMotion(Context_t *context, char *type)
 	return ret;
 }
 
-int LinuxDvbAVSync(Context_t *context __attribute__((unused)), char *type __attribute__((unused)))
+int LinuxDvbAVSync(Context_t *context, char *type __attribute__((unused)))
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_NO_ERROR;
 	/* konfetti: this one is dedicated to audiofd so we
 	 * are ignoring what is given by type! I think we should
@@ -589,51 +688,52 @@ int LinuxDvbAVSync(Context_t *context __attribute__((unused)), char *type __attr
 	 * setOn or something like that instead, this would remove
 	 * using a variable inside the structure.
 	 */
-	if (audiofd != -1)
+	if (dvb->audiofd != -1)
 	{
-		getLinuxDVBMutex();
-		if (ioctl(audiofd, AUDIO_SET_AV_SYNC, 0) == -1) //context->playback->AVSync) == -1)
+		getLinuxDVBMutex(dvb);
+		if (ioctl(dvb->audiofd, AUDIO_SET_AV_SYNC, 0) == -1) //context->playback->AVSync) == -1)
 		{
 			linuxdvb_err("AUDIO_SET_AV_SYNC: ERROR %d, %s\n", errno, strerror(errno));
 			ret = cERR_LINUXDVB_ERROR;
 		}
 
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 	}
 
 	return ret;
 }
 
-int LinuxDvbClear(Context_t *context __attribute__((unused)), char *type)
+int LinuxDvbClear(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_NO_ERROR;
 	uint8_t video = !strcmp("video", type);
 	uint8_t audio = !strcmp("audio", type);
 
 	linuxdvb_printf(10, "LinuxDvbClear v%d a%d\n", video, audio);
 
-	if ((video && videofd != -1) || (audio && audiofd != -1))
+	if ((video && dvb->videofd != -1) || (audio && dvb->audiofd != -1))
 	{
-		getLinuxDVBMutex();
+		getLinuxDVBMutex(dvb);
 
-		if (video && videofd != -1)
+		if (video && dvb->videofd != -1)
 		{
-			if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
+			if (ioctl(dvb->videofd, VIDEO_CLEAR_BUFFER) == -1)
 			{
 				linuxdvb_err("VIDEO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 				ret = cERR_LINUXDVB_ERROR;
 			}
 		}
-		else if (audio && audiofd != -1)
+		else if (audio && dvb->audiofd != -1)
 		{
-			if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
+			if (ioctl(dvb->audiofd, AUDIO_CLEAR_BUFFER) == -1)
 			{
 				linuxdvb_err("AUDIO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 				ret = cERR_LINUXDVB_ERROR;
 			}
 		}
 
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 	}
 
 	linuxdvb_printf(10, "exiting\n");
@@ -641,14 +741,15 @@ int LinuxDvbClear(Context_t *context __attribute__((unused)), char *type)
 	return ret;
 }
 
-int LinuxDvbPts(Context_t *context __attribute__((unused)), unsigned long long int *pts)
+int LinuxDvbPts(Context_t *context, unsigned long long int *pts)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	int32_t ret = cERR_LINUXDVB_ERROR;
 
 	linuxdvb_printf(50, "\n");
 
 	// GET_PTS is immutable call, so it can be done in parallel to other requests
-	if (videofd > -1 && !ioctl(videofd, VIDEO_GET_PTS, (void *)&sCURRENT_PTS))
+	if (dvb->videofd > -1 && !ioctl(dvb->videofd, VIDEO_GET_PTS, (void *)&dvb->currentPts))
 	{
 		ret = cERR_LINUXDVB_NO_ERROR;
 	}
@@ -659,7 +760,7 @@ int LinuxDvbPts(Context_t *context __attribute__((unused)), unsigned long long i
 
 	if (ret != cERR_LINUXDVB_NO_ERROR)
 	{
-		if (audiofd > -1 && !ioctl(audiofd, AUDIO_GET_PTS, (void *)&sCURRENT_PTS))
+		if (dvb->audiofd > -1 && !ioctl(dvb->audiofd, AUDIO_GET_PTS, (void *)&dvb->currentPts))
 		{
 			ret = cERR_LINUXDVB_NO_ERROR;
 		}
@@ -671,10 +772,10 @@ int LinuxDvbPts(Context_t *context __attribute__((unused)), unsigned long long i
 
 	if (ret != cERR_LINUXDVB_NO_ERROR)
 	{
-		sCURRENT_PTS = 0;
+		dvb->currentPts = 0;
 	}
 
-	*((unsigned long long int *)pts) = (unsigned long long int)sCURRENT_PTS;
+	*((unsigned long long int *)pts) = (unsigned long long int)dvb->currentPts;
 
 	return ret;
 }
@@ -686,6 +787,7 @@ int LinuxDvbGetFrameCount(Context_t *context __attribute__((unused)), unsigned l
 
 int LinuxDvbSwitch(Context_t *context, char *type)
 {
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 	uint8_t audio = !strcmp("audio", type);
 	uint8_t video = !strcmp("video", type);
 	Writer_t *writer;
@@ -693,11 +795,11 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 
-	if ((video && videofd != -1) || (audio && audiofd != -1))
+	if ((video && dvb->videofd != -1) || (audio && dvb->audiofd != -1))
 	{
-		getLinuxDVBMutex();
+		getLinuxDVBMutex(dvb);
 
-		if (audio && audiofd != -1)
+		if (audio && dvb->audiofd != -1)
 		{
 			char *Encoding = NULL;
 			if (context && context->manager && context->manager->audio)
@@ -708,12 +810,12 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 
 				writer = getWriter(Encoding);
 
-				if (ioctl(audiofd, AUDIO_STOP, NULL) == -1)
+				if (ioctl(dvb->audiofd, AUDIO_STOP, NULL) == -1)
 				{
 					linuxdvb_err("AUDIO_STOP: ERROR %d, %s\n", errno, strerror(errno));
 				}
 
-				if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
+				if (ioctl(dvb->audiofd, AUDIO_CLEAR_BUFFER) == -1)
 				{
 					linuxdvb_err("AUDIO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 				}
@@ -725,10 +827,10 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 				else
 				{
 					linuxdvb_printf(10, "found writer %s for encoding %s\n", writer->caps->name, Encoding);
-					ret = ioctl(audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, true));
+					ret = ioctl(dvb->audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, true));
 
 					if (ret < 0)
-						ret = ioctl(audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, false));
+						ret = ioctl(dvb->audiofd, AUDIO_SET_BYPASS_MODE, LinuxDvbMapBypassMode(writer->caps->dvbStreamType, false));
 
 					if (ret < 0)
 					{
@@ -736,7 +838,7 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 					}
 				}
 
-				if (ioctl(audiofd, AUDIO_PLAY) == -1)
+				if (ioctl(dvb->audiofd, AUDIO_PLAY) == -1)
 				{
 					linuxdvb_err("AUDIO_PLAY: ERROR %d, %s\n", errno, strerror(errno));
 				}
@@ -748,19 +850,19 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 			}
 		}
 
-		if (video && videofd != -1)
+		if (video && dvb->videofd != -1)
 		{
 			char *Encoding = NULL;
 			if (context && context->manager && context->manager->video)
 			{
 				context->manager->video->Command(context, MANAGER_GETENCODING, &Encoding);
 
-				if (ioctl(videofd, VIDEO_STOP, NULL) == -1)
+				if (ioctl(dvb->videofd, VIDEO_STOP, NULL) == -1)
 				{
 					linuxdvb_err("VIDEO_STOP: ERROR %d, %s\n", errno, strerror(errno));
 				}
 
-				if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
+				if (ioctl(dvb->videofd, VIDEO_CLEAR_BUFFER) == -1)
 				{
 					linuxdvb_err("VIDEO_CLEAR_BUFFER: ERROR %d, %s\n", errno, strerror(errno));
 				}
@@ -776,10 +878,10 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 				else
 				{
 					linuxdvb_printf(10, "found writer %s for encoding %s\n", writer->caps->name, Encoding);
-					ret = ioctl(videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, true));
+					ret = ioctl(dvb->videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, true));
 
 					if (ret < 0)
-						ret = ioctl(videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, false));
+						ret = ioctl(dvb->videofd, VIDEO_SET_STREAMTYPE, LinuxDvbMapStreamType(writer->caps->dvbStreamType, false));
 
 					if (ret < 0)
 					{
@@ -787,7 +889,7 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 					}
 				}
 
-				if (ioctl(videofd, VIDEO_PLAY) == -1)
+				if (ioctl(dvb->videofd, VIDEO_PLAY) == -1)
 				{
 					/* konfetti: fixme: think on this, I think we should
 					 * return an error here and stop the playback mode
@@ -802,7 +904,7 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 			}
 		}
 
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 
 	}
 
@@ -811,6 +913,52 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 	return cERR_LINUXDVB_NO_ERROR;
 }
 
+/* The writer for the encoding of the track, looked up once per track
+ * and kept in it. Tracks are only added and removed in whole, so the
+ * encoding does not change under it. */
+static Writer_t *getTrackWriter(Track_t *track, const char *type)
+{
+	if (track->writer == NULL)
+	{
+		Writer_t *writer = getWriter(track->Encoding);
+
+		if (writer == NULL)
+		{
+			linuxdvb_printf(20, "searching default writer ... %s\n", track->Encoding);
+			writer = !strcmp("video", type) ? getDefaultVideoWriter() : getDefaultAudioWriter();
+		}
+		track->writer = writer;
+	}
+
+	return track->writer;
+}
+
+/* the writer for the current track, for data without a track */
+static Writer_t *getCurrentWriter(Context_t *context, Manager_t *manager, uint8_t video)
+{
+	char *Encoding = NULL;
+	manager->Command(context, MANAGER_GETENCODING, &Encoding);
+
+	linuxdvb_printf(20, "Encoding = %s\n", Encoding);
+
+	Writer_t *writer = getWriter(Encoding);
+
+	if (writer == NULL)
+	{
+		linuxdvb_printf(20, "searching default writer ... %s\n", Encoding);
+		writer = video ? getDefaultVideoWriter() : getDefaultAudioWriter();
+	}
+
+	if (writer == NULL)
+	{
+		linuxdvb_err("unknown %s codec %s and no default writer\n", video ? "video" : "audio", Encoding);
+	}
+
+	free(Encoding);
+
+	return writer;
+}
+
 static int Write(Context_t *context, void *_out)
 {
 	AudioVideoOut_t *out = (AudioVideoOut_t *) _out;
@@ -819,16 +967,32 @@ static int Write(Context_t *context, void *_out)
 	uint8_t video        = 0;
 	uint8_t audio        = 0;
 	Writer_t *writer     = NULL;
+	LinuxDvbOutput_t *dvb = getOutput(context);
 	WriterAVCallData_t call;
 
-	if (out == NULL)
+	if (out == NULL || dvb == NULL)
 	{
 		linuxdvb_err("null pointer passed\n");
 		return cERR_LINUXDVB_ERROR;
 	}
 
-	video = !strcmp("video", out->type);
-	audio = !strcmp("audio", out->type);
+	/* the usual case: the track and with it the writer is known, no
+	 * string handling per packet */
+	if (out->track)
+	{
+		writer = getTrackWriter(out->track, out->type);
+	}
+
+	if (writer)
+	{
+		video = writer->caps->type == eVideo;
+		audio = writer->caps->type == eAudio;
+	}
+	else
+	{
+		video = !strcmp("video", out->type);
+		audio = !strcmp("audio", out->type);
+	}
 
 	linuxdvb_printf(20, "DataLength=%u PrivateLength=%u Pts=%" PRIu64 " FrameRate=%d\n",
 		out->len, out->extralen, out->pts, out->frameRate);
@@ -836,36 +1000,27 @@ static int Write(Context_t *context, void *_out)
 
 	if (video)
 	{
-		getLinuxDVBMutex();
-
-		char *Encoding = NULL;
-		context->manager->video->Command(context, MANAGER_GETENCODING, &Encoding);
-
-		linuxdvb_printf(20, "Encoding = %s\n", Encoding);
-
-		writer = getWriter(Encoding);
+		getLinuxDVBMutex(dvb);
 
 		if (writer == NULL)
 		{
-			linuxdvb_printf(20, "searching default writer ... %s\n", Encoding);
-			writer = getDefaultVideoWriter();
+			writer = getCurrentWriter(context, context->manager->video, 1);
 		}
 
-		if (writer == NULL)
+		if (writer == NULL || selectWriter(&dvb->videoWriter, writer))
 		{
-			linuxdvb_err("unknown video codec and no default writer %s\n", Encoding);
 			ret = cERR_LINUXDVB_ERROR;
 		}
 		else
 		{
 			struct pollfd pfd[1];
-			pfd[0].fd = videofd;
+			pfd[0].fd = dvb->videofd;
 			pfd[0].events = POLLPRI;
 			int pollret = poll(pfd, 1, 0);
 			if (pollret > 0 && pfd[0].revents & POLLPRI)
 			{
 				struct video_event evt;
-				if (ioctl(videofd, VIDEO_GET_EVENT, &evt) == -1)
+				if (ioctl(dvb->videofd, VIDEO_GET_EVENT, &evt) == -1)
 				{
 					linuxdvb_err("ioctl failed with errno %d\n", errno);
 					linuxdvb_err("VIDEO_GET_EVENT: %s\n", strerror(errno));
@@ -879,23 +1034,23 @@ static int Write(Context_t *context, void *_out)
 						linuxdvb_printf(10, "width  : %d\n", evt.u.size.w);
 						linuxdvb_printf(10, "height : %d\n", evt.u.size.h);
 						linuxdvb_printf(10, "aspect : %d\n", evt.u.size.aspect_ratio);
-						videoInfo.width = evt.u.size.w;
-						videoInfo.height = evt.u.size.h;
-						videoInfo.aspect_ratio = evt.u.size.aspect_ratio;
+						dvb->videoInfo.width = evt.u.size.w;
+						dvb->videoInfo.height = evt.u.size.h;
+						dvb->videoInfo.aspect_ratio = evt.u.size.aspect_ratio;
 						changed = true;
 					}
 					else if (evt.type == VIDEO_EVENT_FRAME_RATE_CHANGED)
 					{
 						linuxdvb_printf(10, "VIDEO_EVENT_FRAME_RATE_CHANGED type: 0x%x\n", evt.type);
 						linuxdvb_printf(10, "framerate : %d\n", evt.u.frame_rate);
-						videoInfo.frame_rate = evt.u.frame_rate;
+						dvb->videoInfo.frame_rate = evt.u.frame_rate;
 						changed = true;
 					}
 					else if (evt.type == 16 /*VIDEO_EVENT_PROGRESSIVE_CHANGED*/)
 					{
 						linuxdvb_printf(10, "VIDEO_EVENT_PROGRESSIVE_CHANGED type: 0x%x\n", evt.type);
 						linuxdvb_printf(10, "progressive : %d\n", evt.u.frame_rate);
-						videoInfo.progressive = evt.u.frame_rate;
+						dvb->videoInfo.progressive = evt.u.frame_rate;
 						context->manager->video->Command(context, MANAGER_UPDATED_TRACK_INFO, NULL);
 						changed = true;
 					}
@@ -905,19 +1060,20 @@ static int Write(Context_t *context, void *_out)
 					}
 
 					if (changed &&
-						videoInfo.width != -1 &&
-						videoInfo.height != -1 &&
-						videoInfo.aspect_ratio != -1 &&
-						videoInfo.frame_rate != -1 &&
-						videoInfo.progressive != -1)
+						dvb->videoInfo.width != -1 &&
+						dvb->videoInfo.height != -1 &&
+						dvb->videoInfo.aspect_ratio != -1 &&
+						dvb->videoInfo.frame_rate != -1 &&
+						dvb->videoInfo.progressive != -1)
 					{
 						E2iSendMsg("{\"v_e\":{\"w\":%d,\"h\":%d,\"a\":%d,\"f\":%d,\"p\":%d}}\n",
-							videoInfo.width, videoInfo.height, videoInfo.aspect_ratio, videoInfo.frame_rate, videoInfo.progressive);
+							dvb->videoInfo.width, dvb->videoInfo.height, dvb->videoInfo.aspect_ratio, dvb->videoInfo.frame_rate, dvb->videoInfo.progressive);
 					}
 				}
 			}
 
-			call.fd           = videofd;
+			call.context      = context;
+			call.fd           = dvb->videofd;
 			call.data         = out->data;
 			call.len          = out->len;
 			call.Pts          = out->pts;
@@ -930,7 +1086,8 @@ static int Write(Context_t *context, void *_out)
 			call.Height       = out->height;
 			call.InfoFlags    = out->infoFlags;
 			call.Version      = 0;
-			call.WriteV       = isBufferedOutput ? BufferingWriteV : writev_with_retry;
+			call.WriteV       = isBufferedOutput(context) ? BufferingWriteV : writev_with_retry;
+			call.state        = dvb->videoWriter.state;
 
 			if (writer->writeData)
 			{
@@ -945,35 +1102,25 @@ static int Write(Context_t *context, void *_out)
 			}
 		}
 
-		free(Encoding);
-
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 	}
 	else if (audio)
 	{
-		getLinuxDVBMutex();
-
-		char *Encoding = NULL;
-		context->manager->audio->Command(context, MANAGER_GETENCODING, &Encoding);
-
-		linuxdvb_printf(20, "Encoding = %s\n", Encoding);
-
-		writer = getWriter(Encoding);
+		getLinuxDVBMutex(dvb);
 
 		if (writer == NULL)
 		{
-			linuxdvb_printf(20, "searching default writer ... %s\n", Encoding);
-			writer = getDefaultAudioWriter();
+			writer = getCurrentWriter(context, context->manager->audio, 0);
 		}
 
-		if (writer == NULL)
+		if (writer == NULL || selectWriter(&dvb->audioWriter, writer))
 		{
-			linuxdvb_err("unknown audio codec %s and no default writer\n", Encoding);
 			ret = cERR_LINUXDVB_ERROR;
 		}
 		else
 		{
-			call.fd             = audiofd;
+			call.context        = context;
+			call.fd             = dvb->audiofd;
 			call.data           = out->data;
 			call.len            = out->len;
 			call.Pts            = out->pts;
@@ -984,7 +1131,8 @@ static int Write(Context_t *context, void *_out)
 			call.FrameScale     = out->timeScale;
 			call.InfoFlags      = out->infoFlags;
 			call.Version        = 0;
-			call.WriteV         = isBufferedOutput ? BufferingWriteV : writev_with_retry;
+			call.WriteV         = isBufferedOutput(context) ? BufferingWriteV : writev_with_retry;
+			call.state          = dvb->audioWriter.state;
 
 			if (writer->writeData)
 			{
@@ -999,66 +1147,47 @@ static int Write(Context_t *context, void *_out)
 			}
 		}
 
-		free(Encoding);
-
-		releaseLinuxDVBMutex();
+		releaseLinuxDVBMutex(dvb);
 	}
 
 	return ret;
 }
 
+/* Only the writers used so far have state to reset, a writer selected
+ * later starts from a reset one anyway. */
 static int reset(Context_t *context)
 {
-	int ret = cERR_LINUXDVB_NO_ERROR;
-	Writer_t *writer;
-
-	getLinuxDVBMutex();
-
-	char *Encoding = NULL;
+	LinuxDvbOutput_t *dvb = context->dvbOutput;
 
-	context->manager->video->Command(context, MANAGER_GETENCODING, &Encoding);
+	getLinuxDVBMutex(dvb);
 
-	writer = getWriter(Encoding);
-
-	if (writer == NULL)
+	if (dvb->videoWriter.writer)
 	{
-		linuxdvb_err("unknown video codec %s\n", Encoding);
-		ret = cERR_LINUXDVB_ERROR;
+		dvb->videoWriter.writer->reset(dvb->videoWriter.state);
 	}
-	else
-	{
-		writer->reset();
-	}
-
-	free(Encoding);
 
-	context->manager->audio->Command(context, MANAGER_GETENCODING, &Encoding);
-
-	writer = getWriter(Encoding);
-
-	if (writer == NULL)
+	if (dvb->audioWriter.writer)
 	{
-		linuxdvb_err("unknown audio codec %s\n", Encoding);
-		ret = cERR_LINUXDVB_ERROR;
+		dvb->audioWriter.writer->reset(dvb->audioWriter.state);
 	}
-	else
-	{
-		writer->reset();
-	}
-
-	free(Encoding);
 
-	releaseLinuxDVBMutex();
+	releaseLinuxDVBMutex(dvb);
 
-	if (isBufferedOutput)
+	if (isBufferedOutput(context))
 		LinuxDvbBuffFlush(context);
 
-	return ret;
+	return cERR_LINUXDVB_NO_ERROR;
 }
 
 static int Command(Context_t *context, OutputCmd_t command, void *argument)
 {
 	int ret = cERR_LINUXDVB_NO_ERROR;
+	LinuxDvbOutput_t *dvb = getOutput(context);
+
+	if (dvb == NULL)
+	{
+		return cERR_LINUXDVB_ERROR;
+	}
 
 	linuxdvb_printf(50, "Command %d\n", command);
 
@@ -1073,12 +1202,13 @@ static int Command(Context_t *context, OutputCmd_t command, void *argument)
 		{
 			ret = LinuxDvbClose(context, (char *)argument);
 			reset(context);
-			sCURRENT_PTS = 0;
+			dvb->currentPts = 0;
+			freeOutput(context);
 			break;
 		}
 		case OUTPUT_PLAY:   // 4
 		{
-			sCURRENT_PTS = 0;
+			dvb->currentPts = 0;
 			ret = LinuxDvbPlay(context, (char *)argument);
 			break;
 		}
@@ -1086,14 +1216,14 @@ static int Command(Context_t *context, OutputCmd_t command, void *argument)
 		{
 			ret = LinuxDvbStop(context, (char *)argument);
 			reset(context);
-			sCURRENT_PTS = 0;
+			dvb->currentPts = 0;
 			break;
 		}
 		case OUTPUT_FLUSH:
 		{
 			ret = LinuxDvbFlush(context, (char *)argument);
 			reset(context);
-			sCURRENT_PTS = 0;
+			dvb->currentPts = 0;
 			break;
 		}
 		case OUTPUT_PAUSE:
@@ -1121,7 +1251,7 @@ static int Command(Context_t *context, OutputCmd_t command, void *argument)
 			reset(context);
 			ret = LinuxDvbClear(context, (char *)argument);
 			reset(context);
-			sCURRENT_PTS = 0;
+			dvb->currentPts = 0;
 			break;
 		}
 		case OUTPUT_PTS:
@@ -1156,20 +1286,19 @@ static int Command(Context_t *context, OutputCmd_t command, void *argument)
 		case OUTPUT_GET_PROGRESSIVE:
 		{
 			ret = cERR_LINUXDVB_NO_ERROR;
-			*((int *)argument) = videoInfo.progressive;
+			*((int *)argument) = dvb->videoInfo.progressive;
 			break;
 		}
 		case OUTPUT_SET_BUFFER_SIZE:
 		{
 			ret = cERR_LINUXDVB_ERROR;
-			if (!isBufferedOutput)
+			if (!isBufferedOutput(context))
 			{
 				uint32_t bufferSize = *((uint32_t *)argument);
 				ret = cERR_LINUXDVB_NO_ERROR;
 				if (bufferSize > 0)
 				{
-					LinuxDvbBuffSetSize(bufferSize);
-					isBufferedOutput = true;
+					LinuxDvbBuffSetSize(context, bufferSize);
 				}
 			}
 			break;
@@ -1177,7 +1306,7 @@ static int Command(Context_t *context, OutputCmd_t command, void *argument)
 		case OUTPUT_GET_BUFFER_SIZE:
 		{
 			ret = cERR_LINUXDVB_NO_ERROR;
-			*((uint32_t *)argument) = LinuxDvbBuffGetSize();
+			*((uint32_t *)argument) = LinuxDvbBuffGetSize(context);
 			break;
 		}
 		default:
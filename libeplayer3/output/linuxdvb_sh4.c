@@ -84,8 +84,8 @@ int32_t LinuxDvbBuffFlush(Context_t *context);
 int32_t LinuxDvbBuffResume(Context_t *context);
 
 ssize_t BufferingWriteV(int fd, const struct iovec *iov, int ic);
-int32_t LinuxDvbBuffSetSize(const uint32_t bufferSize);
-uint32_t LinuxDvbBuffGetSize();
+int32_t LinuxDvbBuffSetSize(Context_t *context, const uint32_t bufferSize);
+uint32_t LinuxDvbBuffGetSize(Context_t *context);
 
 int LinuxDvbStop(Context_t *context, char *type);
 
@@ -1131,7 +1131,7 @@ static int reset(Context_t *context)
 	}
 	else
 	{
-		writer->reset();
+		writer->reset(NULL);
 	}
 
 	free(Encoding);
@@ -1147,7 +1147,7 @@ static int reset(Context_t *context)
 	}
 	else
 	{
-		writer->reset();
+		writer->reset(NULL);
 	}
 
 	free(Encoding);
@@ -1281,7 +1281,7 @@ static int Command(void *_context, OutputCmd_t command, void *argument)
 				ret = cERR_LINUXDVB_NO_ERROR;
 				if (bufferSize > 0)
 				{
-					LinuxDvbBuffSetSize(bufferSize);
+					LinuxDvbBuffSetSize(context, bufferSize);
 					isBufferedOutput = true;
 				}
 			}
@@ -1290,7 +1290,7 @@ static int Command(void *_context, OutputCmd_t command, void *argument)
 		case OUTPUT_GET_BUFFER_SIZE:
 		{
 			ret = cERR_LINUXDVB_NO_ERROR;
-			*((uint32_t *)argument) = LinuxDvbBuffGetSize();
+			*((uint32_t *)argument) = LinuxDvbBuffGetSize(context);
 			break;
 		}
 		default:
@@ -61,14 +61,20 @@ Number, Style, Name,, MarginL, MarginR, MarginV, Effect,, Text
 /* Types                         */
 /* ***************************** */
 
+/* the subtitle output of one playback, context->subtitleOutput */
+typedef struct SubtitleOutput_s
+{
+	pthread_mutex_t mutex;
+	int isSubtitleOpened;
+	SubWriter_t *subWriter;
+	void *subWriterState;
+	char escaped[2048];
+} SubtitleOutput_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static pthread_mutex_t mutex;
-static int isSubtitleOpened = 0;
-static SubWriter_t *g_subWriter;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -77,22 +83,50 @@ static SubWriter_t *g_subWriter;
 /* MISC Functions                */
 /* ***************************** */
 
-static void getMutex(int line __attribute__((unused)))
+static void getMutex(SubtitleOutput_t *sub, int line __attribute__((unused)))
 {
 	subtitle_printf(100, "%d requesting mutex\n", line);
 
-	pthread_mutex_lock(&mutex);
+	pthread_mutex_lock(&sub->mutex);
 
 	subtitle_printf(100, "%d received mutex\n", line);
 }
 
-static void releaseMutex(int line __attribute__((unused)))
+static void releaseMutex(SubtitleOutput_t *sub, int line __attribute__((unused)))
 {
-	pthread_mutex_unlock(&mutex);
+	pthread_mutex_unlock(&sub->mutex);
 
 	subtitle_printf(100, "%d released mutex\n", line);
 }
 
+static SubtitleOutput_t *getOutput(Context_t *context)
+{
+	if (context->subtitleOutput == NULL)
+	{
+		SubtitleOutput_t *sub = calloc(1, sizeof(SubtitleOutput_t));
+		if (sub == NULL)
+		{
+			subtitle_err("out of memory\n");
+			return NULL;
+		}
+		pthread_mutex_init(&sub->mutex, NULL);
+		context->subtitleOutput = sub;
+	}
+	return context->subtitleOutput;
+}
+
+static void freeOutput(Context_t *context)
+{
+	SubtitleOutput_t *sub = context->subtitleOutput;
+
+	if (sub)
+	{
+		pthread_mutex_destroy(&sub->mutex);
+		free(sub);
+		context->subtitleOutput = NULL;
+	}
+}
+
 /* ***************************** */
 /* Functions                     */
 /* ***************************** */
@@ -118,9 +152,8 @@ static char *ass_get_text(char *str)
 	return p_str;
 }
 
-static char *json_string_escape(char *str)
+static char *json_string_escape(char *tmp, char *str)
 {
-	static char tmp[2048];
 	char *ptr1 = tmp;
 	char *ptr2 = str;
 	while (*ptr2 != '\0')
@@ -165,10 +198,12 @@ static char *json_string_escape(char *str)
 	return tmp;
 }
 
-static int Flush()
+static int Flush(Context_t *context)
 {
-	if (g_subWriter)
-		g_subWriter->reset();
+	SubtitleOutput_t *sub = context->subtitleOutput;
+
+	if (sub && sub->subWriter)
+		sub->subWriter->reset(&sub->subWriterState);
 
 	E2iSendMsg("{\"s_f\":{\"r\":0}}\n");
 	return cERR_SUBTITLE_NO_ERROR;
@@ -179,10 +214,11 @@ static int Write(Context_t *context, void *data)
 	char *Encoding      = NULL;
 	SubtitleOut_t *out  = NULL;
 	int32_t curtrackid  = -1;
+	SubtitleOutput_t *sub = getOutput(context);
 
 	subtitle_printf(10, "\n");
 
-	if (data == NULL)
+	if (data == NULL || sub == NULL)
 	{
 		subtitle_err("null pointer passed\n");
 		return cERR_SUBTITLE_ERROR;
@@ -193,12 +229,12 @@ static int Write(Context_t *context, void *data)
 	context->manager->subtitle->Command(context, MANAGER_GET, &curtrackid);
 	if (curtrackid != (int32_t)out->trackId)
 	{
-		if (g_subWriter)
+		if (sub->subWriter)
 		{
-			g_subWriter = NULL;
-			g_subWriter->close();
+			sub->subWriter->close(&sub->subWriterState);
+			sub->subWriter = NULL;
 		}
-		Flush();
+		Flush(context);
 	}
 	context->manager->subtitle->Command(context, MANAGER_GETENCODING, &Encoding);
 
@@ -228,7 +264,7 @@ static int Write(Context_t *context, void *data)
 	{
 		case SUBTITLE_CODEC_ID_SUBRIP:
 		case SUBTITLE_CODEC_ID_WEBVTT:
-			E2iSendMsg("{\"s_a\":{\"id\":%d,\"s\":%"PRId64",\"e\":%"PRId64",\"t\":\"%s\"}}\n", out->trackId, out->pts / 90, out->pts / 90 + out->durationMS, json_string_escape((char *)out->data));
+			E2iSendMsg("{\"s_a\":{\"id\":%d,\"s\":%"PRId64",\"e\":%"PRId64",\"t\":\"%s\"}}\n", out->trackId, out->pts / 90, out->pts / 90 + out->durationMS, json_string_escape(sub->escaped, (char *)out->data));
 			break;
 		case SUBTITLE_CODEC_ID_ASS:
 			E2iSendMsg("{\"s_a\":{\"id\":%d,\"s\":%"PRId64",\"e\":%"PRId64",\"t\":\"%s\"}}\n", out->trackId, out->pts / 90, out->pts / 90 + out->durationMS, ass_get_text((char *)out->data));
@@ -237,10 +273,10 @@ static int Write(Context_t *context, void *data)
 		case SUBTITLE_CODEC_ID_DVB:
 		case SUBTITLE_CODEC_ID_XSUB:
 		{
-			if (!g_subWriter)
+			if (!sub->subWriter)
 			{
-				g_subWriter = &WriterSubPGS;
-				//g_subWriter->open(subCodecId, out->extradata, out->extralen);
+				sub->subWriter = &WriterSubPGS;
+				//sub->subWriter->open(&sub->subWriterState, subCodecId, out->extradata, out->extralen);
 			}
 
 			WriterSubCallData_t subPacket;
@@ -256,7 +292,7 @@ static int Write(Context_t *context, void *data)
 			subPacket.durationMS   = out->durationMS;
 			subPacket.width        = out->width;
 			subPacket.height       = out->height;
-			g_subWriter->write(&subPacket);
+			sub->subWriter->write(&sub->subWriterState, &subPacket);
 		}
 		break;
 		default:
@@ -267,42 +303,57 @@ static int Write(Context_t *context, void *data)
 	return cERR_SUBTITLE_NO_ERROR;
 }
 
-static int32_t subtitle_Open(Context_t *context __attribute__((unused)))
+static int32_t subtitle_Open(Context_t *context)
 {
 	//uint32_t i = 0 ;
+	SubtitleOutput_t *sub = getOutput(context);
 
 	subtitle_printf(10, "\n");
 
-	if (isSubtitleOpened == 1)
+	if (sub == NULL)
+	{
+		return cERR_SUBTITLE_ERROR;
+	}
+
+	if (sub->isSubtitleOpened == 1)
 	{
 		subtitle_err("already opened! ignoring\n");
 		return cERR_SUBTITLE_ERROR;
 	}
 
-	getMutex(__LINE__);
+	getMutex(sub, __LINE__);
 
-	isSubtitleOpened = 1;
+	sub->isSubtitleOpened = 1;
 
-	releaseMutex(__LINE__);
+	releaseMutex(sub, __LINE__);
 
 	subtitle_printf(10, "<\n");
 	return cERR_SUBTITLE_NO_ERROR;
 }
 
-static int32_t subtitle_Close(Context_t *context __attribute__((unused)))
+static int32_t subtitle_Close(Context_t *context)
 {
+	SubtitleOutput_t *sub = context->subtitleOutput;
+
 	subtitle_printf(10, "\n");
 
-	getMutex(__LINE__);
+	if (sub == NULL)
+	{
+		return cERR_SUBTITLE_NO_ERROR;
+	}
+
+	getMutex(sub, __LINE__);
 
-	if (g_subWriter)
+	if (sub->subWriter)
 	{
-		g_subWriter->close();
-		g_subWriter = NULL;
+		sub->subWriter->close(&sub->subWriterState);
+		sub->subWriter = NULL;
 	}
 
-	isSubtitleOpened = 0;
-	releaseMutex(__LINE__);
+	sub->isSubtitleOpened = 0;
+	releaseMutex(sub, __LINE__);
+
+	freeOutput(context);
 
 	subtitle_printf(10, "<\n");
 
@@ -337,17 +388,17 @@ static int Command(Context_t *context, OutputCmd_t command, void *argument __att
 		}
 		case OUTPUT_SWITCH:
 		{
-			ret = Flush();
+			ret = Flush(context);
 			break;
 		}
 		case OUTPUT_FLUSH:
 		{
-			ret = Flush();
+			ret = Flush(context);
 			break;
 		}
 		case OUTPUT_CLEAR:
 		{
-			ret = Flush();
+			ret = Flush(context);
 			break;
 		}
 		case OUTPUT_PAUSE:
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "misc.h"
 #include "writer.h"
@@ -35,6 +36,13 @@
 /* Makros/Constants              */
 /* ***************************** */
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* pieces up to this size are copied rather than given an iovec each */
+#define IOVEC_COPY_SIZE 128
+
 /* ***************************** */
 /* Types                         */
 /* ***************************** */
@@ -56,10 +64,182 @@ void FlushPipe(int pipefd)
 	while (read(pipefd, &tmp, 1) == 1);
 }
 
-ssize_t WriteExt(WriteV_t _call, int fd, void *data, size_t size)
+ssize_t WriteExt(WriteV_t _call, Context_t *context, int fd, void *data, size_t size)
 {
 	struct iovec iov[1];
 	iov[0].iov_base = data;
 	iov[0].iov_len = size;
-	return _call(fd, iov, 1);
+	return _call(context, fd, iov, 1);
+}
+
+/* ***************************** */
+/* IOVec builder                 */
+/* ***************************** */
+void IOVecReset(IOVecBuilder_t *b)
+{
+	b->count = 0;
+	b->pesCount = 0;
+	b->scratchLen = 0;
+}
+
+void IOVecFree(IOVecBuilder_t *b)
+{
+	free(b->iov);
+	free(b->pes);
+	free(b->scratch);
+	memset(b, 0, sizeof(*b));
+}
+
+static int32_t IOVecGrow(IOVecBuilder_t *b)
+{
+	if (b->count == b->size)
+	{
+		int32_t size = b->size ? 2 * b->size : 64;
+		struct iovec *iov = realloc(b->iov, size * sizeof(struct iovec));
+		if (iov == NULL)
+		{
+			writer_err("out of memory\n");
+			return -1;
+		}
+		b->iov = iov;
+		b->size = size;
+	}
+	return 0;
+}
+
+/* copies the piece behind the last entry if that one is copied too */
+static int32_t IOVecCopy(IOVecBuilder_t *b, const void *data, size_t len)
+{
+	if (b->scratchLen + len > b->scratchSize)
+	{
+		uint32_t size = b->scratchSize ? b->scratchSize : 4096;
+		while (size < b->scratchLen + len)
+		{
+			size *= 2;
+		}
+		uint8_t *scratch = realloc(b->scratch, size);
+		if (scratch == NULL)
+		{
+			writer_err("out of memory\n");
+			return -1;
+		}
+		/* the entries pointing into the old buffer */
+		if (scratch != b->scratch)
+		{
+			int32_t i;
+			for (i = 0; i < b->count; i++)
+			{
+				uint8_t *base = b->iov[i].iov_base;
+				if (b->scratchLen && base >= b->scratch && base < b->scratch + b->scratchLen)
+				{
+					b->iov[i].iov_base = scratch + (base - b->scratch);
+				}
+			}
+		}
+		b->scratch = scratch;
+		b->scratchSize = size;
+	}
+
+	uint8_t *dst = b->scratch + b->scratchLen;
+	memcpy(dst, data, len);
+	b->scratchLen += len;
+
+	if (b->count > b->pes[b->pesCount - 1] && (uint8_t *)b->iov[b->count - 1].iov_base + b->iov[b->count - 1].iov_len == dst)
+	{
+		b->iov[b->count - 1].iov_len += len;
+		return 0;
+	}
+
+	if (IOVecGrow(b))
+	{
+		return -1;
+	}
+	b->iov[b->count].iov_base = dst;
+	b->iov[b->count++].iov_len = len;
+	return 0;
+}
+
+int32_t IOVecPesStart(IOVecBuilder_t *b, uint8_t *header)
+{
+	if (b->pesCount == b->pesSize)
+	{
+		int32_t size = b->pesSize ? 2 * b->pesSize : 4;
+		int32_t *pes = realloc(b->pes, size * sizeof(int32_t));
+		if (pes == NULL)
+		{
+			writer_err("out of memory\n");
+			return -1;
+		}
+		b->pes = pes;
+		b->pesSize = size;
+	}
+	if (IOVecGrow(b))
+	{
+		return -1;
+	}
+	b->pes[b->pesCount++] = b->count;
+	b->iov[b->count].iov_base = header;
+	b->iov[b->count++].iov_len = 0;
+	return 0;
+}
+
+void IOVecPesHeaderLen(IOVecBuilder_t *b, size_t len)
+{
+	b->iov[b->pes[b->pesCount - 1]].iov_len = len;
+}
+
+int32_t IOVecAdd(IOVecBuilder_t *b, const void *data, size_t len)
+{
+	if (b->pesCount == 0)
+	{
+		writer_err("data before the PES header\n");
+		return -1;
+	}
+	if (len == 0)
+	{
+		return 0;
+	}
+	/* the last entry a PES can have takes everything that is left */
+	if (len <= IOVEC_COPY_SIZE || b->count - b->pes[b->pesCount - 1] >= IOV_MAX - 1)
+	{
+		return IOVecCopy(b, data, len);
+	}
+	if (IOVecGrow(b))
+	{
+		return -1;
+	}
+	b->iov[b->count].iov_base = (void *)data;
+	b->iov[b->count++].iov_len = len;
+	return 0;
+}
+
+/* the entry after the PES */
+static int32_t IOVecPesEnd(IOVecBuilder_t *b, int32_t pes)
+{
+	return pes + 1 < b->pesCount ? b->pes[pes + 1] : b->count;
+}
+
+/* one writev() for as many complete PES as fit into it */
+ssize_t IOVecWrite(IOVecBuilder_t *b, WriteV_t _call, Context_t *context, int fd)
+{
+	ssize_t written = 0;
+	int32_t pes = 0;
+
+	while (pes < b->pesCount)
+	{
+		int32_t first = b->pes[pes];
+		while (pes + 1 < b->pesCount && IOVecPesEnd(b, pes + 1) - first <= IOV_MAX)
+		{
+			pes++;
+		}
+
+		ssize_t ret = _call(context, fd, b->iov + first, IOVecPesEnd(b, pes) - first);
+		if (ret < 0)
+		{
+			return ret;
+		}
+		written += ret;
+		pes++;
+	}
+	return written;
 }
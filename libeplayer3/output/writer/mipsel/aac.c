@@ -63,12 +63,17 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct AacState_s
+{
+	bool needInitHeader;
+	LATMContext *pLATMCtx;
+} AacState_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static bool needInitHeader = true;
-
 /// ** AAC ADTS format **
 ///
 /// AAAAAAAA AAAABCCD EEFFFFGH HHIJKLMM
@@ -116,8 +121,6 @@ static unsigned char DefaultAACHeader[] =
 	0xfc
 };
 
-LATMContext *pLATMCtx = NULL;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -126,17 +129,24 @@ LATMContext *pLATMCtx = NULL;
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state)
 {
-	if (pLATMCtx)
+	AacState_t *st = state;
+
+	if (st->pLATMCtx)
 	{
-		free(pLATMCtx);
-		pLATMCtx = NULL;
+		free(st->pLATMCtx);
+		st->pLATMCtx = NULL;
 	}
-	needInitHeader = true;
+	st->needInitHeader = true;
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	free(((AacState_t *)state)->pLATMCtx);
+}
+
 static int _writeData(WriterAVCallData_t *call, int type)
 {
 	aac_printf(10, "\n _writeData type[%d]\n", type);
@@ -191,7 +201,7 @@ static int _writeData(WriterAVCallData_t *call, int type)
 	iov[0].iov_len  = HeaderLength;
 	iov[1].iov_base = call->data;
 	iov[1].iov_len  = call->len;
-	return call->WriteV(call->fd, iov, 2);
+	return call->WriteV(call->context, call->fd, iov, 2);
 }
 
 static int writeDataADTS(WriterAVCallData_t *call)
@@ -211,12 +221,13 @@ static int writeDataADTS(WriterAVCallData_t *call)
 		return _writeData(call, 0);
 	}
 
-	uint32_t adtsHeaderSize = (call->private_data == NULL || needInitHeader == false) ? AAC_HEADER_LENGTH : call->private_size;
+	AacState_t *st = call->state;
+	uint32_t adtsHeaderSize = (call->private_data == NULL || st->needInitHeader == false) ? AAC_HEADER_LENGTH : call->private_size;
 	uint32_t PacketLength = call->len + adtsHeaderSize;
 	uint8_t PesHeader[PES_MAX_HEADER_SIZE + AAC_HEADER_LENGTH + MAX_PCE_SIZE];
 	uint32_t headerSize = InsertPesHeader(PesHeader, PacketLength, MPEG_AUDIO_PES_START_CODE, call->Pts, 0);
 	uint8_t *pExtraData = &PesHeader[headerSize];
-	needInitHeader = false;
+	st->needInitHeader = false;
 
 	aac_printf(10, "AudioPts %lld\n", call->Pts);
 	if (call->private_data == NULL)
@@ -250,7 +261,7 @@ static int writeDataADTS(WriterAVCallData_t *call)
 	iov[1].iov_base = call->data;
 	iov[1].iov_len = call->len;
 
-	return call->WriteV(call->fd, iov, 2);
+	return call->WriteV(call->context, call->fd, iov, 2);
 }
 
 static int writeDataLATM(WriterAVCallData_t *call)
@@ -276,22 +287,23 @@ static int writeDataLATM(WriterAVCallData_t *call)
 
 	aac_printf(10, "AudioPts %lld\n", call->Pts);
 
-	if (!pLATMCtx)
+	AacState_t *st = call->state;
+	if (!st->pLATMCtx)
 	{
-		pLATMCtx = malloc(sizeof(LATMContext));
-		memset(pLATMCtx, 0x00, sizeof(LATMContext));
-		pLATMCtx->mod = 14;
-		pLATMCtx->counter = 0;
+		st->pLATMCtx = malloc(sizeof(LATMContext));
+		memset(st->pLATMCtx, 0x00, sizeof(LATMContext));
+		st->pLATMCtx->mod = 14;
+		st->pLATMCtx->counter = 0;
 	}
 
-	if (!pLATMCtx)
+	if (!st->pLATMCtx)
 	{
 		aac_err("parsing NULL pLATMCtx. ignoring...\n");
 		return 0;
 	}
 
 	unsigned char PesHeader[PES_MAX_HEADER_SIZE];
-	int ret = latmenc_decode_extradata(pLATMCtx, call->private_data, call->private_size);
+	int ret = latmenc_decode_extradata(st->pLATMCtx, call->private_data, call->private_size);
 	if (ret)
 	{
 		/* printf("%02x %02x %02x %02x %02x %02x %02x %02x\n", (int)call->data[0], (int)call->data[1], (int)call->data[2], (int)call->data[3], \
@@ -300,26 +312,26 @@ static int writeDataLATM(WriterAVCallData_t *call)
 		aac_err("latm_decode_extradata failed. ignoring...\n");
 		return 0;
 	}
-	ret = latmenc_write_packet(pLATMCtx, call->data, call->len, call->private_data, call->private_size);
+	ret = latmenc_write_packet(st->pLATMCtx, call->data, call->len, call->private_data, call->private_size);
 	if (ret)
 	{
 		aac_err("latm_write_packet failed. ignoring...\n");
 		return 0;
 	}
 
-	unsigned int  HeaderLength = InsertPesHeader(PesHeader,  pLATMCtx->len + 3, MPEG_AUDIO_PES_START_CODE, call->Pts, 0);
+	unsigned int  HeaderLength = InsertPesHeader(PesHeader,  st->pLATMCtx->len + 3, MPEG_AUDIO_PES_START_CODE, call->Pts, 0);
 
 	struct iovec iov[3];
 	iov[0].iov_base = PesHeader;
 	iov[0].iov_len  = HeaderLength;
 
-	iov[1].iov_base = pLATMCtx->loas_header;
+	iov[1].iov_base = st->pLATMCtx->loas_header;
 	iov[1].iov_len  = 3;
 
-	iov[2].iov_base = pLATMCtx->buffer;
-	iov[2].iov_len  = pLATMCtx->len;
+	iov[2].iov_base = st->pLATMCtx->buffer;
+	iov[2].iov_len  = st->pLATMCtx->len;
 
-	return call->WriteV(call->fd, iov, 3);
+	return call->WriteV(call->context, call->fd, iov, 3);
 }
 
 /* ***************************** */
@@ -340,7 +352,9 @@ struct Writer_s WriterAudioAAC =
 {
 	&reset,
 	&writeDataADTS,
-	&caps
+	&caps,
+	sizeof(AacState_t),
+	&freeState
 };
 
 static WriterCaps_t caps_aac_latm =
@@ -357,7 +371,9 @@ struct Writer_s WriterAudioAACLATM =
 {
 	&reset,
 	&writeDataLATM,
-	&caps_aac_latm
+	&caps_aac_latm,
+	sizeof(AacState_t),
+	&freeState
 };
 
 static WriterCaps_t caps_aacplus =
@@ -374,5 +390,7 @@ struct Writer_s WriterAudioAACPLUS =
 {
 	&reset,
 	&writeDataADTS,
-	&caps_aacplus
+	&caps_aacplus,
+	sizeof(AacState_t),
+	&freeState
 };
@@ -73,7 +73,7 @@ unsigned char AC3_SYNC_HEADER[] = {0x80, 0x01, 0x00, 0x01};
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state __attribute__((unused)))
 {
 	return 0;
 }
@@ -120,7 +120,7 @@ static int writeData(WriterAVCallData_t *call)
 
 	ac3_printf(40, "PES HEADER LEN %d\n", (int)iov[0].iov_len);
 
-	return call->WriteV(call->fd, iov, 2);
+	return call->WriteV(call->context, call->fd, iov, 2);
 }
 
 /* ***************************** */
@@ -70,7 +70,7 @@
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state __attribute__((unused)))
 {
 	return 0;
 }
@@ -120,7 +120,7 @@ static int writeData(WriterAVCallData_t *call)
 	iov[1].iov_base = call->data;
 	iov[1].iov_len = call->len;
 
-	int len = call->WriteV(call->fd, iov, 2);
+	int len = call->WriteV(call->context, call->fd, iov, 2);
 
 	amr_printf(10, "amr_Write-< len=%d\n", len);
 	return len;
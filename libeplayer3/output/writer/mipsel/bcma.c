@@ -73,7 +73,7 @@
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state __attribute__((unused)))
 {
 	return 0;
 }
@@ -216,7 +216,7 @@ static int writeData(WriterAVCallData_t *call)
 	iov[i].iov_base = call->data;
 	iov[i++].iov_len  = call->len;
 
-	return call->WriteV(call->fd, iov, i);
+	return call->WriteV(call->context, call->fd, iov, i);
 }
 
 /* ***************************** */
@@ -61,12 +61,17 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct Divx3State_s
+{
+	uint8_t initialHeader;
+} Divx3State_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static uint8_t initialHeader = 1;
-static uint8_t brcm_divx311_sequence_header[] =
+static const uint8_t brcm_divx311_sequence_header[] =
 {
 	0x00, 0x00, 0x01, 0xE0, 0x00, 0x34, 0x80, 0x80, // PES HEADER
 	0x05, 0x2F, 0xFF, 0xFF, 0xFF, 0xFF,
@@ -86,9 +91,9 @@ static uint8_t brcm_divx311_sequence_header[] =
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state)
 {
-	initialHeader = 1;
+	((Divx3State_t *)state)->initialHeader = 1;
 	return 0;
 }
 
@@ -117,13 +122,16 @@ static int writeData(WriterAVCallData_t *call)
 
 	divx_printf(10, "AudioPts %lld\n", call->Pts);
 
+	Divx3State_t *st = call->state;
+	uint8_t sequenceHeader[sizeof(brcm_divx311_sequence_header)];
 	struct iovec iov[8];
 	int ic = 0;
 
-	if (initialHeader)
+	if (st->initialHeader)
 	{
-		initialHeader = 0;
-		uint8_t *data = brcm_divx311_sequence_header;
+		st->initialHeader = 0;
+		memcpy(sequenceHeader, brcm_divx311_sequence_header, sizeof(sequenceHeader));
+		uint8_t *data = sequenceHeader;
 		int32_t height = call->Height;
 		int32_t width  = call->Width;
 		data += 38;
@@ -135,8 +143,8 @@ static int writeData(WriterAVCallData_t *call)
 		data[3] = B_SET_BITS("height [1.0]", B_GET_BITS(height, 1, 0), 7, 6) |
 			B_SET_BITS("'100000'", 0x20, 5, 0);
 
-		iov[ic].iov_base = brcm_divx311_sequence_header;
-		iov[ic++].iov_len = sizeof(brcm_divx311_sequence_header);
+		iov[ic].iov_base = sequenceHeader;
+		iov[ic++].iov_len = sizeof(sequenceHeader);
 	}
 
 	iov[ic].iov_base = PesHeader;
@@ -157,7 +165,7 @@ static int writeData(WriterAVCallData_t *call)
 	iov[ic].iov_base = call->data;
 	iov[ic++].iov_len = call->len;
 
-	int len = call->WriteV(call->fd, iov, ic);
+	int len = call->WriteV(call->context, call->fd, iov, ic);
 
 	divx_printf(10, "xvid_Write < len=%d\n", len);
 
@@ -182,5 +190,6 @@ struct Writer_s WriterVideoDIVX3 =
 {
 	&reset,
 	&writeData,
-	&divix3_caps
+	&divix3_caps,
+	sizeof(Divx3State_t)
 };
@@ -75,7 +75,7 @@
 /* MISC Functions                */
 /* ***************************** */
 
-static int32_t reset()
+static int32_t reset(void *state __attribute__((unused)))
 {
 	return 0;
 }
@@ -140,7 +140,7 @@ static int writeData(WriterAVCallData_t *call)
 	iov[1].iov_base = Data;
 	iov[1].iov_len = Size;
 
-	int32_t len = call->WriteV(call->fd, iov, 2);
+	int32_t len = call->WriteV(call->context, call->fd, iov, 2);
 	dts_printf(10, "< len %d\n", len);
 	return len;
 }
@@ -57,23 +57,36 @@
 /* Makros/Constants              */
 /* ***************************** */
 
-#define IOVEC_SIZE                              128
-
 /* ***************************** */
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct H264State_s
+{
+	unsigned int            NalLengthBytes;
+	unsigned char           *CodecData;
+	unsigned int            CodecDataLen;
+	int                     avc3;
+	int                     sps_pps_in_stream;
+
+	/* the extradata CodecData was made from */
+	uint8_t                 *CodecDataSrc;
+	unsigned int            CodecDataSrcLen;
+	uint32_t                CodecDataSrcHash;
+
+	/* the extradata of the stream sps_pps_in_stream was found in */
+	uint8_t                 *SpsPpsSrc;
+	unsigned int            SpsPpsSrcLen;
+
+	IOVecBuilder_t          Iov;
+} H264State_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static unsigned char           Head[] = {0, 0, 0, 1};
-static int                     initialHeader = 1;
-static unsigned int            NalLengthBytes = 1;
-static unsigned char           *CodecData     = NULL;
-static unsigned int            CodecDataLen   = 0;
-static int                     avc3 = 0;
-static int                     sps_pps_in_stream = 0;
+static const unsigned char     Head[] = {0, 0, 0, 1};
 
 /* ***************************** */
 /* Prototypes                    */
@@ -188,7 +201,7 @@ static int32_t UpdateExtraData(uint8_t **ppExtraData, uint32_t *pExtraDataSize,
 	return 0;
 }
 
-static int32_t PreparCodecData(unsigned char *data, unsigned int cd_len, unsigned int *NalLength)
+static int32_t PreparCodecData(H264State_t *st, unsigned char *data, unsigned int cd_len)
 {
 	h264_printf(10, "H264 check codec data..!\n");
 	int32_t ret = -100;
@@ -244,11 +257,11 @@ static int32_t PreparCodecData(unsigned char *data, unsigned int cd_len, unsigne
 						memcpy(tmp + tmp_len, data + cd_pos, len);
 						tmp_len += len;
 
-						CodecData = malloc(tmp_len);
-						memcpy(CodecData, tmp, tmp_len);
-						CodecDataLen = tmp_len;
+						st->CodecData = malloc(tmp_len);
+						memcpy(st->CodecData, tmp, tmp_len);
+						st->CodecDataLen = tmp_len;
 
-						*NalLength = (data[4] & 0x03) + 1;
+						st->NalLengthBytes = (data[4] & 0x03) + 1;
 						ret = 0;
 					}
 					else
@@ -281,20 +294,61 @@ static int32_t PreparCodecData(unsigned char *data, unsigned int cd_len, unsigne
 	}
 	else
 	{
-		*NalLength = 0;
+		st->NalLengthBytes = 0;
 	}
 
 	return ret;
 }
 
-static int reset()
+static void FreeCodecData(H264State_t *st)
 {
-	initialHeader = 1;
-	avc3 = 0;
-	sps_pps_in_stream = 0;
+	free(st->CodecData);
+	st->CodecData = NULL;
+	st->CodecDataLen = 0;
+	st->CodecDataSrc = NULL;
+}
+
+/* The AnnexB parameter sets only depend on the avcC, so they are made once
+ * per extradata. Some RTSP streams update it at runtime, in place or with
+ * a new buffer, which the hash and the pointer catch. */
+static int32_t GetCodecData(H264State_t *st, uint8_t *data, unsigned int cd_len)
+{
+	uint32_t hash = HashData(data, cd_len);
+
+	if (st->CodecData && data == st->CodecDataSrc && cd_len == st->CodecDataSrcLen && hash == st->CodecDataSrcHash)
+	{
+		return 0;
+	}
+
+	FreeCodecData(st);
+	int32_t ret = PreparCodecData(st, data, cd_len);
+	if (ret == 0)
+	{
+		st->CodecDataSrc = data;
+		st->CodecDataSrcLen = cd_len;
+		st->CodecDataSrcHash = hash;
+	}
+	return ret;
+}
+
+static int reset(void *state)
+{
+	H264State_t *st = state;
+
+	st->avc3 = 0;
+	/* sps_pps_in_stream is kept, a seek does not take the SPS/PPS out
+	 * of the stream */
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	H264State_t *st = state;
+
+	FreeCodecData(st);
+	IOVecFree(&st->Iov);
+}
+
 static int writeData(WriterAVCallData_t *call)
 {
 	unsigned char           PesHeader[PES_MAX_HEADER_SIZE];
@@ -302,8 +356,6 @@ static int writeData(WriterAVCallData_t *call)
 	unsigned int            TimeDelta;
 	unsigned int            TimeScale;
 	unsigned int            len = 0;
-	int ic = 0;
-	struct iovec iov[IOVEC_SIZE];
 	h264_printf(20, "\n");
 
 	if (call == NULL)
@@ -333,15 +385,25 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
+	H264State_t *st = call->state;
+
 	/* AnnexA */
-	if (!avc3 && ((1 < call->private_size && call->private_data[0] == 0) ||
+	if (!st->avc3 && ((1 < call->private_size && call->private_data[0] == 0) ||
 			((call->len > 3) && ((call->data[0] == 0x00 && call->data[1] == 0x00 && call->data[2] == 0x00 && call->data[3] == 0x01) ||
 					(call->data[0] == 0xff && call->data[1] == 0xff && call->data[2] == 0xff && call->data[3] == 0xff)))))
 	{
 		uint32_t i = 0;
-		uint8_t InsertPrivData = !sps_pps_in_stream;
+		if (st->sps_pps_in_stream && (call->private_data != st->SpsPpsSrc || call->private_size != st->SpsPpsSrcLen))
+		{
+			/* another stream */
+			st->sps_pps_in_stream = 0;
+		}
+		/* without extradata there is nothing to insert and no need to look for in-band SPS/PPS */
+		uint8_t InsertPrivData = !st->sps_pps_in_stream && call->private_size > 0;
 		uint32_t PacketLength = 0;
 		uint32_t FakeStartCode = (call->Version << 8) | PES_VERSION_FAKE_START_CODE;
+		int ic = 0;
+		struct iovec iov[3];
 		iov[ic++].iov_base = PesHeader;
 
 		while (InsertPrivData && i < 36 && (call->len - i) > 5)
@@ -349,14 +411,15 @@ static int writeData(WriterAVCallData_t *call)
 			if ((call->data[i] == 0x00 && call->data[i + 1] == 0x00 && call->data[i + 2] == 0x00 && call->data[i + 3] == 0x01 && (call->data[i + 4] == 0x67 || call->data[i + 4] == 0x68)))
 			{
 				InsertPrivData = 0;
-				sps_pps_in_stream = 1;
+				st->sps_pps_in_stream = 1;
+				st->SpsPpsSrc = call->private_data;
+				st->SpsPpsSrcLen = call->private_size;
 			}
 			i += 1;
 		}
 
 		if (InsertPrivData && call->private_size > 0 /*&& initialHeader*/) // some rtsp streams can update codec data at runtime
 		{
-			initialHeader = 0;
 			iov[ic].iov_base  = call->private_data;
 			iov[ic++].iov_len = call->private_size;
 			PacketLength     += call->private_size;
@@ -368,7 +431,7 @@ static int writeData(WriterAVCallData_t *call)
 
 		iov[0].iov_len = InsertPesHeader(PesHeader, -1, MPEG_VIDEO_PES_START_CODE, VideoPts, FakeStartCode);
 
-		return call->WriteV(call->fd, iov, ic);
+		return call->WriteV(call->context, call->fd, iov, ic);
 	}
 	else if (!call->private_data || call->private_size < 7 || 1 != call->private_data[0])
 	{
@@ -377,57 +440,44 @@ static int writeData(WriterAVCallData_t *call)
 	}
 
 	uint32_t PacketLength = 0;
+	int32_t err = 0;
 
-	ic = 0;
-	iov[ic++].iov_base = PesHeader;
+	IOVecReset(&st->Iov);
+	err = IOVecPesStart(&st->Iov, PesHeader);
 
-	if (!avc3)
+	if (!st->avc3)
 	{
-		if (CodecData)
+		if (GetCodecData(st, call->private_data, call->private_size))
 		{
-			free(CodecData);
-			CodecData = NULL;
-		}
-
-		uint8_t  *private_data = call->private_data;
-		uint32_t  private_size = call->private_size;
+			/* no SPS/PPS in the avcC, take them from the packet */
+			uint8_t  *private_data = call->private_data;
+			uint32_t  private_size = call->private_size;
 
-		if (PreparCodecData(private_data, private_size, &NalLengthBytes))
-		{
-			UpdateExtraData(&private_data, &private_size, call->data, call->len);
-			PreparCodecData(private_data, private_size, &NalLengthBytes);
-		}
-
-		if (private_data != call->private_data)
-		{
-			avc3 = 1;
-			free(private_data);
-			private_data = NULL;
+			FreeCodecData(st);
+			if (UpdateExtraData(&private_data, &private_size, call->data, call->len) == 0)
+			{
+				st->avc3 = 1;
+				PreparCodecData(st, private_data, private_size);
+				free(private_data);
+				private_data = NULL;
+			}
 		}
 
-		if (CodecData != NULL)
+		if (st->CodecData != NULL)
 		{
-			iov[ic].iov_base  = CodecData;
-			iov[ic++].iov_len = CodecDataLen;
-			PacketLength     += CodecDataLen;
-			initialHeader = 0;
+			err |= IOVecAdd(&st->Iov, st->CodecData, st->CodecDataLen);
+			PacketLength += st->CodecDataLen;
 		}
 	}
 
-	if (CodecData != NULL)
+	if (st->CodecData != NULL)
 	{
 		uint32_t pos = 0;
 		do
 		{
-			if (ic >= IOVEC_SIZE)
-			{
-				h264_err(">> Drop data due to ic overflow\n");
-				break;
-			}
-
 			uint32_t pack_len = 0;
 			uint32_t i = 0;
-			for (i = 0; i < NalLengthBytes; i++, pos++)
+			for (i = 0; i < st->NalLengthBytes; i++, pos++)
 			{
 				pack_len <<= 8;
 				pack_len += call->data[pos];
@@ -438,24 +488,29 @@ static int writeData(WriterAVCallData_t *call)
 				pack_len = call->len - pos;
 			}
 
-			iov[ic].iov_base  = Head;
-			iov[ic++].iov_len = sizeof(Head);
+			err |= IOVecAdd(&st->Iov, Head, sizeof(Head));
 			PacketLength += sizeof(Head);
 
-			iov[ic].iov_base  = call->data + pos;
-			iov[ic++].iov_len = pack_len;
-			PacketLength     += pack_len;
+			err |= IOVecAdd(&st->Iov, call->data + pos, pack_len);
+			PacketLength += pack_len;
 
 			pos += pack_len;
 
 		}
-		while ((pos + NalLengthBytes) < call->len);
+		while ((pos + st->NalLengthBytes) < call->len);
+
+		if (err)
+		{
+			h264_err(">> Drop data, no memory for the iovecs\n");
+			return 0;
+		}
 
 		h264_printf(10, "<<<< PacketLength [%d]\n", PacketLength);
-		iov[0].iov_len = InsertPesHeader(PesHeader, -1, MPEG_VIDEO_PES_START_CODE, VideoPts, 0);
+		unsigned int HeaderLength = InsertPesHeader(PesHeader, -1, MPEG_VIDEO_PES_START_CODE, VideoPts, 0);
+		IOVecPesHeaderLen(&st->Iov, HeaderLength);
 
-		len = call->WriteV(call->fd, iov, ic);
-		PacketLength += iov[0].iov_len;
+		len = IOVecWrite(&st->Iov, call->WriteV, call->context, call->fd);
+		PacketLength += HeaderLength;
 		if (PacketLength != len)
 		{
 			h264_err("<<<< not all data have been written [%d/%d]\n", len, PacketLength);
@@ -484,5 +539,7 @@ struct Writer_s WriterVideoH264 =
 {
 	&reset,
 	&writeData,
-	&caps
+	&caps,
+	sizeof(H264State_t),
+	&freeState
 };
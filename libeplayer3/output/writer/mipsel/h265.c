@@ -56,21 +56,31 @@
 /* Makros/Constants              */
 /* ***************************** */
 
-#define IOVEC_SIZE                                      128
-
 /* ***************************** */
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct H265State_s
+{
+	int                     initialHeader;
+	unsigned int            NalLengthBytes;
+	unsigned char           *CodecData;
+	unsigned int            CodecDataLen;
+
+	/* the extradata CodecData was made from */
+	uint8_t                 *CodecDataSrc;
+	unsigned int            CodecDataSrcLen;
+	uint32_t                CodecDataSrcHash;
+
+	IOVecBuilder_t          Iov;
+} H265State_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static unsigned char           Head[] = {0, 0, 0, 1};
-static int                     initialHeader = 1;
-static unsigned int            NalLengthBytes = 1;
-static unsigned char           *CodecData     = NULL;
-static unsigned int            CodecDataLen   = 0;
+static const unsigned char     Head[] = {0, 0, 0, 1};
 
 /* ***************************** */
 /* Prototypes                    */
@@ -80,7 +90,7 @@ static unsigned int            CodecDataLen   = 0;
 /* MISC Functions                */
 /* ***************************** */
 
-static int32_t PreparCodecData(unsigned char *data, unsigned int cd_len, unsigned int *NalLength)
+static int32_t PreparCodecData(H265State_t *st, unsigned char *data, unsigned int cd_len)
 {
 	h265_printf(10, "H265 check codec data..!\n");
 	int32_t ret = -100;
@@ -101,7 +111,7 @@ static int32_t PreparCodecData(unsigned char *data, unsigned int cd_len, unsigne
 					h265_printf(10, "Unsupported extra data version %d, decoding may fail", (int)data[0]);
 				}
 
-				*NalLength = (data[21] & 3) + 1;
+				st->NalLengthBytes = (data[21] & 3) + 1;
 				int num_param_sets = data[22];
 				uint32_t pos = 23;
 				for (i = 0; i < num_param_sets; i++)
@@ -147,26 +157,54 @@ static int32_t PreparCodecData(unsigned char *data, unsigned int cd_len, unsigne
 					}
 				}
 
-				CodecData = malloc(tmp_len);
-				memcpy(CodecData, tmp, tmp_len);
-				CodecDataLen = tmp_len;
+				st->CodecData = malloc(tmp_len);
+				memcpy(st->CodecData, tmp, tmp_len);
+				st->CodecDataLen = tmp_len;
 			}
 		}
 	}
 	else
 	{
-		*NalLength = 0;
+		st->NalLengthBytes = 0;
 	}
 
 	return ret;
 }
 
-static int reset()
+/* The AnnexB parameter sets only depend on the hvcC, so they are made
+ * once per extradata instead of after every reset. */
+static void GetCodecData(H265State_t *st, uint8_t *data, unsigned int cd_len)
+{
+	uint32_t hash = HashData(data, cd_len);
+
+	if (st->CodecData && data == st->CodecDataSrc && cd_len == st->CodecDataSrcLen && hash == st->CodecDataSrcHash)
+	{
+		return;
+	}
+
+	free(st->CodecData);
+	st->CodecData = NULL;
+	st->CodecDataLen = 0;
+	PreparCodecData(st, data, cd_len);
+	st->CodecDataSrc = data;
+	st->CodecDataSrcLen = cd_len;
+	st->CodecDataSrcHash = hash;
+}
+
+static int reset(void *state)
 {
-	initialHeader = 1;
+	((H265State_t *)state)->initialHeader = 1;
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	H265State_t *st = state;
+
+	free(st->CodecData);
+	IOVecFree(&st->Iov);
+}
+
 static int writeData(WriterAVCallData_t *call)
 {
 	unsigned char           PesHeader[PES_MAX_HEADER_SIZE];
@@ -174,8 +212,6 @@ static int writeData(WriterAVCallData_t *call)
 	unsigned int            TimeDelta;
 	unsigned int            TimeScale;
 	unsigned int            len = 0;
-	int ic = 0;
-	struct iovec iov[IOVEC_SIZE];
 	h265_printf(20, "\n");
 
 	if (call == NULL)
@@ -205,17 +241,21 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
+	H265State_t *st = call->state;
+
 	if (call->InfoFlags & 0x1) // TS container
 	{
 		h265_printf(10, "H265 simple inject method!\n");
 		uint32_t PacketLength = 0;
 		uint32_t FakeStartCode = (call->Version << 8) | PES_VERSION_FAKE_START_CODE;
+		int ic = 0;
+		struct iovec iov[4];
 
 		iov[ic++].iov_base = PesHeader;
-		initialHeader = 0;
-		if (initialHeader)
+		st->initialHeader = 0;
+		if (st->initialHeader)
 		{
-			initialHeader = 0;
+			st->initialHeader = 0;
 			iov[ic].iov_base  = call->private_data;
 			iov[ic++].iov_len = call->private_size;
 			PacketLength     += call->private_size;
@@ -230,51 +270,35 @@ static int writeData(WriterAVCallData_t *call)
 
 		iov[0].iov_len = InsertPesHeader(PesHeader, -1, MPEG_VIDEO_PES_START_CODE, VideoPts, FakeStartCode);
 
-		return call->WriteV(call->fd, iov, ic);
+		return call->WriteV(call->context, call->fd, iov, ic);
 	}
 
 	uint32_t PacketLength = 0;
+	int32_t err = 0;
 
-	ic = 0;
-	iov[ic++].iov_base = PesHeader;
+	IOVecReset(&st->Iov);
+	err = IOVecPesStart(&st->Iov, PesHeader);
 
-	if (initialHeader)
+	if (st->initialHeader)
 	{
-		if (CodecData)
-		{
-			free(CodecData);
-			CodecData = NULL;
-		}
-
-		uint8_t  *private_data = call->private_data;
-		uint32_t  private_size = call->private_size;
-
-		PreparCodecData(private_data, private_size, &NalLengthBytes);
+		GetCodecData(st, call->private_data, call->private_size);
 
-		if (CodecData != NULL)
+		if (st->CodecData != NULL)
 		{
-			iov[ic].iov_base  = CodecData;
-			iov[ic++].iov_len = CodecDataLen;
-			PacketLength     += CodecDataLen;
-			initialHeader = 0;
+			err |= IOVecAdd(&st->Iov, st->CodecData, st->CodecDataLen);
+			PacketLength += st->CodecDataLen;
+			st->initialHeader = 0;
 		}
 	}
 
-	if (CodecData != NULL)
+	if (st->CodecData != NULL)
 	{
 		uint32_t pos = 0;
 		do
 		{
-			if (ic >= IOVEC_SIZE)
-			{
-				h264_err(">> Drop data due to ic overflow\n");
-				exit(-1);
-				break;
-			}
-
 			uint32_t pack_len = 0;
 			uint32_t i = 0;
-			for (i = 0; i < NalLengthBytes; i++, pos++)
+			for (i = 0; i < st->NalLengthBytes; i++, pos++)
 			{
 				pack_len <<= 8;
 				pack_len += call->data[pos];
@@ -285,24 +309,29 @@ static int writeData(WriterAVCallData_t *call)
 				pack_len = call->len - pos;
 			}
 
-			iov[ic].iov_base  = Head;
-			iov[ic++].iov_len = sizeof(Head);
+			err |= IOVecAdd(&st->Iov, Head, sizeof(Head));
 			PacketLength += sizeof(Head);
 
-			iov[ic].iov_base  = call->data + pos;
-			iov[ic++].iov_len = pack_len;
-			PacketLength     += pack_len;
+			err |= IOVecAdd(&st->Iov, call->data + pos, pack_len);
+			PacketLength += pack_len;
 
 			pos += pack_len;
 
 		}
-		while ((pos + NalLengthBytes) < call->len);
+		while ((pos + st->NalLengthBytes) < call->len);
+
+		if (err)
+		{
+			h264_err(">> Drop data, no memory for the iovecs\n");
+			return 0;
+		}
 
 		h265_printf(10, "<<<< PacketLength [%d]\n", PacketLength);
-		iov[0].iov_len = InsertPesHeader(PesHeader, -1, MPEG_VIDEO_PES_START_CODE, VideoPts, 0);
+		unsigned int HeaderLength = InsertPesHeader(PesHeader, -1, MPEG_VIDEO_PES_START_CODE, VideoPts, 0);
+		IOVecPesHeaderLen(&st->Iov, HeaderLength);
 
-		len = call->WriteV(call->fd, iov, ic);
-		PacketLength += iov[0].iov_len;
+		len = IOVecWrite(&st->Iov, call->WriteV, call->context, call->fd);
+		PacketLength += HeaderLength;
 		if (PacketLength != len)
 		{
 			h264_err("<<<< not all data have been written [%d/%d]\n", len, PacketLength);
@@ -331,5 +360,7 @@ struct Writer_s WriterVideoH265 =
 {
 	&reset,
 	&writeData,
-	&caps
+	&caps,
+	sizeof(H265State_t),
+	&freeState
 };
@@ -64,21 +64,24 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct LpcmState_s
+{
+	uint8_t i_freq_code;
+	int32_t i_frame_samples;
+	int32_t i_frame_size;
+	int32_t i_buffer_used;
+	int32_t i_frame_num;
+	int32_t i_bitspersample;
+	uint8_t *p_buffer;
+	uint8_t *p_frame_buffer;
+} LpcmState_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static uint8_t PesHeader[PES_MAX_HEADER_SIZE];
-static uint8_t initialHeader = 1;
-
-static uint8_t i_freq_code = 0;
-static int32_t i_frame_samples;
-static int32_t i_frame_size;
-static int32_t i_buffer_used;
-static int32_t i_frame_num;
-static int32_t i_bitspersample;
-static uint8_t *p_buffer = 0;
-static uint8_t *p_frame_buffer = 0;
+
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -102,12 +105,19 @@ static uint8_t *p_frame_buffer = 0;
  * - dynamic range (8 bits) 0x80 == neutral
  */
 
-static int32_t reset()
+static int32_t reset(void *state __attribute__((unused)))
 {
-	initialHeader = 1;
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	LpcmState_t *st = state;
+
+	free(st->p_buffer);
+	free(st->p_frame_buffer);
+}
+
 static int writeData(WriterAVCallData_t *call)
 {
 	lpcm_printf(10, "\n");
@@ -132,7 +142,9 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
+	LpcmState_t *st = call->state;
 	pcmPrivateData_t *pcmPrivateData = (pcmPrivateData_t *)call->private_data;
+	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
 
 	int32_t i_rate     = (int32_t)pcmPrivateData->sample_rate;
 	int32_t i_channels = (int32_t)pcmPrivateData->channels;
@@ -144,23 +156,23 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
-	if (pcmPrivateData->bResampling || NULL == p_buffer)
+	if (pcmPrivateData->bResampling || NULL == st->p_buffer)
 	{
 		lpcm_printf(1, "i_rate: [%d]\n", i_rate);
 		lpcm_printf(1, "i_channels: [%d]\n", i_channels);
 		switch (i_rate)
 		{
 			case 48000:
-				i_freq_code = 0;
+				st->i_freq_code = 0;
 				break;
 			case 96000:
-				i_freq_code = 1;
+				st->i_freq_code = 1;
 				break;
 			case 44100:
-				i_freq_code = 2;
+				st->i_freq_code = 2;
 				break;
 			case 32000:
-				i_freq_code = 3;
+				st->i_freq_code = 3;
 				break;
 			default:
 				lpcm_err("Error DVD LPCM sample_rate not supported [%d]\n", i_rate);
@@ -168,61 +180,61 @@ static int writeData(WriterAVCallData_t *call)
 		}
 
 		/* In DVD LCPM, a frame is always 150 PTS ticks. */
-		i_frame_samples = i_rate * 150 / 90000;
-		i_frame_size = i_frame_samples * i_channels * 2 + LLPCM_VOB_HEADER_LEN;
-		if (NULL != p_buffer)
+		st->i_frame_samples = i_rate * 150 / 90000;
+		st->i_frame_size = st->i_frame_samples * i_channels * 2 + LLPCM_VOB_HEADER_LEN;
+		if (NULL != st->p_buffer)
 		{
-			free(p_buffer);
+			free(st->p_buffer);
 		}
-		p_buffer = malloc(i_frame_samples * i_channels * 16);
+		st->p_buffer = malloc(st->i_frame_samples * i_channels * 16);
 
-		if (NULL != p_frame_buffer)
+		if (NULL != st->p_frame_buffer)
 		{
-			free(p_frame_buffer);
+			free(st->p_frame_buffer);
 		}
-		p_frame_buffer = malloc(i_frame_size);
-		i_buffer_used = 0;
-		i_frame_num = 0;
-		i_bitspersample = 16;
+		st->p_frame_buffer = malloc(st->i_frame_size);
+		st->i_buffer_used = 0;
+		st->i_frame_num = 0;
+		st->i_bitspersample = 16;
 	}
 
-	const int i_num_frames = (i_buffer_used + i_nb_samples) / i_frame_samples;
-	const int i_leftover_samples = (i_buffer_used + i_nb_samples) % i_frame_samples;
-	const int i_start_offset = -i_buffer_used;
+	const int i_num_frames = (st->i_buffer_used + i_nb_samples) / st->i_frame_samples;
+	const int i_leftover_samples = (st->i_buffer_used + i_nb_samples) % st->i_frame_samples;
+	const int i_start_offset = -st->i_buffer_used;
 
 	int32_t i_bytes_consumed = 0;
 	int32_t i = 0;
 	for (i = 0; i < i_num_frames; ++i)
 	{
-		uint8_t *frame = (uint8_t *)p_frame_buffer;
+		uint8_t *frame = (uint8_t *)st->p_frame_buffer;
 		frame[0] = 1;  /* one frame in packet */
 		frame[1] = 0;
 		frame[2] = 0;  /* no first access unit */
-		frame[3] = (i_frame_num + i) & 0x1f;  /* no emphasis, no mute */
-		frame[4] = (i_freq_code << 4) | (i_channels - 1);
+		frame[3] = (st->i_frame_num + i) & 0x1f;  /* no emphasis, no mute */
+		frame[4] = (st->i_freq_code << 4) | (i_channels - 1);
 		frame[5] = 0x80;  /* neutral dynamic range */
 
-		const int i_consume_samples = i_frame_samples - i_buffer_used;
-		const int i_kept_bytes = i_buffer_used * i_channels * 2;
+		const int i_consume_samples = st->i_frame_samples - st->i_buffer_used;
+		const int i_kept_bytes = st->i_buffer_used * i_channels * 2;
 		const int i_consume_bytes = i_consume_samples * i_channels * 2;
 
 #ifdef WORDS_BIGENDIAN
-		memcpy(frame + 6, p_buffer, i_kept_bytes);
+		memcpy(frame + 6, st->p_buffer, i_kept_bytes);
 		memcpy(frame + 6 + i_kept_bytes, call->data + i_bytes_consumed, i_consume_bytes);
 #else
-		swab(p_buffer, frame + 6, i_kept_bytes);
+		swab(st->p_buffer, frame + 6, i_kept_bytes);
 		swab(call->data + i_bytes_consumed, frame + 6 + i_kept_bytes, i_consume_bytes);
 #endif
 
-		i_frame_num++;
-		i_buffer_used = 0;
+		st->i_frame_num++;
+		st->i_buffer_used = 0;
 		i_bytes_consumed += i_consume_bytes;
 
 		/* We need to find i_length by means of next_pts due to possible roundoff errors. */
-		uint64_t this_pts = call->Pts + (i * i_frame_samples + i_start_offset) * 90000 / i_rate;
+		uint64_t this_pts = call->Pts + (i * st->i_frame_samples + i_start_offset) * 90000 / i_rate;
 
 		uint32_t pes_header_size = 0;
-		pes_header_size = InsertPesHeader(PesHeader, i_frame_size + 1, MPEG_AUDIO_PES_START_CODE, this_pts, 0);
+		pes_header_size = InsertPesHeader(PesHeader, st->i_frame_size + 1, MPEG_AUDIO_PES_START_CODE, this_pts, 0);
 
 		PesHeader[pes_header_size] = 0xa0;
 		pes_header_size += 1;
@@ -231,12 +243,12 @@ static int writeData(WriterAVCallData_t *call)
 		iov[0].iov_base = PesHeader;
 		iov[0].iov_len  = pes_header_size;
 		iov[1].iov_base = frame;
-		iov[1].iov_len  = i_frame_size;
-		i_ret_size += call->WriteV(call->fd, iov, 2);
+		iov[1].iov_len  = st->i_frame_size;
+		i_ret_size += call->WriteV(call->context, call->fd, iov, 2);
 	}
 
-	memcpy(p_buffer, call->data + i_bytes_consumed, i_leftover_samples * i_channels * 2);
-	i_buffer_used = i_leftover_samples;
+	memcpy(st->p_buffer, call->data + i_bytes_consumed, i_leftover_samples * i_channels * 2);
+	st->i_buffer_used = i_leftover_samples;
 
 	return i_ret_size;
 }
@@ -259,5 +271,7 @@ struct Writer_s WriterAudioLPCM =
 {
 	&reset,
 	&writeData, /* writeDataLPCM */
-	&caps_lpcm
+	&caps_lpcm,
+	sizeof(LpcmState_t),
+	&freeState
 };
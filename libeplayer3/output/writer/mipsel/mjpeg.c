@@ -61,8 +61,6 @@
 /* Variables                     */
 /* ***************************** */
 
-static bool must_send_header = false;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -71,9 +69,8 @@ static bool must_send_header = false;
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state __attribute__((unused)))
 {
-	must_send_header = false;
 	return 0;
 }
 
@@ -85,7 +82,7 @@ static int writeDataSimple(WriterAVCallData_t *call)
 	iov[0].iov_len  = InsertPesHeader(PesHeader, call->len, MPEG_VIDEO_PES_START_CODE, call->Pts, 0);
 	iov[1].iov_base = call->data;
 	iov[1].iov_len  = call->len;
-	return call->WriteV(call->fd, iov, 2);;
+	return call->WriteV(call->context, call->fd, iov, 2);;
 }
 
 static int writeDataBCMV(WriterAVCallData_t *call)
@@ -110,10 +107,10 @@ static int writeDataBCMV(WriterAVCallData_t *call)
 	UpdatePesHeaderPayloadSize(PesHeader, payload_len);
 	// pes header
 
-	if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->fd, PesHeader, pes_header_len))
+	if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, PesHeader, pes_header_len))
 		return -1;
 
-	if (bytes != WriteExt(call->WriteV, call->fd, call->data, bytes))
+	if (bytes != WriteExt(call->WriteV, call->context, call->fd, call->data, bytes))
 		return -1;
 
 	offs += bytes;
@@ -133,9 +130,9 @@ static int writeDataBCMV(WriterAVCallData_t *call)
 		PesHeader[8] = 0x00;
 		pes_header_len = 9;
 		UpdatePesHeaderPayloadSize(PesHeader, wr + 3);
-		if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->fd, PesHeader, pes_header_len))
+		if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, PesHeader, pes_header_len))
 			return -1;
-		if (wr != WriteExt(call->WriteV, call->fd, call->data + offs, wr))
+		if (wr != WriteExt(call->WriteV, call->context, call->fd, call->data + offs, wr))
 			return -1;
 		bytes += wr;
 		offs += wr;
@@ -57,14 +57,18 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct Mpeg2State_s
+{
+	bool must_send_header;
+	uint8_t *private_data;
+	uint32_t private_size;
+} Mpeg2State_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static bool must_send_header = true;
-static uint8_t *private_data = NULL;
-static uint32_t private_size = 0;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -73,15 +77,20 @@ static uint32_t private_size = 0;
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state)
 {
-	must_send_header = true;
+	((Mpeg2State_t *)state)->must_send_header = true;
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	free(((Mpeg2State_t *)state)->private_data);
+}
+
 static int writeData(WriterAVCallData_t *call)
 {
-	static uint8_t PesHeader[PES_MAX_HEADER_SIZE];
+	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
 
 	mpeg2_printf(10, "\n");
 
@@ -105,10 +114,11 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
+	Mpeg2State_t *st = call->state;
 	uint8_t *data = call->data;
 	uint32_t data_len = call->len;
 
-	if (!private_data && !call->private_data && data_len > 3 && !memcmp(data, "\x00\x00\x01\xb3", 4))
+	if (!st->private_data && !call->private_data && data_len > 3 && !memcmp(data, "\x00\x00\x01\xb3", 4))
 	{
 		bool ok = true;
 		uint32_t pos = 4;
@@ -194,27 +204,27 @@ static int writeData(WriterAVCallData_t *call)
 					break;
 			}
 
-			free(private_data);
-			private_data = malloc(sheader_data_len);
-			if (private_data)
+			free(st->private_data);
+			st->private_data = malloc(sheader_data_len);
+			if (st->private_data)
 			{
-				private_size = sheader_data_len;
-				memcpy(private_data, data + pos - sheader_data_len, sheader_data_len);
+				st->private_size = sheader_data_len;
+				memcpy(st->private_data, data + pos - sheader_data_len, sheader_data_len);
 			}
-			must_send_header = false;
+			st->must_send_header = false;
 			break;
 		}
 	}
-	else if ((private_data || call->private_data) && must_send_header)
+	else if ((st->private_data || call->private_data) && st->must_send_header)
 	{
 		uint8_t *codec_data = NULL;
 		uint32_t codec_data_size = 0;
 		int pos = 0;
 
-		if (private_data)
+		if (st->private_data)
 		{
-			codec_data = private_data;
-			codec_data_size = private_size;
+			codec_data = st->private_data;
+			codec_data_size = st->private_size;
 		}
 		else
 		{
@@ -243,8 +253,8 @@ static int writeData(WriterAVCallData_t *call)
 			iov[3].iov_base = data + pos;
 			iov[3].iov_len = data_len - pos;
 
-			must_send_header = false;
-			return call->WriteV(call->fd, iov, 4);
+			st->must_send_header = false;
+			return call->WriteV(call->context, call->fd, iov, 4);
 		}
 	}
 
@@ -259,10 +269,10 @@ static int writeData(WriterAVCallData_t *call)
 	PesHeader[6] = 0x81;
 
 	UpdatePesHeaderPayloadSize(PesHeader, data_len + iov[0].iov_len - 6);
-	if (iov[0].iov_len != (unsigned)WriteExt(call->WriteV, call->fd, iov[0].iov_base, iov[0].iov_len))
+	if (iov[0].iov_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, iov[0].iov_base, iov[0].iov_len))
 		return -1;
 
-	if (iov[1].iov_len != (unsigned)WriteExt(call->WriteV, call->fd, iov[1].iov_base, iov[1].iov_len))
+	if (iov[1].iov_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, iov[1].iov_base, iov[1].iov_len))
 		return -1;
 	return 1;
 }
@@ -284,7 +294,9 @@ struct Writer_s WriterVideoMPEG2 =
 {
 	&reset,
 	&writeData,
-	&caps
+	&caps,
+	sizeof(Mpeg2State_t),
+	&freeState
 };
 
 static WriterCaps_t mpg1_caps =
@@ -301,5 +313,7 @@ struct Writer_s WriterVideoMPEG1 =
 {
 	&reset,
 	&writeData,
-	&mpg1_caps
+	&mpg1_caps,
+	sizeof(Mpeg2State_t),
+	&freeState
 };
@@ -57,12 +57,16 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct Mpeg4State_s
+{
+	int initialHeader;
+} Mpeg4State_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static int initialHeader = 1;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -71,9 +75,9 @@ static int initialHeader = 1;
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state)
 {
-	initialHeader = 1;
+	((Mpeg4State_t *)state)->initialHeader = 1;
 	return 0;
 }
 
@@ -103,8 +107,9 @@ static int writeData(WriterAVCallData_t *call)
 
 	mpeg4_printf(10, "VideoPts %lld\n", call->Pts);
 
+	Mpeg4State_t *st = call->state;
 	unsigned int PacketLength = call->len;
-	if (initialHeader && call->private_size && call->private_data != NULL)
+	if (st->initialHeader && call->private_size && call->private_data != NULL)
 	{
 		PacketLength += call->private_size;
 	}
@@ -114,16 +119,16 @@ static int writeData(WriterAVCallData_t *call)
 	iov[ic].iov_base = PesHeader;
 	iov[ic++].iov_len = InsertPesHeader(PesHeader, PacketLength, MPEG_VIDEO_PES_START_CODE, call->Pts, 0);
 
-	if (initialHeader && call->private_size && call->private_data != NULL)
+	if (st->initialHeader && call->private_size && call->private_data != NULL)
 	{
-		initialHeader = 0;
+		st->initialHeader = 0;
 		iov[ic].iov_base = call->private_data;
 		iov[ic++].iov_len = call->private_size;
 	}
 	iov[ic].iov_base = call->data;
 	iov[ic++].iov_len = call->len;
 
-	int len = call->WriteV(call->fd, iov, ic);
+	int len = call->WriteV(call->context, call->fd, iov, ic);
 
 	mpeg4_printf(10, "xvid_Write < len=%d\n", len);
 
@@ -148,7 +153,8 @@ struct Writer_s WriterVideoMPEG4 =
 {
 	&reset,
 	&writeData,
-	&mpeg4p2_caps
+	&mpeg4p2_caps,
+	sizeof(Mpeg4State_t)
 };
 
 static WriterCaps_t caps_h263 =
@@ -165,5 +171,6 @@ struct Writer_s WriterVideoH263 =
 {
 	&reset,
 	&writeData,
-	&caps_h263
+	&caps_h263,
+	sizeof(Mpeg4State_t)
 };
@@ -60,18 +60,21 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct PcmState_s
+{
+	uint8_t codec_data[18];
+	uint64_t fixed_buffertimestamp;
+	uint64_t fixed_bufferduration;
+	uint32_t fixed_buffersize;
+	uint8_t *fixed_buffer;
+	uint32_t fixed_bufferfilled;
+} PcmState_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static uint8_t initialHeader = 1;
-static uint8_t codec_data[18];
-static uint64_t fixed_buffertimestamp;
-static uint64_t fixed_bufferduration;
-static uint32_t fixed_buffersize;
-static uint8_t *fixed_buffer;
-static uint32_t fixed_bufferfilled;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -80,12 +83,16 @@ static uint32_t fixed_bufferfilled;
 /* MISC Functions                */
 /* ***************************** */
 
-static int32_t reset()
+static int32_t reset(void *state __attribute__((unused)))
 {
-	initialHeader = 1;
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	free(((PcmState_t *)state)->fixed_buffer);
+}
+
 static int writeData(WriterAVCallData_t *call)
 {
 	pcm_printf(10, "\n");
@@ -110,12 +117,13 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
-	static uint8_t  PesHeader[PES_MAX_HEADER_SIZE + 22];
+	PcmState_t *st = call->state;
+	uint8_t  PesHeader[PES_MAX_HEADER_SIZE + 22];
 	pcmPrivateData_t *pcmPrivateData = (pcmPrivateData_t *)call->private_data;
 	uint8_t *buffer = call->data;
 	uint32_t   size = call->len;
 
-	if (pcmPrivateData->bResampling || NULL == fixed_buffer)
+	if (pcmPrivateData->bResampling || NULL == st->fixed_buffer)
 	{
 		int32_t width = 0;
 		int32_t depth = 0;
@@ -162,12 +170,12 @@ static int writeData(WriterAVCallData_t *call)
 				break;
 		}
 
-		uint8_t *data = codec_data;
+		uint8_t *data = st->codec_data;
 		uint16_t format = LE ? 0x0001 : 0x0100;
 
 		byterate = channels * rate * width / 8;
 		block_align = channels * width / 8;
-		memset(data, 0, sizeof(codec_data));
+		memset(data, 0, sizeof(st->codec_data));
 		/* format tag */
 		*(data++) = format & 0xff;
 		*(data++) = (format >> 8) & 0xff;
@@ -193,36 +201,36 @@ static int writeData(WriterAVCallData_t *call)
 
 		uint32_t nfixed_buffersize = rate * 30 / 1000;
 		nfixed_buffersize *= channels * depth / 8;
-		fixed_buffertimestamp = call->Pts;
-		fixed_bufferduration = 90000 * nfixed_buffersize /  byterate;
+		st->fixed_buffertimestamp = call->Pts;
+		st->fixed_bufferduration = 90000 * nfixed_buffersize /  byterate;
 
-		if (fixed_buffersize != nfixed_buffersize || NULL == fixed_buffer)
+		if (st->fixed_buffersize != nfixed_buffersize || NULL == st->fixed_buffer)
 		{
-			fixed_buffersize = nfixed_buffersize;
-			if (NULL != fixed_buffer)
+			st->fixed_buffersize = nfixed_buffersize;
+			if (NULL != st->fixed_buffer)
 			{
-				free(fixed_buffer);
+				free(st->fixed_buffer);
 			}
-			fixed_buffer = malloc(fixed_buffersize);
+			st->fixed_buffer = malloc(st->fixed_buffersize);
 		}
-		fixed_bufferfilled = 0;
+		st->fixed_bufferfilled = 0;
 		/* avoid compiler warning */
 		if (LE) {}
-		pcm_printf(40, "PCM fixed_buffersize [%u] [%s]\n", fixed_buffersize, LE ? "LE" : "BE");
+		pcm_printf(40, "PCM fixed_buffersize [%u] [%s]\n", st->fixed_buffersize, LE ? "LE" : "BE");
 	}
 
 	while (size > 0)
 	{
-		uint32_t cpSize = (fixed_buffersize - fixed_bufferfilled);
+		uint32_t cpSize = (st->fixed_buffersize - st->fixed_bufferfilled);
 		if (cpSize > size)
 		{
-			memcpy(fixed_buffer + fixed_bufferfilled, buffer, size);
-			fixed_bufferfilled += size;
+			memcpy(st->fixed_buffer + st->fixed_bufferfilled, buffer, size);
+			st->fixed_bufferfilled += size;
 			return size;
 		}
 
-		memcpy(fixed_buffer + fixed_bufferfilled, buffer, cpSize);
-		fixed_bufferfilled = 0;
+		memcpy(st->fixed_buffer + st->fixed_bufferfilled, buffer, cpSize);
+		st->fixed_bufferfilled = 0;
 		buffer += cpSize;
 		size -= cpSize;
 
@@ -231,7 +239,7 @@ static int writeData(WriterAVCallData_t *call)
 		{
 			addHeaderSize = 4;
 		}
-		uint32_t headerSize = InsertPesHeader(PesHeader, fixed_buffersize + 4 + addHeaderSize + sizeof(codec_data), MPEG_AUDIO_PES_START_CODE, fixed_buffertimestamp, 0);
+		uint32_t headerSize = InsertPesHeader(PesHeader, st->fixed_buffersize + 4 + addHeaderSize + sizeof(st->codec_data), MPEG_AUDIO_PES_START_CODE, st->fixed_buffertimestamp, 0);
 		if (STB_DREAMBOX == GetSTBType())
 		{
 			PesHeader[headerSize++] = 0x42; // B
@@ -240,23 +248,23 @@ static int writeData(WriterAVCallData_t *call)
 			PesHeader[headerSize++] = 0x41; // A
 		}
 
-		PesHeader[headerSize++] = (fixed_buffersize >> 24) & 0xff;
-		PesHeader[headerSize++] = (fixed_buffersize >> 16) & 0xff;
-		PesHeader[headerSize++] = (fixed_buffersize >> 8)  & 0xff;
-		PesHeader[headerSize++] = fixed_buffersize & 0xff;
+		PesHeader[headerSize++] = (st->fixed_buffersize >> 24) & 0xff;
+		PesHeader[headerSize++] = (st->fixed_buffersize >> 16) & 0xff;
+		PesHeader[headerSize++] = (st->fixed_buffersize >> 8)  & 0xff;
+		PesHeader[headerSize++] = st->fixed_buffersize & 0xff;
 
-		memcpy(PesHeader + headerSize, codec_data, sizeof(codec_data));
-		headerSize += sizeof(codec_data);
+		memcpy(PesHeader + headerSize, st->codec_data, sizeof(st->codec_data));
+		headerSize += sizeof(st->codec_data);
 
 		PesHeader[6] |= 1;
 
 		struct iovec iov[2];
 		iov[0].iov_base = PesHeader;
 		iov[0].iov_len  = headerSize;
-		iov[1].iov_base = fixed_buffer;
-		iov[1].iov_len  = fixed_buffersize;
-		call->WriteV(call->fd, iov, 2);
-		fixed_buffertimestamp += fixed_bufferduration;
+		iov[1].iov_base = st->fixed_buffer;
+		iov[1].iov_len  = st->fixed_buffersize;
+		call->WriteV(call->context, call->fd, iov, 2);
+		st->fixed_buffertimestamp += st->fixed_bufferduration;
 	}
 
 	return size;
@@ -280,7 +288,9 @@ struct Writer_s WriterAudioPCM =
 {
 	&reset,
 	&writeData,
-	&caps_pcm
+	&caps_pcm,
+	sizeof(PcmState_t),
+	&freeState
 };
 
 static WriterCaps_t caps_ipcm =
@@ -297,5 +307,7 @@ struct Writer_s WriterAudioIPCM =
 {
 	&reset,
 	&writeData, /* writeDataIPCM */
-	&caps_ipcm
+	&caps_ipcm,
+	sizeof(PcmState_t),
+	&freeState
 };
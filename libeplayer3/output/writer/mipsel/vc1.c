@@ -60,6 +60,12 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct Vc1State_s
+{
+	int initialHeader;
+} Vc1State_t;
+
 //static const unsigned char SequenceLayerStartCode[] = {0x00, 0x00, 0x01, VC1_SEQUENCE_LAYER_METADATA_START_CODE};
 static const uint8_t Vc1FrameStartCode[] = {0, 0, 1, VC1_FRAME_START_CODE};
 
@@ -67,9 +73,6 @@ static const uint8_t Vc1FrameStartCode[] = {0, 0, 1, VC1_FRAME_START_CODE};
 /* Variables                     */
 /* ***************************** */
 
-static int initialHeader = 1;
-static video_codec_data_t videocodecdata = {0, 0};
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -78,9 +81,9 @@ static video_codec_data_t videocodecdata = {0, 0};
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state)
 {
-	initialHeader = 1;
+	((Vc1State_t *)state)->initialHeader = 1;
 	return 0;
 }
 
@@ -117,14 +120,11 @@ static int writeData(WriterAVCallData_t *call)
 	unsigned int PacketLength = 0;
 
 	iov[ic++].iov_base = PesHeader;
-	if (initialHeader)
+	Vc1State_t *st = call->state;
+	video_codec_data_t videocodecdata = {0, 0};
+	if (st->initialHeader)
 	{
-		initialHeader = 0;
-		if (videocodecdata.data)
-		{
-			free(videocodecdata.data);
-			videocodecdata.data = NULL;
-		}
+		st->initialHeader = 0;
 		videocodecdata.length = call->private_size + 8;
 		videocodecdata.data  = malloc(videocodecdata.length);
 		memset(videocodecdata.data, 0, videocodecdata.length);
@@ -160,13 +160,12 @@ static int writeData(WriterAVCallData_t *call)
 		iov[0].iov_len += sizeof(Vc1FrameStartCode);
 	}
 
-	if (videocodecdata.data)
-	{
-		free(videocodecdata.data);
-		videocodecdata.data = NULL;
-	}
+	int len = call->WriteV(call->context, call->fd, iov, ic);
+
+	/* written, or passed by VIDEO_SET_CODEC_DATA, by now */
+	free(videocodecdata.data);
 
-	return call->WriteV(call->fd, iov, ic);
+	return len;
 }
 
 /* ***************************** */
@@ -187,5 +186,6 @@ struct Writer_s WriterVideoVC1 =
 {
 	&reset,
 	&writeData,
-	&caps
+	&caps,
+	sizeof(Vc1State_t)
 };
@@ -69,12 +69,11 @@
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state __attribute__((unused)))
 {
 	return 0;
 }
 
-static uint8_t PesHeader[256];
 static int writeData(WriterAVCallData_t *call, bool is_vp6, bool is_vp9)
 {
 	vp_printf(10, "\n");
@@ -100,6 +99,7 @@ static int writeData(WriterAVCallData_t *call, bool is_vp6, bool is_vp9)
 	vp_printf(10, "VideoPts %lld\n", call->Pts);
 	vp_printf(10, "Got Private Size %d\n", call->private_size);
 
+	uint8_t PesHeader[256];
 	struct iovec iov[2];
 	uint64_t pts = is_vp9 && STB_VUPLUS == GetSTBType() ? 0 : call->Pts;
 
@@ -135,10 +135,10 @@ static int writeData(WriterAVCallData_t *call, bool is_vp6, bool is_vp9)
 	{
 		UpdatePesHeaderPayloadSize(PesHeader, payload_len);
 		// it looks like for VUPLUS drivers PES header must be written separately
-		int ret = call->WriteV(call->fd, iov, 1);
+		int ret = call->WriteV(call->context, call->fd, iov, 1);
 		if (iov[0].iov_len != (unsigned)ret)
 			return ret;
-		ret = call->WriteV(call->fd, iov + 1, 1);
+		ret = call->WriteV(call->context, call->fd, iov + 1, 1);
 		return iov[0].iov_len + ret;
 	}
 	else
@@ -150,10 +150,10 @@ static int writeData(WriterAVCallData_t *call, bool is_vp6, bool is_vp9)
 		int bytes = payload_len - 10 - 8;
 		UpdatePesHeaderPayloadSize(PesHeader, payload_len);
 		// pes header
-		if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->fd, PesHeader, pes_header_len))
+		if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, PesHeader, pes_header_len))
 			return -1;
 
-		if (bytes != WriteExt(call->WriteV, call->fd, call->data, bytes))
+		if (bytes != WriteExt(call->WriteV, call->context, call->fd, call->data, bytes))
 			return -1;
 
 		offs += bytes;
@@ -175,10 +175,10 @@ static int writeData(WriterAVCallData_t *call, bool is_vp6, bool is_vp9)
 
 			UpdatePesHeaderPayloadSize(PesHeader, wr + 3);
 
-			if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->fd, PesHeader, pes_header_len))
+			if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, PesHeader, pes_header_len))
 				return -1;
 
-			if (wr != WriteExt(call->WriteV, call->fd, call->data + offs, wr))
+			if (wr != WriteExt(call->WriteV, call->context, call->fd, call->data + offs, wr))
 				return -1;
 
 			bytes += wr;
@@ -205,12 +205,12 @@ static int writeData(WriterAVCallData_t *call, bool is_vp6, bool is_vp9)
 		PesHeader[29] = 0xFF;
 		PesHeader[33] = 0x85;
 
-		if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->fd, PesHeader, 184))
+		if (pes_header_len != (unsigned)WriteExt(call->WriteV, call->context, call->fd, PesHeader, 184))
 			return -1;
 
 		return 1;
 	}
-	//return call->WriteV(call->fd, iov, 2);
+	//return call->WriteV(call->context, call->fd, iov, 2);
 }
 
 static int writeDataVP6(WriterAVCallData_t *call)
@@ -57,14 +57,17 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct WmaState_s
+{
+	uint8_t *PesHeader;
+	uint32_t MaxPesHeader;
+} WmaState_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static int initialHeader = 1;
-static uint8_t *PesHeader = NULL;
-static uint32_t MaxPesHeader = 0;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -73,12 +76,16 @@ static uint32_t MaxPesHeader = 0;
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state __attribute__((unused)))
 {
-	initialHeader = 1;
 	return 0;
 }
 
+static void freeState(void *state)
+{
+	free(((WmaState_t *)state)->PesHeader);
+}
+
 static int writeData(WriterAVCallData_t *call)
 {
 	//int len = 0;
@@ -105,6 +112,7 @@ static int writeData(WriterAVCallData_t *call)
 		return 0;
 	}
 
+	WmaState_t *st = call->state;
 	uint32_t packetLength = 4 + call->private_size + call->len;
 
 	if (STB_DREAMBOX == GetSTBType())
@@ -112,43 +120,43 @@ static int writeData(WriterAVCallData_t *call)
 		packetLength += 4;
 	}
 
-	if ((packetLength + PES_MAX_HEADER_SIZE)  > MaxPesHeader)
+	if ((packetLength + PES_MAX_HEADER_SIZE)  > st->MaxPesHeader)
 	{
-		if (PesHeader)
+		if (st->PesHeader)
 		{
-			free(PesHeader);
+			free(st->PesHeader);
 		}
-		MaxPesHeader = packetLength + PES_MAX_HEADER_SIZE;
-		PesHeader = malloc(MaxPesHeader);
+		st->MaxPesHeader = packetLength + PES_MAX_HEADER_SIZE;
+		st->PesHeader = malloc(st->MaxPesHeader);
 	}
 
-	uint32_t headerSize = InsertPesHeader(PesHeader, packetLength, MPEG_AUDIO_PES_START_CODE, call->Pts, 0);
+	uint32_t headerSize = InsertPesHeader(st->PesHeader, packetLength, MPEG_AUDIO_PES_START_CODE, call->Pts, 0);
 	if (STB_DREAMBOX == GetSTBType())
 	{
-		PesHeader[headerSize++] = 0x42; // B
-		PesHeader[headerSize++] = 0x43; // C
-		PesHeader[headerSize++] = 0x4D; // M
-		PesHeader[headerSize++] = 0x41; // A
+		st->PesHeader[headerSize++] = 0x42; // B
+		st->PesHeader[headerSize++] = 0x43; // C
+		st->PesHeader[headerSize++] = 0x4D; // M
+		st->PesHeader[headerSize++] = 0x41; // A
 	}
 
 	size_t payload_len = call->len;
-	PesHeader[headerSize++] = (payload_len >> 24) & 0xff;
-	PesHeader[headerSize++] = (payload_len >> 16) & 0xff;
-	PesHeader[headerSize++] = (payload_len >> 8)  & 0xff;
-	PesHeader[headerSize++] = payload_len & 0xff;
+	st->PesHeader[headerSize++] = (payload_len >> 24) & 0xff;
+	st->PesHeader[headerSize++] = (payload_len >> 16) & 0xff;
+	st->PesHeader[headerSize++] = (payload_len >> 8)  & 0xff;
+	st->PesHeader[headerSize++] = payload_len & 0xff;
 
-	memcpy(PesHeader + headerSize, call->private_data, call->private_size);
+	memcpy(st->PesHeader + headerSize, call->private_data, call->private_size);
 	headerSize += call->private_size;
 
-	PesHeader[6] |= 1;
+	st->PesHeader[6] |= 1;
 
 	struct iovec iov[2];
-	iov[0].iov_base = PesHeader;
+	iov[0].iov_base = st->PesHeader;
 	iov[0].iov_len  = headerSize;
 	iov[1].iov_base = call->data;
 	iov[1].iov_len  = call->len;
 
-	return call->WriteV(call->fd, iov, 2);
+	return call->WriteV(call->context, call->fd, iov, 2);
 }
 
 /* ***************************** */
@@ -169,7 +177,9 @@ struct Writer_s WriterAudioWMAPRO =
 {
 	&reset,
 	&writeData,
-	&capsWMAPRO
+	&capsWMAPRO,
+	sizeof(WmaState_t),
+	&freeState
 };
 
 static WriterCaps_t capsWMA =
@@ -186,5 +196,7 @@ struct Writer_s WriterAudioWMA =
 {
 	&reset,
 	&writeData,
-	&capsWMA
+	&capsWMA,
+	sizeof(WmaState_t),
+	&freeState
 };
@@ -59,15 +59,18 @@
 /* Types                         */
 /* ***************************** */
 
+/* per decoder, see Writer_t */
+typedef struct WmvState_s
+{
+	int initialHeader;
+} WmvState_t;
+
 static const  uint8_t Vc1FrameStartCode[]     = {0, 0, 1, WMV_FRAME_START_CODE};
 
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
 
-static int initialHeader = 1;
-static video_codec_data_t videocodecdata = {0, 0};
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -76,9 +79,9 @@ static video_codec_data_t videocodecdata = {0, 0};
 /* MISC Functions                */
 /* ***************************** */
 
-static int reset()
+static int reset(void *state)
 {
-	initialHeader = 1;
+	((WmvState_t *)state)->initialHeader = 1;
 	return 0;
 }
 
@@ -113,14 +116,11 @@ static int writeData(WriterAVCallData_t *call)
 	unsigned int PacketLength = 0;
 
 	iov[ic++].iov_base = PesHeader;
-	if (initialHeader)
+	WmvState_t *st = call->state;
+	video_codec_data_t videocodecdata = {0, 0};
+	if (st->initialHeader)
 	{
-		initialHeader = 0;
-		if (videocodecdata.data)
-		{
-			free(videocodecdata.data);
-			videocodecdata.data = NULL;
-		}
+		st->initialHeader = 0;
 
 		unsigned int codec_size = call->private_size;
 
@@ -172,13 +172,12 @@ static int writeData(WriterAVCallData_t *call)
 		iov[0].iov_len += sizeof(Vc1FrameStartCode);
 	}
 
-	if (videocodecdata.data)
-	{
-		free(videocodecdata.data);
-		videocodecdata.data = NULL;
-	}
+	int len = call->WriteV(call->context, call->fd, iov, ic);
+
+	/* written, or passed by VIDEO_SET_CODEC_DATA, by now */
+	free(videocodecdata.data);
 
-	return call->WriteV(call->fd, iov, ic);
+	return len;
 }
 
 /* ***************************** */
@@ -199,5 +198,6 @@ struct Writer_s WriterVideoWMV =
 {
 	&reset,
 	&writeData,
-	&caps
+	&caps,
+	sizeof(WmvState_t)
 };
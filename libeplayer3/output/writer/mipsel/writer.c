@@ -111,7 +111,7 @@ ssize_t WriteWithRetry(Context_t *context, int pipefd, int fd, void *pDVBMtx __a
 	int retval = -1;
 	int maxFd = pipefd > fd ? pipefd : fd;
 	struct timeval tv;
-	while (size > 0 && PlaybackDieNow(0) == 0 && !context->playback->isSeeking)
+	while (size > 0 && PlaybackDieNow(context, 0) == 0 && !context->playback->isSeeking)
 	{
 		FD_ZERO(&rfds);
 		FD_ZERO(&wfds);
@@ -190,11 +190,11 @@ ssize_t WriteWithRetry(Context_t *context, int pipefd, int fd, void *pDVBMtx __a
 	return 0;
 }
 
-ssize_t write_with_retry(int fd, const void *buf, int size)
+ssize_t write_with_retry(Context_t *context, int fd, const void *buf, int size)
 {
 	ssize_t ret;
 	int retval = 0;
-	while (size > 0 && PlaybackDieNow(0) == 0)
+	while (size > 0 && PlaybackDieNow(context, 0) == 0)
 	{
 		ret = write(fd, buf, size);
 		if (ret < 0)
@@ -234,15 +234,15 @@ ssize_t write_with_retry(int fd, const void *buf, int size)
 	return 0;
 }
 
-ssize_t writev_with_retry(int fd, const struct iovec *iov, int ic)
+ssize_t writev_with_retry(Context_t *context, int fd, const struct iovec *iov, int ic)
 {
 	ssize_t len = 0;
 	int i = 0;
 	for (i = 0; i < ic; ++i)
 	{
-		write_with_retry(fd, iov[i].iov_base, iov[i].iov_len);
+		write_with_retry(context, fd, iov[i].iov_base, iov[i].iov_len);
 		len += iov[i].iov_len;
-		if (PlaybackDieNow(0))
+		if (PlaybackDieNow(context, 0))
 		{
 			return -1;
 		}
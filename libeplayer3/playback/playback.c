@@ -36,68 +36,63 @@
 #define cMaxSpeed_ff    128 /* fixme: revise */
 #define cMaxSpeed_fr   -320 /* fixme: revise */
 
-#define MAX_PLAYBACK_DIE_NOW_CALLBACKS 10
-
 /* ***************************** */
 /* Varaibles                     */
 /* ***************************** */
 
-static pthread_t supervisorThread;
-static int hasThreadStarted = 0;
-
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
 
 static int32_t PlaybackTerminate(Context_t *context);
 
-static int8_t dieNow = 0;
-static PlaybackDieNowCallback playbackDieNowCallbacks[MAX_PLAYBACK_DIE_NOW_CALLBACKS] = {NULL};
-
 /* ***************************** */
 /* MISC Functions                */
 /* ***************************** */
 
-int8_t PlaybackDieNow(int8_t val)
+int8_t PlaybackDieNow(Context_t *context, int8_t val)
 {
-	if (val == 1 && dieNow == 0)
+	PlaybackHandler_t *playback = context->playback;
+
+	if (val == 1 && playback->dieNow == 0)
 	{
 		uint32_t i = 0;
-		dieNow = 1;
+		playback->dieNow = 1;
 		while (i < MAX_PLAYBACK_DIE_NOW_CALLBACKS)
 		{
-			if (playbackDieNowCallbacks[i] == NULL)
+			if (playback->dieNowCallbacks[i] == NULL)
 			{
 				break;
 			}
-			playbackDieNowCallbacks[i]();
+			playback->dieNowCallbacks[i](context);
 			i += 1;
 		}
 	}
 	else if (val == 2)
 	{
-		dieNow = 0;
+		playback->dieNow = 0;
 	}
-	return dieNow;
+	return playback->dieNow;
 }
 
-bool PlaybackDieNowRegisterCallback(PlaybackDieNowCallback callback)
+bool PlaybackDieNowRegisterCallback(Context_t *context, PlaybackDieNowCallback callback)
 {
+	PlaybackHandler_t *playback = context->playback;
 	bool ret = false;
 	if (callback)
 	{
 		uint32_t i = 0;
 		while (i < MAX_PLAYBACK_DIE_NOW_CALLBACKS)
 		{
-			if (playbackDieNowCallbacks[i] == callback)
+			if (playback->dieNowCallbacks[i] == callback)
 			{
 				ret = true;
 				break;
 			}
 
-			if (playbackDieNowCallbacks[i] == NULL)
+			if (playback->dieNowCallbacks[i] == NULL)
 			{
-				playbackDieNowCallbacks[i] = callback;
+				playback->dieNowCallbacks[i] = callback;
 				ret = true;
 				break;
 			}
@@ -113,7 +108,7 @@ bool PlaybackDieNowRegisterCallback(PlaybackDieNowCallback callback)
 
 static void SupervisorThread(Context_t *context)
 {
-	hasThreadStarted = 1;
+	context->playback->hasThreadStarted = 1;
 	playback_printf(10, ">\n");
 
 	while (context && context->playback && context->playback->isPlaying && !context->playback->abortRequested)
@@ -122,10 +117,10 @@ static void SupervisorThread(Context_t *context)
 	}
 
 	playback_printf(10, "<\n");
-	hasThreadStarted = 2;
+	context->playback->hasThreadStarted = 2;
 	PlaybackTerminate(context);
 	playback_printf(0, "terminating\n");
-	hasThreadStarted = 0;
+	context->playback->hasThreadStarted = 0;
 }
 
 /* ***************************** */
@@ -263,7 +258,7 @@ static int PlaybackClose(Context_t *context)
 		context->playback->uri = NULL;
 	}
 
-	PlaybackDieNow(2);
+	PlaybackDieNow(context, 2);
 	playback_printf(10, "exiting with value %d\n", ret);
 
 	return ret;
@@ -309,13 +304,13 @@ static int PlaybackPlay(Context_t *context)
 			context->playback->SlowMotion   = 0;
 			context->playback->Speed        = 1;
 
-			if (hasThreadStarted == 0)
+			if (context->playback->hasThreadStarted == 0)
 			{
 				int error;
 				pthread_attr_init(&attr);
 				pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-				if ((error = pthread_create(&supervisorThread, &attr, (void *)&SupervisorThread, context)) != 0)
+				if ((error = pthread_create(&context->playback->supervisorThread, &attr, (void *)&SupervisorThread, context)) != 0)
 				{
 					playback_printf(10, "Error creating thread, error:%d:%s\n", error, strerror(error));
 					ret = cERR_PLAYBACK_ERROR;
@@ -423,7 +418,7 @@ static int32_t PlaybackStop(Context_t *context)
 
 	playback_printf(10, "\n");
 
-	PlaybackDieNow(1);
+	PlaybackDieNow(context, 1);
 
 	context->playback->stamp = (void *) -1;
 
@@ -447,7 +442,7 @@ static int32_t PlaybackStop(Context_t *context)
 		ret = cERR_PLAYBACK_ERROR;
 	}
 
-	while ((hasThreadStarted == 1) && (--wait_time) > 0)
+	while ((context->playback->hasThreadStarted == 1) && (--wait_time) > 0)
 	{
 		playback_printf(10, "Waiting for supervisor thread to terminate itself, will try another %d times\n", wait_time);
 		usleep(100000);
@@ -471,7 +466,7 @@ static int32_t PlaybackTerminate(Context_t *context)
 
 	playback_printf(20, "\n");
 
-	PlaybackDieNow(1);
+	PlaybackDieNow(context, 1);
 
 	if (context && context->playback && context->playback->isPlaying)
 	{
@@ -506,7 +501,7 @@ static int32_t PlaybackTerminate(Context_t *context)
 		 */
 	}
 
-	while ((hasThreadStarted == 1) && (--wait_time) > 0)
+	while ((context->playback->hasThreadStarted == 1) && (--wait_time) > 0)
 	{
 		playback_printf(10, "Waiting for supervisor thread to terminate itself, will try another %d times\n", wait_time);
 		usleep(100000);
@@ -1032,3 +1027,69 @@ PlaybackHandler_t PlaybackHandler =
 	4000,       //httpTimeout
 	NULL        //stamp
 };
+
+Context_t *PlaybackCreateContext(int32_t decoder)
+{
+	Context_t *context = calloc(1, sizeof(Context_t));
+
+	if (context == NULL)
+	{
+		playback_err("out of memory\n");
+		return NULL;
+	}
+
+	initTrackList(&context->audioTracks, 0);
+	initTrackList(&context->videoTracks, 0);
+	initTrackList(&context->subtitleTracks, -1);
+	initTrackList(&context->chapterTracks, 0);
+
+	context->playback  = malloc(sizeof(PlaybackHandler_t));
+	context->container = malloc(sizeof(ContainerHandler_t));
+	context->output    = malloc(sizeof(OutputHandler_t));
+
+	if (context->playback == NULL || context->container == NULL || context->output == NULL)
+	{
+		playback_err("out of memory\n");
+		PlaybackFreeContext(context);
+		return NULL;
+	}
+
+	*context->playback  = PlaybackHandler;
+	*context->container = ContainerHandler;
+	*context->output    = OutputHandler;
+	/* only points to the managers, the tracks are in the context */
+	context->manager    = &ManagerHandler;
+	context->decoder    = decoder;
+
+	return context;
+}
+
+void PlaybackFreeContext(Context_t *context)
+{
+	if (context == NULL)
+	{
+		return;
+	}
+
+	if (context->playback && context->playback->hasThreadStarted)
+	{
+		/* the supervisor thread still uses it */
+		playback_err("playback not terminated, context %p is not freed\n", context);
+		return;
+	}
+
+	if (context->container)
+	{
+		context->container->Command(context, CONTAINER_DEL, NULL);
+	}
+
+	freeTrackList(&context->audioTracks);
+	freeTrackList(&context->videoTracks);
+	freeTrackList(&context->subtitleTracks);
+	freeTrackList(&context->chapterTracks);
+
+	free(context->playback);
+	free(context->container);
+	free(context->output);
+	free(context);
+}
@@ -24,6 +24,7 @@
 #include <poll.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cstring>
@@ -31,6 +32,12 @@
 #include <string>
 #include <sys/ioctl.h>
 #include "dmx_hal.h"
+#include "section_cache.h"
+#include "section_timing.h"
+#include "stc_clock.h"
+#include "ts_analyzer.h"
+#include "dmx_buffers.h"
+#include "vdmx.h"
 #include "hal_debug.h"
 
 #include "video_lib.h"
@@ -76,6 +83,51 @@ static int dmx_tp_count = 0;
 
 extern bool HAL_nodec;
 
+/* the virtual adapter replaces the demux device if HAL_VDMX is set */
+static cVirtualDemux *vdmx = NULL;
+
+static int dmx_open(const char *dev, int flags)
+{
+	if (vdmx)
+		return vdmx->Open(flags);
+	return open(dev, flags);
+}
+
+static int dmx_close(int fd)
+{
+	if (vdmx)
+		return vdmx->Close(fd);
+	return close(fd);
+}
+
+static ssize_t dmx_read(int fd, void *buf, size_t len)
+{
+	if (vdmx)
+		return vdmx->Read(fd, buf, len);
+	return ::read(fd, buf, len);
+}
+
+static int dmx_ioctl(int fd, unsigned long request)
+{
+	if (vdmx)
+		return vdmx->Ioctl(fd, request, 0);
+	return ioctl(fd, request);
+}
+
+template <class T> static int dmx_ioctl(int fd, unsigned long request, T arg)
+{
+	if (vdmx)
+		return vdmx->Ioctl(fd, request, (unsigned long)arg);
+	return ioctl(fd, request, arg);
+}
+
+static int64_t time_ms(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
 cDemux::cDemux(int n)
 {
 	if (n < 0 || n > 2)
@@ -86,12 +138,20 @@ cDemux::cDemux(int n)
 	else
 		num = n;
 	fd = -1;
+	section_cache = true;
+	sections = NULL;
+	watch = NULL;
+	buffers = NULL;
+	analyzer = NULL;
 }
 
 cDemux::~cDemux()
 {
 	hal_debug("%s #%d fd: %d\n", __FUNCTION__, num, fd);
 	Close();
+	delete sections;
+	delete watch;
+	delete analyzer;
 }
 
 bool cDemux::Open(DMX_CHANNEL_TYPE pes_type, void * /*hVideoBuffer*/, int uBufferSize)
@@ -105,7 +165,8 @@ bool cDemux::Open(DMX_CHANNEL_TYPE pes_type, void * /*hVideoBuffer*/, int uBuffe
 	if (pes_type != DMX_PSI_CHANNEL)
 		flags |= O_NONBLOCK;
 
-	fd = open(devname[devnum], flags);
+	vdmx = cVirtualDemux::getInstance();
+	fd = dmx_open(devname[devnum], flags);
 	if (fd < 0)
 	{
 		hal_info("%s %s: %m\n", __FUNCTION__, devname[devnum]);
@@ -125,13 +186,13 @@ bool cDemux::Open(DMX_CHANNEL_TYPE pes_type, void * /*hVideoBuffer*/, int uBuffe
 		return false;
 	}
 	int n = DMX_SOURCE_FRONT0;
-	if (ioctl(fd, DMX_SET_SOURCE, &n) < 0)
+	if (dmx_ioctl(fd, DMX_SET_SOURCE, &n) < 0)
 		hal_info("%s DMX_SET_SOURCE %d failed! (%m)\n", __func__, n);
 #endif
 	if (uBufferSize > 0)
 	{
 		/* probably uBufferSize == 0 means "use default size". TODO: find a reasonable default */
-		if (ioctl(fd, DMX_SET_BUFFER_SIZE, uBufferSize) < 0)
+		if (dmx_ioctl(fd, DMX_SET_BUFFER_SIZE, uBufferSize) < 0)
 			hal_info("%s DMX_SET_BUFFER_SIZE failed (%m)\n", __func__);
 	}
 	buffersize = uBufferSize;
@@ -149,8 +210,12 @@ void cDemux::Close(void)
 	}
 
 	pesfds.clear();
-	ioctl(fd, DMX_STOP);
-	close(fd);
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Stop();
+	dmx_ioctl(fd, DMX_STOP);
+	delete buffers;
+	buffers = NULL;
+	dmx_close(fd);
 	fd = -1;
 	if (dmx_type == DMX_TP_CHANNEL)
 	{
@@ -171,7 +236,9 @@ bool cDemux::Start(bool)
 		hal_info("%s #%d: not open!\n", __FUNCTION__, num);
 		return false;
 	}
-	ioctl(fd, DMX_START);
+	dmx_ioctl(fd, DMX_START);
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Start(pid);
 	return true;
 }
 
@@ -183,7 +250,9 @@ bool cDemux::Stop(void)
 		hal_info("%s #%d: not open!\n", __FUNCTION__, num);
 		return false;
 	}
-	ioctl(fd, DMX_STOP);
+	dmx_ioctl(fd, DMX_STOP);
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Stop();
 	return true;
 }
 
@@ -204,6 +273,7 @@ int cDemux::Read(unsigned char *buff, int len, int timeout)
 	 * return from read(), so as a "emergency exit" for e.g. NIT scan, set a (long)
 	 * timeout here */
 	int to = timeout;
+	int64_t deadline = 0;
 	if (dmx_type == DMX_PSI_CHANNEL && timeout <= 0)
 	{
 		to = 60 * 1000;
@@ -244,14 +314,136 @@ retry:
 		}
 	}
 
-	rc = ::read(fd, buff, len);
+	rc = dmx_read(fd, buff, len);
 	//fprintf(stderr, "fd %d ret: %d\n", fd, rc);
+	if (!afterRead(buff, rc))
+	{
+		/* unchanged repetition of a section that was delivered before,
+		 * wait for the next one. timeout 0 means wait forever */
+		if (timeout > 0)
+		{
+			if (!deadline)
+				deadline = time_ms() + timeout;
+			to = deadline - time_ms();
+			if (to <= 0)
+				return 0;
+		}
+		goto retry;
+	}
+
+	return rc;
+}
+
+/* everything that has to see the data read, shared by Read() and
+ * ReadAvailable(). false: unchanged repetition of a section */
+bool cDemux::afterRead(unsigned char *buff, int rc)
+{
 	if (rc < 0)
-		dmx_err("read: %s", strerror(errno), 0);
+	{
+		int err = errno;
+		dmx_err("read: %s", strerror(err), 0);
+		if (err == ETIMEDOUT && watch)
+			watch->Timeout();
+		if (err == EOVERFLOW && analyzer)
+			analyzer->Overflow();
+		errno = err;
+		return true;
+	}
+	if (rc == 0)
+		return true;
+	if (watch)
+		watch->Section(buff, rc);
+	if (analyzer)
+		analyzer->Process(buff, rc);
+	return !sections || sections->Deliver(GetSource(num), pid, buff, rc);
+}
 
+int cDemux::ReadAvailable(unsigned char *buff, int len)
+{
+	if (fd < 0)
+	{
+		errno = EBADF;
+		return -1;
+	}
+	int rc = dmx_read(fd, buff, len);
+	/* nothing there (yet), not an error */
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return -1;
+	if (!afterRead(buff, rc))
+		return 0;
 	return rc;
 }
 
+int cDemux::getCachedSection(unsigned short _pid, unsigned char table_id, unsigned short ext,
+	unsigned char secnum, unsigned char *buf, int len, unsigned int max_age)
+{
+	return cSectionCache::getInstance()->Lookup(GetSource(num), _pid, table_id, ext, secnum, buf, len, max_age);
+}
+
+void cDemux::setTransponder(uint32_t transponder)
+{
+	cSectionTiming::getInstance()->SetTransponder(GetSource(num), transponder);
+	cSectionCache::getInstance()->Flush(GetSource(num));
+}
+
+int cDemux::ReadBuffer(const unsigned char **data, int timeout)
+{
+	if (fd < 0 || dmx_type != DMX_TP_CHANNEL)
+	{
+		hal_info("%s #%d: not open or not a TS channel!\n", __func__, num);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!buffers)
+	{
+		buffers = new cDemuxBuffers(fd);
+		if (!buffers->Init())
+		{
+			hal_info("%s #%d: unable to allocate buffer! (out of memory)\n", __func__, num);
+			delete buffers;
+			buffers = NULL;
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	if (buffers->isMapped())
+	{
+		int rc = buffers->Dequeue(data, timeout);
+		if (rc > 0 && analyzer)
+			analyzer->Process(*data, rc);
+		else if (rc < 0 && errno == EOVERFLOW && analyzer)
+			analyzer->Overflow();
+		return rc;
+	}
+	*data = buffers->getReadBuffer();
+	return Read(buffers->getReadBuffer(), DMX_BUFFER_SIZE, timeout);
+}
+
+void cDemux::setAnalyzer(bool enable)
+{
+	if (!enable)
+	{
+		delete analyzer;
+		analyzer = NULL;
+	}
+	else if (!analyzer)
+		analyzer = new cTSAnalyzer;
+}
+
+bool cDemux::getTSStats(struct ts_stats *s)
+{
+	if (!analyzer)
+		return false;
+	analyzer->GetStats(s);
+	return true;
+}
+
+void cDemux::ReleaseBuffer(void)
+{
+	if (buffers && buffers->isMapped())
+		buffers->Queue();
+}
+
 bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filter,
 	const unsigned char *const mask, int len, int timeout,
 	const unsigned char *const negmask)
@@ -260,6 +452,19 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 	memset(&s_flt, 0, sizeof(s_flt));
 	pid = _pid;
 
+	/* only sections that changed since the filter was set are returned */
+	if (section_cache && dmx_type == DMX_PSI_CHANNEL)
+	{
+		if (!sections)
+			sections = new cSectionSession;
+		sections->Reset();
+	}
+	else
+	{
+		delete sections;
+		sections = NULL;
+	}
+
 	if (len > DMX_FILTER_SIZE)
 	{
 		hal_info("%s #%d: len too long: %d, DMX_FILTER_SIZE %d\n", __func__, num, len, DMX_FILTER_SIZE);
@@ -357,7 +562,18 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 	 * and sectionsd EIT-Version change. And they really want no timeout
 	 * if timeout == 0 instead of "default timeout" */
 	if (timeout == 0 && negmask == NULL)
-		s_flt.timeout = to;
+		s_flt.timeout = cSectionTiming::getInstance()->Timeout(GetSource(num), pid, filter[0], to);
+
+	/* learn how often the table repeats, not from filters that wait
+	 * for a change */
+	if (dmx_type == DMX_PSI_CHANNEL && negmask == NULL && mask[0] == 0xff)
+	{
+		if (!watch)
+			watch = new cSectionWatch;
+		watch->Start(GetSource(num), pid, filter[0]);
+	}
+	else if (watch)
+		watch->Stop();
 
 	hal_debug("%s #%d pid:0x%04hx fd:%d type:%s len:%d to:%d flags:%x flt[0]:%02x\n",
 		__func__, num, pid, fd, DMX_T[dmx_type], len, s_flt.timeout, s_flt.flags, s_flt.filter.filter[0]);
@@ -378,8 +594,8 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 		fprintf(stderr, "\n");
 	}
 
-	ioctl(fd, DMX_STOP);
-	if (ioctl(fd, DMX_SET_FILTER, &s_flt) < 0)
+	dmx_ioctl(fd, DMX_STOP);
+	if (dmx_ioctl(fd, DMX_SET_FILTER, &s_flt) < 0)
 		return false;
 
 	return true;
@@ -437,7 +653,12 @@ bool cDemux::pesFilter(const unsigned short _pid)
 			hal_info("%s #%d invalid dmx_type %d!\n", __func__, num, dmx_type);
 			return false;
 	}
-	return (ioctl(fd, DMX_SET_PES_FILTER, &p_flt) >= 0);
+	if (dmx_ioctl(fd, DMX_SET_PES_FILTER, &p_flt) < 0)
+		return false;
+	/* the STC follows the PCR of the service */
+	if (dmx_type == DMX_PCR_ONLY_CHANNEL)
+		cSTCClock::getInstance(num)->Start(pid);
+	return true;
 }
 
 void cDemux::SetSyncMode(AVSYNC_TYPE /*mode*/)
@@ -472,7 +693,7 @@ bool cDemux::addPid(unsigned short Pid)
 	pfd.fd = fd; /* dummy */
 	pfd.pid = Pid;
 	pesfds.push_back(pfd);
-	ret = (ioctl(fd, DMX_ADD_PID, &Pid));
+	ret = (dmx_ioctl(fd, DMX_ADD_PID, &Pid));
 	if (ret < 0)
 		hal_info("%s: DMX_ADD_PID (%m)\n", __func__);
 	return (ret != -1);
@@ -490,7 +711,7 @@ void cDemux::removePid(unsigned short Pid)
 		if ((*i).pid == Pid)
 		{
 			hal_debug("removePid: removing demux fd %d pid 0x%04x\n", fd, Pid);
-			if (ioctl(fd, DMX_REMOVE_PID, Pid) < 0)
+			if (dmx_ioctl(fd, DMX_REMOVE_PID, &Pid) < 0)
 				hal_info("%s: (DMX_REMOVE_PID, 0x%04hx): %m\n", __func__, Pid);
 			pesfds.erase(i);
 			return; /* TODO: what if the same PID is there multiple times */
@@ -501,6 +722,9 @@ void cDemux::removePid(unsigned short Pid)
 
 void cDemux::getSTC(int64_t *STC)
 {
+	/* the clock recovered from the PCR, if the PCR filter is running */
+	if (cSTCClock::getInstance(num)->getSTC(STC))
+		return;
 	int64_t pts = 0;
 	if (videoDecoder)
 		pts = videoDecoder->GetPTS();
@@ -522,8 +746,9 @@ bool cDemux::SetSource(int unit, int source)
 	return true;
 }
 
-int cDemux::GetSource(int unit)
+/* all units read demux0, see devname[]. Also the source that keys the
+ * section cache */
+int cDemux::GetSource(int /*unit*/)
 {
-	hal_info_c("%s(%d): not implemented yet\n", __func__, unit);
 	return 0;
 }
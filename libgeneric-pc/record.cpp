@@ -9,9 +9,13 @@
 #include <cstring>
 
 #include <pthread.h>
-#include <aio.h>
 
 #include "record_lib.h"
+#include "record_writer.h"
+#include "ts_fanout.h"
+#include "ts_analyzer.h"
+#include "ts_indexer.h"
+#include "ts_remux.h"
 #include "hal_debug.h"
 #define hal_debug(args...) _hal_debug(HAL_DEBUG_RECORD, this, args)
 #define hal_info(args...) _hal_info(HAL_DEBUG_RECORD, this, args)
@@ -35,20 +39,33 @@ cRecord::cRecord(int num, int bs_dmx, int bs)
 {
 	hal_info("%s %d\n", __func__, num);
 	dmx = NULL;
+	remux = NULL;
 	record_thread_running = false;
 	file_fd = -1;
 	exit_flag = RECORD_STOPPED;
 	dmx_num = num;
 	bufsize = bs;
 	bufsize_dmx = bs_dmx;
+	cache_window = RECORD_CACHE_WINDOW;
+	split_size = 0;
+	ring_size = 0;
+	video_pid = 0;
+	index = true;
+	spts = false;
+	analyze = true;
 	failureCallback = NULL;
 	failureData = NULL;
+	pthread_mutex_init(&stats_mutex, NULL);
+	pthread_mutex_init(&dmx_mutex, NULL);
+	memset(&stats, 0, sizeof(stats));
 }
 
 cRecord::~cRecord()
 {
 	hal_info("%s: calling ::Stop()\n", __func__);
 	Stop();
+	pthread_mutex_destroy(&stats_mutex);
+	pthread_mutex_destroy(&dmx_mutex);
 	hal_info("%s: end\n", __func__);
 }
 
@@ -67,22 +84,43 @@ void cRecord::Close(void)
 }
 #endif
 
-bool cRecord::Start(int fd, unsigned short vpid, unsigned short *apids, int numpids, uint64_t)
+bool cRecord::Start(int fd, unsigned short vpid, unsigned short *apids, int numpids, uint64_t ch)
 {
 	hal_info("%s: fd %d, vpid 0x%03x\n", __func__, fd, vpid);
 	int i;
 
+	/* recordings on the same demux source share one demux */
 	if (!dmx)
-		dmx = new cDemux(dmx_num);
+		dmx = cTSFanout::Open(dmx_num, bufsize_dmx);
+	if (!dmx)
+	{
+		exit_flag = RECORD_FAILED_MEMORY;
+		return false;
+	}
 
-	dmx->Open(DMX_TP_CHANNEL, NULL, bufsize_dmx);
-	dmx->pesFilter(vpid);
+	dmx->AddPid(vpid);
 
 	for (i = 0; i < numpids; i++)
-		dmx->addPid(apids[i]);
+		dmx->AddPid(apids[i]);
+
+	/* the low 16 bits of the channel id are the service id */
+	if (spts && (ch & 0xffff))
+	{
+		remux = new cTSRemux(ch & 0xffff);
+		remux->AddPid(vpid);
+		for (i = 0; i < numpids; i++)
+			remux->AddPid(apids[i]);
+		int pid;
+		while ((pid = remux->NewPid()) >= 0)
+			dmx->AddPid(pid);
+	}
 
 	file_fd = fd;
+	video_pid = vpid;
 	exit_flag = RECORD_RUNNING;
+	pthread_mutex_lock(&stats_mutex);
+	memset(&stats, 0, sizeof(stats));
+	pthread_mutex_unlock(&stats_mutex);
 	if (posix_fadvise(file_fd, 0, 0, POSIX_FADV_DONTNEED))
 		perror("posix_fadvise");
 
@@ -92,8 +130,10 @@ bool cRecord::Start(int fd, unsigned short vpid, unsigned short *apids, int nump
 		exit_flag = RECORD_FAILED_READ;
 		errno = i;
 		hal_info("%s: error creating thread! (%m)\n", __func__);
-		delete dmx;
+		dmx->Close();
 		dmx = NULL;
+		delete remux;
+		remux = NULL;
 		return false;
 	}
 	record_thread_running = true;
@@ -116,8 +156,10 @@ bool cRecord::Stop(void)
 	if (!dmx)
 		hal_info("%s: dmx == NULL?\n", __func__);
 	else
-		delete dmx;
+		dmx->Close();
 	dmx = NULL;
+	delete remux;
+	remux = NULL;
 
 	if (file_fd != -1)
 		close(file_fd);
@@ -129,7 +171,7 @@ bool cRecord::Stop(void)
 
 bool cRecord::ChangePids(unsigned short /*vpid*/, unsigned short *apids, int numapids)
 {
-	std::vector<pes_pids> pids;
+	std::vector<unsigned short> pids;
 	int j;
 	bool found;
 	unsigned short pid;
@@ -139,12 +181,13 @@ bool cRecord::ChangePids(unsigned short /*vpid*/, unsigned short *apids, int num
 		hal_info("%s: DMX = NULL\n", __func__);
 		return false;
 	}
-	pids = dmx->pesfds;
+	pthread_mutex_lock(&dmx_mutex);
+	pids = dmx->pids;
 	/* the first PID is the video pid, so start with the second PID... */
-	for (std::vector<pes_pids>::const_iterator i = pids.begin() + 1; i != pids.end(); ++i)
+	for (std::vector<unsigned short>::const_iterator i = pids.begin() + 1; i < pids.end(); ++i)
 	{
 		found = false;
-		pid = (*i).pid;
+		pid = *i;
 		for (j = 0; j < numapids; j++)
 		{
 			if (pid == apids[j])
@@ -153,42 +196,61 @@ bool cRecord::ChangePids(unsigned short /*vpid*/, unsigned short *apids, int num
 				break;
 			}
 		}
-		if (!found)
-			dmx->removePid(pid);
+		if (found)
+			continue;
+		if (remux)
+		{
+			remux->RemovePid(pid);
+			/* PAT, PMT, PCR */
+			if (remux->Internal(pid))
+				continue;
+		}
+		dmx->RemovePid(pid);
 	}
 	for (j = 0; j < numapids; j++)
 	{
 		found = false;
-		for (std::vector<pes_pids>::const_iterator i = pids.begin() + 1; i != pids.end(); ++i)
+		for (std::vector<unsigned short>::const_iterator i = pids.begin() + 1; i < pids.end(); ++i)
 		{
-			if ((*i).pid == apids[j])
+			if (*i == apids[j])
 			{
 				found = true;
 				break;
 			}
 		}
 		if (!found)
-			dmx->addPid(apids[j]);
+			dmx->AddPid(apids[j]);
+		if (remux)
+			remux->AddPid(apids[j]);
 	}
+	pthread_mutex_unlock(&dmx_mutex);
 	return true;
 }
 
 bool cRecord::AddPid(unsigned short pid)
 {
-	std::vector<pes_pids> pids;
+	std::vector<unsigned short> pids;
 	hal_info("%s: \n", __func__);
 	if (!dmx)
 	{
 		hal_info("%s: DMX = NULL\n", __func__);
 		return false;
 	}
-	pids = dmx->pesfds;
-	for (std::vector<pes_pids>::const_iterator i = pids.begin(); i != pids.end(); ++i)
+	if (remux)
+		remux->AddPid(pid);
+	pthread_mutex_lock(&dmx_mutex);
+	pids = dmx->pids;
+	for (std::vector<unsigned short>::const_iterator i = pids.begin(); i != pids.end(); ++i)
 	{
-		if ((*i).pid == pid)
+		if (*i == pid)
+		{
+			pthread_mutex_unlock(&dmx_mutex);
 			return true; /* or is it an error to try to add the same PID twice? */
+		}
 	}
-	return dmx->addPid(pid);
+	bool ret = dmx->AddPid(pid);
+	pthread_mutex_unlock(&dmx_mutex);
+	return ret;
 }
 
 void cRecord::WriterThread()
@@ -227,16 +289,35 @@ void cRecord::RecordThread()
 	threadname[16] = 0;
 	prctl(PR_SET_NAME, (unsigned long)&threadname);
 	int readsize = bufsize / 16;
-	int buf_pos = 0;
-	int count = 0;
-	int queued = 0;
-	uint8_t *buf;
-	struct aiocb a;
+	cTSIndexer *indexer = NULL;
+	/* no index for radio recordings. Offsets in a ring file wrap,
+	 * there the indexer only provides the PTS range */
+	if ((index || ring_size) && video_pid && video_pid < 0x1fff)
+	{
+		indexer = new cTSIndexer(video_pid);
+		if (!ring_size && !indexer->Open(file_fd))
+		{
+			delete indexer;
+			indexer = NULL;
+		}
+	}
+	/* told apart from the overflows of the buffer below: damage of
+	 * the received stream and data lost before it was read */
+	cTSAnalyzer *analyzer = analyze ? new cTSAnalyzer : NULL;
+	int ringsize = bufsize;
+	/* the remuxer works on whole packets, keep them contiguous in the ring */
+	if (remux)
+		ringsize -= ringsize % TS_PACKET_SIZE;
+	cRecordWriter *writer = new cRecordWriter(file_fd, ringsize, readsize, cache_window);
+	writer->SetSplitSize(split_size);
+	writer->SetRingSize(ring_size);
 
-	buf = (uint8_t *)malloc(bufsize);
 	hal_info("BUFSIZE=0x%x READSIZE=0x%x\n", bufsize, readsize);
-	if (!buf)
+	if (!writer->Init())
 	{
+		delete writer;
+		delete indexer;
+		delete analyzer;
 		exit_flag = RECORD_FAILED_MEMORY;
 		hal_info("%s: unable to allocate buffer! (out of memory)\n", __func__);
 		if (failureCallback)
@@ -245,38 +326,41 @@ void cRecord::RecordThread()
 		pthread_exit(NULL);
 	}
 
-	int val = fcntl(file_fd, F_GETFL);
-	if (fcntl(file_fd, F_SETFL, val | O_APPEND))
-		hal_info("%s: O_APPEND? (%m)\n", __func__);
-
-	memset(&a, 0, sizeof(a));
-	a.aio_fildes = file_fd;
-	a.aio_sigevent.sigev_notify = SIGEV_NONE;
-
 	dmx->Start();
 	int overflow_count = 0;
+	unsigned int overflows = 0;
 	bool overflow = false;
-	int r = 0;
 	while (exit_flag == RECORD_RUNNING)
 	{
-		if (buf_pos < bufsize)
+		size_t avail;
+		uint8_t *buf = writer->GetWritePtr(&avail);
+		if (avail > 0)
 		{
 			if (overflow_count)
 			{
 				hal_info("%s: Overflow cleared after %d iterations\n", __func__, overflow_count);
 				overflow_count = 0;
 			}
-			int toread = bufsize - buf_pos;
+			int toread = avail;
 			if (toread > readsize)
 				toread = readsize;
-			ssize_t s = dmx->Read(buf + buf_pos, toread, 50);
-			hal_debug("%s: buf_pos %6d s %6d / %6d\n", __func__, buf_pos, (int)s, bufsize - buf_pos);
+			if (remux)
+			{
+				/* leave room for inserted PAT / PMT */
+				if ((int)avail >= TS_REMUX_SLACK + TS_PACKET_SIZE && toread > (int)avail - TS_REMUX_SLACK)
+					toread = avail - TS_REMUX_SLACK;
+				toread -= toread % TS_PACKET_SIZE;
+			}
+			ssize_t s = dmx->Read(buf, toread, 50);
+			hal_debug("%s: s %6d / %6d\n", __func__, (int)s, toread);
 			if (s < 0)
 			{
+				if (errno == EOVERFLOW && analyzer)
+					analyzer->Overflow();
 				if (errno != EAGAIN && (errno != EOVERFLOW || !overflow))
 				{
+					exit_flag = errno == ENOMEM ? RECORD_FAILED_MEMORY : RECORD_FAILED_READ;
 					hal_info("%s: read failed: %m\n", __func__);
-					exit_flag = RECORD_FAILED_READ;
 					state = REC_STATUS_OVERFLOW;
 					break;
 				}
@@ -284,88 +368,71 @@ void cRecord::RecordThread()
 			else
 			{
 				overflow = false;
-				buf_pos += s;
-				if (count > 100)
+				if (analyzer)
+					analyzer->Process(buf, s);
+				if (remux)
 				{
-					if (buf_pos < bufsize / 2)
-						continue;
+					s = remux->Process(buf, s, avail);
+					int pid;
+					while ((pid = remux->NewPid()) >= 0)
+					{
+						pthread_mutex_lock(&dmx_mutex);
+						dmx->AddPid(pid);
+						pthread_mutex_unlock(&dmx_mutex);
+					}
 				}
-				else
+				if (indexer)
 				{
-					count += 1;
+					uint64_t offset, pts;
+					indexer->Parse(buf, s);
+					if (indexer->LastPts(&offset, &pts))
+						writer->AddPts(offset, pts);
 				}
+				writer->Commit(s);
 			}
 		}
 		else
 		{
 			if (!overflow)
+			{
 				overflow_count = 0;
+				overflows++;
+			}
 			overflow = true;
 			if (!(overflow_count % 10))
 				hal_info("%s: buffer full! Overflow? (%d)\n", __func__, ++overflow_count);
 			state = REC_STATUS_SLOW;
 		}
-		r = aio_error(&a);
-		if (r == EINPROGRESS)
+		/* if the buffer is full, wait for the disk to catch up */
+		if (writer->Process(avail > 0 ? 0 : 50) < 0)
 		{
-			hal_debug("%s: aio in progress, free: %d\n", __func__, bufsize - buf_pos);
-			continue;
-		}
-		// not calling aio_return causes a memory leak --martii
-		r = aio_return(&a);
-		if (r < 0)
-		{
-			exit_flag = RECORD_FAILED_FILE;
-			hal_debug("%s: aio_return = %d (%m)\n", __func__, r);
-			break;
-		}
-		else
-			hal_debug("%s: aio_return = %d, free: %d\n", __func__, r, bufsize - buf_pos);
-		if (posix_fadvise(file_fd, 0, 0, POSIX_FADV_DONTNEED))
-			perror("posix_fadvise");
-		if (queued)
-		{
-			memmove(buf, buf + queued, buf_pos - queued);
-			buf_pos -= queued;
-		}
-		queued = buf_pos;
-		a.aio_buf = buf;
-		a.aio_nbytes = queued;
-		r = aio_write(&a);
-		if (r)
-		{
-			hal_info("%s: aio_write %d (%m)\n", __func__, r);
 			exit_flag = RECORD_FAILED_FILE;
+			hal_info("%s: write failed\n", __func__);
 			break;
 		}
+		pthread_mutex_lock(&stats_mutex);
+		writer->GetStats(&stats);
+		stats.overflows = overflows;
+		if (analyzer)
+			analyzer->GetStats(&stats.ts);
+		pthread_mutex_unlock(&stats_mutex);
 	}
 	dmx->Stop();
-	while (true) /* write out the unwritten buffer content */
+	/* write out the unwritten buffer content */
+	if (!writer->Flush() && exit_flag == RECORD_STOPPED)
 	{
-		hal_debug("%s: run-out write, buf_pos %d\n", __func__, buf_pos);
-		r = aio_error(&a);
-		if (r == EINPROGRESS)
-		{
-			usleep(50000);
-			continue;
-		}
-		r = aio_return(&a);
-		if (r < 0)
-		{
-			exit_flag = RECORD_FAILED_FILE;
-			hal_info("%s: aio_result: %d (%m)\n", __func__, r);
-			break;
-		}
-		if (!queued)
-			break;
-		memmove(buf, buf + queued, buf_pos - queued);
-		buf_pos -= queued;
-		queued = buf_pos;
-		a.aio_buf = buf;
-		a.aio_nbytes = queued;
-		r = aio_write(&a);
+		exit_flag = RECORD_FAILED_FILE;
+		hal_info("%s: run-out write failed\n", __func__);
 	}
-	free(buf);
+	pthread_mutex_lock(&stats_mutex);
+	writer->GetStats(&stats);
+	stats.overflows = overflows;
+	if (analyzer)
+		analyzer->GetStats(&stats.ts);
+	pthread_mutex_unlock(&stats_mutex);
+	delete writer;
+	delete indexer;
+	delete analyzer;
 
 #if 0
 	// TODO: do we need to notify neutrino about failing recording?
@@ -396,3 +463,10 @@ void cRecord::ResetStatus()
 {
 	return;
 }
+
+void cRecord::GetStats(record_stats_t *s)
+{
+	pthread_mutex_lock(&stats_mutex);
+	*s = stats;
+	pthread_mutex_unlock(&stats_mutex);
+}
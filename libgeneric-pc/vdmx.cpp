@@ -0,0 +1,752 @@
+/*
+ * virtual DVB demux fed from a transport stream file, FIFO or socket
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/dvb/dmx.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+
+#include "vdmx.h"
+#include "ts_fanout.h"
+#include "section_filter.h"
+#include "hal_debug.h"
+#define hal_debug(args...) _hal_debug(HAL_DEBUG_DEMUX, this, args)
+#define hal_info(args...) _hal_info(HAL_DEBUG_DEMUX, this, args)
+#define hal_info_c(args...) _hal_info(HAL_DEBUG_DEMUX, NULL, args)
+
+#define VDMX_READSIZE (TS_PACKET_SIZE * 348)
+/* filter buffer if DMX_SET_BUFFER_SIZE is not used, as in the kernel */
+#define VDMX_BUFSIZE 8192
+/* without pacing: how long to wait for a TS / PES reader with a full buffer */
+#define VDMX_STALL_MS 200
+
+#define BIT_SET(a, pid) ((a)[(pid) >> 3] |= (1 << ((pid) & 7)))
+#define BIT_CLR(a, pid) ((a)[(pid) >> 3] &= ~(1 << ((pid) & 7)))
+#define BIT_TST(a, pid) ((a)[(pid) >> 3] & (1 << ((pid) & 7)))
+
+enum vdmx_type
+{
+	VDMX_NONE,
+	VDMX_SECTION,
+	VDMX_PES
+};
+
+struct vdmx_filter
+{
+	cVirtualDemux *owner;
+	int fd;			/* the eventfd, -1 once closed */
+	bool nonblock;
+	vdmx_type type;
+	bool running;
+	int output;		/* enum dmx_output of PES filters */
+	uint8_t pids[TS_MAX_PID / 8];
+	bool all_pids;		/* PID 0x2000 */
+	struct dmx_sct_filter_params sct;
+	int sf_id;		/* in the cSectionFilter of the PID, -1: none */
+	int64_t deadline;	/* ms, for the first section, 0: none */
+
+	/* data for read(): whole sections, or a byte ring for PES / TS */
+	std::deque<std::vector<uint8_t> > sections;
+	size_t sec_pos;		/* of the first section already read */
+	std::vector<uint8_t> ring;
+	size_t rpos;
+	size_t fill;
+	size_t queued;
+	size_t bufsize;
+	int error;		/* returned once by read(), e.g. EOVERFLOW */
+	bool signalled;		/* eventfd is readable */
+	bool stalled;		/* did not read, no more waiting for it */
+};
+
+static int64_t time_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void *execute_vdmx_thread(void *c)
+{
+	cVirtualDemux *obj = (cVirtualDemux *)c;
+	obj->Run();
+	return NULL;
+}
+
+cVirtualDemux *cVirtualDemux::getInstance()
+{
+	static cVirtualDemux *instance = NULL;
+	static bool checked = false;
+	static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&instance_mutex);
+	if (!checked)
+	{
+		checked = true;
+		const char *source = getenv("HAL_VDMX");
+		if (source && *source)
+		{
+			instance = new cVirtualDemux(source);
+			int ret = pthread_create(&instance->thread, 0, execute_vdmx_thread, instance);
+			if (ret != 0)
+			{
+				errno = ret;
+				hal_info_c("%s: error creating thread! (%m)\n", __func__);
+			}
+		}
+	}
+	pthread_mutex_unlock(&instance_mutex);
+	return instance;
+}
+
+cVirtualDemux::cVirtualDemux(const char *_source)
+{
+	source = _source;
+	const char *tmp = getenv("HAL_VDMX_PACE");
+	pace = !(tmp && !strcmp(tmp, "none"));
+	tmp = getenv("HAL_VDMX_LOOP");
+	loop = tmp && atoi(tmp);
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	pcr_pid = -1;
+	pcr_last = -1;
+	pcr_base = -1;
+	clock_base = 0;
+	packets = 0;
+	bytes = 0;
+	hal_info("%s: demux from %s, %s\n", __func__, _source, pace ? "paced by PCR" : "unthrottled");
+}
+
+/* called with mutex held */
+struct vdmx_filter *cVirtualDemux::find(int fd)
+{
+	for (std::vector<vdmx_filter *>::iterator i = filters.begin(); i != filters.end(); ++i)
+		if ((*i)->fd == fd && fd >= 0)
+			return *i;
+	return NULL;
+}
+
+/* called with mutex held: the eventfd is readable while there is
+ * something for read() */
+void cVirtualDemux::update(struct vdmx_filter *f)
+{
+	bool ready = f->queued || f->error;
+	if (ready == f->signalled || f->fd < 0)
+		return;
+	uint64_t v = 1;
+	ssize_t ret;
+	if (ready)
+		ret = write(f->fd, &v, sizeof(v));
+	else
+		ret = read(f->fd, &v, sizeof(v));
+	if (ret == sizeof(v))
+		f->signalled = ready;
+	pthread_cond_broadcast(&cond);
+}
+
+static void flush(struct vdmx_filter *f)
+{
+	f->sections.clear();
+	f->sec_pos = 0;
+	f->rpos = 0;
+	f->fill = 0;
+	f->queued = 0;
+	f->error = 0;
+}
+
+/* called with mutex held */
+void cVirtualDemux::start(struct vdmx_filter *f)
+{
+	stop(f);
+	f->running = true;
+	f->stalled = false;
+	f->deadline = 0;
+	if (f->type == VDMX_SECTION)
+	{
+		/* all section filters on a PID share one reassembly */
+		unsigned short pid = f->sct.pid & 0x1fff;
+		cSectionFilter *&sf = section_pids[pid];
+		if (!sf)
+			sf = new cSectionFilter(pid);
+		f->sf_id = sf->Add(&f->sct, section_cb, f);
+		if (f->sct.timeout)
+			f->deadline = time_us() / 1000 + f->sct.timeout;
+	}
+	if (f->type == VDMX_PES && f->ring.size() != f->bufsize)
+	{
+		f->ring.resize(f->bufsize);
+		f->rpos = 0;
+		f->fill = 0;
+		f->queued = 0;
+	}
+}
+
+/* called with mutex held */
+void cVirtualDemux::stop(struct vdmx_filter *f)
+{
+	f->running = false;
+	if (f->sf_id < 0)
+		return;
+	std::map<unsigned short, cSectionFilter *>::iterator i = section_pids.find(f->sct.pid & 0x1fff);
+	if (i != section_pids.end())
+	{
+		i->second->Remove(f->sf_id);
+		if (i->second->Empty())
+		{
+			delete i->second;
+			section_pids.erase(i);
+		}
+	}
+	f->sf_id = -1;
+}
+
+int cVirtualDemux::Open(int flags)
+{
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	vdmx_filter *f = new vdmx_filter;
+	f->owner = this;
+	f->fd = fd;
+	f->nonblock = flags & O_NONBLOCK;
+	f->type = VDMX_NONE;
+	f->running = false;
+	f->output = DMX_OUT_DECODER;
+	memset(f->pids, 0, sizeof(f->pids));
+	f->all_pids = false;
+	memset(&f->sct, 0, sizeof(f->sct));
+	f->sf_id = -1;
+	f->deadline = 0;
+	f->bufsize = VDMX_BUFSIZE;
+	f->signalled = false;
+	f->stalled = false;
+	flush(f);
+	pthread_mutex_lock(&mutex);
+	filters.push_back(f);
+	pthread_mutex_unlock(&mutex);
+	hal_debug("%s: fd %d\n", __func__, fd);
+	return fd;
+}
+
+int cVirtualDemux::Close(int fd)
+{
+	pthread_mutex_lock(&mutex);
+	vdmx_filter *f = find(fd);
+	if (!f)
+	{
+		pthread_mutex_unlock(&mutex);
+		errno = EBADF;
+		return -1;
+	}
+	/* the feeder thread frees it, it may be using it right now */
+	stop(f);
+	f->fd = -1;
+	close(fd);
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	hal_debug("%s: fd %d\n", __func__, fd);
+	return 0;
+}
+
+int cVirtualDemux::Ioctl(int fd, unsigned long request, unsigned long arg)
+{
+	int ret = 0;
+	pthread_mutex_lock(&mutex);
+	vdmx_filter *f = find(fd);
+	if (!f)
+	{
+		pthread_mutex_unlock(&mutex);
+		errno = EBADF;
+		return -1;
+	}
+	switch (request)
+	{
+		case DMX_START:
+			if (f->type == VDMX_NONE)
+			{
+				ret = -EINVAL;
+				break;
+			}
+			start(f);
+			break;
+		case DMX_STOP:
+			stop(f);
+			break;
+		case DMX_SET_FILTER:
+			stop(f);
+			memcpy(&f->sct, (void *)arg, sizeof(f->sct));
+			f->type = VDMX_SECTION;
+			memset(f->pids, 0, sizeof(f->pids));
+			f->all_pids = false;
+			flush(f);
+			if (f->sct.flags & DMX_IMMEDIATE_START)
+				start(f);
+			break;
+		case DMX_SET_PES_FILTER:
+		{
+			struct dmx_pes_filter_params *p = (struct dmx_pes_filter_params *)arg;
+			stop(f);
+			f->type = VDMX_PES;
+			f->output = p->output;
+			memset(f->pids, 0, sizeof(f->pids));
+			f->all_pids = p->pid >= TS_MAX_PID;
+			if (!f->all_pids)
+				BIT_SET(f->pids, p->pid);
+			flush(f);
+			if (p->flags & DMX_IMMEDIATE_START)
+				start(f);
+			break;
+		}
+		case DMX_SET_BUFFER_SIZE:
+			if (f->running)
+			{
+				ret = -EBUSY;
+				break;
+			}
+			f->bufsize = arg;
+			flush(f);
+			break;
+		case DMX_ADD_PID:
+		case DMX_REMOVE_PID:
+		{
+			uint16_t pid = *(uint16_t *)arg;
+			if (f->type != VDMX_PES || f->output != DMX_OUT_TSDEMUX_TAP)
+				ret = -EINVAL;
+			else if (pid >= TS_MAX_PID)
+				f->all_pids = (request == DMX_ADD_PID);
+			else if (request == DMX_ADD_PID)
+				BIT_SET(f->pids, pid);
+			else
+				BIT_CLR(f->pids, pid);
+			break;
+		}
+		case DMX_SET_SOURCE:
+			break;
+		case DMX_GET_STC:
+		{
+			/* the PCR is as close as it gets to an STC */
+			struct dmx_stc *stc = (struct dmx_stc *)arg;
+			if (pcr_last < 0)
+			{
+				ret = -EAGAIN;
+				break;
+			}
+			stc->base = 1;
+			stc->stc = pcr_last / 300;
+			break;
+		}
+		default:
+			ret = -ENOTTY;
+			break;
+	}
+	update(f);
+	pthread_mutex_unlock(&mutex);
+	if (ret < 0)
+	{
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+ssize_t cVirtualDemux::Read(int fd, void *buf, size_t len)
+{
+	pthread_mutex_lock(&mutex);
+	vdmx_filter *f = find(fd);
+	while (f && !f->queued && !f->error)
+	{
+		if (f->nonblock)
+		{
+			pthread_mutex_unlock(&mutex);
+			errno = EAGAIN;
+			return -1;
+		}
+		pthread_cond_wait(&cond, &mutex);
+		f = find(fd);
+	}
+	if (!f)
+	{
+		pthread_mutex_unlock(&mutex);
+		errno = EBADF;
+		return -1;
+	}
+	if (f->error)
+	{
+		/* like the kernel: report the error once and start over */
+		int err = f->error;
+		flush(f);
+		update(f);
+		pthread_mutex_unlock(&mutex);
+		errno = err;
+		return -1;
+	}
+	size_t n;
+	uint8_t *dst = (uint8_t *)buf;
+	if (f->type == VDMX_SECTION)
+	{
+		/* one section per read() */
+		std::vector<uint8_t> &sec = f->sections.front();
+		n = std::min(len, sec.size() - f->sec_pos);
+		memcpy(dst, &sec[f->sec_pos], n);
+		f->sec_pos += n;
+		if (f->sec_pos == sec.size())
+		{
+			f->sections.pop_front();
+			f->sec_pos = 0;
+		}
+	}
+	else
+	{
+		n = std::min(len, f->fill);
+		size_t m = std::min(n, f->ring.size() - f->rpos);
+		memcpy(dst, &f->ring[f->rpos], m);
+		if (m < n)
+			memcpy(dst + m, &f->ring[0], n - m);
+		f->rpos = (f->rpos + n) % f->ring.size();
+		f->fill -= n;
+	}
+	f->queued -= n;
+	f->stalled = false;
+	update(f);
+	/* the feeder may wait for room */
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	return n;
+}
+
+/* called with mutex held, from cSectionFilter::Packet() */
+void cVirtualDemux::section_cb(int, const uint8_t *sec, int len, void *user)
+{
+	vdmx_filter *f = (vdmx_filter *)user;
+	f->owner->section(f, sec, len);
+}
+
+/* called with mutex held */
+void cVirtualDemux::section(struct vdmx_filter *f, const uint8_t *sec, int len)
+{
+	f->deadline = 0;
+	if (f->queued + len > f->bufsize)
+		f->error = EOVERFLOW;
+	else
+	{
+		f->sections.push_back(std::vector<uint8_t>(sec, sec + len));
+		f->queued += len;
+	}
+	/* cSectionFilter does not deliver more, stop() removes it */
+	if (f->sct.flags & DMX_ONESHOT)
+		f->running = false;
+	update(f);
+}
+
+/* called with mutex held, may wait for a reader */
+void cVirtualDemux::deliver(struct vdmx_filter *f, const uint8_t *data, size_t len)
+{
+	while (!pace && !f->stalled && f->running && f->queued + len > f->bufsize)
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += VDMX_STALL_MS * 1000000;
+		if (ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		if (pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+		{
+			hal_debug("%s: fd %d does not read, dropping\n", __func__, f->fd);
+			f->stalled = true;
+		}
+	}
+	/* closed or stopped while waiting */
+	if (!f->running)
+		return;
+	if (f->queued + len > f->bufsize)
+	{
+		f->error = EOVERFLOW;
+		update(f);
+		return;
+	}
+	size_t wpos = (f->rpos + f->fill) % f->ring.size();
+	size_t n = std::min(len, f->ring.size() - wpos);
+	memcpy(&f->ring[wpos], data, n);
+	if (n < len)
+		memcpy(&f->ring[0], data + n, len - n);
+	f->fill += len;
+	f->queued += len;
+	update(f);
+}
+
+/* called with mutex held */
+void cVirtualDemux::feed(const uint8_t *p)
+{
+	unsigned int pid = ((p[1] & 0x1f) << 8) | p[2];
+	int afc = (p[3] >> 4) & 3;
+	int off = 4;
+	if (afc & 2)
+		off += 1 + p[4];
+	bool payload = (afc & 1) && off < TS_PACKET_SIZE;
+	packets++;
+
+	if ((afc & 2) && p[4] >= 7 && (p[5] & 0x10) && (pcr_pid < 0 || pcr_pid == (int)pid))
+	{
+		int64_t pcr = (((int64_t)p[6] << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7)) * 300
+			+ (((p[10] & 1) << 8) | p[11]);
+		int64_t now = time_us();
+		pcr_pid = pid;
+		if (pcr_base < 0 || pcr < pcr_last || pcr - pcr_last > 27000000)
+		{
+			/* start, wrap around or discontinuity */
+			pcr_base = pcr;
+			clock_base = now;
+		}
+		else if (pace)
+		{
+			int64_t due = clock_base + (pcr - pcr_base) / 27;
+			if (due > now)
+			{
+				pthread_mutex_unlock(&mutex);
+				usleep(due - now);
+				pthread_mutex_lock(&mutex);
+			}
+			else if (now - due > 1000000)
+			{
+				/* fell behind, e.g. the source stalled */
+				pcr_base = pcr;
+				clock_base = now;
+			}
+		}
+		pcr_last = pcr;
+	}
+
+	/* by index, deliver() may wait and filters may be added meanwhile */
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		vdmx_filter *f = filters[i];
+		if (f->type != VDMX_PES || !f->running || !(f->all_pids || BIT_TST(f->pids, pid)))
+			continue;
+		if (f->output == DMX_OUT_TSDEMUX_TAP)
+			deliver(f, p, TS_PACKET_SIZE);
+		else if (f->output == DMX_OUT_TAP && payload)
+			deliver(f, p + off, TS_PACKET_SIZE - off);
+	}
+
+	std::map<unsigned short, cSectionFilter *>::iterator sf = section_pids.find(pid);
+	if (sf != section_pids.end())
+		sf->second->Packet(p);
+}
+
+/* called with mutex held */
+void cVirtualDemux::check_timeouts(void)
+{
+	int64_t now = time_us() / 1000;
+	std::vector<vdmx_filter *>::iterator i = filters.begin();
+	while (i != filters.end())
+	{
+		vdmx_filter *f = *i;
+		if (f->fd < 0)
+		{
+			/* closed, nothing refers to it anymore */
+			delete f;
+			i = filters.erase(i);
+			continue;
+		}
+		if (f->running && f->deadline && now >= f->deadline)
+		{
+			/* the kernel stops the filter and read() returns ETIMEDOUT */
+			hal_debug("%s: fd %d pid 0x%04x table 0x%02x timed out\n", __func__,
+				f->fd, f->sct.pid, f->sct.filter.filter[0]);
+			stop(f);
+			f->deadline = 0;
+			flush(f);
+			f->error = ETIMEDOUT;
+			update(f);
+		}
+		++i;
+	}
+}
+
+int cVirtualDemux::open_source(bool *regular)
+{
+	const char *s = source.c_str();
+	int fd;
+	*regular = false;
+	if (!strncmp(s, "udp://", 6) || !strncmp(s, "tcp://", 6))
+	{
+		bool udp = (s[0] == 'u');
+		std::string addr = s + 6;
+		std::string host, port;
+		size_t colon = addr.rfind(':');
+		if (colon == std::string::npos)
+		{
+			host = udp ? "127.0.0.1" : "";
+			port = addr;
+		}
+		else
+		{
+			host = addr.substr(0, colon);
+			port = addr.substr(colon + 1);
+		}
+		struct addrinfo hints, *res;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+		if (udp)
+			hints.ai_flags = AI_PASSIVE;
+		int ret = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+		if (ret)
+		{
+			hal_info("%s: %s: %s\n", __func__, s, gai_strerror(ret));
+			return -1;
+		}
+		fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+		if (fd >= 0)
+		{
+			if (udp)
+			{
+				int on = 1;
+				int size = 4 * 1024 * 1024;
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+				setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+				ret = bind(fd, res->ai_addr, res->ai_addrlen);
+			}
+			else
+				ret = connect(fd, res->ai_addr, res->ai_addrlen);
+			if (ret < 0)
+			{
+				hal_info("%s: %s: %m\n", __func__, s);
+				close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(res);
+	}
+	else
+	{
+		/* blocks until a FIFO has a writer */
+		fd = open(s, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			hal_info("%s: %s: %m\n", __func__, s);
+		else
+		{
+			struct stat st;
+			*regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+		}
+	}
+	if (fd >= 0)
+		hal_info("%s: reading %s\n", __func__, s);
+	return fd;
+}
+
+void cVirtualDemux::Run(void)
+{
+	char threadname[17];
+	strncpy(threadname, "VirtualDemux", sizeof(threadname));
+	threadname[16] = 0;
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	uint8_t *buf = (uint8_t *)malloc(VDMX_READSIZE);
+	if (!buf)
+	{
+		hal_info("%s: unable to allocate buffer! (out of memory)\n", __func__);
+		return;
+	}
+	size_t carry = 0;
+	int src = -1;
+	bool regular = false;
+	bool done = false;	/* regular file ended, nothing more to feed */
+	int64_t start = 0;
+	while (true)
+	{
+		pthread_mutex_lock(&mutex);
+		check_timeouts();
+		pthread_mutex_unlock(&mutex);
+		if (src < 0)
+		{
+			if (!done)
+				src = open_source(&regular);
+			if (src < 0)
+			{
+				usleep(done ? 100000 : 1000000);
+				continue;
+			}
+			carry = 0;
+			pcr_base = -1;
+			packets = 0;
+			bytes = 0;
+			start = time_us();
+		}
+		struct pollfd ufds;
+		ufds.fd = src;
+		ufds.events = POLLIN;
+		ufds.revents = 0;
+		if (poll(&ufds, 1, 100) <= 0)
+			continue;
+		ssize_t n = read(src, buf + carry, VDMX_READSIZE - carry);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+		{
+			int64_t ms = (time_us() - start) / 1000;
+			hal_info("%s: end of %s: %" PRIu64 " packets in %" PRId64 " ms (%" PRId64 " kbit/s)\n", __func__,
+				source.c_str(), packets, ms, ms > 0 ? (int64_t)(bytes * 8 / ms) : 0);
+			if (regular && loop && n == 0)
+			{
+				lseek(src, 0, SEEK_SET);
+				carry = 0;
+				pcr_base = -1;
+				continue;
+			}
+			/* FIFOs and sockets are opened again */
+			close(src);
+			src = -1;
+			done = regular;
+			continue;
+		}
+		bytes += n;
+		n += carry;
+		uint8_t *p = buf;
+		uint8_t *end = buf + n;
+		pthread_mutex_lock(&mutex);
+		while (end - p >= TS_PACKET_SIZE)
+		{
+			if (*p != 0x47)
+			{
+				/* lost sync, skip to the next sync byte */
+				uint8_t *s = (uint8_t *)memchr(p + 1, 0x47, end - p - 1);
+				p = s ? s : end;
+				continue;
+			}
+			feed(p);
+			p += TS_PACKET_SIZE;
+		}
+		pthread_mutex_unlock(&mutex);
+		carry = end - p;
+		if (carry)
+			memmove(buf, p, carry);
+	}
+}
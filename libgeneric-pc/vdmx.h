@@ -0,0 +1,97 @@
+/*
+ * virtual DVB demux fed from a transport stream file, FIFO or socket
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VDMX_H__
+#define __VDMX_H__
+
+#include <config.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <map>
+#include <string>
+#include <vector>
+
+struct vdmx_filter;
+class cSectionFilter;
+
+/*
+ * Replaces /dev/dvb/adapter0/demux0 if HAL_VDMX is set:
+ *   export HAL_VDMX=/path/to/dump.ts (regular file or FIFO)
+ *   export HAL_VDMX=udp://[addr:]port (bind, default 127.0.0.1)
+ *   export HAL_VDMX=tcp://host:port (connect)
+ * The stream is paced by the PCR of the first PID that carries one,
+ * HAL_VDMX_PACE=none feeds it as fast as the readers take it. Regular
+ * files start over at the end with HAL_VDMX_LOOP=1.
+ *
+ * Every "device" is an eventfd that is readable while the filter has
+ * data, so poll() / epoll can wait for it, but the data has to be read
+ * with Read(), i.e. through cDemux (cDemuxReactor does that). A plain
+ * read() of the fd returns the eventfd counter and leaves the filter
+ * silent until it is signalled again. Section, PES and TS filters
+ * and the demux ioctls that cDemux uses are done in user space with
+ * the semantics of the kernel's software demux: section filtering as
+ * in cSectionFilter, the first section timeout (ETIMEDOUT), one section
+ * per read() and EOVERFLOW with the buffer flushed if a reader was too
+ * slow. Without pacing, TS and PES readers are waited for instead,
+ * unless they stop reading.
+ */
+class cVirtualDemux
+{
+	public:
+		/* NULL if HAL_VDMX is not set */
+		static cVirtualDemux *getInstance();
+
+		int Open(int flags);
+		int Close(int fd);
+		int Ioctl(int fd, unsigned long request, unsigned long arg);
+		ssize_t Read(int fd, void *buf, size_t len);
+
+		void Run(void);
+	private:
+		cVirtualDemux(const char *source);
+		std::string source;
+		bool pace;
+		bool loop;
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;		/* data read / filter changed */
+		std::vector<struct vdmx_filter *> filters;
+		std::map<unsigned short, cSectionFilter *> section_pids;
+
+		/* PCR pacing */
+		int pcr_pid;
+		int64_t pcr_last;		/* 27 MHz */
+		int64_t pcr_base;
+		int64_t clock_base;		/* us, monotonic */
+
+		uint64_t packets;
+		uint64_t bytes;
+
+		struct vdmx_filter *find(int fd);
+		int open_source(bool *regular);
+		void feed(const uint8_t *p);
+		void start(struct vdmx_filter *f);
+		void stop(struct vdmx_filter *f);
+		void deliver(struct vdmx_filter *f, const uint8_t *data, size_t len);
+		static void section_cb(int id, const uint8_t *sec, int len, void *user);
+		void section(struct vdmx_filter *f, const uint8_t *sec, int len);
+		void check_timeouts(void);
+		void update(struct vdmx_filter *f);
+};
+
+#endif // __VDMX_H__
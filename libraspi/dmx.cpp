@@ -24,6 +24,7 @@
 #include <poll.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cstring>
@@ -31,6 +32,10 @@
 #include <string>
 #include <sys/ioctl.h>
 #include "dmx_hal.h"
+#include "section_cache.h"
+#include "section_timing.h"
+#include "ts_analyzer.h"
+#include "dmx_buffers.h"
 #include "hal_debug.h"
 
 #include "video_lib.h"
@@ -74,6 +79,13 @@ static const char *devname[] =
 static int dmx_tp_count = 0;
 #define MAX_TS_COUNT 8
 
+static int64_t time_ms(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
 cDemux::cDemux(int n)
 {
 	if (n < 0 || n > 2)
@@ -84,12 +96,20 @@ cDemux::cDemux(int n)
 	else
 		num = n;
 	fd = -1;
+	section_cache = true;
+	sections = NULL;
+	watch = NULL;
+	buffers = NULL;
+	analyzer = NULL;
 }
 
 cDemux::~cDemux()
 {
 	hal_debug("%s #%d fd: %d\n", __FUNCTION__, num, fd);
 	Close();
+	delete sections;
+	delete watch;
+	delete analyzer;
 }
 
 bool cDemux::Open(DMX_CHANNEL_TYPE pes_type, void * /*hVideoBuffer*/, int uBufferSize)
@@ -148,6 +168,8 @@ void cDemux::Close(void)
 
 	pesfds.clear();
 	ioctl(fd, DMX_STOP);
+	delete buffers;
+	buffers = NULL;
 	close(fd);
 	fd = -1;
 	if (dmx_type == DMX_TP_CHANNEL)
@@ -198,10 +220,13 @@ int cDemux::Read(unsigned char *buff, int len, int timeout)
 	ufds.events = POLLIN | POLLPRI | POLLERR;
 	ufds.revents = 0;
 
-	if (timeout > 0)
+	int to = timeout;
+	int64_t deadline = 0;
+
+	if (to > 0)
 	{
 retry:
-		rc = ::poll(&ufds, 1, timeout);
+		rc = ::poll(&ufds, 1, to);
 		if (!rc)
 			return 0; // timeout
 		else if (rc < 0)
@@ -235,12 +260,136 @@ retry:
 
 	rc = ::read(fd, buff, len);
 	//fprintf(stderr, "fd %d ret: %d\n", fd, rc);
+	if (!afterRead(buff, rc))
+	{
+		/* unchanged repetition of a section that was delivered before,
+		 * wait for the next one. timeout 0 means wait forever */
+		if (timeout > 0)
+		{
+			if (!deadline)
+				deadline = time_ms() + timeout;
+			to = deadline - time_ms();
+			if (to <= 0)
+				return 0;
+		}
+		else
+			to = -1;
+		goto retry;
+	}
+
+	return rc;
+}
+
+/* everything that has to see the data read, shared by Read() and
+ * ReadAvailable(). false: unchanged repetition of a section */
+bool cDemux::afterRead(unsigned char *buff, int rc)
+{
 	if (rc < 0)
-		dmx_err("read: %s", strerror(errno), 0);
+	{
+		int err = errno;
+		dmx_err("read: %s", strerror(err), 0);
+		if (err == ETIMEDOUT && watch)
+			watch->Timeout();
+		if (err == EOVERFLOW && analyzer)
+			analyzer->Overflow();
+		errno = err;
+		return true;
+	}
+	if (rc == 0)
+		return true;
+	if (watch)
+		watch->Section(buff, rc);
+	if (analyzer)
+		analyzer->Process(buff, rc);
+	return !sections || sections->Deliver(GetSource(num), pid, buff, rc);
+}
 
+int cDemux::ReadAvailable(unsigned char *buff, int len)
+{
+	if (fd < 0)
+	{
+		errno = EBADF;
+		return -1;
+	}
+	int rc = ::read(fd, buff, len);
+	/* nothing there (yet), not an error */
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return -1;
+	if (!afterRead(buff, rc))
+		return 0;
 	return rc;
 }
 
+int cDemux::getCachedSection(unsigned short _pid, unsigned char table_id, unsigned short ext,
+	unsigned char secnum, unsigned char *buf, int len, unsigned int max_age)
+{
+	return cSectionCache::getInstance()->Lookup(GetSource(num), _pid, table_id, ext, secnum, buf, len, max_age);
+}
+
+void cDemux::setTransponder(uint32_t transponder)
+{
+	cSectionTiming::getInstance()->SetTransponder(GetSource(num), transponder);
+	cSectionCache::getInstance()->Flush(GetSource(num));
+}
+
+int cDemux::ReadBuffer(const unsigned char **data, int timeout)
+{
+	if (fd < 0 || dmx_type != DMX_TP_CHANNEL)
+	{
+		hal_info("%s #%d: not open or not a TS channel!\n", __func__, num);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!buffers)
+	{
+		buffers = new cDemuxBuffers(fd);
+		if (!buffers->Init())
+		{
+			hal_info("%s #%d: unable to allocate buffer! (out of memory)\n", __func__, num);
+			delete buffers;
+			buffers = NULL;
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	if (buffers->isMapped())
+	{
+		int rc = buffers->Dequeue(data, timeout);
+		if (rc > 0 && analyzer)
+			analyzer->Process(*data, rc);
+		else if (rc < 0 && errno == EOVERFLOW && analyzer)
+			analyzer->Overflow();
+		return rc;
+	}
+	*data = buffers->getReadBuffer();
+	return Read(buffers->getReadBuffer(), DMX_BUFFER_SIZE, timeout);
+}
+
+void cDemux::ReleaseBuffer(void)
+{
+	if (buffers && buffers->isMapped())
+		buffers->Queue();
+}
+
+void cDemux::setAnalyzer(bool enable)
+{
+	if (!enable)
+	{
+		delete analyzer;
+		analyzer = NULL;
+	}
+	else if (!analyzer)
+		analyzer = new cTSAnalyzer;
+}
+
+bool cDemux::getTSStats(struct ts_stats *s)
+{
+	if (!analyzer)
+		return false;
+	analyzer->GetStats(s);
+	return true;
+}
+
 bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filter,
 	const unsigned char *const mask, int len, int timeout,
 	const unsigned char *const negmask)
@@ -249,6 +398,19 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 	memset(&s_flt, 0, sizeof(s_flt));
 	pid = _pid;
 
+	/* only sections that changed since the filter was set are returned */
+	if (section_cache && dmx_type == DMX_PSI_CHANNEL)
+	{
+		if (!sections)
+			sections = new cSectionSession;
+		sections->Reset();
+	}
+	else
+	{
+		delete sections;
+		sections = NULL;
+	}
+
 	if (len > DMX_FILTER_SIZE)
 	{
 		hal_info("%s #%d: len too long: %d, DMX_FILTER_SIZE %d\n", __func__, num, len, DMX_FILTER_SIZE);
@@ -342,7 +504,18 @@ bool cDemux::sectionFilter(unsigned short _pid, const unsigned char *const filte
 	 * and sectionsd EIT-Version change. And they really want no timeout
 	 * if timeout == 0 instead of "default timeout" */
 	if (timeout == 0 && negmask == NULL)
-		s_flt.timeout = to;
+		s_flt.timeout = cSectionTiming::getInstance()->Timeout(GetSource(num), pid, filter[0], to);
+
+	/* learn how often the table repeats, not from filters that wait
+	 * for a change */
+	if (dmx_type == DMX_PSI_CHANNEL && negmask == NULL && mask[0] == 0xff)
+	{
+		if (!watch)
+			watch = new cSectionWatch;
+		watch->Start(GetSource(num), pid, filter[0]);
+	}
+	else if (watch)
+		watch->Stop();
 
 	hal_debug("%s #%d pid:0x%04hx fd:%d type:%s len:%d to:%d flags:%x flt[0]:%02x\n",
 		__func__, num, pid, fd, DMX_T[dmx_type], len, s_flt.timeout, s_flt.flags, s_flt.filter.filter[0]);
@@ -471,7 +644,7 @@ void cDemux::removePid(unsigned short Pid)
 		if ((*i).pid == Pid)
 		{
 			hal_debug("removePid: removing demux fd %d pid 0x%04x\n", fd, Pid);
-			if (ioctl(fd, DMX_REMOVE_PID, Pid) < 0)
+			if (ioctl(fd, DMX_REMOVE_PID, &Pid) < 0)
 				hal_info("%s: (DMX_REMOVE_PID, 0x%04hx): %m\n", __func__, Pid);
 			pesfds.erase(i);
 			return; /* TODO: what if the same PID is there multiple times */
@@ -503,8 +676,9 @@ bool cDemux::SetSource(int unit, int source)
 	return true;
 }
 
-int cDemux::GetSource(int unit)
+/* all units read demux0, see devname[]. Also the source that keys the
+ * section cache */
+int cDemux::GetSource(int /*unit*/)
 {
-	hal_info_c("%s(%d): not implemented yet\n", __func__, unit);
 	return 0;
 }
@@ -0,0 +1,341 @@
+/*
+ * benchmark of the software section filter and CRC on an EIT carousel
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Builds an EIT carousel on PID 0x12 in memory (present/following and
+ * four schedule tables with eight sections each, for every service),
+ * then feeds it as TS packets through cSectionFilter with the filters
+ * a typical EPG reader sets, and compares the table driven CRC with a
+ * bitwise one. Given a TS file instead, it replays the packets of PID
+ * 0x12 from the file the same way, and the CRCs run over the sections
+ * found in them.
+ * Usage: sectionbench [services | file.ts [loops]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <set>
+#include <vector>
+
+#include "section_filter.h"
+
+#define EIT_PID 0x12
+#define EIT_SECTION_LEN 1024	/* bytes per section, including header and CRC */
+#define SCHEDULE_TABLES 4
+#define SCHEDULE_SECTIONS 8
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* the reference: one bit at a time */
+static uint32_t crc32_bitwise(const uint8_t *data, unsigned int len)
+{
+	uint32_t crc = 0xffffffff;
+	while (len--)
+	{
+		crc ^= (uint32_t)*data++ << 24;
+		for (int i = 0; i < 8; i++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+	}
+	return crc;
+}
+
+static void make_section(std::vector<uint8_t> &s, uint8_t table_id, uint16_t sid, uint8_t secnum, uint8_t last)
+{
+	s.resize(EIT_SECTION_LEN);
+	int l = EIT_SECTION_LEN - 3;
+	s[0] = table_id;
+	s[1] = 0xf0 | (l >> 8);
+	s[2] = l & 0xff;
+	s[3] = sid >> 8;
+	s[4] = sid & 0xff;
+	s[5] = 0xc1;		/* version 0, current */
+	s[6] = secnum;
+	s[7] = last;
+	s[8] = 0x04;		/* transport_stream_id */
+	s[9] = 0x4b;
+	s[10] = 0x00;		/* original_network_id */
+	s[11] = 0x01;
+	s[12] = last;		/* segment_last_section_number */
+	s[13] = table_id;	/* last_table_id */
+	/* the events, as far as the filters care */
+	for (int i = 14; i < EIT_SECTION_LEN - 4; i++)
+		s[i] = rand();
+	uint32_t crc = crc32_mpeg(&s[0], EIT_SECTION_LEN - 4);
+	s[EIT_SECTION_LEN - 4] = crc >> 24;
+	s[EIT_SECTION_LEN - 3] = crc >> 16;
+	s[EIT_SECTION_LEN - 2] = crc >> 8;
+	s[EIT_SECTION_LEN - 1] = crc;
+}
+
+/* every section starts a packet, the rest of its last packet is stuffing */
+static void packetize(std::vector<uint8_t> &ts, const std::vector<uint8_t> &s, int &cc)
+{
+	unsigned int pos = 0;
+	while (pos < s.size())
+	{
+		uint8_t p[188];
+		memset(p, 0xff, sizeof(p));
+		p[0] = 0x47;
+		p[1] = (EIT_PID >> 8) | (pos == 0 ? 0x40 : 0);
+		p[2] = EIT_PID & 0xff;
+		p[3] = 0x10 | cc;
+		cc = (cc + 1) & 0x0f;
+		int off = 4;
+		if (pos == 0)
+			p[off++] = 0;	/* pointer_field */
+		unsigned int n = 188 - off;
+		if (n > s.size() - pos)
+			n = s.size() - pos;
+		memcpy(p + off, &s[pos], n);
+		pos += n;
+		ts.insert(ts.end(), p, p + 188);
+	}
+}
+
+/* the sections of PID 0x12 in a TS file */
+struct replay
+{
+	std::vector<std::vector<uint8_t> > sections;
+	std::set<int> services;		/* of present/following actual */
+};
+
+static void count_section(int, const uint8_t *, int, void *user)
+{
+	(*(unsigned long *)user)++;
+}
+
+static void keep_section(int, const uint8_t *sec, int len, void *user)
+{
+	replay *r = (replay *)user;
+	r->sections.push_back(std::vector<uint8_t>(sec, sec + len));
+	if (sec[0] == 0x4e && r->services.size() < 4)
+		r->services.insert((sec[3] << 8) | sec[4]);
+}
+
+/* the packets of PID 0x12 in file, false if there are none */
+static bool read_ts(const char *file, std::vector<uint8_t> &ts)
+{
+	FILE *f = fopen(file, "rb");
+	if (!f)
+	{
+		perror(file);
+		return false;
+	}
+	std::vector<uint8_t> buf(188 * 4096);
+	size_t fill = 0, n;
+	while ((n = fread(&buf[fill], 1, buf.size() - fill, f)) > 0)
+	{
+		fill += n;
+		size_t pos = 0;
+		while (fill - pos >= 188)
+		{
+			const uint8_t *p = &buf[pos];
+			if (p[0] != 0x47)
+			{
+				/* lost sync, try the next sync byte */
+				pos++;
+				continue;
+			}
+			if ((((p[1] & 0x1f) << 8) | p[2]) == EIT_PID)
+				ts.insert(ts.end(), p, p + 188);
+			pos += 188;
+		}
+		memmove(&buf[0], &buf[pos], fill - pos);
+		fill -= pos;
+	}
+	fclose(f);
+	if (ts.empty())
+	{
+		fprintf(stderr, "%s: no packets on PID 0x%02x\n", file, EIT_PID);
+		return false;
+	}
+	return true;
+}
+
+static void add_filter(cSectionFilter &sf, uint8_t table_id, uint8_t mask, int sid, unsigned long *count)
+{
+	struct dmx_sct_filter_params p;
+	memset(&p, 0, sizeof(p));
+	p.pid = EIT_PID;
+	p.filter.filter[0] = table_id;
+	p.filter.mask[0] = mask;
+	if (sid >= 0)
+	{
+		p.filter.filter[1] = sid >> 8;
+		p.filter.filter[2] = sid & 0xff;
+		p.filter.mask[1] = 0xff;
+		p.filter.mask[2] = 0xff;
+	}
+	p.flags = DMX_CHECK_CRC;
+	sf.Add(&p, count_section, count);
+}
+
+/* an EPG reader: present/following of actual and other TS, the
+ * schedules, and a few services it waits for explicitly */
+static void add_epg_filters(cSectionFilter &sf, const std::vector<int> &sids, unsigned long *count)
+{
+	add_filter(sf, 0x4e, 0xff, -1, count);
+	add_filter(sf, 0x4f, 0xff, -1, count);
+	add_filter(sf, 0x50, 0xf0, -1, count);
+	add_filter(sf, 0x60, 0xf0, -1, count);
+	for (unsigned int i = 0; i < sids.size(); i++)
+		add_filter(sf, 0x4e, 0xff, sids[i], count);
+}
+
+int main(int argc, char **argv)
+{
+	const char *file = NULL;
+	int services = 64;
+	if (argc > 1)
+	{
+		if (strspn(argv[1], "0123456789") != strlen(argv[1]))
+			file = argv[1];
+		else
+			services = atoi(argv[1]);
+	}
+	int loops = argc > 2 ? atoi(argv[2]) : 20;
+	if (services < 1 || services > 0xffff || loops < 1)
+	{
+		fprintf(stderr, "usage: sectionbench [services | file.ts [loops]]\n");
+		return 1;
+	}
+
+	std::vector<std::vector<uint8_t> > sections;
+	std::vector<uint8_t> ts;
+	std::vector<int> sids;
+	/* sections the filters deliver per loop */
+	unsigned long per_loop;
+	if (file)
+	{
+		if (!read_ts(file, ts))
+			return 1;
+		/* once through a filter for everything with a good CRC, to
+		 * find the sections, and through the EPG reader's filters */
+		replay r;
+		cSectionFilter all(EIT_PID);
+		struct dmx_sct_filter_params p;
+		memset(&p, 0, sizeof(p));
+		p.pid = EIT_PID;
+		p.flags = DMX_CHECK_CRC;
+		all.Add(&p, keep_section, &r);
+		for (unsigned int i = 0; i < ts.size() / 188; i++)
+			all.Packet(&ts[i * 188]);
+		sections.swap(r.sections);
+		sids.assign(r.services.begin(), r.services.end());
+		per_loop = 0;
+		cSectionFilter sf(EIT_PID);
+		add_epg_filters(sf, sids, &per_loop);
+		for (unsigned int i = 0; i < ts.size() / 188; i++)
+			sf.Packet(&ts[i * 188]);
+		printf("file:     %s, %u packets (%.1f MB), %u sections\n",
+			file, (unsigned int)(ts.size() / 188), ts.size() / 1e6, (unsigned int)sections.size());
+	}
+	else
+	{
+		for (int sid = 1; sid <= services; sid++)
+		{
+			for (int i = 0; i < 2; i++)
+			{
+				sections.push_back(std::vector<uint8_t>());
+				make_section(sections.back(), 0x4e, sid, i, 1);
+			}
+			for (int t = 0; t < SCHEDULE_TABLES; t++)
+				for (int i = 0; i < SCHEDULE_SECTIONS; i++)
+				{
+					sections.push_back(std::vector<uint8_t>());
+					make_section(sections.back(), 0x50 + t, sid, i, SCHEDULE_SECTIONS - 1);
+				}
+		}
+		int cc = 0;
+		for (unsigned int i = 0; i < sections.size(); i++)
+			packetize(ts, sections[i], cc);
+		/* the carousel has to continue seamlessly into the next loop.
+		 * Fill up with DVB stuffing sections, one per packet, which no
+		 * filter wants, until the continuity_counter wraps */
+		std::vector<uint8_t> stuffing(188 - 5, 0xff);
+		stuffing[0] = 0x72;
+		stuffing[1] = 0x70 | ((stuffing.size() - 3) >> 8);
+		stuffing[2] = (stuffing.size() - 3) & 0xff;
+		while (cc)
+			packetize(ts, stuffing, cc);
+		/* and an adaptation field only packet, as multiplexers send
+		 * them for the PCR. Without payload it repeats the last
+		 * continuity_counter */
+		std::vector<uint8_t> pad(188, 0xff);
+		pad[0] = 0x47;
+		pad[1] = EIT_PID >> 8;
+		pad[2] = EIT_PID & 0xff;
+		pad[3] = 0x20 | ((cc - 1) & 0x0f);
+		pad[4] = 183;
+		pad[5] = 0;
+		ts.insert(ts.end(), pad.begin(), pad.end());
+		for (int i = 0; i < 4; i++)
+			sids.push_back(1 + i * services / 4);
+		per_loop = sections.size() + 4 * 2;
+		printf("carousel: %d services, %u sections, %u packets (%.1f MB)\n",
+			services, (unsigned int)sections.size(), (unsigned int)(ts.size() / 188), ts.size() / 1e6);
+	}
+	unsigned int packets = ts.size() / 188;
+	uint64_t bytes = 0;
+	for (unsigned int i = 0; i < sections.size(); i++)
+		bytes += sections[i].size();
+
+	unsigned long delivered = 0;
+	cSectionFilter sf(EIT_PID);
+	add_epg_filters(sf, sids, &delivered);
+
+	double start = now();
+	for (int l = 0; l < loops; l++)
+	{
+		/* a file does not continue into its start */
+		if (file)
+			sf.Reset();
+		for (unsigned int i = 0; i < packets; i++)
+			sf.Packet(&ts[i * 188]);
+	}
+	double t = now() - start;
+	unsigned long expected = (unsigned long)loops * per_loop;
+	printf("filter:   %.1f MB/s, %.0f packets/s, %.0f sections/s, %lu delivered%s\n",
+		loops * ts.size() / t / 1e6, loops * packets / t, loops * sections.size() / t,
+		delivered, delivered == expected ? "" : " (WRONG)");
+
+	uint32_t sum = 0;
+	start = now();
+	for (int l = 0; l < loops; l++)
+		for (unsigned int i = 0; i < sections.size(); i++)
+			sum |= crc32_mpeg(&sections[i][0], sections[i].size());
+	double t_table = now() - start;
+	start = now();
+	for (int l = 0; l < loops; l++)
+		for (unsigned int i = 0; i < sections.size(); i++)
+			sum |= crc32_bitwise(&sections[i][0], sections[i].size());
+	double t_bit = now() - start;
+	printf("crc32:    %.1f MB/s table driven, %.1f MB/s bitwise%s\n",
+		loops * bytes / t_table / 1e6, loops * bytes / t_bit / 1e6, sum ? " (WRONG)" : "");
+
+	return (delivered != expected || sum) ? 1 : 0;
+}
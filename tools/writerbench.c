@@ -0,0 +1,153 @@
+/*
+ * benchmark of the per packet writer lookup in the libeplayer3 output
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Write() in output/linuxdvb_mipsel.c used to find the writer for every
+ * packet: strcmp() on the type, the encoding strdup()ed by
+ * MANAGER_GETENCODING and a linear search through AvailableWriter[] in
+ * getWriter(). Now it is looked up once per track (getTrackWriter()).
+ * This times both with the encodings of the mipsel writer table, as
+ * the real writers can not run off target.
+ * Usage: writerbench [packets]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* textEncoding of AvailableWriter[] in output/writer/mipsel/writer.c */
+static const char *encodings[] =
+{
+	"A_AAC", "A_AAC_LATM", "A_AAC_PLUS", "A_AC3", "A_EAC3", "A_MP3",
+	"A_MPEG/L3", "A_PCM", "A_IPCM", "A_LPCM", "A_DTS", "A_WMA",
+	"A_WMA/PRO", "A_OPUS", "A_VORBIS",
+	"V_MPEG4/ISO/AVC", "V_HEVC", "V_H263", "V_MPEG4", "V_MPEG2",
+	"V_MPEG1", "V_VC1", "V_DIVX3", "V_VP6", "V_VP8", "V_VP9", "V_FLV",
+	"V_WMV", "V_MJPEG", "V_RV40", "V_RV30", "V_AVS2",
+	NULL
+};
+
+typedef struct Track_s
+{
+	char *Encoding;
+	const char **writer;
+} Track_t;
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static const char **getWriter(const char *encoding)
+{
+	int i;
+
+	for (i = 0; encodings[i] != NULL; i++)
+	{
+		if (strcmp(encodings[i], encoding) == 0)
+		{
+			return &encodings[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* before: type check, MANAGER_GETENCODING and the search per packet */
+static const char **lookupPerPacket(Track_t *track, const char *type, int *video)
+{
+	const char **writer;
+	char *Encoding;
+
+	*video = !strcmp("video", type);
+	if (!*video && strcmp("audio", type))
+	{
+		return NULL;
+	}
+
+	Encoding = strdup(track->Encoding);
+	writer = getWriter(Encoding);
+	free(Encoding);
+
+	return writer;
+}
+
+/* after: getTrackWriter() */
+static const char **lookupPerTrack(Track_t *track, const char *type, int *video)
+{
+	if (track->writer == NULL)
+	{
+		track->writer = getWriter(track->Encoding);
+	}
+
+	*video = track->writer && **track->writer == 'V';
+	(void)type;
+
+	return track->writer;
+}
+
+static double run(const char **(*lookup)(Track_t *, const char *, int *), const char *encoding, long packets)
+{
+	Track_t track;
+	const char *type = encoding[0] == 'V' ? "video" : "audio";
+	volatile long sink = 0;
+	double start;
+	long i;
+
+	track.Encoding = (char *)encoding;
+	track.writer = NULL;
+
+	start = now();
+	for (i = 0; i < packets; i++)
+	{
+		int video;
+		const char **writer = lookup(&track, type, &video);
+		sink += (writer - encodings) + video;
+	}
+
+	return (now() - start) * 1e9 / packets;
+}
+
+int main(int argc, char **argv)
+{
+	/* first and last entry of the table, and the usual ones */
+	static const char *tests[] = { "A_AAC", "A_AC3", "V_MPEG4/ISO/AVC", "V_HEVC", "V_AVS2", NULL };
+	long packets = argc > 1 ? atol(argv[1]) : 10000000;
+	int i;
+
+	if (packets < 1)
+	{
+		fprintf(stderr, "usage: writerbench [packets]\n");
+		return 1;
+	}
+
+	printf("%-16s %14s %14s\n", "encoding", "per packet ns", "per track ns");
+	for (i = 0; tests[i] != NULL; i++)
+	{
+		double before = run(lookupPerPacket, tests[i], packets);
+		double after = run(lookupPerTrack, tests[i], packets);
+		printf("%-16s %14.1f %14.1f\n", tests[i], before, after);
+	}
+
+	return 0;
+}